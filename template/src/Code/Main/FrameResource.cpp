@@ -1,6 +1,6 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT lightCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -8,10 +8,6 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
 
   //  FrameCB = std::make_unique<UploadBuffer<FrameConstants>>(device, 1, true);
     PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
-    MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
-    ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
-    LightCB = std::make_unique<UploadBuffer<LightConstants>>(device, lightCount, true);
-    PassShadowCB = std::make_unique<UploadBuffer<PassShadowConstants>>(device, lightCount, true);
 }
 
 FrameResource::~FrameResource()
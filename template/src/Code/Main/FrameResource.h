@@ -4,11 +4,18 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 
+// Read by the shaders as a structured buffer; matches ObjectData in Instancing.hlsl.
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
     DirectX::XMFLOAT4X4 InvWorld = MathHelper::Identity4x4();
 	DirectX::XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
+
+	// Box the CompactVertex positions of this object are quantized against.
+	DirectX::XMFLOAT3 PosCenter = { 0.0f, 0.0f, 0.0f };
+	float cbPerObjectPad0 = 0.0f;
+	DirectX::XMFLOAT3 PosExtents = { 1.0f, 1.0f, 1.0f };
+	float cbPerObjectPad1 = 0.0f;
 };
 
 struct PassConstants
@@ -57,13 +64,24 @@ struct Vertex
     Vertex() {};
 };
 
+// Quantized vertex used by the G-buffer and shadow passes, 20 bytes instead of 44.
+// Pos is snorm16 relative to the submesh bounds (w unused), Normal and Tangent are
+// octahedral snorm16 and TexC is half precision.  See VertexQuantization.h.
+struct CompactVertex
+{
+    std::int16_t Pos[4];
+    std::int16_t Normal[2];
+    std::int16_t Tangent[2];
+    DirectX::PackedVector::HALF TexC[2];
+};
+
 // Stores the resources needed for the CPU to build the command lists
 // for a frame.  
 struct FrameResource
 {
 public:
     
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount,UINT lightCount);
+    FrameResource(ID3D12Device* device, UINT passCount);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -76,10 +94,16 @@ public:
     // that reference it.  So each frame needs their own cbuffers.
    // std::unique_ptr<UploadBuffer<FrameConstants>> FrameCB = nullptr;
     std::unique_ptr<UploadBuffer<PassConstants>> PassCB = nullptr;
-    std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
-    std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
-    std::unique_ptr<UploadBuffer<LightConstants>> LightCB = nullptr;
-    std::unique_ptr<UploadBuffer<PassShadowConstants>> PassShadowCB = nullptr;
+
+    // This frame's data in the app's LinearAllocator, written during Update.  The
+    // constant buffers are arrays of 256-byte elements indexed by MatCBIndex and
+    // LightCBIndex; the structured buffers hold ObjectConstants by ObjCBIndex and
+    // the object index of each instance drawn.
+    D3D12_GPU_VIRTUAL_ADDRESS MaterialCB = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS ObjectBuffer = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS InstanceBuffer = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS LightCB = 0;
+    D3D12_GPU_VIRTUAL_ADDRESS PassShadowCB = 0;
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
     UINT64 Fence = 0;
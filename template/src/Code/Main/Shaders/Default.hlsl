@@ -29,13 +29,7 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
-// Constant data that varies per frame.
-cbuffer cbPerObject : register(b0)
-{
-    float4x4 gWorld;
-    float4x4 gInvWorld;
-	float4x4 gTexTransform;
-};
+#include "Instancing.hlsl"
 
 // Constant data that varies per material.
 cbuffer cbPass : register(b1)
@@ -104,21 +98,22 @@ float3 NormalSampleToWorldSpace(float3 normalMapSample, float3 unitNormalW, floa
 
     return bumpedNormalW;
 }
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
 	VertexOut vout = (VertexOut)0.0f;
+    ObjectData obj = GetObjectData(instanceID);
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(vin.PosL, 1.0f), obj.World);
     vout.PosW = posW;
 
     vout.PosH = mul(posW, gViewProj);
     
-    float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+    float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), obj.TexTransform);
     vout.TexC = mul(texC, gMatTransform).xy;
     
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)gWorld);
-    vout.Tan = mul(vin.Tan, (float3x3) gWorld);
+    vout.NormalW = mul(vin.NormalL, (float3x3)obj.World);
+    vout.Tan = mul(vin.Tan, (float3x3) obj.World);
     // Transform to homogeneous clip space.
 
 	// Output vertex attributes for interpolation across triangle.
@@ -12,13 +12,7 @@ SamplerState gsamLinearClamp : register(s3);
 SamplerState gsamAnisotropicWrap : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
-// Constant data that varies per frame.
-cbuffer cbPerObject : register(b0)
-{
-    float4x4 gWorld;
-    float4x4 gInvWorld;
-    float4x4 gTexTransform;
-};
+#include "Instancing.hlsl"
 
 // Constant data that varies per material.
 cbuffer cbPass : register(b1)
@@ -56,10 +50,17 @@ cbuffer cbMaterial : register(b2)
 
 struct VertexIn
 {
+#ifdef COMPACT_VERTEX
+    float4 PosQ : POSITION;     // snorm16, relative to PosCenter/PosExtents
+    float2 NormalOct : NORMAL;  // octahedral snorm16
+    float2 TexC : TEXCOORD;     // half
+    float2 TanOct : TANGENT;    // octahedral snorm16
+#else
     float3 PosL : POSITION;
     float3 NormalL : NORMAL;
     float2 TexC : TEXCOORD;
     float3 Tan : TANGENT;
+#endif
 };
 
 struct VertexOut
@@ -71,21 +72,40 @@ struct VertexOut
     float3 Tan : TANGENT;
 };
 
-VertexOut VS(VertexIn vin)
+// Inverse of VertexQuantization::EncodeDirection.
+float3 OctDecode(float2 e)
+{
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = max(-n.z, 0.0f);
+    n.xy += (n.xy >= 0.0f) ? -t : t;
+    return normalize(n);
+}
+
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout = (VertexOut) 0.0f;
+    ObjectData obj = GetObjectData(instanceID);
+#ifdef COMPACT_VERTEX
+    float3 posL = obj.PosCenter + vin.PosQ.xyz * obj.PosExtents;
+    float3 normalL = OctDecode(vin.NormalOct);
+    float3 tanL = OctDecode(vin.TanOct);
+#else
+    float3 posL = vin.PosL;
+    float3 normalL = vin.NormalL;
+    float3 tanL = vin.Tan;
+#endif
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), obj.World);
     vout.PosW = posW;
 
     vout.PosH = mul(posW, gViewProj);
     
-    float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), gTexTransform);
+    float4 texC = mul(float4(vin.TexC, 0.0f, 1.0f), obj.TexTransform);
     vout.TexC = mul(texC, gMatTransform).xy;
     
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3) gWorld);
-    vout.Tan = mul(vin.Tan, (float3x3) gWorld);
+    vout.NormalW = mul(normalL, (float3x3) obj.World);
+    vout.Tan = mul(tanL, (float3x3) obj.World);
     // Transform to homogeneous clip space.
 
 	// Output vertex attributes for interpolation across triangle.
@@ -0,0 +1,29 @@
+// Instancing.hlsl
+//
+// Per-object data of instanced draws.  gObjects holds the ObjectConstants of every
+// render item; a draw of N instances reads the objects listed in
+// gInstanceObjects[gFirstInstance, gFirstInstance + N).
+
+struct ObjectData
+{
+    float4x4 World;
+    float4x4 InvWorld;
+    float4x4 TexTransform;
+    float3 PosCenter;
+    float Pad0;
+    float3 PosExtents;
+    float Pad1;
+};
+
+StructuredBuffer<ObjectData> gObjects : register(t2);
+StructuredBuffer<uint> gInstanceObjects : register(t3);
+
+cbuffer cbPerDraw : register(b0)
+{
+    uint gFirstInstance;
+};
+
+ObjectData GetObjectData(uint instanceID)
+{
+    return gObjects[gInstanceObjects[gFirstInstance + instanceID]];
+}
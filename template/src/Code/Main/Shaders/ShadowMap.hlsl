@@ -2,7 +2,11 @@
 
 struct VertexIn
 {
+#ifdef COMPACT_VERTEX
+    float4 PosQ : POSITION; // snorm16, relative to PosCenter/PosExtents
+#else
     float3 PosL : POSITION;
+#endif
     // Other attributes like TexC might be needed if using alpha testing for shadows
 };
 
@@ -12,13 +16,8 @@ struct VertexOut
     // Potentially TexC if doing alpha testing
 };
 
-// Same ObjectConstants as in your main shaders for gWorld
-cbuffer cbPerObject : register(b0)
-{
-    float4x4 gWorld;
-    float4x4 gInvWorld; // Not used in shadow pass typically
-    float4x4 gTexTransform; // Not used in shadow pass typically
-};
+// Same per-object data as the main shaders.
+#include "Instancing.hlsl"
 
 // Pass constants for the shadow pass (Light's View-Projection matrix)
 cbuffer cbPassShadow : register(b1) // Using b1, ensure it's distinct or managed
@@ -26,12 +25,19 @@ cbuffer cbPassShadow : register(b1) // Using b1, ensure it's distinct or managed
     float4x4 gLightViewProj;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout = (VertexOut) 0.0f;
+    ObjectData obj = GetObjectData(instanceID);
+
+#ifdef COMPACT_VERTEX
+    float3 posL = obj.PosCenter + vin.PosQ.xyz * obj.PosExtents;
+#else
+    float3 posL = vin.PosL;
+#endif
 
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), obj.World);
 
     // Transform to light's clip space.
     vout.PosH = mul(posW, gLightViewProj);
@@ -6,7 +6,25 @@
 #include "../../Common/MathHelper.h"
 #include "../../Common/UploadBuffer.h"
 #include "../../Common/GeometryGenerator.h"
+#include "../../Common/MeshCache.h"
+#include "../../Common/JobSystem.h"
+#include "../../Common/VertexQuantization.h"
+#include "../../Common/ClusterCuller.h"
+#include "../../Common/FrustumCuller.h"
+#include "../../Common/DynamicBvh.h"
+#include "../../Common/OcclusionCuller.h"
+#include "../../Common/StaticBatcher.h"
+#include "../../Common/RadixSort.h"
+#include "../../Common/CommandStream.h"
+#include "../../Common/D3D12CommandBackend.h"
+#include "../../Common/LinearAllocator.h"
+#include "../../Common/D3D12UploadPageSource.h"
+#include "../../Common/D3D12UploadRing.h"
+#include "../../Common/DescriptorAllocator.h"
+#include "../../Common/RenderGraph.h"
+#include <array>
 #include <filesystem>
+#include <tuple>
 #include "FrameResource.h"
 #include <iostream>
 
@@ -24,6 +42,54 @@ using namespace DirectX::PackedVector;
 
 const int gNumFrameResources = 3;
 
+// Going back to a finer LOD waits until the current one's error is this much above
+// the threshold, so objects sitting at a threshold do not switch every frame.
+const float gLodHysteresis = 0.25f;
+
+// The scene BVH is rebuilt once moved items have been reinserted this many times
+// per leaf; reinsertion keeps it balanced but not as tight as a fresh build.
+const float gBvhRebuildRatio = 0.5f;
+
+// Software occlusion culling.  Submeshes with a level of at most
+// gMaxOccluderTriangles triangles can occlude; each frame the visible ones covering
+// at least gOccluderMinScreenSize of the screen height are drawn, largest first, up
+// to gOccluderTriangleBudget triangles, into a depth buffer gOcclusionBufferWidth
+// pixels wide.
+const UINT gMaxOccluderTriangles = 1024;
+const float gOccluderMinScreenSize = 0.1f;
+const UINT gOccluderTriangleBudget = 16384;
+const int gOcclusionBufferWidth = 320;
+
+// Imported assets placed once with a single transform.  Their submeshes are merged
+// by material at load time, so each material takes one draw instead of one per
+// submesh.
+const std::array<const char*, 1> gStaticAssets = { "sponza" };
+
+// Draw batches are recorded into command streams gRecordBatchGrain at a time, one
+// job per stream, and the streams are replayed in order into the command list.
+const size_t gRecordBatchGrain = 64;
+
+// Pipelines set from command streams, by their index in mStreamPipelines.
+enum StreamPipeline : std::uint32_t
+{
+	StreamPipelineShadowMap,
+	StreamPipelineShadowMapCompact,
+	StreamPipelineCount
+};
+const std::array<const char*, StreamPipelineCount> gStreamPipelineNames = { "shadow_map", "shadow_map_compact" };
+
+// Staging memory shared by the copies to static buffers and textures.  Loading more
+// than this at once executes the copies recorded so far and waits for them.
+const UINT64 gUploadRingSize = 64ull << 20;
+
+// Slots of the shader-visible SRV heap, for views that live until their resource
+// goes away.
+const UINT gSrvCapacity = 4096;
+
+// The object constant update runs as ParallelFor jobs over this many render items
+// each.
+const size_t gObjectUpdateGrain = 256;
+
 // Lightweight structure stores parameters to draw a shape.  This will
 // vary from app-to-app.
 struct RenderItem
@@ -49,7 +115,7 @@ struct RenderItem
 	// NumFramesDirty = gNumFrameResources so that each frame resource gets the update.
 	int NumFramesDirty = gNumFrameResources;
 
-	// Index into GPU constant buffer corresponding to the ObjectCB for this render item.
+	// Index of the render item's ObjectConstants in the frame's object buffer.
 	UINT ObjCBIndex = -1;
 
 	Material* Mat = nullptr;
@@ -62,9 +128,52 @@ struct RenderItem
     UINT IndexCount = 0;
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
+
+	// Object space bounds of the submesh.  Also the box its CompactVertex
+	// positions are quantized against.
+	BoundingBox Bounds;
+	BoundingSphere Sphere;
+
+	// The same bounds in world space.  Whoever changes World sets BoundsDirty, and
+	// UpdateWorldBounds refreshes them once per change.
+	BoundingBox WorldBounds;
+	BoundingSphere WorldSphere;
+	bool BoundsDirty = true;
+
+	// Slot of WorldBounds in the opaque frustum culler, or -1 if the item is not
+	// frustum culled.
+	int CullSlot = -1;
+
+	// Leaf of the item in the scene BVH, or -1 before its first bounds update.
+	int BvhProxy = -1;
+
+	// Low-poly stand-in drawn when the item occludes others, or null.
+	std::shared_ptr<const SubmeshOccluder> Occluder;
+
+	// Levels of detail of the submesh, finest first, and the one currently drawn.
+	// UpdateLods copies the chosen range into IndexCount/StartIndexLocation.
+	std::vector<SubmeshLod> Lods;
+	UINT CurrentLod = 0;
+
+	// Cullable clusters of Lods[0], and what CullClusters left of the current LOD
+	// for this frame's camera pass.  Only refreshed while the item is in the frustum.
+	std::vector<SubmeshCluster> Clusters;
+	std::vector<ClusterCuller::Range> DrawRanges;
 	std::string Name;
 };
 
+// Render items sharing geometry, index range and material, and in the main pass the
+// ranges cluster culling left of them, drawn with one DrawIndexedInstanced call per
+// range.  Their ObjCBIndex values are InstanceCount consecutive entries of the
+// frame's InstanceBuffer starting at FirstInstance.
+struct DrawBatch
+{
+	// The first item of the batch; supplies the geometry and material.
+	RenderItem* Item = nullptr;
+	UINT FirstInstance = 0;
+	UINT InstanceCount = 0;
+};
+
 class TexColumnsApp : public D3DApp
 {
 public:
@@ -93,12 +202,34 @@ private:
 	void UpdateCamera(const GameTimer& gt);
 	void BuildShadowMapViews();
 	void AnimateMaterials(const GameTimer& gt);
+	void UpdateWorldBounds(const GameTimer& gt);
+	void UpdateLods(const GameTimer& gt);
+	void CullRenderItems(const GameTimer& gt);
+	void CullSmallRenderItems(const GameTimer& gt);
+	void CullOccludedRenderItems(const GameTimer& gt);
+	void PickRenderItem(int x, int y);
+	void CullClusters(const GameTimer& gt);
 	void UpdateObjectCBs(const GameTimer& gt);
 	void UpdateLightCBs(const GameTimer& gt);
+	void CullShadowCasters(const GameTimer& gt);
+	void UpdateDrawBatches(const GameTimer& gt);
+	void BuildDrawBatches(std::vector<RenderItem*>& ritems, bool matchMaterial, std::vector<DrawBatch>& batches);
+	void SortDrawBatches(std::vector<DrawBatch>& batches, UINT pass, bool useMaterial, const XMFLOAT4X4& viewProj);
+	size_t RecordDrawBatches(const std::vector<DrawBatch>& batches, bool bindMaterials, bool compactVertices, UINT instanceSlot, UINT& skippedBinds);
+	void ReplayCommandStreams(ID3D12GraphicsCommandList* cmdList, size_t streamCount);
 	void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void CreateGBuffer() override;
 	void CreateSceneTexture();
+	D3D12_RESOURCE_DESC ScreenTargetDesc(DXGI_FORMAT format, UINT sampleCount, UINT sampleQuality) const;
+	void BuildRenderGraph();
+	// Makes sure mTransientHeap is large and aligned enough for the compiled graph.
+	// The transient targets must be created again after the graph is rebuilt.
+	void EnsureTransientHeap();
+	void IssueGraphBarriers(const std::vector<RenderGraph::Barrier>& barriers);
+	void DrawGeometryPass();
+	void DrawLightingPass();
+	void DrawPostProcessPass();
 	void LoadAllTextures();
 	void LoadTexture(const std::string& name);
     void BuildRootSignature();
@@ -108,23 +239,41 @@ private:
 	void BuildLights();
 	void SetLightShapes();
 	void BuildDescriptorHeaps();
+	void BuildScreenViews();
+	UINT AllocateSrv(UINT count = 1);
     void BuildShadersAndInputLayout();
     void BuildShapeGeometry();
     void BuildPSOs();
     void BuildFrameResources();
+	void FlushUploads();
 	void CreateMaterial(std::string _name, int _CBIndex, int _SRVDiffIndex, int _SRVNMapIndex, XMFLOAT4 _DiffuseAlbedo, XMFLOAT3 _FresnelR0, float _Roughness);
     void BuildMaterials();
 	void RenderCustomMesh(std::string unique_name, std::string meshname, std::string materialName, XMFLOAT3 Scale, XMFLOAT3 Rotation, XMFLOAT3 Position);
-	void BuildCustomMeshGeometry(std::string name, UINT& meshVertexOffset, UINT& meshIndexOffset, UINT& prevVertSize, UINT& prevIndSize, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo);
+	static MeshCache::ImportedMesh ImportCustomMesh(const std::string& name);
+	void BuildCustomMeshGeometry(const std::string& name, MeshCache::ImportedMesh& imported, bool staticBatch, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo);
     void BuildRenderItems();
 	void DrawSceneToShadowMap();
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<DrawBatch>& batches, bool compactVertices = false);
 
 	std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> GetStaticSamplers();
 	void CreateSpotLight(XMFLOAT3 pos, XMFLOAT3 rot, XMFLOAT3 color, float faloff_start, float faloff_end, float strength, float spotpower);
 	void CreatePointLight(XMFLOAT3 pos, XMFLOAT3 color, float faloff_start, float faloff_end,float strength);
 
 private:
+	std::unique_ptr<JobSystem> mJobSystem;
+
+	// Object, instance, material and light data is suballocated from upload pages
+	// every frame; the pages of a frame are reused once its fence completes.
+	std::unique_ptr<D3D12UploadPageSource> mUploadPageSource;
+	std::unique_ptr<LinearAllocator> mUploadAllocator;
+	// ObjectConstants of mAllRitems by ObjCBIndex, recomputed for dirty items and
+	// copied whole into each frame's allocation.
+	std::vector<ObjectConstants> mObjectConstants;
+	// This frame's instance buffer, filled by BuildDrawBatches.
+	UINT* mInstanceData = nullptr;
+
+	// Stages geometry and texture data on their way to the default heap.
+	std::unique_ptr<D3D12UploadRing> mUploadRing;
 	std::unordered_map<std::string, unsigned int>ObjectsMeshCount;
     std::vector<std::unique_ptr<FrameResource>> mFrameResources;
     FrameResource* mCurrFrameResource = nullptr;
@@ -139,6 +288,9 @@ private:
 	ComPtr<ID3D12RootSignature> mShadowPassRootSignature = nullptr;
 
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
+	std::unique_ptr<DescriptorAllocator> mSrvAllocator;
+	// Albedo, normal and position SRVs, in consecutive slots.
+	UINT mGBufferSrvIndex = 0;
 	ComPtr<ID3D12DescriptorHeap> m_ImGuiSrvDescriptorHeap; // Member variable
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
@@ -148,12 +300,93 @@ private:
 	std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
 
     std::vector<D3D12_INPUT_ELEMENT_DESC> mInputLayout;
+    std::vector<D3D12_INPUT_ELEMENT_DESC> mCompactInputLayout;
+
+	// Draw the G-buffer and shadow passes from the quantized vertex stream.
+	bool mUseCompactVertices = true;
+
+	// A coarser LOD is used once its error projects to fewer than this many pixels.
+	float mLodErrorPixels = 1.0f;
+
+	// Skip clusters outside the camera frustum or facing away from it.
+	bool mUseClusterCulling = true;
+	ClusterCuller::Stats mClusterStats;
+	UINT mDrawnTriangles = 0;
+
+	// Skip whole render items outside the camera frustum.  mFrustumCuller holds the
+	// world boxes of mOpaqueRitems in the same order.
+	bool mUseFrustumCulling = true;
+	FrustumCuller mFrustumCuller;
+	std::vector<std::uint32_t> mVisibleIndices;
+
+	// World bounds of mAllRitems for spatial queries; leaves carry the index into
+	// mAllRitems.
+	DynamicBvh mSceneBvh = DynamicBvh(0.5f);
+
+	// Skip items whose bounding sphere projects to fewer pixels across than this,
+	// in the main view and in the shadow maps.
+	bool mUseContributionCulling = true;
+	float mMinMainPixels = 2.0f;
+	float mMinShadowPixels = 1.0f;
+	UINT mSmallCulledMain = 0;
+	UINT mSmallCulledShadow = 0;
+
+	// Drop frustum-visible items hidden behind the largest occluders.
+	bool mUseOcclusionCulling = true;
+	OcclusionCuller mOcclusionCuller;
+	UINT mOccluderCount = 0;
+	UINT mOccludedRitems = 0;
+
+	// Opaque items inside each shadow-casting light's volume, indexed like mLights.
+	bool mUseShadowCasterCulling = true;
+	std::vector<std::vector<RenderItem*>> mShadowCasters;
+	// What the last cull kept and dropped for each shadow-casting light.
+	struct ShadowCasterStats
+	{
+		size_t Light = 0;
+		size_t Drawn = 0;
+		size_t Outside = 0;
+		UINT TooSmall = 0;
+	};
+	std::vector<ShadowCasterStats> mShadowCasterStats;
+
+	// Draw items that share geometry and material as instances of one draw.
+	// mOpaqueBatches covers mVisibleOpaqueRitems, mShadowBatches mShadowCasters.
+	bool mUseInstancing = true;
+	std::vector<DrawBatch> mOpaqueBatches;
+	std::vector<std::vector<DrawBatch>> mShadowBatches;
+	std::vector<RenderItem*> mBatchItems;
+	UINT mInstanceCount = 0;
+
+	// Order each pass's batches by state, then front to back, and skip binds that
+	// repeat the previous draw's.  The counts are from the last frame drawn.
+	bool mUseDrawSorting = true;
+	std::unordered_map<const MeshGeometry*, UINT> mGeometrySortIds;
+	std::vector<RadixSort::Entry> mSortEntries;
+	std::vector<RadixSort::Entry> mSortScratch;
+	std::vector<DrawBatch> mSortedBatches;
+	UINT mMainStateChangesSkipped = 0;
+	UINT mShadowStateChangesSkipped = 0;
+
+	// Record each pass's draws in parallel into mCommandStreams; mPassStream holds
+	// the pass's own binds, replayed before them.  The count is from the last frame.
+	bool mUseParallelRecording = true;
+	std::vector<CommandStream> mCommandStreams;
+	std::vector<UINT> mStreamSkippedBinds;
+	CommandStream mPassStream;
+	std::vector<ID3D12PipelineState*> mStreamPipelines;
+	size_t mRecordedCommands = 0;
+
+	// Render item chosen with a right click, editable in the Settings panel.
+	RenderItem* mPickedRitem = nullptr;
  
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 	std::vector<Light>mLights;
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mOpaqueRitems;
+	// The opaque items that passed frustum culling this frame.
+	std::vector<RenderItem*> mVisibleOpaqueRitems;
 
     PassConstants mMainPassCB;
 	XMFLOAT3 mEyePos = { 0.0f, 0.0f, 0.0f };
@@ -203,6 +436,15 @@ private:
 
 	// post-process resources
 	ComPtr<ID3D12Resource> mSceneTexture;        // Texture to hold the lit scene
+
+	// The deferred frame.  The G-buffer and scene texture are transient: they are
+	// placed in mTransientHeap where the graph puts them.
+	RenderGraph mRenderGraph;
+	RenderGraph::Resource mBackBufferTarget = 0;
+	RenderGraph::Resource mGBufferTargets[3] = {}; // 0:Albedo, 1:Normal, 2:Position
+	RenderGraph::Resource mSceneTarget = 0;
+	ComPtr<ID3D12Heap> mTransientHeap;
+	std::vector<D3D12_RESOURCE_BARRIER> mGraphBarriers;
 	CD3DX12_CPU_DESCRIPTOR_HANDLE mSceneRtvHandle;
 	CD3DX12_GPU_DESCRIPTOR_HANDLE mSceneSrvHandle; // GPU handle for the SRV
 	UINT mSceneSrvHeapIndex = -1; // Index in your main SRV heap if you combine them
@@ -300,6 +542,7 @@ bool TexColumnsApp::Initialize()
 
 	cam.SetPosition(0, 3, 10);
 	cam.RotateY(MathHelper::Pi);
+	mJobSystem = std::make_unique<JobSystem>();
     if(!D3DApp::Initialize())
         return false;
 
@@ -310,6 +553,9 @@ bool TexColumnsApp::Initialize()
 	// so we have to query this information.
     mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 
+	mUploadPageSource = std::make_unique<D3D12UploadPageSource>(md3dDevice.Get());
+	mUploadAllocator = std::make_unique<LinearAllocator>(*mUploadPageSource);
+	mUploadRing = std::make_unique<D3D12UploadRing>(md3dDevice.Get(), gUploadRingSize, [this]() { FlushUploads(); });
  
 	LoadAllTextures();
     BuildRootSignature();
@@ -318,6 +564,11 @@ bool TexColumnsApp::Initialize()
 	BuildPostProcessRootSignature();
 	BuildLights();
 	BuildShadowMapViews();
+	// Now with the shadow maps.  The targets are placed again where the new graph
+	// puts them.
+	BuildRenderGraph();
+	CreateGBuffer();
+	CreateSceneTexture();
 	BuildDescriptorHeaps();
     BuildShapeGeometry();
 	SetLightShapes();
@@ -361,6 +612,12 @@ bool TexColumnsApp::Initialize()
 
     // Wait until initialization is complete.
     FlushCommandQueue();
+	mUploadRing->Submit(mCurrentFence);
+	mUploadRing->Retire(mFence->GetCompletedValue());
+
+	// The geometry is on the GPU now; drop the upload heaps and CPU copies.
+	for (auto& geo : mGeometries)
+		geo.second->FinishUpload();
     return true;
 }
 void TexColumnsApp::CreateSceneTexture()
@@ -369,31 +626,21 @@ void TexColumnsApp::CreateSceneTexture()
 	mSceneTexture.Reset();
 	// mSceneRtvHeap.Reset(); // Only if it's a separate heap
 
-	D3D12_RESOURCE_DESC texDesc = {};
-	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
-	texDesc.Alignment = 0;
-	texDesc.Width = mClientWidth;
-	texDesc.Height = mClientHeight;
-	texDesc.DepthOrArraySize = 1;
-	texDesc.MipLevels = 1;
-	texDesc.Format = mBackBufferFormat; // Use your main back buffer format
-	texDesc.SampleDesc.Count = m4xMsaaState ? 4 : 1;
-	texDesc.SampleDesc.Quality = m4xMsaaState ? (m4xMsaaQuality - 1) : 0;
-	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+	D3D12_RESOURCE_DESC texDesc = ScreenTargetDesc(mBackBufferFormat, m4xMsaaState ? 4 : 1, m4xMsaaState ? (m4xMsaaQuality - 1) : 0);
 
 	D3D12_CLEAR_VALUE clearValue;
 	clearValue.Format = mBackBufferFormat;
 	memcpy(clearValue.Color, Colors::Black, sizeof(float) * 4); // Clear to black
 
-	ThrowIfFailed(md3dDevice->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
+	ThrowIfFailed(md3dDevice->CreatePlacedResource(
+		mTransientHeap.Get(),
+		mRenderGraph.Offset(mSceneTarget),
 		&texDesc,
-		D3D12_RESOURCE_STATE_RENDER_TARGET, // Initial state
+		(D3D12_RESOURCE_STATES)mRenderGraph.InitialState(mSceneTarget),
 		&clearValue,
 		IID_PPV_ARGS(&mSceneTexture)));
 	mSceneTexture->SetName(L"Scene Texture");
+	mRenderGraph.SetHandle(mSceneTarget, (UINT64)mSceneTexture.Get());
 	
 
 	// Create RTV for mSceneTexture
@@ -430,18 +677,23 @@ void TexColumnsApp::CreateSceneTexture()
 	md3dDevice->CreateRenderTargetView(mSceneTexture.Get(), &rtvDesc, mSceneRtvHandle);
 
 
-	// SRV for mSceneTexture will be created in BuildDescriptorHeaps
+	// SRV for mSceneTexture will be created in BuildScreenViews
 }
 void TexColumnsApp::OnResize()
 {
     D3DApp::OnResize();
+	BuildRenderGraph();
 	CreateGBuffer();
 	CreateSceneTexture();
-	BuildDescriptorHeaps();
+	// The first resize comes from D3DApp::Initialize, before the heap exists.
+	if (mSrvDescriptorHeap)
+		BuildScreenViews();
     // The window resized, so update the aspect ratio and recompute the projection matrix.
     XMMATRIX P = XMMatrixPerspectiveFovLH(0.4*MathHelper::Pi, AspectRatio(), 1.0f, 1000.0f);
     XMStoreFloat4x4(&mProj, P);
 
+	mOcclusionCuller.Resize(gOcclusionBufferWidth, std::max(1, gOcclusionBufferWidth * mClientHeight / std::max(1, mClientWidth)));
+
 
 }
 
@@ -461,39 +713,79 @@ void TexColumnsApp::Update(const GameTimer& gt)
 		WaitForSingleObject(eventHandle, INFINITE);
 		CloseHandle(eventHandle);
 	}
+	mUploadAllocator->Recycle(mFence->GetCompletedValue());
+	mUploadRing->Retire(mFence->GetCompletedValue());
 	UpdateCamera(gt);
 	// === ImGui Setup ===
 	ImGui_ImplDX12_NewFrame();
 	ImGui_ImplWin32_NewFrame();
 	ImGui::NewFrame();
 	ImGui::Begin("Settings");
+	ImGui::Checkbox("Compact vertex format", &mUseCompactVertices);
+	ImGui::SliderFloat("LOD error (pixels)", &mLodErrorPixels, 0.0f, 8.0f);
+	ImGui::Checkbox("Frustum culling", &mUseFrustumCulling);
+	ImGui::Checkbox("Cluster culling", &mUseClusterCulling);
+	ImGui::Checkbox("Contribution culling", &mUseContributionCulling);
+	ImGui::SliderFloat("Min size, main view (pixels)", &mMinMainPixels, 0.0f, 16.0f);
+	ImGui::SliderFloat("Min size, shadow maps (pixels)", &mMinShadowPixels, 0.0f, 16.0f);
+	ImGui::Text("Too small: %u main view draws, %u shadow draws", mSmallCulledMain, mSmallCulledShadow);
+	ImGui::Checkbox("Occlusion culling", &mUseOcclusionCulling);
+	ImGui::Checkbox("Shadow caster culling", &mUseShadowCasterCulling);
+	for (const ShadowCasterStats& stats : mShadowCasterStats)
+	{
+		ImGui::Text("Light %zu shadow casters: %zu drawn, %zu outside, %u too small",
+			stats.Light, stats.Drawn, stats.Outside, stats.TooSmall);
+	}
+	ImGui::Checkbox("Instancing", &mUseInstancing);
+	ImGui::Checkbox("Sort draws", &mUseDrawSorting);
+	ImGui::Checkbox("Parallel command recording", &mUseParallelRecording);
+	ImGui::Text("Objects: %zu of %zu visible", mVisibleOpaqueRitems.size(), mOpaqueRitems.size());
+	ImGui::Text("Occluders: %u (%zu triangles), %u objects occluded",
+		mOccluderCount, mOcclusionCuller.RasterizedTriangles(), mOccludedRitems);
+	ImGui::Text("Triangles: %u", mDrawnTriangles);
+	ImGui::Text("Clusters: %u visible, %u outside, %u back facing",
+		mClusterStats.Visible, mClusterStats.FrustumCulled, mClusterStats.BackfaceCulled);
+	ImGui::Text("Picked (right click): %s", mPickedRitem ? mPickedRitem->Name.c_str() : "none");
 	ImGui::Text("Objects\n\n");
 	for (auto& rItem : mAllRitems)
 	{
 
-		if (rItem->Name == "nigga" || rItem->Name == "eyeL" || rItem->Name == "eyeR")
+		if (rItem->Name == "nigga" || rItem->Name == "eyeL" || rItem->Name == "eyeR" || rItem.get() == mPickedRitem)
 		{
 			ImGui::Text(rItem->Name.c_str());
 			ImGui::PushID(++imguiID);
-			ImGui::DragFloat3("Position", (float*)&rItem->Position, 0.1f);
+			bool changed = ImGui::DragFloat3("Position", (float*)&rItem->Position, 0.1f);
 
-			ImGui::DragFloat3("Rotation", (float*)&rItem->RotationAngle, 0.05f);
+			changed |= ImGui::DragFloat3("Rotation", (float*)&rItem->RotationAngle, 0.05f);
 
-			ImGui::DragFloat3("Scale", (float*)&rItem->Scale, 0.05f);
+			changed |= ImGui::DragFloat3("Scale", (float*)&rItem->Scale, 0.05f);
 
 			ImGui::PopID();
-			rItem->TranslationM = XMMatrixTranslation(rItem->Position.x, rItem->Position.y, rItem->Position.z);
-			rItem->RotationM = XMMatrixRotationRollPitchYaw(rItem->RotationAngle.x, rItem->RotationAngle.y, rItem->RotationAngle.z);
-			rItem->ScaleM = XMMatrixScaling(rItem->Scale.x, rItem->Scale.y, rItem->Scale.z);
-			XMStoreFloat4x4(&rItem->World, rItem->ScaleM * rItem->RotationM * rItem->TranslationM);
-			rItem->NumFramesDirty = gNumFrameResources;
+			// Untouched items keep their constants, bounds and place in the BVH.
+			if (changed)
+			{
+				rItem->TranslationM = XMMatrixTranslation(rItem->Position.x, rItem->Position.y, rItem->Position.z);
+				rItem->RotationM = XMMatrixRotationRollPitchYaw(rItem->RotationAngle.x, rItem->RotationAngle.y, rItem->RotationAngle.z);
+				rItem->ScaleM = XMMatrixScaling(rItem->Scale.x, rItem->Scale.y, rItem->Scale.z);
+				XMStoreFloat4x4(&rItem->World, rItem->ScaleM * rItem->RotationM * rItem->TranslationM);
+				rItem->NumFramesDirty = gNumFrameResources;
+				rItem->BoundsDirty = true;
+			}
 		}
 	}
 	ImGui::Text("\n\nLights\n\n");
 	AnimateMaterials(gt);
+	UpdateWorldBounds(gt);
+	UpdateLods(gt);
+	CullRenderItems(gt);
+	CullSmallRenderItems(gt);
+	CullOccludedRenderItems(gt);
+	CullClusters(gt);
 	UpdateObjectCBs(gt);
 	UpdateMaterialCBs(gt);
 	UpdateLightCBs(gt);
+	CullShadowCasters(gt);
+	UpdateDrawBatches(gt);
 	// post process update
 	ImGui::End();
 	ImGui::Begin("Distortion Settings");
@@ -531,6 +823,9 @@ void TexColumnsApp::OnMouseDown(WPARAM btnState, int x, int y)
     mLastMousePos.x = x;
     mLastMousePos.y = y;
 
+	if ((btnState & MK_RBUTTON) != 0 && !ImGui::GetIO().WantCaptureMouse)
+		PickRenderItem(x, y);
+
     SetCapture(mhMainWnd);
 }
 
@@ -642,37 +937,276 @@ void TexColumnsApp::AnimateMaterials(const GameTimer& gt)
 	
 }
 
-void TexColumnsApp::UpdateObjectCBs(const GameTimer& gt)
+void TexColumnsApp::UpdateWorldBounds(const GameTimer& gt)
 {
-	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
-	for(auto& e : mAllRitems)
+	// Opaque items are given culler slots in list order whenever the list changes.
+	if (mFrustumCuller.Size() != mOpaqueRitems.size())
 	{
+		mFrustumCuller.Resize(mOpaqueRitems.size());
+		for (size_t i = 0; i < mOpaqueRitems.size(); ++i)
+		{
+			mOpaqueRitems[i]->CullSlot = static_cast<int>(i);
+			mOpaqueRitems[i]->BoundsDirty = true;
+		}
+	}
+
+	for (auto& e : mAllRitems)
+	{
+		if (!e->BoundsDirty)
+			continue;
 
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
+		XMMATRIX world = XMLoadFloat4x4(&e->World);
+		e->Bounds.Transform(e->WorldBounds, world);
+		e->Sphere.Transform(e->WorldSphere, world);
+		if (e->CullSlot >= 0)
+			mFrustumCuller.SetBounds(e->CullSlot, e->WorldBounds);
+		if (e->BvhProxy < 0)
+			e->BvhProxy = mSceneBvh.Insert(e->WorldBounds, static_cast<std::uint32_t>(&e - mAllRitems.data()));
+		else
+			mSceneBvh.Move(e->BvhProxy, e->WorldBounds);
+		e->BoundsDirty = false;
+	}
+
+	if (mSceneBvh.ReinsertCount() > gBvhRebuildRatio * mSceneBvh.LeafCount())
+		mSceneBvh.Rebuild();
+}
+
+void TexColumnsApp::UpdateLods(const GameTimer& gt)
+{
+	// Screen pixels covered by one world unit at distance 1 from the camera.
+	const float pixelsPerUnit = 0.5f * mClientHeight * mProj._22;
+	const XMVECTOR eye = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mView)).r[3];
+	// Near plane of mProj, set in OnResize.
+	const float nearZ = 1.0f;
+
+	for (auto& e : mAllRitems)
+	{
+		if (!e->Lods.empty())
 		{
 			XMMATRIX world = XMLoadFloat4x4(&e->World);
-			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+			float scale = std::max({ XMVectorGetX(XMVector3Length(world.r[0])),
+				XMVectorGetX(XMVector3Length(world.r[1])),
+				XMVectorGetX(XMVector3Length(world.r[2])) });
+
+			// Distance to the nearest point of the bounding sphere.
+			XMVECTOR center = XMLoadFloat3(&e->WorldSphere.Center);
+			float distance = std::max(XMVectorGetX(XMVector3Length(center - eye)) - e->WorldSphere.Radius, nearZ);
+
+			// Object space error -> pixels.
+			const float toPixels = pixelsPerUnit * scale / distance;
+
+			UINT lod = e->CurrentLod;
+			while (lod + 1 < e->Lods.size() && e->Lods[lod + 1].Error * toPixels < mLodErrorPixels)
+				++lod;
+			while (lod > 0 && e->Lods[lod].Error * toPixels > mLodErrorPixels * (1.0f + gLodHysteresis))
+				--lod;
+
+			e->CurrentLod = lod;
+			e->IndexCount = e->Lods[lod].IndexCount;
+			e->StartIndexLocation = e->Lods[lod].StartIndexLocation;
+		}
+	}
+}
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-			XMStoreFloat4x4(&objConstants.InvWorld,MathHelper::InverseTranspose(world));
-			XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+void TexColumnsApp::CullRenderItems(const GameTimer& gt)
+{
+	mVisibleOpaqueRitems.clear();
+	if (!mUseFrustumCulling)
+	{
+		mVisibleOpaqueRitems = mOpaqueRitems;
+		return;
+	}
 
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMLoadFloat4x4(&mView) * XMLoadFloat4x4(&mProj));
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(viewProj, planes);
 
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
-		}
+	mFrustumCuller.Cull(planes, mVisibleIndices);
+	for (std::uint32_t i : mVisibleIndices)
+		mVisibleOpaqueRitems.push_back(mOpaqueRitems[i]);
+}
+
+void TexColumnsApp::CullSmallRenderItems(const GameTimer& gt)
+{
+	mSmallCulledMain = 0;
+	if (!mUseContributionCulling)
+		return;
+
+	// Diameter in pixels of a sphere of radius r at distance d: r * _22 * height / d.
+	const float pixelsPerUnit = mProj._22 * mClientHeight;
+	const XMVECTOR eye = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mView)).r[3];
+
+	auto tooSmall = [&](RenderItem* ri)
+	{
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&ri->WorldSphere.Center) - eye));
+		return distance > ri->WorldSphere.Radius && ri->WorldSphere.Radius * pixelsPerUnit < mMinMainPixels * distance;
+	};
+	auto end = std::remove_if(mVisibleOpaqueRitems.begin(), mVisibleOpaqueRitems.end(), tooSmall);
+	mSmallCulledMain = (UINT)(mVisibleOpaqueRitems.end() - end);
+	mVisibleOpaqueRitems.erase(end, mVisibleOpaqueRitems.end());
+}
+
+void TexColumnsApp::CullOccludedRenderItems(const GameTimer& gt)
+{
+	mOccluderCount = 0;
+	mOccludedRitems = 0;
+	if (!mUseOcclusionCulling)
+		return;
+
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMLoadFloat4x4(&mView) * XMLoadFloat4x4(&mProj));
+	mOcclusionCuller.Begin(viewProj);
+
+	// Occluders are the visible items that cover the most of the screen, measured
+	// by their bounding sphere; the camera being inside one counts as the largest.
+	const XMMATRIX invView = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mView));
+	const XMVECTOR eye = invView.r[3];
+	std::vector<std::pair<float, RenderItem*>> candidates;
+	for (auto ri : mVisibleOpaqueRitems)
+	{
+		if (!ri->Occluder)
+			continue;
+		float distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&ri->WorldSphere.Center) - eye));
+		float size = distance > ri->WorldSphere.Radius ? ri->WorldSphere.Radius * mProj._22 / distance : MathHelper::Infinity;
+		if (size >= gOccluderMinScreenSize)
+			candidates.push_back({ size, ri });
+	}
+	std::sort(candidates.begin(), candidates.end(),
+		[](const auto& a, const auto& b) { return a.first > b.first; });
+
+	UINT triangles = 0;
+	for (const auto& candidate : candidates)
+	{
+		const SubmeshOccluder& occluder = *candidate.second->Occluder;
+		const UINT count = (UINT)occluder.Indices.size() / 3;
+		if (triangles + count > gOccluderTriangleBudget)
+			continue;
+		mOcclusionCuller.AddOccluder(occluder.Positions.data(), occluder.Positions.size(),
+			occluder.Indices.data(), occluder.Indices.size(), candidate.second->World);
+		triangles += count;
+		++mOccluderCount;
+	}
+	if (mOccluderCount == 0)
+		return;
+
+	mOcclusionCuller.Rasterize(mJobSystem.get());
+
+	auto occluded = [&](RenderItem* ri) { return !mOcclusionCuller.IsVisible(ri->WorldBounds); };
+	auto end = std::remove_if(mVisibleOpaqueRitems.begin(), mVisibleOpaqueRitems.end(), occluded);
+	mOccludedRitems = (UINT)(mVisibleOpaqueRitems.end() - end);
+	mVisibleOpaqueRitems.erase(end, mVisibleOpaqueRitems.end());
+}
+
+void TexColumnsApp::PickRenderItem(int x, int y)
+{
+	// Ray through the pixel centre in view space, then in world space.
+	const float vx = (2.0f * (x + 0.5f) / mClientWidth - 1.0f) / mProj(0, 0);
+	const float vy = (1.0f - 2.0f * (y + 0.5f) / mClientHeight) / mProj(1, 1);
+	const XMMATRIX invView = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mView));
+	const XMVECTOR origin = XMVector3TransformCoord(XMVectorZero(), invView);
+	const XMVECTOR dir = XMVector3Normalize(XMVector3TransformNormal(XMVectorSet(vx, vy, 1.0f, 0.0f), invView));
+
+	// Leaves are confirmed against the object space box, which fits rotated items
+	// better than the world box.  Items the camera is inside of, like the level
+	// itself, cannot be picked.
+	auto hitTest = [&](std::uint32_t index, float maxDistance)
+	{
+		const RenderItem* ri = mAllRitems[index].get();
+		const XMMATRIX world = XMLoadFloat4x4(&ri->World);
+		const XMMATRIX invWorld = XMMatrixInverse(nullptr, world);
+		const XMVECTOR localOrigin = XMVector3TransformCoord(origin, invWorld);
+		const XMVECTOR localDir = XMVector3Normalize(XMVector3TransformNormal(dir, invWorld));
+
+		float localDistance;
+		if (ri->Bounds.Contains(localOrigin) != DISJOINT || !ri->Bounds.Intersects(localOrigin, localDir, localDistance))
+			return -1.0f;
+		XMVECTOR hit = XMVector3TransformCoord(localOrigin + localDir * localDistance, world);
+		return XMVectorGetX(XMVector3Length(hit - origin));
+	};
+
+	XMFLOAT3 o, d;
+	XMStoreFloat3(&o, origin);
+	XMStoreFloat3(&d, dir);
+	std::uint32_t index;
+	float distance;
+	if (mSceneBvh.RayCast(o, d, mMainPassCB.FarZ, hitTest, index, distance))
+		mPickedRitem = mAllRitems[index].get();
+	else
+		mPickedRitem = nullptr;
+}
+
+void TexColumnsApp::CullClusters(const GameTimer& gt)
+{
+	// The matrices the frame is drawn with, as in CullRenderItems.
+	const XMMATRIX invView = XMMatrixInverse(nullptr, XMLoadFloat4x4(&mView));
+	BoundingFrustum frustum;
+	BoundingFrustum::CreateFromMatrix(frustum, XMLoadFloat4x4(&mProj));
+	frustum.Transform(frustum, invView);
+	XMFLOAT3 eye;
+	XMStoreFloat3(&eye, invView.r[3]);
+
+	mClusterStats = ClusterCuller::Stats();
+	for (auto e : mVisibleOpaqueRitems)
+	{
+		e->DrawRanges.clear();
+
+		// Clusters only cover the full resolution mesh; coarser LODs are drawn whole.
+		if (mUseClusterCulling && e->CurrentLod == 0 && !e->Clusters.empty())
+			ClusterCuller::Cull(e->Clusters, e->World, frustum, eye, e->DrawRanges, mClusterStats);
+		else
+			e->DrawRanges.push_back({ e->IndexCount, e->StartIndexLocation });
 	}
 }
 
+void TexColumnsApp::UpdateObjectCBs(const GameTimer& gt)
+{
+	mObjectConstants.resize(mAllRitems.size());
+	mJobSystem->ParallelFor(mAllRitems.size(), gObjectUpdateGrain, [this](size_t begin, size_t end)
+	{
+		for (size_t i = begin; i < end; ++i)
+		{
+			RenderItem* e = mAllRitems[i].get();
+
+			// Only recompute the constants if they have changed.  Every frame gets a
+			// copy of the whole array, so one update covers all the frame resources.
+			if(e->NumFramesDirty > 0)
+			{
+				XMMATRIX world = XMLoadFloat4x4(&e->World);
+				XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+
+				ObjectConstants& objConstants = mObjectConstants[e->ObjCBIndex];
+				XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
+				XMStoreFloat4x4(&objConstants.InvWorld,MathHelper::InverseTranspose(world));
+				XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+				objConstants.PosCenter = e->Bounds.Center;
+				objConstants.PosExtents = VertexQuantization::QuantizationExtents(e->Bounds.Extents);
+
+				e->NumFramesDirty = 0;
+			}
+		}
+	});
+
+	// Items are not stored in ObjCBIndex order, so the copy into this frame's
+	// buffer is split separately, by index.
+	const size_t byteSize = mObjectConstants.size() * sizeof(ObjectConstants);
+	LinearAllocator::Allocation objects = mUploadAllocator->Allocate(byteSize);
+	mJobSystem->ParallelFor(mObjectConstants.size(), gObjectUpdateGrain, [&](size_t begin, size_t end)
+	{
+		memcpy(objects.CpuAddress + begin * sizeof(ObjectConstants), mObjectConstants.data() + begin, (end - begin) * sizeof(ObjectConstants));
+	});
+	mCurrFrameResource->ObjectBuffer = objects.GpuAddress;
+}
+
 void TexColumnsApp::UpdateLightCBs(const GameTimer& gt)
 {
 	
-	auto currLightCB = mCurrFrameResource->LightCB.get();
-	auto currShadowCB = mCurrFrameResource->PassShadowCB.get();
+	const UINT lightCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(LightConstants));
+	const UINT shadowCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassShadowConstants));
+	LinearAllocator::Allocation lightCB = mUploadAllocator->Allocate(mLights.size() * lightCBByteSize);
+	LinearAllocator::Allocation shadowCB = mUploadAllocator->Allocate(mLights.size() * shadowCBByteSize);
+	mCurrFrameResource->LightCB = lightCB.GpuAddress;
+	mCurrFrameResource->PassShadowCB = shadowCB.GpuAddress;
 	int lId = 0;
 	for (auto& l : mLights)
 	{
@@ -818,36 +1352,225 @@ void TexColumnsApp::UpdateLightCBs(const GameTimer& gt)
 		}
 		lConst.light = l;
 		shConst.LightViewProj = l.LightViewProj;
-		currShadowCB->CopyData(l.LightCBIndex,shConst);
-		currLightCB->CopyData(l.LightCBIndex, lConst);
+		memcpy(shadowCB.CpuAddress + l.LightCBIndex * shadowCBByteSize, &shConst, sizeof(shConst));
+		memcpy(lightCB.CpuAddress + l.LightCBIndex * lightCBByteSize, &lConst, sizeof(lConst));
 		lId++;
 	}
 }
 
-void TexColumnsApp::UpdateMaterialCBs(const GameTimer& gt)
+void TexColumnsApp::CullShadowCasters(const GameTimer& gt)
 {
-	auto currMaterialCB = mCurrFrameResource->MaterialCB.get();
-	for(auto& e : mMaterials)
+	mSmallCulledShadow = 0;
+	mShadowCasters.resize(mLights.size());
+	mShadowCasterStats.clear();
+	for (size_t i = 0; i < mLights.size(); ++i)
 	{
-		
-		// Only update the cbuffer data if the constants have changed.  If the cbuffer
-		// data changes, it needs to be updated for each FrameResource.
-		Material* mat = e.second.get();
-		if(mat->NumFramesDirty > 0)
+		const Light& l = mLights[i];
+		std::vector<RenderItem*>& casters = mShadowCasters[i];
+		casters.clear();
+		if (!(l.type == 2 || l.type == 3) || !l.CastsShadows)
+			continue;
+		if (!mUseShadowCasterCulling)
 		{
-			XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
+			casters = mOpaqueRitems;
+			mShadowCasterStats.push_back({ i, casters.size(), 0, 0 });
+			continue;
+		}
 
-			MaterialConstants matConstants;
-			matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
-			matConstants.FresnelR0 = mat->FresnelR0;
-			matConstants.Roughness = mat->Roughness;
-			XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+		XMFLOAT4X4 viewProj;
+		XMStoreFloat4x4(&viewProj, XMLoadFloat4x4(&l.LightView) * XMLoadFloat4x4(&l.LightProj));
+		XMFLOAT4 planes[6];
+		FrustumCuller::ExtractPlanes(viewProj, planes);
 
-			currMaterialCB->CopyData(mat->MatCBIndex, matConstants);
+		// Casters between the light and its near plane still block light, so the
+		// volume is open towards the light: the near plane is replaced by one every
+		// box passes, and the shadow PSO clamps their depth instead of clipping them.
+		planes[4] = XMFLOAT4(0.0f, 0.0f, 0.0f, 1.0f);
 
-			// Next FrameResource need to be updated too.
-			mat->NumFramesDirty--;
+		// A spot light's receivers are within FalloffEnd of it, and so are the
+		// casters between them and the light.
+		if (l.type == 3)
+		{
+			XMVECTOR dir = XMVector3Normalize(XMLoadFloat3(&l.Direction));
+			float reach = XMVectorGetX(XMVector3Dot(dir, XMLoadFloat3(&l.Position))) + l.FalloffEnd;
+			planes[5] = XMFLOAT4(-XMVectorGetX(dir), -XMVectorGetY(dir), -XMVectorGetZ(dir), reach);
+		}
+
+		mFrustumCuller.Cull(planes, mVisibleIndices);
+		for (std::uint32_t index : mVisibleIndices)
+			casters.push_back(mOpaqueRitems[index]);
+
+		// Casters covering less than mMinShadowPixels of the shadow map.  An
+		// orthographic map has the same texels per unit everywhere; a spot light's
+		// shrink with the distance from the light.
+		UINT small = 0;
+		if (mUseContributionCulling)
+		{
+			const float pixelsPerUnit = l.LightProj._11 * SHADOW_MAP_WIDTH;
+			const XMVECTOR lightPos = XMLoadFloat3(&l.Position);
+			auto tooSmall = [&](RenderItem* ri)
+			{
+				float distance = 1.0f;
+				if (l.type == 3)
+				{
+					distance = XMVectorGetX(XMVector3Length(XMLoadFloat3(&ri->WorldSphere.Center) - lightPos));
+					if (distance <= ri->WorldSphere.Radius)
+						return false;
+				}
+				return ri->WorldSphere.Radius * pixelsPerUnit < mMinShadowPixels * distance;
+			};
+			auto end = std::remove_if(casters.begin(), casters.end(), tooSmall);
+			small = (UINT)(casters.end() - end);
+			casters.erase(end, casters.end());
+			mSmallCulledShadow += small;
 		}
+
+		mShadowCasterStats.push_back({ i, casters.size(), mOpaqueRitems.size() - casters.size() - small, small });
+	}
+}
+
+void TexColumnsApp::UpdateDrawBatches(const GameTimer& gt)
+{
+	// Every item drawn in the main pass or a shadow pass takes one instance entry.
+	mInstanceCount = 0;
+	size_t instanceCapacity = mVisibleOpaqueRitems.size();
+	for (const auto& casters : mShadowCasters)
+		instanceCapacity += casters.size();
+	LinearAllocator::Allocation instances = mUploadAllocator->Allocate(instanceCapacity * sizeof(UINT));
+	mInstanceData = reinterpret_cast<UINT*>(instances.CpuAddress);
+	mCurrFrameResource->InstanceBuffer = instances.GpuAddress;
+
+	// Items with all their clusters culled have nothing left to draw.
+	mBatchItems.clear();
+	for (RenderItem* ri : mVisibleOpaqueRitems)
+		if (!ri->DrawRanges.empty())
+			mBatchItems.push_back(ri);
+	BuildDrawBatches(mBatchItems, true, mOpaqueBatches);
+	XMFLOAT4X4 viewProj;
+	XMStoreFloat4x4(&viewProj, XMLoadFloat4x4(&mView) * XMLoadFloat4x4(&mProj));
+	SortDrawBatches(mOpaqueBatches, 0, true, viewProj);
+
+	// The instances of a batch share their cluster culled ranges.
+	mDrawnTriangles = 0;
+	for (const DrawBatch& batch : mOpaqueBatches)
+		for (const auto& range : batch.Item->DrawRanges)
+			mDrawnTriangles += range.IndexCount / 3 * batch.InstanceCount;
+	ImGui::Text("Main pass: %zu draws for %zu objects, %u binds skipped",
+		mOpaqueBatches.size(), mBatchItems.size(), mMainStateChangesSkipped);
+
+	// The shadow pass binds no material, so only the geometry has to match.
+	mShadowBatches.resize(mShadowCasters.size());
+	size_t shadowDraws = 0;
+	size_t shadowItems = 0;
+	for (size_t i = 0; i < mShadowCasters.size(); ++i)
+	{
+		BuildDrawBatches(mShadowCasters[i], false, mShadowBatches[i]);
+		XMStoreFloat4x4(&viewProj, XMLoadFloat4x4(&mLights[i].LightView) * XMLoadFloat4x4(&mLights[i].LightProj));
+		SortDrawBatches(mShadowBatches[i], 1, false, viewProj);
+		shadowDraws += mShadowBatches[i].size();
+		shadowItems += mShadowCasters[i].size();
+	}
+	ImGui::Text("Shadow passes: %zu draws for %zu objects, %u binds skipped",
+		shadowDraws, shadowItems, mShadowStateChangesSkipped);
+	ImGui::Text("Commands recorded: %zu", mRecordedCommands);
+}
+
+void TexColumnsApp::BuildDrawBatches(std::vector<RenderItem*>& ritems, bool matchMaterial, std::vector<DrawBatch>& batches)
+{
+	batches.clear();
+
+	// Sorting brings the items of a batch together.  The main pass draws only what
+	// cluster culling left of each item, so its instances must also have the same
+	// ranges left; items the camera sees differently are drawn on their own.
+	auto key = [matchMaterial](const RenderItem* ri)
+	{
+		return std::make_tuple(ri->Geo, matchMaterial ? ri->Mat : nullptr, ri->PrimitiveType,
+			ri->BaseVertexLocation, ri->StartIndexLocation, ri->IndexCount);
+	};
+	auto rangesLess = [](const RenderItem* a, const RenderItem* b)
+	{
+		return std::lexicographical_compare(a->DrawRanges.begin(), a->DrawRanges.end(), b->DrawRanges.begin(), b->DrawRanges.end(),
+			[](const ClusterCuller::Range& x, const ClusterCuller::Range& y)
+			{
+				return std::make_pair(x.StartIndexLocation, x.IndexCount) < std::make_pair(y.StartIndexLocation, y.IndexCount);
+			});
+	};
+	auto less = [&](const RenderItem* a, const RenderItem* b)
+	{
+		if (key(a) != key(b))
+			return key(a) < key(b);
+		return matchMaterial && rangesLess(a, b);
+	};
+	if (mUseInstancing)
+		std::sort(ritems.begin(), ritems.end(), less);
+
+	for (RenderItem* ri : ritems)
+	{
+		if (mUseInstancing && !batches.empty() && !less(batches.back().Item, ri))
+			++batches.back().InstanceCount;
+		else
+			batches.push_back({ ri, mInstanceCount, 1 });
+		mInstanceData[mInstanceCount++] = ri->ObjCBIndex;
+	}
+}
+
+// Packs a draw's state into a sort key, most significant field first:
+// pass (4 bits) | geometry (16) | material (16) | depth (16).
+// Sorting by it groups the draws sharing state and orders each group front to back.
+// Every draw of a pass uses the same pipeline state, so it is not part of the key.
+static std::uint64_t MakeDrawSortKey(UINT pass, UINT geometry, UINT material, float depth)
+{
+	const std::uint64_t depthBucket = (std::uint64_t)(MathHelper::Clamp(depth, 0.0f, 1.0f) * 65535.0f);
+	return (std::uint64_t(pass & 0xf) << 48) |
+		(std::uint64_t(geometry & 0xffff) << 32) |
+		(std::uint64_t(material & 0xffff) << 16) |
+		depthBucket;
+}
+
+void TexColumnsApp::SortDrawBatches(std::vector<DrawBatch>& batches, UINT pass, bool useMaterial, const XMFLOAT4X4& viewProj)
+{
+	if (!mUseDrawSorting)
+		return;
+
+	// The depth of a batch is the clip space depth of its first item's centre.
+	const XMMATRIX m = XMLoadFloat4x4(&viewProj);
+	mSortEntries.resize(batches.size());
+	for (size_t i = 0; i < batches.size(); ++i)
+	{
+		const RenderItem* ri = batches[i].Item;
+		XMVECTOR clip = XMVector3Transform(XMLoadFloat3(&ri->WorldSphere.Center), m);
+		float w = XMVectorGetW(clip);
+		float depth = w > 0.0f ? XMVectorGetZ(clip) / w : 0.0f;
+		UINT geometry = mGeometrySortIds.emplace(ri->Geo, (UINT)mGeometrySortIds.size()).first->second;
+		UINT material = useMaterial ? (UINT)ri->Mat->MatCBIndex : 0;
+		mSortEntries[i] = { MakeDrawSortKey(pass, geometry, material, depth), (std::uint32_t)i };
+	}
+	RadixSort::Sort(mSortEntries, mSortScratch);
+
+	mSortedBatches.clear();
+	for (const RadixSort::Entry& e : mSortEntries)
+		mSortedBatches.push_back(batches[e.Value]);
+	batches.swap(mSortedBatches);
+}
+
+void TexColumnsApp::UpdateMaterialCBs(const GameTimer& gt)
+{
+	// There are few materials, so all of them are written to this frame's buffer.
+	const UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	LinearAllocator::Allocation materialCB = mUploadAllocator->Allocate(mMaterials.size() * matCBByteSize);
+	mCurrFrameResource->MaterialCB = materialCB.GpuAddress;
+	for(auto& e : mMaterials)
+	{
+		Material* mat = e.second.get();
+		XMMATRIX matTransform = XMLoadFloat4x4(&mat->MatTransform);
+
+		MaterialConstants matConstants;
+		matConstants.DiffuseAlbedo = mat->DiffuseAlbedo;
+		matConstants.FresnelR0 = mat->FresnelR0;
+		matConstants.Roughness = mat->Roughness;
+		XMStoreFloat4x4(&matConstants.MatTransform, XMMatrixTranspose(matTransform));
+
+		memcpy(materialCB.CpuAddress + mat->MatCBIndex * matCBByteSize, &matConstants, sizeof(matConstants));
 	}
 }
 
@@ -878,16 +1601,8 @@ void TexColumnsApp::UpdateMainPassCB(const GameTimer& gt)
 	currPassCB->CopyData(0, mMainPassCB);
 }
 
-void TexColumnsApp::CreateGBuffer()
+D3D12_RESOURCE_DESC TexColumnsApp::ScreenTargetDesc(DXGI_FORMAT format, UINT sampleCount, UINT sampleQuality) const
 {
-	//        
-	const DXGI_FORMAT positionFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
-	const DXGI_FORMAT normalFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
-	const DXGI_FORMAT albedoFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
-	FlushCommandQueue();
-
-	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
-	//                 
 	D3D12_RESOURCE_DESC texDesc = {};
 	texDesc.Dimension = D3D12_RESOURCE_DIMENSION_TEXTURE2D;
 	texDesc.Alignment = 0;
@@ -895,44 +1610,137 @@ void TexColumnsApp::CreateGBuffer()
 	texDesc.Height = mClientHeight;
 	texDesc.DepthOrArraySize = 1;
 	texDesc.MipLevels = 1;
-	texDesc.SampleDesc.Count = 1;
-	texDesc.SampleDesc.Quality = 0;
+	texDesc.Format = format;
+	texDesc.SampleDesc.Count = sampleCount;
+	texDesc.SampleDesc.Quality = sampleQuality;
 	texDesc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
-	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET ;
+	texDesc.Flags = D3D12_RESOURCE_FLAG_ALLOW_RENDER_TARGET;
+	return texDesc;
+}
+
+void TexColumnsApp::BuildRenderGraph()
+{
+	mRenderGraph.Clear();
+
+	// Its handle changes every frame; DeferredDraw sets it.
+	mBackBufferTarget = mRenderGraph.Import("back buffer", D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_PRESENT);
+	mRenderGraph.MarkOutput(mBackBufferTarget);
+	RenderGraph::Resource depth = mRenderGraph.Import("depth", D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	mRenderGraph.SetHandle(depth, (UINT64)mDepthStencilBuffer.Get());
+
+	std::vector<RenderGraph::Resource> shadowMaps;
+	for (const Light& light : mLights)
+	{
+		if (!light.ShadowMap)
+			continue;
+		shadowMaps.push_back(mRenderGraph.Import("shadow map", D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+		mRenderGraph.SetHandle(shadowMaps.back(), (UINT64)light.ShadowMap.Get());
+	}
+
+	// On a resize the handles are replaced once the targets are created again.
+	const char* gbufferNames[3] = { "gbuffer albedo", "gbuffer normal", "gbuffer position" };
+	const DXGI_FORMAT gbufferFormats[3] = { albedoFormat, normalFormat, positionFormat };
+	ID3D12Resource* gbuffer[3] = { mGBufferAlbedo.Get(), mGBufferNormal.Get(), mGBufferPosition.Get() };
+	for (int i = 0; i < 3; ++i)
+	{
+		D3D12_RESOURCE_DESC desc = ScreenTargetDesc(gbufferFormats[i], 1, 0);
+		D3D12_RESOURCE_ALLOCATION_INFO info = md3dDevice->GetResourceAllocationInfo(0, 1, &desc);
+		mGBufferTargets[i] = mRenderGraph.CreateTransient(gbufferNames[i], info.SizeInBytes, info.Alignment);
+		mRenderGraph.SetHandle(mGBufferTargets[i], (UINT64)gbuffer[i]);
+	}
+	D3D12_RESOURCE_DESC sceneDesc = ScreenTargetDesc(mBackBufferFormat, m4xMsaaState ? 4 : 1, m4xMsaaState ? (m4xMsaaQuality - 1) : 0);
+	D3D12_RESOURCE_ALLOCATION_INFO sceneInfo = md3dDevice->GetResourceAllocationInfo(0, 1, &sceneDesc);
+	mSceneTarget = mRenderGraph.CreateTransient("scene", sceneInfo.SizeInBytes, sceneInfo.Alignment);
+	mRenderGraph.SetHandle(mSceneTarget, (UINT64)mSceneTexture.Get());
+
+	RenderGraph::Pass shadow = mRenderGraph.AddPass("shadow maps", [this]() { DrawSceneToShadowMap(); });
+	for (RenderGraph::Resource shadowMap : shadowMaps)
+		mRenderGraph.Write(shadow, shadowMap, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+	RenderGraph::Pass geometry = mRenderGraph.AddPass("geometry", [this]() { DrawGeometryPass(); });
+	for (RenderGraph::Resource target : mGBufferTargets)
+		mRenderGraph.Write(geometry, target, D3D12_RESOURCE_STATE_RENDER_TARGET);
+	mRenderGraph.Write(geometry, depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+
+	RenderGraph::Pass lighting = mRenderGraph.AddPass("lighting", [this]() { DrawLightingPass(); });
+	for (RenderGraph::Resource target : mGBufferTargets)
+		mRenderGraph.Read(lighting, target, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	for (RenderGraph::Resource shadowMap : shadowMaps)
+		mRenderGraph.Read(lighting, shadowMap, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	mRenderGraph.Write(lighting, depth, D3D12_RESOURCE_STATE_DEPTH_WRITE);
+	mRenderGraph.Write(lighting, mSceneTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	RenderGraph::Pass postProcess = mRenderGraph.AddPass("post process", [this]() { DrawPostProcessPass(); });
+	mRenderGraph.Read(postProcess, mSceneTarget, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
+	mRenderGraph.Write(postProcess, mBackBufferTarget, D3D12_RESOURCE_STATE_RENDER_TARGET);
+
+	mRenderGraph.Compile();
+	EnsureTransientHeap();
+}
+
+void TexColumnsApp::EnsureTransientHeap()
+{
+	// The heap only grows, so going back to a smaller size needs no new one.
+	if (mTransientHeap)
+	{
+		const D3D12_HEAP_DESC current = mTransientHeap->GetDesc();
+		if (current.SizeInBytes >= mRenderGraph.TransientHeapSize() && current.Alignment >= mRenderGraph.TransientHeapAlignment())
+			return;
+	}
+
+	// The targets placed in the old heap keep it alive until they are replaced.
+	D3D12_HEAP_DESC heapDesc = {};
+	heapDesc.SizeInBytes = mRenderGraph.TransientHeapSize();
+	heapDesc.Properties = CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT);
+	heapDesc.Alignment = mRenderGraph.TransientHeapAlignment();
+	heapDesc.Flags = D3D12_HEAP_FLAG_ALLOW_ONLY_RT_DS_TEXTURES;
+	mTransientHeap.Reset();
+	ThrowIfFailed(md3dDevice->CreateHeap(&heapDesc, IID_PPV_ARGS(&mTransientHeap)));
+}
+
+void TexColumnsApp::IssueGraphBarriers(const std::vector<RenderGraph::Barrier>& barriers)
+{
+	mGraphBarriers.clear();
+	for (const RenderGraph::Barrier& b : barriers)
+	{
+		ID3D12Resource* resource = reinterpret_cast<ID3D12Resource*>(mRenderGraph.Handle(b.Target));
+		if (b.Type == RenderGraph::BarrierType::Aliasing)
+			mGraphBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Aliasing(nullptr, resource));
+		else
+			mGraphBarriers.push_back(CD3DX12_RESOURCE_BARRIER::Transition(resource,
+				(D3D12_RESOURCE_STATES)b.Before, (D3D12_RESOURCE_STATES)b.After));
+	}
+	mCommandList->ResourceBarrier((UINT)mGraphBarriers.size(), mGraphBarriers.data());
+}
+
+void TexColumnsApp::CreateGBuffer()
+{
+	//        
+	const DXGI_FORMAT positionFormat = DXGI_FORMAT_R32G32B32A32_FLOAT;
+	const DXGI_FORMAT normalFormat = DXGI_FORMAT_R16G16B16A16_FLOAT;
+	const DXGI_FORMAT albedoFormat = DXGI_FORMAT_R8G8B8A8_UNORM;
+	// The old targets may still be in use by the GPU.  Nothing below records
+	// commands, so this also works while the command list is open.
+	FlushCommandQueue();
 
 	mGBufferPosition.Reset();
 	mGBufferNormal.Reset();
 	mGBufferAlbedo.Reset();
 	//                   --------------------------------------------------------
-	// Position
-	texDesc.Format = positionFormat;
-	ThrowIfFailed(md3dDevice->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&texDesc,
-		D3D12_RESOURCE_STATE_RENDER_TARGET,
-		&CD3DX12_CLEAR_VALUE(positionFormat, Colors::Black),
-		IID_PPV_ARGS(&mGBufferPosition)));
-
-	// Normal
-	texDesc.Format = normalFormat;
-	ThrowIfFailed(md3dDevice->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&texDesc,
-		D3D12_RESOURCE_STATE_RENDER_TARGET,
-		&CD3DX12_CLEAR_VALUE(normalFormat, Colors::Black),
-		IID_PPV_ARGS(&mGBufferNormal)));
-
-	// Albedo
-	texDesc.Format = albedoFormat;
-	ThrowIfFailed(md3dDevice->CreateCommittedResource(
-		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-		D3D12_HEAP_FLAG_NONE,
-		&texDesc,
-		D3D12_RESOURCE_STATE_RENDER_TARGET,
-		&CD3DX12_CLEAR_VALUE(albedoFormat, Colors::Black),
-		IID_PPV_ARGS(&mGBufferAlbedo)));
+	const DXGI_FORMAT formats[3] = { albedoFormat, normalFormat, positionFormat };
+	ComPtr<ID3D12Resource>* targets[3] = { &mGBufferAlbedo, &mGBufferNormal, &mGBufferPosition };
+	for (int i = 0; i < 3; ++i)
+	{
+		D3D12_RESOURCE_DESC texDesc = ScreenTargetDesc(formats[i], 1, 0);
+		ThrowIfFailed(md3dDevice->CreatePlacedResource(
+			mTransientHeap.Get(),
+			mRenderGraph.Offset(mGBufferTargets[i]),
+			&texDesc,
+			(D3D12_RESOURCE_STATES)mRenderGraph.InitialState(mGBufferTargets[i]),
+			&CD3DX12_CLEAR_VALUE(formats[i], Colors::Black),
+			IID_PPV_ARGS(targets[i]->GetAddressOf())));
+		mRenderGraph.SetHandle(mGBufferTargets[i], (UINT64)targets[i]->Get());
+	}
 
 	//          RTV -------------------------------------------------------------
 	CD3DX12_CPU_DESCRIPTOR_HANDLE rtvHandle(
@@ -960,16 +1768,6 @@ void TexColumnsApp::CreateGBuffer()
 	rtvDesc.Format = positionFormat;
 	md3dDevice->CreateRenderTargetView(mGBufferPosition.Get(), &rtvDesc, rtvHandle);
 	mGBufferRTVs[2] = rtvHandle;
-
-
-	// Execute the resize commands.
-	ThrowIfFailed(mCommandList->Close());
-	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
-
-	// Wait until resize is complete.
-	FlushCommandQueue();
-
 }
 
 
@@ -997,7 +1795,7 @@ void TexColumnsApp::LoadTexture(const std::string& name)
 	
 	HRESULT hr = DirectX::CreateDDSTextureFromFile12(md3dDevice.Get(),
 		mCommandList.Get(), tex->Filename.c_str(),
-		tex->Resource, tex->UploadHeap);
+		tex->Resource, *mUploadRing);
 	
 	if (FAILED(hr)) {
 		std::wcout << L"Failed to load texture: " << tex->Filename.c_str() 
@@ -1024,20 +1822,22 @@ void TexColumnsApp::BuildRootSignature()
 	normalRange.Init(D3D12_DESCRIPTOR_RANGE_TYPE_SRV, 1, 1);  //                             t1
 
     // Root parameter can be a table, root descriptor or root constants.
-    CD3DX12_ROOT_PARAMETER slotRootParameter[5];
+    CD3DX12_ROOT_PARAMETER slotRootParameter[7];
 
 	// Perfomance TIP: Order from most frequent to least frequent.
 	slotRootParameter[0].InitAsDescriptorTable(1, &diffuseRange, D3D12_SHADER_VISIBILITY_ALL);
 	slotRootParameter[1].InitAsDescriptorTable(1, &normalRange, D3D12_SHADER_VISIBILITY_ALL);
 
-    slotRootParameter[2].InitAsConstantBufferView(0); // register b0
+    slotRootParameter[2].InitAsConstants(1, 0); // register b0, first instance of the draw
     slotRootParameter[3].InitAsConstantBufferView(1); // register b1
     slotRootParameter[4].InitAsConstantBufferView(2); // register b2
+    slotRootParameter[5].InitAsShaderResourceView(2); // register t2, object data
+    slotRootParameter[6].InitAsShaderResourceView(3); // register t3, instance object indices
 
 	auto staticSamplers = GetStaticSamplers();
 
     // A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(5, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(7, slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -1112,10 +1912,12 @@ void TexColumnsApp::BuildLightingRootSignature()
 // shadow root signature 
 void TexColumnsApp::BuildShadowPassRootSignature()
 {
-	CD3DX12_ROOT_PARAMETER slotRootParameter[2];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
 
-	slotRootParameter[0].InitAsConstantBufferView(0); // ObjectConstants (b0)
+	slotRootParameter[0].InitAsConstants(1, 0); // First instance of the draw (b0)
 	slotRootParameter[1].InitAsConstantBufferView(1); // ShadowPassConstants (b1 - gLightViewProj)
+	slotRootParameter[2].InitAsShaderResourceView(2); // Object data (t2)
+	slotRootParameter[3].InitAsShaderResourceView(3); // Instance object indices (t3)
 	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc;
 	rootSigDesc.Init(
 		_countof(slotRootParameter), slotRootParameter,
@@ -1320,7 +2122,7 @@ void TexColumnsApp::BuildShadowMapViews()
 				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
 				D3D12_HEAP_FLAG_NONE,
 				&texDesc,
-				D3D12_RESOURCE_STATE_GENERIC_READ, // Start in generic read, will transition to DEPTH_WRITE
+				D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, // The state the render graph expects between frames
 				&clearValue,
 				IID_PPV_ARGS(&light.ShadowMap)));
 			// Create DSV for the shadow map.
@@ -1336,7 +2138,6 @@ void TexColumnsApp::BuildShadowMapViews()
 			light.ShadowMapDsvHandle.Offset(i, mDsvDescriptorSize); // Use the stored index
 			md3dDevice->CreateDepthStencilView(light.ShadowMap.Get(), &dsvDesc, light.ShadowMapDsvHandle);
 
-			light.ShadowMapSrvHeapIndex = mTextures.size() + 3 + i;
 			i++;
 		}
 	}
@@ -1353,8 +2154,9 @@ void TexColumnsApp::BuildDescriptorHeaps()
 	//
 	// Create the SRV heap.
 	//
+	mSrvAllocator = std::make_unique<DescriptorAllocator>(gSrvCapacity);
 	D3D12_DESCRIPTOR_HEAP_DESC srvHeapDesc = {};
-	srvHeapDesc.NumDescriptors = mTextures.size() + 3 + mLights.size();
+	srvHeapDesc.NumDescriptors = mSrvAllocator->HeapSize();
 	srvHeapDesc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
 	srvHeapDesc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 	ThrowIfFailed(md3dDevice->CreateDescriptorHeap(&srvHeapDesc, IID_PPV_ARGS(&mSrvDescriptorHeap)));
@@ -1365,17 +2167,14 @@ void TexColumnsApp::BuildDescriptorHeaps()
 	//
 	// Fill out the heap with actual descriptors.
 	//
-	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
 	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
 	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
-	int offset = 0;
 	for (const auto& tex : mTextures) {
 		// Проверяем, что текстура была успешно загружена
 		if (tex.second == nullptr || tex.second->Resource == nullptr) {
 			std::wcout << L"Warning: Texture " << tex.first.c_str() << L" failed to load, skipping..." << std::endl;
 			TexOffsets[tex.first] = 0; // Используем индекс 0 для неудачно загруженных текстур
-			offset++;
 			continue;
 		}
 
@@ -1402,28 +2201,12 @@ void TexColumnsApp::BuildDescriptorHeaps()
 		srvDesc.Texture2D.MipLevels = desc.MipLevels;
 		
 		// Создаем SRV только для валидных текстур
+		const UINT index = AllocateSrv();
+		CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+		hDescriptor.Offset(index, mCbvSrvDescriptorSize);
 		md3dDevice->CreateShaderResourceView(text.Get(), &srvDesc, hDescriptor);
-		hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-		TexOffsets[tex.first] = offset;
-		offset++;
+		TexOffsets[tex.first] = index;
 	}
-	srvDesc.Texture2D.MipLevels = 1;
-	// Albedo SRV
-	srvDesc.Format = albedoFormat;
-	md3dDevice->CreateShaderResourceView(
-		mGBufferAlbedo.Get(), &srvDesc, hDescriptor);
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-
-	// Normal SRV
-	srvDesc.Format = normalFormat;
-	md3dDevice->CreateShaderResourceView(
-		mGBufferNormal.Get(), &srvDesc, hDescriptor);
-	//mGBufferSRVs[1] = CD3DX12_GPU_DESCRIPTOR_HANDLE(srvHandle);
-	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
-	// Position SRV
-	srvDesc.Format = positionFormat;
-	md3dDevice->CreateShaderResourceView(
-		mGBufferPosition.Get(), &srvDesc, hDescriptor);
 	for (auto& light : mLights)
 	{
 		if (light.type == 2 || light.type == 3)
@@ -1435,6 +2218,7 @@ void TexColumnsApp::BuildDescriptorHeaps()
 			srvDesc.Texture2D.MostDetailedMip = 0;
 			srvDesc.Texture2D.PlaneSlice = 0;
 			srvDesc.Texture2D.ResourceMinLODClamp = 0.0f;
+			light.ShadowMapSrvHeapIndex = AllocateSrv();
 			CD3DX12_CPU_DESCRIPTOR_HANDLE shadowMapSrvHandle(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 			shadowMapSrvHandle.Offset(light.ShadowMapSrvHeapIndex, mCbvSrvDescriptorSize); // Use the stored index
 
@@ -1442,27 +2226,51 @@ void TexColumnsApp::BuildDescriptorHeaps()
 		}
 	}
 	
-	// create scene texture SRV
-	int maxShadowSrvIndex = 0;
-	for (const auto& light : mLights) {
-		if ((light.type == 2 || light.type == 3) && light.CastsShadows) { // [cite: 1]
-			if (light.ShadowMapSrvHeapIndex > maxShadowSrvIndex) { // [cite: 1]
-				maxShadowSrvIndex = light.ShadowMapSrvHeapIndex; // [cite: 1]
-			}
-		}
-	}
 
-	// The next available CPU descriptor handle for mSceneTexture's SRV.
-	// It's after all textures, G-Buffer SRVs, and shadow map SRVs.
-	// The SRV for mSceneTexture will be at index: (maxShadowSrvIndex == -1) ? (mTextures.size() + 3) : (maxShadowSrvIndex + 1)
-	mSceneSrvHeapIndex = (maxShadowSrvIndex == -1) ? (mTextures.size() + 3) : (maxShadowSrvIndex + 1);
+	// Views of the size-dependent targets keep their slots; resizing only rewrites them.
+	mGBufferSrvIndex = AllocateSrv(3);
+	mSceneSrvHeapIndex = AllocateSrv();
+	mSceneSrvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+	mSceneSrvHandle.Offset(mSceneSrvHeapIndex, mCbvSrvDescriptorSize);
+	BuildScreenViews();
+}
+
+UINT TexColumnsApp::AllocateSrv(UINT count)
+{
+	UINT index = mSrvAllocator->Allocate(count);
+	if (index == DescriptorAllocator::Invalid)
+		ThrowIfFailed(E_OUTOFMEMORY);
+	return index;
+}
+
+void TexColumnsApp::BuildScreenViews()
+{
+	D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc = {};
+	srvDesc.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING;
+	srvDesc.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D;
+	srvDesc.Texture2D.MipLevels = 1;
+	CD3DX12_CPU_DESCRIPTOR_HANDLE hDescriptor(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
+	hDescriptor.Offset(mGBufferSrvIndex, mCbvSrvDescriptorSize);
+
+	// Albedo SRV
+	srvDesc.Format = albedoFormat;
+	md3dDevice->CreateShaderResourceView(
+		mGBufferAlbedo.Get(), &srvDesc, hDescriptor);
+	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+
+	// Normal SRV
+	srvDesc.Format = normalFormat;
+	md3dDevice->CreateShaderResourceView(
+		mGBufferNormal.Get(), &srvDesc, hDescriptor);
+	hDescriptor.Offset(1, mCbvSrvDescriptorSize);
+	// Position SRV
+	srvDesc.Format = positionFormat;
+	md3dDevice->CreateShaderResourceView(
+		mGBufferPosition.Get(), &srvDesc, hDescriptor);
 
 	CD3DX12_CPU_DESCRIPTOR_HANDLE sceneTexCpuHandle(mSrvDescriptorHeap->GetCPUDescriptorHandleForHeapStart());
 	sceneTexCpuHandle.Offset(mSceneSrvHeapIndex, mCbvSrvDescriptorSize);
 
-	mSceneSrvHandle = CD3DX12_GPU_DESCRIPTOR_HANDLE(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-	mSceneSrvHandle.Offset(mSceneSrvHeapIndex, mCbvSrvDescriptorSize);
-
 	// Create SRV for mSceneTexture
 	srvDesc.Format = mBackBufferFormat; // Or mSceneTexture->GetDesc().Format
 	if (m4xMsaaState)
@@ -1494,15 +2302,23 @@ void TexColumnsApp::BuildShadersAndInputLayout()
 		NULL, NULL
 	};
 
+	const D3D_SHADER_MACRO compactVertexDefines[] =
+	{
+		"COMPACT_VERTEX", "1",
+		NULL, NULL
+	};
+
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "VS", "vs_5_1");
 	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\Default.hlsl", nullptr, "PS", "ps_5_1");
 	mShaders["gbufferVS"] = d3dUtil::CompileShader(L"Shaders\\GeometryPass.hlsl", nullptr, "VS", "vs_5_0");
 	mShaders["gbufferPS"] = d3dUtil::CompileShader(L"Shaders\\GeometryPass.hlsl", nullptr, "PS", "ps_5_0");
+	mShaders["gbufferCompactVS"] = d3dUtil::CompileShader(L"Shaders\\GeometryPass.hlsl", compactVertexDefines, "VS", "vs_5_0");
 	mShaders["lightingVS"] = d3dUtil::CompileShader(L"Shaders\\LightingPass.hlsl", nullptr, "VS", "vs_5_0");
 	mShaders["lightingQUADVS"] = d3dUtil::CompileShader(L"Shaders\\LightingPass.hlsl", nullptr, "VS_QUAD", "vs_5_0");
 	mShaders["lightingPS"] = d3dUtil::CompileShader(L"Shaders\\LightingPass.hlsl", nullptr, "PS", "ps_5_0");
 	mShaders["lightingPSDebug"] = d3dUtil::CompileShader(L"Shaders\\LightingPass.hlsl", nullptr, "PS_debug", "ps_5_0");
 	mShaders["shadowVS"] = d3dUtil::CompileShader(L"Shaders\\ShadowMap.hlsl", nullptr, "VS", "vs_5_1");
+	mShaders["shadowCompactVS"] = d3dUtil::CompileShader(L"Shaders\\ShadowMap.hlsl", compactVertexDefines, "VS", "vs_5_1");
 	mShaders["postprocessVS"] = d3dUtil::CompileShader(L"Shaders\\Distortion.hlsl", nullptr, "VS", "vs_5_0");
 	mShaders["postprocessPS"] = d3dUtil::CompileShader(L"Shaders\\Distortion.hlsl", nullptr, "PS", "ps_5_0");
 
@@ -1513,153 +2329,183 @@ void TexColumnsApp::BuildShadersAndInputLayout()
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
         { "TANGENT", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 32, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
     };
+
+	// Matches CompactVertex.  The SNORM/FLOAT formats do the unpacking, the shader only
+	// rescales the position and unfolds the octahedral directions.
+	mCompactInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_SNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TANGENT", 0, DXGI_FORMAT_R16G16_SNORM, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 16, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
 }
-void TexColumnsApp::BuildCustomMeshGeometry(std::string name, UINT& meshVertexOffset, UINT& meshIndexOffset, UINT& prevVertSize, UINT& prevIndSize, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo)
+// Runs on a worker thread, so it must not touch any app state.
+MeshCache::ImportedMesh TexColumnsApp::ImportCustomMesh(const std::string& name)
 {
-	std::vector<GeometryGenerator::MeshData> meshDatas; //                                                  
-
-	//                          .
-	Assimp::Importer importer;
-
-	//                               :             ,      UV (          )                     .
-	const aiScene* scene = importer.ReadFile("../../Common/" + name + ".obj",
-		aiProcess_Triangulate |
-		aiProcess_ConvertToLeftHanded |
-		aiProcess_FlipUVs |
-		aiProcess_GenNormals |
-		aiProcess_CalcTangentSpace);
-	if (!scene || !scene->mRootNode)
+	// Imports go through the cooked mesh cache; Assimp, the 16-bit split, the mesh
+	// optimizer and LOD generation only run when the .obj changed since it was last
+	// cooked.
+	MeshCache::ImportedMesh imported;
+	if (!MeshCache::LoadOrImport("../../Common/" + name + ".obj", MeshCache::DefaultImportFlags, imported))
 	{
-		std::cerr << "Assimp error: " << importer.GetErrorString() << std::endl;
+		std::cerr << "Failed to load mesh " << name << std::endl;
+		return MeshCache::ImportedMesh();
 	}
-	unsigned int nMeshes = scene->mNumMeshes;
-	ObjectsMeshCount[name] = nMeshes;
-	
-	for (int i = 0;i < scene->mNumMeshes;i++)
-	{
-		GeometryGenerator::MeshData meshData;
-		aiMesh* mesh = scene->mMeshes[i];
-
-		//                                             .
-		std::vector<GeometryGenerator::Vertex> vertices;
-		std::vector<std::uint16_t> indices;
-
-		//                                            .
-		for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
-		{
-			GeometryGenerator::Vertex v;
 
-			v.Position.x = mesh->mVertices[i].x;
-			v.Position.y = mesh->mVertices[i].y;
-			v.Position.z = mesh->mVertices[i].z;
+	return imported;
+}
 
-			if (mesh->HasNormals())
-			{
-				v.Normal.x = mesh->mNormals[i].x;
-				v.Normal.y = mesh->mNormals[i].y;
-				v.Normal.z = mesh->mNormals[i].z;
-			}
+// Append converted vertices and indices to the packed geometry arrays.  Callers
+// reserve the arrays for all geometry first, so these never reallocate.
+static void PackVertices(const std::vector<GeometryGenerator::Vertex>& src, std::vector<Vertex>& dst)
+{
+	for (const auto& v : src)
+		dst.emplace_back(v.Position, v.Normal, v.TexC, v.TangentU);
+}
 
-			if (mesh->HasTextureCoords(0))
-			{
-				v.TexC.x = mesh->mTextureCoords[0][i].x;
-				v.TexC.y = mesh->mTextureCoords[0][i].y;
-			}
-			else
-			{
-				v.TexC = XMFLOAT2(0.0f, 0.0f);
-			}
-			if (mesh->HasTangentsAndBitangents())
-			{
-				v.TangentU.x = mesh->mTangents[i].x;
-				v.TangentU.y = mesh->mTangents[i].y;
-				v.TangentU.z = mesh->mTangents[i].z;
+static void PackIndices16(const std::vector<std::uint32_t>& src, std::vector<std::uint16_t>& dst)
+{
+	for (std::uint32_t index : src)
+		dst.push_back(static_cast<std::uint16_t>(index));
+}
 
-			}
+// Adds the finest level of mesh within gMaxOccluderTriangles, with only the
+// vertices it uses, to occluder.  A simplified level can stick out of the surface by
+// up to its Error, which would hide what is just behind the mesh, so its vertices
+// are pulled in along their normals by that much.  Returns false and leaves
+// occluder alone if even the coarsest level is too detailed.
+static bool AppendOccluder(const GeometryGenerator::MeshData& mesh, SubmeshOccluder& occluder)
+{
+	const std::vector<std::uint32_t>* level = &mesh.Indices32;
+	float error = 0.0f;
+	for (const GeometryGenerator::MeshLod& lod : mesh.Lods)
+	{
+		if (level->size() / 3 <= gMaxOccluderTriangles)
+			break;
+		level = &lod.Indices32;
+		error = lod.Error;
+	}
+	if (level->empty() || level->size() / 3 > gMaxOccluderTriangles)
+		return false;
 
-			//                ,                                            .
-			vertices.push_back(v);
-		}
-		//                                                  .
-		for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+	std::unordered_map<std::uint32_t, std::uint32_t> remap;
+	occluder.Indices.reserve(occluder.Indices.size() + level->size());
+	for (std::uint32_t index : *level)
+	{
+		auto it = remap.emplace(index, (std::uint32_t)occluder.Positions.size());
+		if (it.second)
 		{
-			aiFace face = mesh->mFaces[i];
-			//         ,                      .
-			if (face.mNumIndices != 3) continue;
-			indices.push_back(static_cast<std::uint16_t>(face.mIndices[0]));
-			indices.push_back(static_cast<std::uint16_t>(face.mIndices[1]));
-			indices.push_back(static_cast<std::uint16_t>(face.mIndices[2]));
+			const GeometryGenerator::Vertex& v = mesh.Vertices[index];
+			XMFLOAT3 position;
+			XMStoreFloat3(&position, XMLoadFloat3(&v.Position) - error * XMVector3Normalize(XMLoadFloat3(&v.Normal)));
+			occluder.Positions.push_back(position);
 		}
+		occluder.Indices.push_back(it.first->second);
+	}
+	return true;
+}
 
-		//           meshData.                                                 :
-		meshData.Vertices = vertices;
-		meshData.Indices32.resize(indices.size());
-		for (size_t j = 0; j < indices.size(); ++j)
-			meshData.Indices32[j] = indices[j];
-
-		aiMaterial* mat = scene->mMaterials[mesh->mMaterialIndex];
-		aiString texturePath;
+// Packs the imported meshes after the geometry already in vertices/indices and
+// records their ranges in Geo->MultiDrawArgs[name].  Only the ranges, material
+// names and bounds are kept; the caller frees imported afterwards.  With
+// staticBatch the meshes are first merged by material.
+void TexColumnsApp::BuildCustomMeshGeometry(const std::string& name, MeshCache::ImportedMesh& imported, bool staticBatch, std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices, MeshGeometry* Geo)
+{
+	// Occluders are chosen per source mesh, so a batch occludes with the parts that
+	// would have occluded on their own.
+	std::vector<std::shared_ptr<SubmeshOccluder>> occluders;
+	auto buildOccluder = [](const std::vector<GeometryGenerator::MeshData>& meshes, const std::vector<std::size_t>& parts)
+	{
+		auto occluder = std::make_shared<SubmeshOccluder>();
+		bool any = false;
+		for (std::size_t m : parts)
+			any |= AppendOccluder(meshes[m], *occluder);
+		return any ? occluder : nullptr;
+	};
+	if (staticBatch)
+	{
+		std::vector<std::vector<std::size_t>> parts;
+		std::vector<GeometryGenerator::MeshData> batches = StaticBatcher::Merge(imported.Meshes, &parts);
+		std::cout << "StaticBatcher: " << name << " " << imported.Meshes.size() << " submeshes -> " << batches.size() << " batches\n";
+		for (const auto& batchParts : parts)
+			occluders.push_back(buildOccluder(imported.Meshes, batchParts));
+		imported.Meshes = std::move(batches);
+	}
+	else
+	{
+		for (std::size_t m = 0; m < imported.Meshes.size(); ++m)
+			occluders.push_back(buildOccluder(imported.Meshes, { m }));
+	}
 
-		aiString texPath;
+	std::vector<GeometryGenerator::MeshData>& meshDatas = imported.Meshes;
+	ObjectsMeshCount[name] = (unsigned int)meshDatas.size();
 
-		meshData.matName = scene->mMaterials[mesh->mMaterialIndex]->GetName().C_Str();
-		//               ,                                        ,         ,             ,                         . .
-		meshDatas.push_back(meshData);
-	}
-	for (int k = 0;k < scene->mNumMaterials;k++)
+	for (int k = 0;k < imported.Materials.size();k++)
 	{
-		aiString texPath;
-		scene->mMaterials[k]->GetTexture(aiTextureType_DIFFUSE, 0, &texPath);
-		std::string a = std::string(texPath.C_Str());
-		a = a.substr(0, a.length() - 4);
+		const GeometryGenerator::Material& material = imported.Materials[k];
+		std::string a = material.diffFile.substr(0, material.diffFile.length() - 4);
 		std::cout << "DIFFUSE: " << a << "\n";
-		scene->mMaterials[k]->GetTexture(aiTextureType_DISPLACEMENT, 0, &texPath);
-		std::string b = std::string(texPath.C_Str());
-		b = b.substr(0, b.length() - 4);
+		std::string b = material.normFile.substr(0, material.normFile.length() - 4);
 		std::cout << "NORMAL: " << b << "\n";
 
-		CreateMaterial(scene->mMaterials[k]->GetName().C_Str(), k, TexOffsets[a], TexOffsets[b], XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), XMFLOAT3(0.05f, 0.05f, 0.05f), 0.3f);
+		CreateMaterial(material.name, k, TexOffsets[a], TexOffsets[b], XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), XMFLOAT3(0.05f, 0.05f, 0.05f), 0.3f);
 	}
 
-	UINT totalMeshSize = 0;
-	UINT k = vertices.size();
-	std::vector<std::pair<GeometryGenerator::MeshData,SubmeshGeometry>>meshSubmeshes;
-	for (auto mesh : meshDatas)
+	// Each mesh is written straight into the packed arrays, which the caller has
+	// reserved for everything.
+	auto& meshSubmeshes = Geo->MultiDrawArgs[name];
+	meshSubmeshes.clear();
+	meshSubmeshes.reserve(meshDatas.size());
+	for (size_t m = 0; m < meshDatas.size(); ++m)
 	{
-		meshVertexOffset = meshVertexOffset + prevVertSize;
-		prevVertSize = mesh.Vertices.size();
-		totalMeshSize += mesh.Vertices.size();
-
-		meshIndexOffset = meshIndexOffset + prevIndSize;
-		prevIndSize = mesh.Indices32.size();
+		GeometryGenerator::MeshData& mesh = meshDatas[m];
 		SubmeshGeometry meshSubmesh;
 		meshSubmesh.IndexCount = (UINT)mesh.Indices32.size();
-		meshSubmesh.StartIndexLocation = meshIndexOffset;
-		meshSubmesh.BaseVertexLocation = meshVertexOffset;
-		GeometryGenerator::MeshData m = mesh;
-		meshSubmeshes.push_back(std::make_pair(m,meshSubmesh));
-	}
-	/////////
-	/////
-	for (auto mesh : meshDatas)
-	{
-		for (size_t i = 0; i < mesh.Vertices.size(); ++i, ++k)
+		meshSubmesh.StartIndexLocation = (UINT)indices.size();
+		meshSubmesh.BaseVertexLocation = (INT)vertices.size();
+		meshSubmesh.VertexCount = (UINT)mesh.Vertices.size();
+		PackVertices(mesh.Vertices, vertices);
+		PackIndices16(mesh.Indices32, indices);
+
+		meshSubmesh.Clusters.reserve(mesh.Meshlets.size());
+		for (const auto& meshlet : mesh.Meshlets)
 		{
-			vertices.push_back(Vertex(mesh.Vertices[i].Position, mesh.Vertices[i].Normal, mesh.Vertices[i].TexC,mesh.Vertices[i].TangentU));
+			SubmeshCluster cluster;
+			cluster.IndexCount = meshlet.IndexCount;
+			cluster.StartIndexLocation = meshSubmesh.StartIndexLocation + meshlet.FirstIndex;
+			cluster.Center = meshlet.Center;
+			cluster.Radius = meshlet.Radius;
+			cluster.ConeAxis = meshlet.ConeAxis;
+			cluster.ConeCutoff = meshlet.ConeCutoff;
+			meshSubmesh.Clusters.push_back(cluster);
 		}
-	}
-	////////
 
-	///////
-	for (auto mesh : meshDatas)
-	{
-		indices.insert(indices.end(), std::begin(mesh.GetIndices16()), std::end(mesh.GetIndices16()));
+		// The LOD index ranges follow the submesh's own indices.
+		meshSubmesh.Lods.reserve(mesh.Lods.size() + 1);
+		meshSubmesh.Lods.push_back({ meshSubmesh.IndexCount, meshSubmesh.StartIndexLocation, 0.0f });
+		for (const auto& lod : mesh.Lods)
+		{
+			meshSubmesh.Lods.push_back({ (UINT)lod.Indices32.size(), (UINT)indices.size(), lod.Error });
+			PackIndices16(lod.Indices32, indices);
+		}
+
+		meshSubmesh.Occluder = std::move(occluders[m]);
+		meshSubmesh.MaterialName = std::move(mesh.matName);
+		meshSubmeshes.push_back(std::move(meshSubmesh));
 	}
-	///////
-	Geo->MultiDrawArgs[name] = meshSubmeshes;
 }
 void TexColumnsApp::BuildShapeGeometry()
 {
+	// Import every asset concurrently, overlapping with generating the shapes below.
+	// Each job only reads its own file and returns the processed meshes; materials
+	// and buffer offsets are assigned afterwards in a fixed order, so the result does
+	// not depend on which import finishes first.
+	const std::array<std::string, 5> assetNames = { "sponza", "madoka", "left", "right", "plane2" };
+	std::vector<std::future<MeshCache::ImportedMesh>> imports;
+	for (const auto& name : assetNames)
+		imports.push_back(mJobSystem->Submit([name]() { return ImportCustomMesh(name); }));
+
     GeometryGenerator geoGen;
 	GeometryGenerator::MeshData box = geoGen.CreateBox(1.0f, 1.0f, 1.0f, 0);
 	GeometryGenerator::MeshData grid = geoGen.CreateGrid(20.0f, 30.0f, 60, 40);
@@ -1686,109 +2532,137 @@ void TexColumnsApp::BuildShapeGeometry()
 	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
 	boxSubmesh.StartIndexLocation = boxIndexOffset;
 	boxSubmesh.BaseVertexLocation = boxVertexOffset;
+	boxSubmesh.VertexCount = (UINT)box.Vertices.size();
 
 	SubmeshGeometry gridSubmesh;
 	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
 	gridSubmesh.StartIndexLocation = gridIndexOffset;
 	gridSubmesh.BaseVertexLocation = gridVertexOffset;
+	gridSubmesh.VertexCount = (UINT)grid.Vertices.size();
 
 	SubmeshGeometry sphereSubmesh;
 	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
 	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
 	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
+	sphereSubmesh.VertexCount = (UINT)sphere.Vertices.size();
 
 	SubmeshGeometry cylinderSubmesh;
 	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
 	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
 	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
+	cylinderSubmesh.VertexCount = (UINT)cylinder.Vertices.size();
 
 	//
 	// Extract the vertex elements we are interested in and pack the
-	// vertices of all the meshes into one vertex buffer.
+	// vertices of all the meshes into one vertex buffer.  The packed arrays are
+	// sized once for the shapes and every imported mesh, LODs included, so the
+	// packing below never reallocates.
 	//
-	
-	auto totalVertexCount =
-		box.Vertices.size() +
-		grid.Vertices.size() +
-		sphere.Vertices.size() +
-		cylinder.Vertices.size();
-
-	
-	std::vector<Vertex> vertices(totalVertexCount);
 
-	UINT k = 0;
-	for(size_t i = 0; i < box.Vertices.size(); ++i, ++k)
+	std::vector<MeshCache::ImportedMesh> assets;
+	assets.reserve(assetNames.size());
+	size_t totalVertices = box.Vertices.size() + grid.Vertices.size() + sphere.Vertices.size() + cylinder.Vertices.size();
+	size_t totalIndices = box.Indices32.size() + grid.Indices32.size() + sphere.Indices32.size() + cylinder.Indices32.size();
+	// Static batches can repeat a part's coarsest LOD, so for them the index count
+	// is an upper bound.
+	std::vector<bool> staticBatch(assetNames.size());
+	for (size_t i = 0; i < assetNames.size(); ++i)
 	{
-		vertices[k].Pos = box.Vertices[i].Position;
-		vertices[k].Normal = box.Vertices[i].Normal;
-		vertices[k].TexC = box.Vertices[i].TexC;
+		assets.push_back(imports[i].get());
+		staticBatch[i] = std::find(gStaticAssets.begin(), gStaticAssets.end(), assetNames[i]) != gStaticAssets.end();
+		for (const auto& mesh : assets.back().Meshes)
+		{
+			totalVertices += mesh.Vertices.size();
+			if (staticBatch[i])
+				continue;
+			totalIndices += mesh.Indices32.size();
+			for (const auto& lod : mesh.Lods)
+				totalIndices += lod.Indices32.size();
+		}
+		if (staticBatch[i])
+			totalIndices += StaticBatcher::MaxIndexCount(assets.back().Meshes);
 	}
 
-	for(size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+	std::vector<Vertex> vertices;
+	std::vector<std::uint16_t> indices;
+	vertices.reserve(totalVertices);
+	indices.reserve(totalIndices);
+	for (const GeometryGenerator::MeshData* shape : { &box, &grid, &sphere, &cylinder })
 	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = grid.Vertices[i].Normal;
-		vertices[k].TexC = grid.Vertices[i].TexC;
+		PackVertices(shape->Vertices, vertices);
+		PackIndices16(shape->Indices32, indices);
 	}
 
-	for(size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "shapeGeo";
+	for (size_t i = 0; i < assetNames.size(); ++i)
+		BuildCustomMeshGeometry(assetNames[i], assets[i], staticBatch[i], vertices, indices, geo.get());
+	assets.clear();
+	assert(vertices.size() == totalVertices && indices.size() <= totalIndices);
+
+	// Fill in the submesh bounds and build the quantized copy of the vertices.  Every
+	// submesh owns its vertex range, so its positions are quantized against its own box.
+	std::vector<CompactVertex> compactVertices(vertices.size());
+	auto quantizeSubmesh = [&](SubmeshGeometry& submesh)
 	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].TexC = sphere.Vertices[i].TexC;
-	}
-
-	for(size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+		if (submesh.VertexCount == 0)
+			return;
+		const Vertex* first = &vertices[submesh.BaseVertexLocation];
+		d3dUtil::ComputeBounds(&first->Pos, submesh.VertexCount, sizeof(Vertex), submesh.Bounds, submesh.Sphere);
+		for (UINT i = 0; i < submesh.VertexCount; ++i)
+		{
+			const Vertex& v = first[i];
+			CompactVertex& c = compactVertices[submesh.BaseVertexLocation + i];
+			VertexQuantization::EncodePosition(v.Pos, submesh.Bounds.Center, submesh.Bounds.Extents, c.Pos);
+			VertexQuantization::EncodeDirection(v.Normal, c.Normal);
+			VertexQuantization::EncodeDirection(v.Tangent, c.Tangent);
+			VertexQuantization::EncodeTexCoord(v.TexC, c.TexC);
+		}
+	};
+	quantizeSubmesh(boxSubmesh);
+	quantizeSubmesh(gridSubmesh);
+	quantizeSubmesh(sphereSubmesh);
+	quantizeSubmesh(cylinderSubmesh);
+	for (auto& meshSubmeshes : geo->MultiDrawArgs)
 	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
-		vertices[k].TexC = cylinder.Vertices[i].TexC;
+		for (auto& meshSubmesh : meshSubmeshes.second)
+			quantizeSubmesh(meshSubmesh);
 	}
-	
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-	
-	
-	
-	UINT meshVertexOffset = cylinderVertexOffset;
-	UINT meshIndexOffset = cylinderIndexOffset;
-	UINT prevIndSize = (UINT)cylinder.Indices32.size();
-	UINT prevVertSize = (UINT)cylinder.Vertices.size();
-
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "shapeGeo";
-	BuildCustomMeshGeometry("sponza", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
-	BuildCustomMeshGeometry("madoka", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
-	BuildCustomMeshGeometry("left", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
-	BuildCustomMeshGeometry("right", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
-	BuildCustomMeshGeometry("plane2", meshVertexOffset, meshIndexOffset, prevVertSize, prevIndSize, vertices, indices, geo.get());
-	
-
-
 
 	const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+	const UINT compactVbByteSize = (UINT)compactVertices.size() * sizeof(CompactVertex);
 	const UINT ibByteSize = (UINT)indices.size() * sizeof(std::uint16_t);
+	std::cout << "Vertex data: " << vbByteSize << " bytes, compact " << compactVbByteSize << " bytes\n";
 
 
 
 
-	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	// Nothing on the CPU reads the scene geometry back yet, so under the default
+	// policy the system memory copies are not even made.
+	if (geo->CpuPolicy == CpuGeometryPolicy::Keep)
+	{
+		ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
+		CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+		CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+	}
 
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+		mCommandList.Get(), vertices.data(), vbByteSize, *mUploadRing);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		mCommandList.Get(), indices.data(), ibByteSize, *mUploadRing);
+
+	geo->CompactVertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+		mCommandList.Get(), compactVertices.data(), compactVbByteSize, *mUploadRing);
 
 	geo->VertexByteStride = sizeof(Vertex);
 	geo->VertexBufferByteSize = vbByteSize;
+	geo->CompactVertexByteStride = sizeof(CompactVertex);
+	geo->CompactVertexBufferByteSize = compactVbByteSize;
+	// Every submesh addresses at most 65536 vertices relative to its BaseVertexLocation
+	// (imported meshes are split when they are cooked), so 16-bit indices suffice.
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
@@ -1861,6 +2735,12 @@ void TexColumnsApp::BuildPSOs()
 
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&gbPsoDesc, IID_PPV_ARGS(&mPSOs["gbuffer"])));
 
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC gbCompactPsoDesc = gbPsoDesc;
+	gbCompactPsoDesc.InputLayout = { mCompactInputLayout.data(), (UINT)mCompactInputLayout.size() };
+	gbCompactPsoDesc.VS = { reinterpret_cast<BYTE*>(mShaders["gbufferCompactVS"]->GetBufferPointer()),
+					 mShaders["gbufferCompactVS"]->GetBufferSize() };
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&gbCompactPsoDesc, IID_PPV_ARGS(&mPSOs["gbuffer_compact"])));
+
 	// Lighting pass PSO
 
 
@@ -1952,6 +2832,9 @@ void TexColumnsApp::BuildPSOs()
 	//    mShaders["shadowPS"]->GetBufferSize()
 	// };
 	shadowPsoDesc.RasterizerState = CD3DX12_RASTERIZER_DESC(D3D12_DEFAULT);
+	// Casters in front of the near plane are flattened onto it rather than clipped;
+	// CullShadowCasters keeps them for that reason.
+	shadowPsoDesc.RasterizerState.DepthClipEnable = FALSE;
 	// You might need to tweak RasterizerState for shadow acne (DepthBias, SlopeScaledDepthBias)
 	// e.g., shadowPsoDesc.RasterizerState.DepthBias = 100000; // Experiment with values
 	// shadowPsoDesc.RasterizerState.DepthBiasClamp = 0.0f;
@@ -1970,6 +2853,15 @@ void TexColumnsApp::BuildPSOs()
 
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&shadowPsoDesc, IID_PPV_ARGS(&mPSOs["shadow_map"])));
 
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC shadowCompactPsoDesc = shadowPsoDesc;
+	shadowCompactPsoDesc.InputLayout = { mCompactInputLayout.data(), (UINT)mCompactInputLayout.size() };
+	shadowCompactPsoDesc.VS =
+	{
+		reinterpret_cast<BYTE*>(mShaders["shadowCompactVS"]->GetBufferPointer()),
+		mShaders["shadowCompactVS"]->GetBufferSize()
+	};
+	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&shadowCompactPsoDesc, IID_PPV_ARGS(&mPSOs["shadow_map_compact"])));
+
 	// PSO for post-process pass
 	D3D12_GRAPHICS_PIPELINE_STATE_DESC caPsoDesc = {};
 	caPsoDesc.InputLayout = { nullptr, 0 }; // Full-screen triangle, no input layout needed from IA
@@ -1999,6 +2891,10 @@ void TexColumnsApp::BuildPSOs()
 	caPsoDesc.DSVFormat = mDepthStencilFormat; // Not strictly needed if DepthEnable is FALSE
 
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&caPsoDesc, IID_PPV_ARGS(&mPSOs["PostProcess"])));
+
+	mStreamPipelines.clear();
+	for (const char* name : gStreamPipelineNames)
+		mStreamPipelines.push_back(mPSOs[name].Get());
 }
 
 void TexColumnsApp::BuildFrameResources()
@@ -2007,8 +2903,7 @@ void TexColumnsApp::BuildFrameResources()
 	mFrameResources.clear();
     for(int i = 0; i < gNumFrameResources; ++i)
     {
-        mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(),(UINT)mLights.size()));
+        mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(), 1));
     }
 	mDistortionCB = std::make_unique<UploadBuffer<DistortionParams>>(md3dDevice.Get(), 1, true);
 
@@ -2026,6 +2921,21 @@ void TexColumnsApp::BuildFrameResources()
 	}
 }
 
+// Runs the copies recorded so far during initialization, waits for them and frees
+// their staging space, then reopens the command list.
+void TexColumnsApp::FlushUploads()
+{
+	ThrowIfFailed(mCommandList->Close());
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
+	FlushCommandQueue();
+	mUploadRing->Submit(mCurrentFence);
+	mUploadRing->Retire(mFence->GetCompletedValue());
+
+	ThrowIfFailed(mDirectCmdListAlloc->Reset());
+	ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
+}
+
 void TexColumnsApp::BuildMaterials()
 {
 	CreateMaterial("NiggaMat",0, TexOffsets["textures/mskin"], TexOffsets["textures/mskin_nm"], XMFLOAT4(1.0f, 1.0f, 1.0f, 1.0f), XMFLOAT3(0.05f, 0.05f, 0.05f), 0.3f);
@@ -2057,14 +2967,19 @@ void TexColumnsApp::RenderCustomMesh(std::string unique_name, std::string meshna
 		rItem->ObjCBIndex = mAllRitems.size();
 		rItem->Geo = mGeometries["shapeGeo"].get();
 		rItem->PrimitiveType = D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
-		std::string matname = rItem->Geo->MultiDrawArgs[meshname][i].first.matName;
+		std::string matname = rItem->Geo->MultiDrawArgs[meshname][i].MaterialName;
 		std::cout << " mat : " << matname << "\n";
 		std::cout << unique_name << " " << matname << "\n";
 		if (materialName != "") matname = materialName;
 		rItem->Mat = mMaterials[matname].get();
-		rItem->IndexCount = rItem->Geo->MultiDrawArgs[meshname][i].second.IndexCount;
-		rItem->StartIndexLocation = rItem->Geo->MultiDrawArgs[meshname][i].second.StartIndexLocation;
-		rItem->BaseVertexLocation = rItem->Geo->MultiDrawArgs[meshname][i].second.BaseVertexLocation;
+		rItem->IndexCount = rItem->Geo->MultiDrawArgs[meshname][i].IndexCount;
+		rItem->StartIndexLocation = rItem->Geo->MultiDrawArgs[meshname][i].StartIndexLocation;
+		rItem->BaseVertexLocation = rItem->Geo->MultiDrawArgs[meshname][i].BaseVertexLocation;
+		rItem->Bounds = rItem->Geo->MultiDrawArgs[meshname][i].Bounds;
+		rItem->Sphere = rItem->Geo->MultiDrawArgs[meshname][i].Sphere;
+		rItem->Lods = rItem->Geo->MultiDrawArgs[meshname][i].Lods;
+		rItem->Clusters = rItem->Geo->MultiDrawArgs[meshname][i].Clusters;
+		rItem->Occluder = rItem->Geo->MultiDrawArgs[meshname][i].Occluder;
 		mAllRitems.push_back(std::move(rItem));
 	}
 	
@@ -2076,7 +2991,14 @@ void TexColumnsApp::BuildRenderItems()
 {
 	auto boxRitem = std::make_unique<RenderItem>();
 	boxRitem->Name = "box";
-	XMStoreFloat4x4(&boxRitem->World, XMMatrixScaling(2.0f, 2.0f, 2.0f) * XMMatrixTranslation(0.0f, 5.0f, -10.0f));
+	// Kept in Position/RotationAngle/Scale too, which the editor rebuilds World from
+	// once the box is picked.
+	boxRitem->Position = XMFLOAT3(0.0f, 5.0f, -10.0f);
+	boxRitem->RotationAngle = XMFLOAT3(0.0f, 0.0f, 0.0f);
+	boxRitem->Scale = XMFLOAT3(2.0f, 2.0f, 2.0f);
+	boxRitem->TranslationM = XMMatrixTranslation(boxRitem->Position.x, boxRitem->Position.y, boxRitem->Position.z);
+	boxRitem->ScaleM = XMMatrixScaling(boxRitem->Scale.x, boxRitem->Scale.y, boxRitem->Scale.z);
+	XMStoreFloat4x4(&boxRitem->World, boxRitem->ScaleM * boxRitem->RotationM * boxRitem->TranslationM);
 	XMStoreFloat4x4(&boxRitem->TexTransform, XMMatrixScaling(1,1,1));
 	boxRitem->ObjCBIndex = 0;
 	boxRitem->Mat = mMaterials["NiggaMat"].get();
@@ -2085,6 +3007,8 @@ void TexColumnsApp::BuildRenderItems()
 	boxRitem->IndexCount = boxRitem->Geo->DrawArgs["box"].IndexCount;
 	boxRitem->StartIndexLocation = boxRitem->Geo->DrawArgs["box"].StartIndexLocation;
 	boxRitem->BaseVertexLocation = boxRitem->Geo->DrawArgs["box"].BaseVertexLocation;
+	boxRitem->Bounds = boxRitem->Geo->DrawArgs["box"].Bounds;
+	boxRitem->Sphere = boxRitem->Geo->DrawArgs["box"].Sphere;
 	mAllRitems.push_back(std::move(boxRitem));
 
 	RenderCustomMesh("building", "sponza", "", XMFLOAT3(0.07, 0.07, 0.07), XMFLOAT3(0, 3.14 / 2, 0), XMFLOAT3(0, 0, 0));
@@ -2092,7 +3016,6 @@ void TexColumnsApp::BuildRenderItems()
 	RenderCustomMesh("nigga2", "madoka", "NiggaMat", XMFLOAT3(3, 3, 3), XMFLOAT3(0, -3.14 / 2, 0), XMFLOAT3(-10, 3, 30));
 	RenderCustomMesh("eyeL", "left", "eye", XMFLOAT3(3, 3, 3), XMFLOAT3(0, 3.14, 0), XMFLOAT3());
 	RenderCustomMesh("eyeR", "right", "eye", XMFLOAT3(3, 3, 3), XMFLOAT3(0, 3.14, 0), XMFLOAT3());
-	BuildFrameResources();
 	//RenderCustomMesh("plan", "plane2", "map", XMMatrixScaling(3, 3, 3), XMMatrixRotationRollPitchYaw(3.14, 0, 3.14), XMMatrixTranslation(0,-10,0));
 	//RenderCustomMesh("plan", "plane2", "map2", XMMatrixScaling(3, 3, 3), XMMatrixRotationRollPitchYaw(3.14, 0, 3.14), XMMatrixTranslation(0,10,0));
 	// All the render items are opaque.
@@ -2120,6 +3043,7 @@ void TexColumnsApp::Draw(const GameTimer& gt)
 	// A command list can be reset after it has been added to the command queue via ExecuteCommandList.
 	// Reusing the command list reuses memory.
 	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), mPSOs["opaque"].Get()));
+	mRecordedCommands = 0;
 
 	mCommandList->RSSetViewports(1, &mScreenViewport);
 	mCommandList->RSSetScissorRects(1, &mScissorRect);
@@ -2144,7 +3068,7 @@ void TexColumnsApp::Draw(const GameTimer& gt)
 	mCommandList->SetGraphicsRootConstantBufferView(3, passCB->GetGPUVirtualAddress());
 
 
-	DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
+	DrawRenderItems(mCommandList.Get(), mOpaqueBatches);
 
 
 	// Indicate a state transition on the resource usage.
@@ -2164,6 +3088,8 @@ void TexColumnsApp::Draw(const GameTimer& gt)
 
 	// Advance the fence value to mark commands up to this fence point.
 	mCurrFrameResource->Fence = ++mCurrentFence;
+	mUploadAllocator->FinishFrame(mCurrentFence);
+	mUploadRing->Submit(mCurrentFence);
 
 	// Add an instruction to the command queue to set a new fence point. 
 	// Because we are on the GPU timeline, the new fence point won't be 
@@ -2175,50 +3101,36 @@ void TexColumnsApp::DrawSceneToShadowMap()
 	
 
 	UINT shadowCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(PassShadowConstants));
-	for (auto light : mLights)
+	mShadowStateChangesSkipped = 0;
+	for (size_t l = 0; l < mLights.size(); ++l)
 	{
+		const Light& light = mLights[l];
 		if (light.type == 2 || light.type == 3)
 		{
 			if (light.CastsShadows)
 			{
-				mCommandList->SetPipelineState(mPSOs["shadow_map"].Get());
 				mCommandList->SetGraphicsRootSignature(mShadowPassRootSignature.Get());
 				// Set the viewport and scissor rect for the shadow map.
 				mCommandList->RSSetViewports(1, &mShadowViewport);
 				mCommandList->RSSetScissorRects(1, &mShadowScissorRect);
-				// Transition the shadow map from generic read to depth-write.
-				mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(light.ShadowMap.Get(),
-					D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_STATE_DEPTH_WRITE));
-
 				// Clear the shadow map.
 				mCommandList->ClearDepthStencilView(light.ShadowMapDsvHandle, D3D12_CLEAR_FLAG_DEPTH | D3D12_CLEAR_FLAG_STENCIL, 1.0f, 0, 0, nullptr);
 
 				// Set the shadow map as the depth-stencil buffer. No render targets.
 				mCommandList->OMSetRenderTargets(0, nullptr, FALSE, &light.ShadowMapDsvHandle);
 
-				D3D12_GPU_VIRTUAL_ADDRESS shadowCBAddress = mCurrFrameResource->PassShadowCB->Resource()->GetGPUVirtualAddress() + light.LightCBIndex * shadowCBByteSize;
-				mCommandList->SetGraphicsRootConstantBufferView(1, shadowCBAddress);
-				// Draw all opaque items.
-				UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-
-				auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-
-				// For each render item...
-				for (size_t i = 0; i < mOpaqueRitems.size(); ++i)
-				{
-					auto ri = mOpaqueRitems[i];
-					mCommandList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-					mCommandList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-					mCommandList->IASetPrimitiveTopology(ri->PrimitiveType);
-
-					D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
-					mCommandList->SetGraphicsRootConstantBufferView(0, objCBAddress);
-
-					mCommandList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-				}
-				// Transition the shadow map from depth-write to pixel shader resource for the lighting pass.
-				mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(light.ShadowMap.Get(),
-					D3D12_RESOURCE_STATE_DEPTH_WRITE, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+				UINT skipped = 0;
+				size_t streamCount = RecordDrawBatches(mShadowBatches[l], false, mUseCompactVertices, 0, skipped);
+				mShadowStateChangesSkipped += skipped;
+
+				D3D12_GPU_VIRTUAL_ADDRESS shadowCBAddress = mCurrFrameResource->PassShadowCB + light.LightCBIndex * shadowCBByteSize;
+				mPassStream.Clear();
+				mPassStream.SetPipeline(mUseCompactVertices ? StreamPipelineShadowMapCompact : StreamPipelineShadowMap);
+				mPassStream.SetRootConstantBuffer(1, shadowCBAddress);
+				// Draw the opaque items inside the light's volume.
+				mPassStream.SetRootShaderResource(2, mCurrFrameResource->ObjectBuffer);
+				mPassStream.SetRootShaderResource(3, mCurrFrameResource->InstanceBuffer);
+				ReplayCommandStreams(mCommandList.Get(), streamCount);
 			}
 			
 		}
@@ -2231,22 +3143,42 @@ void TexColumnsApp::DeferredDraw(const GameTimer& gt)
 	auto cmdListAlloc = mCurrFrameResource->CmdListAlloc;
 	ThrowIfFailed(cmdListAlloc->Reset());
 	ThrowIfFailed(mCommandList->Reset(cmdListAlloc.Get(), nullptr));
+	mRecordedCommands = 0;
+
+	mRenderGraph.SetHandle(mBackBufferTarget, (UINT64)CurrentBackBuffer());
+	mRenderGraph.Execute([this](const std::vector<RenderGraph::Barrier>& barriers) { IssueGraphBarriers(barriers); });
+
+	// Done recording commands.
+	ThrowIfFailed(mCommandList->Close());
 
+	// Add the command list to the queue for execution.
+	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
+	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
 
-	// draw shadow maps 
-	DrawSceneToShadowMap();
+	// Swap the back and front buffers
+	ThrowIfFailed(mSwapChain->Present(0, 0));
+	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
 
+	// Advance the fence value to mark commands up to this fence point.
+	mCurrFrameResource->Fence = ++mCurrentFence;
+	mUploadAllocator->FinishFrame(mCurrentFence);
+	mUploadRing->Submit(mCurrentFence);
+
+	// Add an instruction to the command queue to set a new fence point. 
+	// Because we are on the GPU timeline, the new fence point won't be 
+	// set until the GPU finishes processing all the commands prior to this Signal().
+	mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+}
 
+void TexColumnsApp::DrawGeometryPass()
+{
 	// ==GEOMETRY PASS==
-	mCommandList->SetPipelineState(mPSOs["gbuffer"].Get());
+	mCommandList->SetPipelineState(mPSOs[mUseCompactVertices ? "gbuffer_compact" : "gbuffer"].Get());
 
 
 	mCommandList->RSSetViewports(1, &mScreenViewport);
 	mCommandList->RSSetScissorRects(1, &mScissorRect);
 
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
-		D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET));
-
 	//                 G-Buffer
 	//                G-Buffer          
 	//      :
@@ -2281,20 +3213,11 @@ void TexColumnsApp::DeferredDraw(const GameTimer& gt)
 	auto passCB = mCurrFrameResource->PassCB->Resource();
 	mCommandList->SetGraphicsRootConstantBufferView(3, passCB->GetGPUVirtualAddress());
 
-	DrawRenderItems(mCommandList.Get(), mOpaqueRitems);
-
+	DrawRenderItems(mCommandList.Get(), mOpaqueBatches, mUseCompactVertices);
+}
 
-	D3D12_RESOURCE_BARRIER barrier[3] = {
-	CD3DX12_RESOURCE_BARRIER::Transition(mGBufferAlbedo.Get(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
-	CD3DX12_RESOURCE_BARRIER::Transition(mGBufferNormal.Get(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE),
-	CD3DX12_RESOURCE_BARRIER::Transition(mGBufferPosition.Get(),
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE)
-	};
-	mCommandList->ResourceBarrier(3, barrier);
-	// ================================================
-	
+void TexColumnsApp::DrawLightingPass()
+{
 	// ===============LIGHTING PASS=====================
 
 	mCommandList->SetPipelineState(mPSOs["lighting"].Get());
@@ -2312,11 +3235,11 @@ void TexColumnsApp::DeferredDraw(const GameTimer& gt)
 
 
 	CD3DX12_GPU_DESCRIPTOR_HANDLE positionHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-	positionHandle.Offset(mTextures.size() + 0, mCbvSrvDescriptorSize);
+	positionHandle.Offset(mGBufferSrvIndex + 0, mCbvSrvDescriptorSize);
 	CD3DX12_GPU_DESCRIPTOR_HANDLE normalHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-	normalHandle.Offset(mTextures.size() + 1, mCbvSrvDescriptorSize);
+	normalHandle.Offset(mGBufferSrvIndex + 1, mCbvSrvDescriptorSize);
 	CD3DX12_GPU_DESCRIPTOR_HANDLE albedoHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-	albedoHandle.Offset(mTextures.size() + 2, mCbvSrvDescriptorSize);
+	albedoHandle.Offset(mGBufferSrvIndex + 2, mCbvSrvDescriptorSize);
 	mCommandList->SetGraphicsRootDescriptorTable(0, positionHandle); // t0
 	mCommandList->SetGraphicsRootDescriptorTable(1, normalHandle); // t1
 	mCommandList->SetGraphicsRootDescriptorTable(2, albedoHandle); // t2
@@ -2330,11 +3253,10 @@ void TexColumnsApp::DeferredDraw(const GameTimer& gt)
 	// draw light
 	for (auto& light : mLights)
 	{
-		auto lightCB = mCurrFrameResource->LightCB->Resource();
 		mCommandList->IASetVertexBuffers(0, 1, &mGeometries["shapeGeo"]->VertexBufferView());
 		mCommandList->IASetIndexBuffer(&mGeometries["shapeGeo"]->IndexBufferView());
 
-		D3D12_GPU_VIRTUAL_ADDRESS lightCBAddress = lightCB->GetGPUVirtualAddress() + light.LightCBIndex * lightCBByteSize;
+		D3D12_GPU_VIRTUAL_ADDRESS lightCBAddress = mCurrFrameResource->LightCB + light.LightCBIndex * lightCBByteSize;
 		mCommandList->SetGraphicsRootConstantBufferView(5, lightCBAddress); // b2
 
 		if (light.CastsShadows) // Only bind shadow map if this light uses it
@@ -2363,11 +3285,10 @@ void TexColumnsApp::DeferredDraw(const GameTimer& gt)
 	{
 		if (light.type != 0 && light.type != 2 && light.isDebugOn == 1)
 		{
-			auto lightCB = mCurrFrameResource->LightCB->Resource();
 			mCommandList->IASetVertexBuffers(0, 1, &mGeometries["shapeGeo"]->VertexBufferView());
 			mCommandList->IASetIndexBuffer(&mGeometries["shapeGeo"]->IndexBufferView());
 
-			D3D12_GPU_VIRTUAL_ADDRESS lightCBAddress = lightCB->GetGPUVirtualAddress() + light.LightCBIndex * lightCBByteSize;
+			D3D12_GPU_VIRTUAL_ADDRESS lightCBAddress = mCurrFrameResource->LightCB + light.LightCBIndex * lightCBByteSize;
 			mCommandList->SetGraphicsRootConstantBufferView(5, lightCBAddress);
 
 			mCommandList->DrawIndexedInstanced(light.ShapeGeo.IndexCount, 1, light.ShapeGeo.StartIndexLocation, light.ShapeGeo.BaseVertexLocation, 0);
@@ -2376,18 +3297,10 @@ void TexColumnsApp::DeferredDraw(const GameTimer& gt)
 	}
 	
 
-	//                :
-	D3D12_RESOURCE_BARRIER revertBarrier[3] = {
-		CD3DX12_RESOURCE_BARRIER::Transition(mGBufferAlbedo.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
-		CD3DX12_RESOURCE_BARRIER::Transition(mGBufferNormal.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET),
-		CD3DX12_RESOURCE_BARRIER::Transition(mGBufferPosition.Get(), D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_RENDER_TARGET)
-	};
-	mCommandList->ResourceBarrier(3, revertBarrier);
-
-	D3D12_RESOURCE_BARRIER presentBarrier = CD3DX12_RESOURCE_BARRIER::Transition(
-		mSceneTexture.Get(), D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE);
-	mCommandList->ResourceBarrier(1, &presentBarrier);
+}
 
+void TexColumnsApp::DrawPostProcessPass()
+{
 	mCommandList->SetPipelineState(mPSOs["PostProcess"].Get());
 	mCommandList->OMSetRenderTargets(1, &CurrentBackBufferView(), true, nullptr); // No depth stencil for CA pass
 	mCommandList->ClearRenderTargetView(CurrentBackBufferView(), Colors::CornflowerBlue, 0, nullptr); // Clear back buffer
@@ -2404,65 +3317,137 @@ void TexColumnsApp::DeferredDraw(const GameTimer& gt)
 
 	ImGui::Render();
 	ImGui_ImplDX12_RenderDrawData(ImGui::GetDrawData(), mCommandList.Get());
+}
 
-	mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(), // [cite: 1]
-		D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT)); // [cite: 1]
-
-	// Done recording commands.
-	ThrowIfFailed(mCommandList->Close());
-
-	// Add the command list to the queue for execution.
-	ID3D12CommandList* cmdsLists[] = { mCommandList.Get() };
-	mCommandQueue->ExecuteCommandLists(_countof(cmdsLists), cmdsLists);
-
-	// Swap the back and front buffers
-	ThrowIfFailed(mSwapChain->Present(0, 0));
-	mCurrBackBuffer = (mCurrBackBuffer + 1) % SwapChainBufferCount;
-
-	// Advance the fence value to mark commands up to this fence point.
-	mCurrFrameResource->Fence = ++mCurrentFence;
-
-	// Add an instruction to the command queue to set a new fence point. 
-	// Because we are on the GPU timeline, the new fence point won't be 
-	// set until the GPU finishes processing all the commands prior to this Signal().
-	mCommandQueue->Signal(mFence.Get(), mCurrentFence);
+void TexColumnsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<DrawBatch>& batches, bool compactVertices)
+{
+	mMainStateChangesSkipped = 0;
+	size_t streamCount = RecordDrawBatches(batches, true, compactVertices, 2, mMainStateChangesSkipped);
 
+	mPassStream.Clear();
+	mPassStream.SetRootShaderResource(5, mCurrFrameResource->ObjectBuffer);
+	mPassStream.SetRootShaderResource(6, mCurrFrameResource->InstanceBuffer);
+	ReplayCommandStreams(cmdList, streamCount);
 }
 
+size_t TexColumnsApp::RecordDrawBatches(const std::vector<DrawBatch>& batches, bool bindMaterials, bool compactVertices, UINT instanceSlot, UINT& skippedBinds)
+{
+	const size_t streamCount = (batches.size() + gRecordBatchGrain - 1) / gRecordBatchGrain;
+	if (mCommandStreams.size() < streamCount)
+	{
+		mCommandStreams.resize(streamCount);
+		mStreamSkippedBinds.resize(streamCount);
+	}
 
+	UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
+	D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = mCurrFrameResource->MaterialCB;
+	UINT64 srvHeapStart = mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart().ptr;
 
+	// Each stream starts with nothing bound, so it can be recorded on its own; for
+	// each batch, bind only what differs from the previous one in the stream...
+	auto record = [&](size_t index)
+	{
+		const size_t begin = index * gRecordBatchGrain;
+		const size_t end = std::min(begin + gRecordBatchGrain, batches.size());
+		CommandStream& stream = mCommandStreams[index];
+		stream.Clear();
+		const MeshGeometry* boundGeo = nullptr;
+		D3D12_PRIMITIVE_TOPOLOGY boundTopology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+		int boundDiffuse = -1;
+		int boundNormal = -1;
+		const Material* boundMat = nullptr;
+		UINT skipped = 0;
+		for (size_t b = begin; b < end; ++b)
+		{
+			const DrawBatch& batch = batches[b];
+			auto ri = batch.Item;
 
-void TexColumnsApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
-{
-    UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
-    UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
- 
-	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
-	auto matCB = mCurrFrameResource->MaterialCB->Resource();
+			if (ri->Geo != boundGeo)
+			{
+				stream.SetVertexBuffer(D3D12CommandBackend::ToBinding(compactVertices ? ri->Geo->CompactVertexBufferView() : ri->Geo->VertexBufferView()));
+				stream.SetIndexBuffer(D3D12CommandBackend::ToBinding(ri->Geo->IndexBufferView()));
+				boundGeo = ri->Geo;
+			}
+			else
+				skipped += 2;
+			if (ri->PrimitiveType != boundTopology)
+			{
+				stream.SetTopology(D3D12CommandBackend::ToTopology(ri->PrimitiveType));
+				boundTopology = ri->PrimitiveType;
+			}
+			else
+				++skipped;
 
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
-    {
-        auto ri = ritems[i];
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+			if (bindMaterials)
+			{
+				if (ri->Mat->DiffuseSrvHeapIndex != boundDiffuse)
+				{
+					stream.SetRootTable(0, srvHeapStart + UINT64(ri->Mat->DiffuseSrvHeapIndex) * mCbvSrvDescriptorSize);
+					boundDiffuse = ri->Mat->DiffuseSrvHeapIndex;
+				}
+				else
+					++skipped;
+				if (ri->Mat->NormalSrvHeapIndex != boundNormal)
+				{
+					stream.SetRootTable(1, srvHeapStart + UINT64(ri->Mat->NormalSrvHeapIndex) * mCbvSrvDescriptorSize);
+					boundNormal = ri->Mat->NormalSrvHeapIndex;
+				}
+				else
+					++skipped;
+				if (ri->Mat != boundMat)
+				{
+					stream.SetRootConstantBuffer(4, matCBAddress + ri->Mat->MatCBIndex * matCBByteSize);
+					boundMat = ri->Mat;
+				}
+				else
+					++skipped;
+			}
+
+			stream.SetRootConstant(instanceSlot, batch.FirstInstance);
 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE diffuseHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		diffuseHandle.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(0, diffuseHandle);
-		CD3DX12_GPU_DESCRIPTOR_HANDLE normalHandle(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		normalHandle.Offset(ri->Mat->NormalSrvHeapIndex, mCbvSrvDescriptorSize);
-		cmdList->SetGraphicsRootDescriptorTable(1, normalHandle);
+			// The main pass draws the cluster culled ranges its instances share.
+			if (bindMaterials)
+			{
+				for (const auto& range : ri->DrawRanges)
+					stream.DrawIndexed({ range.IndexCount, batch.InstanceCount, range.StartIndexLocation, ri->BaseVertexLocation, 0 });
+			}
+			else
+			{
+				stream.DrawIndexed({ ri->IndexCount, batch.InstanceCount, ri->StartIndexLocation, ri->BaseVertexLocation, 0 });
+			}
+		}
+		mStreamSkippedBinds[index] = skipped;
+	};
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex*objCBByteSize;
-		D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex*matCBByteSize;
+	if (mUseParallelRecording)
+	{
+		mJobSystem->ParallelFor(streamCount, 1, [&](size_t first, size_t last)
+		{
+			for (size_t i = first; i < last; ++i)
+				record(i);
+		});
+	}
+	else
+	{
+		for (size_t i = 0; i < streamCount; ++i)
+			record(i);
+	}
 
-        cmdList->SetGraphicsRootConstantBufferView(2, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(4, matCBAddress);
+	for (size_t i = 0; i < streamCount; ++i)
+		skippedBinds += mStreamSkippedBinds[i];
+	return streamCount;
+}
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+void TexColumnsApp::ReplayCommandStreams(ID3D12GraphicsCommandList* cmdList, size_t streamCount)
+{
+	D3D12CommandBackend backend(cmdList, mStreamPipelines);
+	mPassStream.Replay(backend);
+	mRecordedCommands += mPassStream.CommandCount();
+	for (size_t i = 0; i < streamCount; ++i)
+	{
+		mCommandStreams[i].Replay(backend);
+		mRecordedCommands += mCommandStreams[i].CommandCount();
+	}
 }
 
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 7> TexColumnsApp::GetStaticSamplers()
@@ -0,0 +1,75 @@
+#include "ClusterCuller.h"
+
+using namespace DirectX;
+
+void ClusterCuller::Cull(
+	const std::vector<SubmeshCluster>& clusters,
+	const XMFLOAT4X4& world,
+	const BoundingFrustum& frustum,
+	const XMFLOAT3& eyePos,
+	std::vector<Range>& out,
+	Stats& stats)
+{
+	if (clusters.empty())
+		return;
+
+	XMMATRIX W = XMLoadFloat4x4(&world);
+	float scale = std::max({ XMVectorGetX(XMVector3Length(W.r[0])),
+		XMVectorGetX(XMVector3Length(W.r[1])),
+		XMVectorGetX(XMVector3Length(W.r[2])) });
+
+	// Whether a triangle faces the eye does not change under an affine transform,
+	// so the cone test runs in object space against the eye brought into it.  That
+	// stays exact for non-uniform scale, unlike transforming the cones.
+	XMVECTOR det;
+	XMMATRIX invW = XMMatrixInverse(&det, W);
+	bool coneTest = XMVectorGetX(det) > 0.0f;
+	XMVECTOR localEye = XMVector3TransformCoord(XMLoadFloat3(&eyePos), invW);
+
+	bool open = false;
+	for (const SubmeshCluster& c : clusters)
+	{
+		XMVECTOR center = XMLoadFloat3(&c.Center);
+
+		bool visible = true;
+		if (coneTest)
+		{
+			XMVECTOR toCenter = center - localEye;
+			float distance = XMVectorGetX(XMVector3Length(toCenter));
+			float along = XMVectorGetX(XMVector3Dot(toCenter, XMLoadFloat3(&c.ConeAxis)));
+			if (along >= c.ConeCutoff * (distance + c.Radius) + c.Radius)
+			{
+				++stats.BackfaceCulled;
+				visible = false;
+			}
+		}
+		if (visible)
+		{
+			BoundingSphere sphere;
+			XMStoreFloat3(&sphere.Center, XMVector3TransformCoord(center, W));
+			sphere.Radius = c.Radius * scale;
+			if (frustum.Contains(sphere) == DISJOINT)
+			{
+				++stats.FrustumCulled;
+				visible = false;
+			}
+		}
+
+		if (!visible)
+		{
+			open = false;
+			continue;
+		}
+
+		++stats.Visible;
+		if (open && out.back().StartIndexLocation + out.back().IndexCount == c.StartIndexLocation)
+		{
+			out.back().IndexCount += c.IndexCount;
+		}
+		else
+		{
+			out.push_back({ c.IndexCount, c.StartIndexLocation });
+			open = true;
+		}
+	}
+}
@@ -0,0 +1,42 @@
+//***************************************************************************************
+// ClusterCuller.h
+//
+// Per-view culling of the clusters built by MeshletBuilder.  Each cluster is tested
+// against the view frustum with its bounding sphere and against the eye with its
+// normal cone; the survivors are returned as index ranges, with neighbouring ranges
+// merged so a mostly visible submesh still takes only a few draws.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+
+class ClusterCuller
+{
+public:
+
+	// One DrawIndexedInstanced worth of indices.
+	struct Range
+	{
+		UINT IndexCount = 0;
+		UINT StartIndexLocation = 0;
+	};
+
+	struct Stats
+	{
+		UINT Visible = 0;
+		UINT FrustumCulled = 0;
+		UINT BackfaceCulled = 0;
+	};
+
+	// Appends the visible clusters of one render item to out.  frustum and eyePos
+	// are in world space, the clusters in the object space of world.  The cone
+	// test assumes back faces are culled by the pipeline state.
+	static void Cull(
+		const std::vector<SubmeshCluster>& clusters,
+		const DirectX::XMFLOAT4X4& world,
+		const DirectX::BoundingFrustum& frustum,
+		const DirectX::XMFLOAT3& eyePos,
+		std::vector<Range>& out,
+		Stats& stats);
+};
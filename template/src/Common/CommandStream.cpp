@@ -0,0 +1,269 @@
+#include "CommandStream.h"
+#include <cstring>
+
+namespace
+{
+	// Arguments are stored unaligned, so they are always read through memcpy.
+	template<typename T>
+	T Read(const std::uint8_t*& p)
+	{
+		T value;
+		std::memcpy(&value, p, sizeof(T));
+		p += sizeof(T);
+		return value;
+	}
+}
+
+template<typename T>
+void CommandStream::Write(const T& value)
+{
+	const std::size_t offset = mBytes.size();
+	mBytes.resize(offset + sizeof(T));
+	std::memcpy(mBytes.data() + offset, &value, sizeof(T));
+}
+
+void CommandStream::Begin(CommandType type)
+{
+	mBytes.push_back((std::uint8_t)type);
+	++mCommandCount;
+}
+
+void CommandStream::Clear()
+{
+	mBytes.clear();
+	mCommandCount = 0;
+}
+
+void CommandStream::SetPipeline(std::uint32_t pipeline)
+{
+	Begin(CommandType::SetPipeline);
+	Write(pipeline);
+}
+
+void CommandStream::SetVertexBuffer(const VertexBufferBinding& binding)
+{
+	Begin(CommandType::SetVertexBuffer);
+	Write(binding);
+}
+
+void CommandStream::SetIndexBuffer(const IndexBufferBinding& binding)
+{
+	Begin(CommandType::SetIndexBuffer);
+	Write(binding);
+}
+
+void CommandStream::SetTopology(PrimitiveTopology topology)
+{
+	Begin(CommandType::SetTopology);
+	Write(topology);
+}
+
+void CommandStream::SetRootTable(std::uint32_t slot, std::uint64_t descriptor)
+{
+	Begin(CommandType::SetRootTable);
+	Write(slot);
+	Write(descriptor);
+}
+
+void CommandStream::SetRootConstantBuffer(std::uint32_t slot, std::uint64_t address)
+{
+	Begin(CommandType::SetRootConstantBuffer);
+	Write(slot);
+	Write(address);
+}
+
+void CommandStream::SetRootShaderResource(std::uint32_t slot, std::uint64_t address)
+{
+	Begin(CommandType::SetRootShaderResource);
+	Write(slot);
+	Write(address);
+}
+
+void CommandStream::SetRootConstant(std::uint32_t slot, std::uint32_t value, std::uint32_t offset)
+{
+	Begin(CommandType::SetRootConstant);
+	Write(slot);
+	Write(value);
+	Write(offset);
+}
+
+void CommandStream::DrawIndexed(const DrawIndexedArgs& args)
+{
+	Begin(CommandType::DrawIndexed);
+	Write(args);
+}
+
+void CommandStream::Barrier(std::uint64_t resource, std::uint32_t before, std::uint32_t after)
+{
+	Begin(CommandType::Barrier);
+	Write(resource);
+	Write(before);
+	Write(after);
+}
+
+void CommandStream::Replay(CommandBackend& backend) const
+{
+	const std::uint8_t* p = mBytes.data();
+	const std::uint8_t* end = p + mBytes.size();
+	while (p < end)
+	{
+		switch ((CommandType)*p++)
+		{
+		case CommandType::SetPipeline:
+			backend.SetPipeline(Read<std::uint32_t>(p));
+			break;
+		case CommandType::SetVertexBuffer:
+			backend.SetVertexBuffer(Read<VertexBufferBinding>(p));
+			break;
+		case CommandType::SetIndexBuffer:
+			backend.SetIndexBuffer(Read<IndexBufferBinding>(p));
+			break;
+		case CommandType::SetTopology:
+			backend.SetTopology(Read<PrimitiveTopology>(p));
+			break;
+		case CommandType::SetRootTable:
+		{
+			std::uint32_t slot = Read<std::uint32_t>(p);
+			backend.SetRootTable(slot, Read<std::uint64_t>(p));
+			break;
+		}
+		case CommandType::SetRootConstantBuffer:
+		{
+			std::uint32_t slot = Read<std::uint32_t>(p);
+			backend.SetRootConstantBuffer(slot, Read<std::uint64_t>(p));
+			break;
+		}
+		case CommandType::SetRootShaderResource:
+		{
+			std::uint32_t slot = Read<std::uint32_t>(p);
+			backend.SetRootShaderResource(slot, Read<std::uint64_t>(p));
+			break;
+		}
+		case CommandType::SetRootConstant:
+		{
+			std::uint32_t slot = Read<std::uint32_t>(p);
+			std::uint32_t value = Read<std::uint32_t>(p);
+			backend.SetRootConstant(slot, value, Read<std::uint32_t>(p));
+			break;
+		}
+		case CommandType::DrawIndexed:
+			backend.DrawIndexed(Read<DrawIndexedArgs>(p));
+			break;
+		case CommandType::Barrier:
+		{
+			std::uint64_t resource = Read<std::uint64_t>(p);
+			std::uint32_t before = Read<std::uint32_t>(p);
+			backend.Barrier(resource, before, Read<std::uint32_t>(p));
+			break;
+		}
+		default:
+			// Only the recording functions above write to the stream.
+			return;
+		}
+	}
+}
+
+void NullCommandBackend::Reset()
+{
+	*this = NullCommandBackend();
+}
+
+std::size_t NullCommandBackend::CommandCount() const
+{
+	std::size_t total = 0;
+	for (std::size_t count : mCounts)
+		total += count;
+	return total;
+}
+
+void NullCommandBackend::Error(const char* message)
+{
+	if (mErrorCount++ == 0)
+		mFirstError = message;
+}
+
+void NullCommandBackend::CheckSlot(std::uint32_t slot)
+{
+	if (slot >= MaxRootSlots)
+		Error("root slot out of range");
+}
+
+void NullCommandBackend::SetPipeline(std::uint32_t /*pipeline*/)
+{
+	++mCounts[(std::size_t)CommandType::SetPipeline];
+	mHasPipeline = true;
+}
+
+void NullCommandBackend::SetVertexBuffer(const VertexBufferBinding& binding)
+{
+	++mCounts[(std::size_t)CommandType::SetVertexBuffer];
+	if (binding.Address == 0 || binding.StrideInBytes == 0 || binding.SizeInBytes < binding.StrideInBytes)
+		Error("invalid vertex buffer");
+	mHasVertexBuffer = true;
+}
+
+void NullCommandBackend::SetIndexBuffer(const IndexBufferBinding& binding)
+{
+	++mCounts[(std::size_t)CommandType::SetIndexBuffer];
+	if (binding.Address == 0 || (binding.IndexSize != 2 && binding.IndexSize != 4))
+		Error("invalid index buffer");
+	mHasIndexBuffer = true;
+}
+
+void NullCommandBackend::SetTopology(PrimitiveTopology topology)
+{
+	++mCounts[(std::size_t)CommandType::SetTopology];
+	if (topology > PrimitiveTopology::PointList)
+		Error("invalid topology");
+	mHasTopology = true;
+}
+
+void NullCommandBackend::SetRootTable(std::uint32_t slot, std::uint64_t descriptor)
+{
+	++mCounts[(std::size_t)CommandType::SetRootTable];
+	CheckSlot(slot);
+	if (descriptor == 0)
+		Error("null descriptor table");
+}
+
+void NullCommandBackend::SetRootConstantBuffer(std::uint32_t slot, std::uint64_t address)
+{
+	++mCounts[(std::size_t)CommandType::SetRootConstantBuffer];
+	CheckSlot(slot);
+	if (address == 0 || address % 256 != 0)
+		Error("constant buffer address not 256-byte aligned");
+}
+
+void NullCommandBackend::SetRootShaderResource(std::uint32_t slot, std::uint64_t address)
+{
+	++mCounts[(std::size_t)CommandType::SetRootShaderResource];
+	CheckSlot(slot);
+	if (address == 0)
+		Error("null shader resource");
+}
+
+void NullCommandBackend::SetRootConstant(std::uint32_t slot, std::uint32_t /*value*/, std::uint32_t /*offset*/)
+{
+	++mCounts[(std::size_t)CommandType::SetRootConstant];
+	CheckSlot(slot);
+}
+
+void NullCommandBackend::DrawIndexed(const DrawIndexedArgs& args)
+{
+	++mCounts[(std::size_t)CommandType::DrawIndexed];
+	if (!mHasPipeline || !mHasVertexBuffer || !mHasIndexBuffer || !mHasTopology)
+		Error("draw before pipeline, buffers and topology are set");
+	if (args.IndexCount == 0 || args.InstanceCount == 0)
+		Error("empty draw");
+	mIndices += std::uint64_t(args.IndexCount) * args.InstanceCount;
+	mInstances += args.InstanceCount;
+}
+
+void NullCommandBackend::Barrier(std::uint64_t resource, std::uint32_t before, std::uint32_t after)
+{
+	++mCounts[(std::size_t)CommandType::Barrier];
+	if (resource == 0)
+		Error("barrier on a null resource");
+	if (before == after)
+		Error("barrier does not change the state");
+}
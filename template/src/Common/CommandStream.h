@@ -0,0 +1,166 @@
+//***************************************************************************************
+// CommandStream.h
+//
+// Backend-agnostic recording of render commands.  A CommandStream packs commands
+// (set pipeline, bind buffers and root arguments, draw, barrier) into a byte
+// buffer, one type byte followed by the arguments, and Replay decodes them in order
+// into a CommandBackend.  Streams are independent, so worker threads can each
+// record a chunk of a pass and the chunks are then replayed one after another into
+// the API command list.
+//
+// Buffers, descriptor tables and resources are passed as GPU addresses and opaque
+// 64-bit handles, and resource states as opaque integers, so nothing here depends
+// on D3D12.  NullCommandBackend validates and counts what it is given and runs
+// anywhere, for tests and for measuring recording throughput.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum class CommandType : std::uint8_t
+{
+	SetPipeline,
+	SetVertexBuffer,
+	SetIndexBuffer,
+	SetTopology,
+	SetRootTable,
+	SetRootConstantBuffer,
+	SetRootShaderResource,
+	SetRootConstant,
+	DrawIndexed,
+	Barrier,
+	Count
+};
+
+enum class PrimitiveTopology : std::uint8_t
+{
+	TriangleList,
+	TriangleStrip,
+	LineList,
+	PointList
+};
+
+struct VertexBufferBinding
+{
+	std::uint64_t Address;
+	std::uint32_t SizeInBytes;
+	std::uint32_t StrideInBytes;
+};
+
+struct IndexBufferBinding
+{
+	std::uint64_t Address;
+	std::uint32_t SizeInBytes;
+	// 2 or 4.
+	std::uint32_t IndexSize;
+};
+
+struct DrawIndexedArgs
+{
+	std::uint32_t IndexCount;
+	std::uint32_t InstanceCount;
+	std::uint32_t StartIndex;
+	std::int32_t BaseVertex;
+	std::uint32_t StartInstance;
+};
+
+// Receives the commands of a replayed stream.
+class CommandBackend
+{
+public:
+	virtual ~CommandBackend() = default;
+
+	virtual void SetPipeline(std::uint32_t pipeline) = 0;
+	virtual void SetVertexBuffer(const VertexBufferBinding& binding) = 0;
+	virtual void SetIndexBuffer(const IndexBufferBinding& binding) = 0;
+	virtual void SetTopology(PrimitiveTopology topology) = 0;
+	virtual void SetRootTable(std::uint32_t slot, std::uint64_t descriptor) = 0;
+	virtual void SetRootConstantBuffer(std::uint32_t slot, std::uint64_t address) = 0;
+	virtual void SetRootShaderResource(std::uint32_t slot, std::uint64_t address) = 0;
+	virtual void SetRootConstant(std::uint32_t slot, std::uint32_t value, std::uint32_t offset) = 0;
+	virtual void DrawIndexed(const DrawIndexedArgs& args) = 0;
+	virtual void Barrier(std::uint64_t resource, std::uint32_t before, std::uint32_t after) = 0;
+};
+
+class CommandStream
+{
+public:
+
+	// Drops the recorded commands but keeps the memory.
+	void Clear();
+
+	std::size_t CommandCount() const { return mCommandCount; }
+	std::size_t SizeInBytes() const { return mBytes.size(); }
+
+	void SetPipeline(std::uint32_t pipeline);
+	void SetVertexBuffer(const VertexBufferBinding& binding);
+	void SetIndexBuffer(const IndexBufferBinding& binding);
+	void SetTopology(PrimitiveTopology topology);
+	void SetRootTable(std::uint32_t slot, std::uint64_t descriptor);
+	void SetRootConstantBuffer(std::uint32_t slot, std::uint64_t address);
+	void SetRootShaderResource(std::uint32_t slot, std::uint64_t address);
+	void SetRootConstant(std::uint32_t slot, std::uint32_t value, std::uint32_t offset = 0);
+	void DrawIndexed(const DrawIndexedArgs& args);
+	void Barrier(std::uint64_t resource, std::uint32_t before, std::uint32_t after);
+
+	// Sends the commands to backend in the order they were recorded.
+	void Replay(CommandBackend& backend) const;
+
+private:
+	template<typename T>
+	void Write(const T& value);
+	void Begin(CommandType type);
+
+	std::vector<std::uint8_t> mBytes;
+	std::size_t mCommandCount = 0;
+};
+
+// Checks each command against the state set before it and counts them.  A draw
+// needs a pipeline, both buffers and a topology; root slots must be below
+// MaxRootSlots; a barrier must change the state.  Only the first error is kept.
+class NullCommandBackend : public CommandBackend
+{
+public:
+
+	static const std::uint32_t MaxRootSlots = 64;
+
+	void Reset();
+
+	bool Valid() const { return mErrorCount == 0; }
+	std::size_t ErrorCount() const { return mErrorCount; }
+	const std::string& FirstError() const { return mFirstError; }
+
+	std::size_t Count(CommandType type) const { return mCounts[(std::size_t)type]; }
+	std::size_t CommandCount() const;
+	std::uint64_t IndexCount() const { return mIndices; }
+	std::uint64_t InstanceCount() const { return mInstances; }
+
+	void SetPipeline(std::uint32_t pipeline) override;
+	void SetVertexBuffer(const VertexBufferBinding& binding) override;
+	void SetIndexBuffer(const IndexBufferBinding& binding) override;
+	void SetTopology(PrimitiveTopology topology) override;
+	void SetRootTable(std::uint32_t slot, std::uint64_t descriptor) override;
+	void SetRootConstantBuffer(std::uint32_t slot, std::uint64_t address) override;
+	void SetRootShaderResource(std::uint32_t slot, std::uint64_t address) override;
+	void SetRootConstant(std::uint32_t slot, std::uint32_t value, std::uint32_t offset) override;
+	void DrawIndexed(const DrawIndexedArgs& args) override;
+	void Barrier(std::uint64_t resource, std::uint32_t before, std::uint32_t after) override;
+
+private:
+	void Error(const char* message);
+	void CheckSlot(std::uint32_t slot);
+
+	std::size_t mCounts[(std::size_t)CommandType::Count] = {};
+	std::uint64_t mIndices = 0;
+	std::uint64_t mInstances = 0;
+	bool mHasPipeline = false;
+	bool mHasVertexBuffer = false;
+	bool mHasIndexBuffer = false;
+	bool mHasTopology = false;
+	std::size_t mErrorCount = 0;
+	std::string mFirstError;
+};
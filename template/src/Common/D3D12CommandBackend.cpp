@@ -0,0 +1,96 @@
+#include "D3D12CommandBackend.h"
+#include "d3dx12.h"
+
+D3D12CommandBackend::D3D12CommandBackend(ID3D12GraphicsCommandList* cmdList, const std::vector<ID3D12PipelineState*>& pipelines)
+	: mCmdList(cmdList), mPipelines(pipelines)
+{
+}
+
+VertexBufferBinding D3D12CommandBackend::ToBinding(const D3D12_VERTEX_BUFFER_VIEW& view)
+{
+	return { view.BufferLocation, view.SizeInBytes, view.StrideInBytes };
+}
+
+IndexBufferBinding D3D12CommandBackend::ToBinding(const D3D12_INDEX_BUFFER_VIEW& view)
+{
+	return { view.BufferLocation, view.SizeInBytes, view.Format == DXGI_FORMAT_R32_UINT ? 4u : 2u };
+}
+
+PrimitiveTopology D3D12CommandBackend::ToTopology(D3D12_PRIMITIVE_TOPOLOGY topology)
+{
+	switch (topology)
+	{
+	case D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP: return PrimitiveTopology::TriangleStrip;
+	case D3D_PRIMITIVE_TOPOLOGY_LINELIST: return PrimitiveTopology::LineList;
+	case D3D_PRIMITIVE_TOPOLOGY_POINTLIST: return PrimitiveTopology::PointList;
+	default: return PrimitiveTopology::TriangleList;
+	}
+}
+
+void D3D12CommandBackend::SetPipeline(std::uint32_t pipeline)
+{
+	mCmdList->SetPipelineState(mPipelines[pipeline]);
+}
+
+void D3D12CommandBackend::SetVertexBuffer(const VertexBufferBinding& binding)
+{
+	D3D12_VERTEX_BUFFER_VIEW vbv;
+	vbv.BufferLocation = binding.Address;
+	vbv.SizeInBytes = binding.SizeInBytes;
+	vbv.StrideInBytes = binding.StrideInBytes;
+	mCmdList->IASetVertexBuffers(0, 1, &vbv);
+}
+
+void D3D12CommandBackend::SetIndexBuffer(const IndexBufferBinding& binding)
+{
+	D3D12_INDEX_BUFFER_VIEW ibv;
+	ibv.BufferLocation = binding.Address;
+	ibv.SizeInBytes = binding.SizeInBytes;
+	ibv.Format = binding.IndexSize == 4 ? DXGI_FORMAT_R32_UINT : DXGI_FORMAT_R16_UINT;
+	mCmdList->IASetIndexBuffer(&ibv);
+}
+
+void D3D12CommandBackend::SetTopology(PrimitiveTopology topology)
+{
+	static const D3D12_PRIMITIVE_TOPOLOGY topologies[] =
+	{
+		D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST,
+		D3D_PRIMITIVE_TOPOLOGY_TRIANGLESTRIP,
+		D3D_PRIMITIVE_TOPOLOGY_LINELIST,
+		D3D_PRIMITIVE_TOPOLOGY_POINTLIST
+	};
+	mCmdList->IASetPrimitiveTopology(topologies[(std::size_t)topology]);
+}
+
+void D3D12CommandBackend::SetRootTable(std::uint32_t slot, std::uint64_t descriptor)
+{
+	D3D12_GPU_DESCRIPTOR_HANDLE handle;
+	handle.ptr = descriptor;
+	mCmdList->SetGraphicsRootDescriptorTable(slot, handle);
+}
+
+void D3D12CommandBackend::SetRootConstantBuffer(std::uint32_t slot, std::uint64_t address)
+{
+	mCmdList->SetGraphicsRootConstantBufferView(slot, address);
+}
+
+void D3D12CommandBackend::SetRootShaderResource(std::uint32_t slot, std::uint64_t address)
+{
+	mCmdList->SetGraphicsRootShaderResourceView(slot, address);
+}
+
+void D3D12CommandBackend::SetRootConstant(std::uint32_t slot, std::uint32_t value, std::uint32_t offset)
+{
+	mCmdList->SetGraphicsRoot32BitConstant(slot, value, offset);
+}
+
+void D3D12CommandBackend::DrawIndexed(const DrawIndexedArgs& args)
+{
+	mCmdList->DrawIndexedInstanced(args.IndexCount, args.InstanceCount, args.StartIndex, args.BaseVertex, args.StartInstance);
+}
+
+void D3D12CommandBackend::Barrier(std::uint64_t resource, std::uint32_t before, std::uint32_t after)
+{
+	mCmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(reinterpret_cast<ID3D12Resource*>(resource),
+		(D3D12_RESOURCE_STATES)before, (D3D12_RESOURCE_STATES)after));
+}
@@ -0,0 +1,40 @@
+//***************************************************************************************
+// D3D12CommandBackend.h
+//
+// Replays a CommandStream into a D3D12 graphics command list.  Pipelines are
+// recorded as indices into a table of pipeline state objects given at construction,
+// descriptor tables as GPU descriptor handles, barrier resources as ID3D12Resource
+// pointers and their states as D3D12_RESOURCE_STATES.  The static helpers convert
+// the D3D12 views and topologies into the stream's types.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "CommandStream.h"
+
+class D3D12CommandBackend : public CommandBackend
+{
+public:
+	D3D12CommandBackend(ID3D12GraphicsCommandList* cmdList, const std::vector<ID3D12PipelineState*>& pipelines);
+
+	static VertexBufferBinding ToBinding(const D3D12_VERTEX_BUFFER_VIEW& view);
+	static IndexBufferBinding ToBinding(const D3D12_INDEX_BUFFER_VIEW& view);
+	static PrimitiveTopology ToTopology(D3D12_PRIMITIVE_TOPOLOGY topology);
+	static std::uint64_t ToHandle(ID3D12Resource* resource) { return reinterpret_cast<std::uint64_t>(resource); }
+
+	void SetPipeline(std::uint32_t pipeline) override;
+	void SetVertexBuffer(const VertexBufferBinding& binding) override;
+	void SetIndexBuffer(const IndexBufferBinding& binding) override;
+	void SetTopology(PrimitiveTopology topology) override;
+	void SetRootTable(std::uint32_t slot, std::uint64_t descriptor) override;
+	void SetRootConstantBuffer(std::uint32_t slot, std::uint64_t address) override;
+	void SetRootShaderResource(std::uint32_t slot, std::uint64_t address) override;
+	void SetRootConstant(std::uint32_t slot, std::uint32_t value, std::uint32_t offset) override;
+	void DrawIndexed(const DrawIndexedArgs& args) override;
+	void Barrier(std::uint64_t resource, std::uint32_t before, std::uint32_t after) override;
+
+private:
+	ID3D12GraphicsCommandList* mCmdList;
+	const std::vector<ID3D12PipelineState*>& mPipelines;
+};
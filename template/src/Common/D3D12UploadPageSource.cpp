@@ -0,0 +1,36 @@
+#include "D3D12UploadPageSource.h"
+
+D3D12UploadPageSource::D3D12UploadPageSource(ID3D12Device* device)
+	: mDevice(device)
+{
+}
+
+UploadPage D3D12UploadPageSource::CreatePage(std::uint64_t size)
+{
+	const std::uint64_t granularity = D3D12_DEFAULT_RESOURCE_PLACEMENT_ALIGNMENT;
+	size = (size + granularity - 1) & ~(granularity - 1);
+
+	Microsoft::WRL::ComPtr<ID3D12Resource> buffer;
+	ThrowIfFailed(mDevice->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(size),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&buffer)));
+
+	UploadPage page;
+	ThrowIfFailed(buffer->Map(0, nullptr, reinterpret_cast<void**>(&page.CpuAddress)));
+	page.GpuAddress = buffer->GetGPUVirtualAddress();
+	page.Size = size;
+	// The page keeps the reference until DestroyPage.
+	page.Resource = buffer.Detach();
+	return page;
+}
+
+void D3D12UploadPageSource::DestroyPage(const UploadPage& page)
+{
+	auto buffer = static_cast<ID3D12Resource*>(page.Resource);
+	buffer->Unmap(0, nullptr);
+	buffer->Release();
+}
@@ -0,0 +1,24 @@
+//***************************************************************************************
+// D3D12UploadPageSource.h
+//
+// UploadPageSource backed by committed buffers in the upload heap, mapped for their
+// whole lifetime.  Page sizes are rounded up to 64 KB, the granularity D3D12 places
+// buffers at anyway.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "LinearAllocator.h"
+
+class D3D12UploadPageSource : public UploadPageSource
+{
+public:
+	explicit D3D12UploadPageSource(ID3D12Device* device);
+
+	UploadPage CreatePage(std::uint64_t size) override;
+	void DestroyPage(const UploadPage& page) override;
+
+private:
+	ID3D12Device* mDevice;
+};
@@ -0,0 +1,72 @@
+#include "D3D12UploadRing.h"
+
+using Microsoft::WRL::ComPtr;
+
+D3D12UploadRing::D3D12UploadRing(ID3D12Device* device, UINT64 capacity, std::function<void()> makeRoom)
+	: mDevice(device), mRing(capacity), mMakeRoom(std::move(makeRoom))
+{
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(capacity),
+		D3D12_RESOURCE_STATE_GENERIC_READ,
+		nullptr,
+		IID_PPV_ARGS(&mBuffer)));
+
+	// Keep the buffer mapped; UpdateSubresources maps it again for each copy, which
+	// then costs no more than a reference count.
+	void* mapped = nullptr;
+	ThrowIfFailed(mBuffer->Map(0, nullptr, &mapped));
+}
+
+D3D12UploadRing::~D3D12UploadRing()
+{
+	if (mBuffer != nullptr)
+		mBuffer->Unmap(0, nullptr);
+}
+
+void D3D12UploadRing::Upload(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* dest,
+	UINT firstSubresource, UINT count, const D3D12_SUBRESOURCE_DATA* data)
+{
+	const UINT64 size = GetRequiredIntermediateSize(dest, firstSubresource, count);
+
+	if (size > mRing.Capacity())
+	{
+		ComPtr<ID3D12Resource> buffer;
+		ThrowIfFailed(mDevice->CreateCommittedResource(
+			&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
+			D3D12_HEAP_FLAG_NONE,
+			&CD3DX12_RESOURCE_DESC::Buffer(size),
+			D3D12_RESOURCE_STATE_GENERIC_READ,
+			nullptr,
+			IID_PPV_ARGS(&buffer)));
+		UpdateSubresources(cmdList, dest, buffer.Get(), 0, firstSubresource, count, data);
+		mPendingDedicated.push_back(buffer);
+		return;
+	}
+
+	// Texture footprints need the stricter alignment; buffers take it too.
+	UINT64 offset = 0;
+	if (!mRing.Allocate(size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, offset))
+	{
+		mMakeRoom();
+		if (!mRing.Allocate(size, D3D12_TEXTURE_DATA_PLACEMENT_ALIGNMENT, offset))
+			ThrowIfFailed(E_OUTOFMEMORY);
+	}
+	UpdateSubresources(cmdList, dest, mBuffer.Get(), offset, firstSubresource, count, data);
+}
+
+void D3D12UploadRing::Submit(UINT64 fence)
+{
+	mRing.Submit(fence);
+	for (auto& buffer : mPendingDedicated)
+		mSubmittedDedicated.push_back({ fence, buffer });
+	mPendingDedicated.clear();
+}
+
+void D3D12UploadRing::Retire(UINT64 completedFence)
+{
+	mRing.Retire(completedFence);
+	while (!mSubmittedDedicated.empty() && mSubmittedDedicated.front().Fence <= completedFence)
+		mSubmittedDedicated.pop_front();
+}
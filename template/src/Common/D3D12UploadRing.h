@@ -0,0 +1,54 @@
+//***************************************************************************************
+// D3D12UploadRing.h
+//
+// Stages the initial contents of default heap buffers and textures through one
+// persistently mapped upload buffer managed by an UploadRing, instead of a committed
+// upload resource per copy.  The copies are recorded on the caller's command list.
+// When the ring is full, makeRoom is called; it must execute the recorded copies,
+// call Submit and Retire, and leave the command list open for recording.  A copy
+// larger than the whole ring gets a temporary upload buffer, kept until the fence
+// of its submission completes.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "UploadRing.h"
+#include <functional>
+
+class D3D12UploadRing
+{
+public:
+	D3D12UploadRing(ID3D12Device* device, UINT64 capacity, std::function<void()> makeRoom);
+	D3D12UploadRing(const D3D12UploadRing& rhs) = delete;
+	D3D12UploadRing& operator=(const D3D12UploadRing& rhs) = delete;
+	~D3D12UploadRing();
+
+	// Records copies of data into subresources [firstSubresource, firstSubresource +
+	// count) of dest, which must be in the COPY_DEST state.  For a buffer, pass one
+	// subresource with RowPitch and SlicePitch set to its size.
+	void Upload(ID3D12GraphicsCommandList* cmdList, ID3D12Resource* dest,
+		UINT firstSubresource, UINT count, const D3D12_SUBRESOURCE_DATA* data);
+
+	// See UploadRing.
+	void Submit(UINT64 fence);
+	void Retire(UINT64 completedFence);
+
+	const UploadRing& Ring() const { return mRing; }
+
+private:
+	struct DedicatedBuffer
+	{
+		UINT64 Fence;
+		Microsoft::WRL::ComPtr<ID3D12Resource> Buffer;
+	};
+
+	ID3D12Device* mDevice;
+	UploadRing mRing;
+	Microsoft::WRL::ComPtr<ID3D12Resource> mBuffer;
+	std::function<void()> mMakeRoom;
+
+	// Oversized copies not yet submitted, then those waiting for their fence.
+	std::vector<Microsoft::WRL::ComPtr<ID3D12Resource>> mPendingDedicated;
+	std::deque<DedicatedBuffer> mSubmittedDedicated;
+};
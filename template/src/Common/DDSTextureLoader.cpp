@@ -24,6 +24,7 @@
 #include <wrl.h>
 
 #include "DDSTextureLoader.h" 
+#include "D3D12UploadRing.h"
 
 using namespace Microsoft::WRL;
 
@@ -1241,7 +1242,8 @@ static HRESULT CreateD3DResources12(
 	_In_ bool isCubeMap,
 	_In_reads_opt_(mipCount*arraySize) D3D12_SUBRESOURCE_DATA* initData,
 	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap
+	ComPtr<ID3D12Resource>& textureUploadHeap,
+	D3D12UploadRing* uploadRing
 	)
 {
 	if (device == nullptr)
@@ -1288,6 +1290,18 @@ static HRESULT CreateD3DResources12(
 			const UINT num2DSubresources = texDesc.DepthOrArraySize * texDesc.MipLevels;
 			const UINT64 uploadBufferSize = GetRequiredIntermediateSize(texture.Get(), 0, num2DSubresources);
 
+			if (uploadRing)
+			{
+				cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
+					D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
+
+				uploadRing->Upload(cmdList, texture.Get(), 0, num2DSubresources, initData);
+
+				cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(texture.Get(),
+					D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE));
+				return S_OK;
+			}
+
 			hr = device->CreateCommittedResource(
 				&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
 				D3D12_HEAP_FLAG_NONE,
@@ -1678,7 +1692,8 @@ static HRESULT CreateTextureFromDDS12(
 	_In_ size_t maxsize,
 	_In_ bool forceSRGB,
 	ComPtr<ID3D12Resource>& texture,
-	ComPtr<ID3D12Resource>& textureUploadHeap)
+	ComPtr<ID3D12Resource>& textureUploadHeap,
+	D3D12UploadRing* uploadRing)
 {
 	HRESULT hr = S_OK;
 
@@ -1867,7 +1882,8 @@ static HRESULT CreateTextureFromDDS12(
 			isCubeMap,
 			initData.get(),
 			texture, 
-			textureUploadHeap);
+			textureUploadHeap,
+			uploadRing);
 	}
 
 	return hr;
@@ -1979,7 +1995,8 @@ HRESULT DirectX::CreateDDSTextureFromMemory12(
 		maxsize,
 		false,
 		texture,
-		textureUploadHeap
+		textureUploadHeap,
+		nullptr
 		);
 
 	if (SUCCEEDED(hr))
@@ -2172,7 +2189,7 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	}
 
 	hr = CreateTextureFromDDS12(device, cmdList, header,
-		bitData, bitSize, maxsize, false, texture, textureUploadHeap);
+		bitData, bitSize, maxsize, false, texture, textureUploadHeap, nullptr);
 
 	if (SUCCEEDED(hr))
 	{
@@ -2228,6 +2245,49 @@ HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
 	return hr;
 }
 
+HRESULT DirectX::CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
+	_In_ ID3D12GraphicsCommandList* cmdList,
+	_In_z_ const wchar_t* szFileName,
+	_Out_ ComPtr<ID3D12Resource>& texture,
+	D3D12UploadRing& uploadRing,
+	_In_ size_t maxsize,
+	_Out_opt_ DDS_ALPHA_MODE* alphaMode)
+{
+	texture = nullptr;
+	if (alphaMode)
+	{
+		*alphaMode = DDS_ALPHA_MODE_UNKNOWN;
+	}
+
+	if (!device || !cmdList || !szFileName)
+	{
+		return E_INVALIDARG;
+	}
+
+	DDS_HEADER* header = nullptr;
+	uint8_t* bitData = nullptr;
+	size_t bitSize = 0;
+
+	std::unique_ptr<uint8_t[]> ddsData;
+	HRESULT hr = LoadTextureDataFromFile(szFileName, ddsData, &header, &bitData, &bitSize);
+	if (FAILED(hr))
+	{
+		return hr;
+	}
+
+	// Unused; the data goes through the ring.
+	ComPtr<ID3D12Resource> textureUploadHeap;
+	hr = CreateTextureFromDDS12(device, cmdList, header,
+		bitData, bitSize, maxsize, false, texture, textureUploadHeap, &uploadRing);
+
+	if (SUCCEEDED(hr) && alphaMode)
+	{
+		*alphaMode = GetAlphaMode(header);
+	}
+
+	return hr;
+}
+
 _Use_decl_annotations_
 HRESULT DirectX::CreateDDSTextureFromFile( ID3D11Device* d3dDevice,
                                            ID3D11DeviceContext* d3dContext,
@@ -26,6 +26,8 @@
 #include <d3d11_1.h>
 #include "d3dx12.h"
 
+class D3D12UploadRing;
+
 #pragma warning(push)
 #pragma warning(disable : 4005)
 #include <stdint.h>
@@ -92,6 +94,16 @@ namespace DirectX
 		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
 		                               );
 
+	// Stages the texture data in uploadRing instead of a new upload heap.
+	HRESULT CreateDDSTextureFromFile12(_In_ ID3D12Device* device,
+		                               _In_ ID3D12GraphicsCommandList* cmdList,
+		                               _In_z_ const wchar_t* szFileName,
+		                               _Out_ Microsoft::WRL::ComPtr<ID3D12Resource>& texture,
+		                               D3D12UploadRing& uploadRing,
+		                               _In_ size_t maxsize = 0,
+		                               _Out_opt_ DDS_ALPHA_MODE* alphaMode = nullptr
+		                               );
+
     // Standard version with optional auto-gen mipmap support
     HRESULT CreateDDSTextureFromMemory( _In_ ID3D11Device* d3dDevice,
                                         _In_opt_ ID3D11DeviceContext* d3dContext,
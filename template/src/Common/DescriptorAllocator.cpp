@@ -0,0 +1,61 @@
+#include "DescriptorAllocator.h"
+#include <algorithm>
+#include <cassert>
+
+DescriptorAllocator::DescriptorAllocator(std::uint32_t capacity)
+	: mCapacity(capacity)
+{
+	if (capacity > 0)
+		mFreeRanges.push_back({ 0, capacity });
+}
+
+std::uint32_t DescriptorAllocator::Allocate(std::uint32_t count)
+{
+	if (count == 0)
+		return Invalid;
+	for (size_t i = 0; i < mFreeRanges.size(); ++i)
+	{
+		Range& range = mFreeRanges[i];
+		if (range.Count < count)
+			continue;
+
+		const std::uint32_t first = range.First;
+		range.First += count;
+		range.Count -= count;
+		if (range.Count == 0)
+			mFreeRanges.erase(mFreeRanges.begin() + i);
+		mInUse += count;
+		return first;
+	}
+	return Invalid;
+}
+
+void DescriptorAllocator::Free(std::uint32_t first, std::uint32_t count)
+{
+	if (count == 0)
+		return;
+	assert(first + count <= mCapacity);
+
+	auto next = std::lower_bound(mFreeRanges.begin(), mFreeRanges.end(), first,
+		[](const Range& r, std::uint32_t value) { return r.First < value; });
+	assert(next == mFreeRanges.end() || first + count <= next->First);
+	assert(next == mFreeRanges.begin() || (next - 1)->First + (next - 1)->Count <= first);
+	mInUse -= count;
+
+	const bool joinsPrevious = next != mFreeRanges.begin() && (next - 1)->First + (next - 1)->Count == first;
+	const bool joinsNext = next != mFreeRanges.end() && first + count == next->First;
+	if (joinsPrevious && joinsNext)
+	{
+		(next - 1)->Count += count + next->Count;
+		mFreeRanges.erase(next);
+	}
+	else if (joinsPrevious)
+		(next - 1)->Count += count;
+	else if (joinsNext)
+	{
+		next->First = first;
+		next->Count += count;
+	}
+	else
+		mFreeRanges.insert(next, { first, count });
+}
@@ -0,0 +1,43 @@
+//***************************************************************************************
+// DescriptorAllocator.h
+//
+// Hands out slots of a descriptor heap without touching the heap itself.  The slots
+// hold long-lived views and are managed as a list of free ranges, first fit, with
+// freed ranges merged into their neighbours.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+class DescriptorAllocator
+{
+public:
+	static const std::uint32_t Invalid = 0xffffffff;
+
+	explicit DescriptorAllocator(std::uint32_t capacity);
+
+	// Slots needed in the heap.
+	std::uint32_t HeapSize() const { return mCapacity; }
+
+	// First slot of count consecutive slots, or Invalid if no free range is long
+	// enough.
+	std::uint32_t Allocate(std::uint32_t count = 1);
+	void Free(std::uint32_t first, std::uint32_t count = 1);
+
+	std::uint32_t InUse() const { return mInUse; }
+
+private:
+	struct Range
+	{
+		std::uint32_t First;
+		std::uint32_t Count;
+	};
+
+	std::uint32_t mCapacity;
+
+	// Sorted by First, never adjacent to each other.
+	std::vector<Range> mFreeRanges;
+	std::uint32_t mInUse = 0;
+};
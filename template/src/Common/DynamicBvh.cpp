@@ -0,0 +1,496 @@
+#include "DynamicBvh.h"
+#include <algorithm>
+#include <cassert>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	// Signed distance of the box's farthest corner in front of the plane, and of
+	// its nearest one.
+	void PlaneExtent(const XMFLOAT4& plane, const XMFLOAT3& minP, const XMFLOAT3& maxP, float& farthest, float& nearest)
+	{
+		float cx = 0.5f * (minP.x + maxP.x), cy = 0.5f * (minP.y + maxP.y), cz = 0.5f * (minP.z + maxP.z);
+		float ex = 0.5f * (maxP.x - minP.x), ey = 0.5f * (maxP.y - minP.y), ez = 0.5f * (maxP.z - minP.z);
+		float d = plane.x * cx + plane.y * cy + plane.z * cz + plane.w;
+		float r = std::fabs(plane.x) * ex + std::fabs(plane.y) * ey + std::fabs(plane.z) * ez;
+		farthest = d + r;
+		nearest = d - r;
+	}
+
+	// Distance along the ray at which it enters the box, or a negative value if it
+	// misses it before maxDistance.  Starting inside counts as entering at 0.
+	float RayEnter(const XMFLOAT3& origin, const XMFLOAT3& invDir, float maxDistance, const XMFLOAT3& minP, const XMFLOAT3& maxP)
+	{
+		float t1 = (minP.x - origin.x) * invDir.x, t2 = (maxP.x - origin.x) * invDir.x;
+		float tMin = std::min(t1, t2), tMax = std::max(t1, t2);
+		t1 = (minP.y - origin.y) * invDir.y; t2 = (maxP.y - origin.y) * invDir.y;
+		tMin = std::max(tMin, std::min(t1, t2)); tMax = std::min(tMax, std::max(t1, t2));
+		t1 = (minP.z - origin.z) * invDir.z; t2 = (maxP.z - origin.z) * invDir.z;
+		tMin = std::max(tMin, std::min(t1, t2)); tMax = std::min(tMax, std::max(t1, t2));
+
+		tMin = std::max(tMin, 0.0f);
+		if (tMin > tMax || tMin >= maxDistance)
+			return -1.0f;
+		return tMin;
+	}
+
+	// Avoids 0 * inf when the ray runs along a slab boundary.
+	float SafeInverse(float d)
+	{
+		const float big = 1.0e30f;
+		if (std::fabs(d) < 1.0e-30f)
+			return d < 0.0f ? -big : big;
+		return 1.0f / d;
+	}
+}
+
+DynamicBvh::DynamicBvh(float margin) :
+	mMargin(margin)
+{
+}
+
+int DynamicBvh::Insert(const BoundingBox& box, std::uint32_t userData)
+{
+	int leaf = AllocateNode();
+	mNodes[leaf].Box = Fatten(box, mMargin);
+	mNodes[leaf].UserData = userData;
+	mNodes[leaf].Height = 0;
+	InsertLeaf(leaf);
+	++mLeafCount;
+	return leaf;
+}
+
+void DynamicBvh::Remove(int proxy)
+{
+	assert(proxy >= 0 && proxy < (int)mNodes.size() && mNodes[proxy].IsLeaf() && mNodes[proxy].Height == 0);
+	RemoveLeaf(proxy);
+	FreeNode(proxy);
+	--mLeafCount;
+}
+
+bool DynamicBvh::Move(int proxy, const BoundingBox& box)
+{
+	assert(proxy >= 0 && proxy < (int)mNodes.size() && mNodes[proxy].IsLeaf() && mNodes[proxy].Height == 0);
+
+	Aabb tight = Fatten(box, 0.0f);
+	if (Contains(mNodes[proxy].Box, tight))
+		return false;
+
+	RemoveLeaf(proxy);
+	mNodes[proxy].Box = Fatten(box, mMargin);
+	InsertLeaf(proxy);
+	++mReinsertCount;
+	return true;
+}
+
+void DynamicBvh::Rebuild()
+{
+	std::vector<int> leaves;
+	leaves.reserve(mLeafCount);
+	for (int i = 0; i < (int)mNodes.size(); ++i)
+	{
+		if (mNodes[i].Height < 0)
+			continue;
+		if (mNodes[i].IsLeaf())
+			leaves.push_back(i);
+		else
+			FreeNode(i);
+	}
+
+	mRoot = leaves.empty() ? NullNode : BuildRange(leaves.data(), leaves.size());
+	if (mRoot != NullNode)
+		mNodes[mRoot].Parent = NullNode;
+	mReinsertCount = 0;
+}
+
+void DynamicBvh::Clear()
+{
+	mNodes.clear();
+	mRoot = NullNode;
+	mFreeList = NullNode;
+	mLeafCount = 0;
+	mReinsertCount = 0;
+}
+
+int DynamicBvh::Height() const
+{
+	return mRoot == NullNode ? 0 : mNodes[mRoot].Height;
+}
+
+void DynamicBvh::QueryFrustum(const XMFLOAT4 planes[6], std::vector<std::uint32_t>& out) const
+{
+	if (mRoot == NullNode)
+		return;
+
+	// Each entry carries the planes its box still straddles; a node entirely in
+	// front of a plane does not test it again below.
+	struct Entry { int Node; unsigned Planes; };
+	std::vector<Entry> stack;
+	stack.push_back({ mRoot, 0x3fu });
+	while (!stack.empty())
+	{
+		Entry e = stack.back();
+		stack.pop_back();
+		const Node& node = mNodes[e.Node];
+
+		unsigned planesLeft = e.Planes;
+		bool outside = false;
+		for (int p = 0; p < 6 && !outside; ++p)
+		{
+			if (!(planesLeft & (1u << p)))
+				continue;
+			float farthest, nearest;
+			PlaneExtent(planes[p], node.Box.Min, node.Box.Max, farthest, nearest);
+			if (farthest < 0.0f)
+				outside = true;
+			else if (nearest >= 0.0f)
+				planesLeft &= ~(1u << p);
+		}
+		if (outside)
+			continue;
+
+		if (node.IsLeaf())
+		{
+			out.push_back(node.UserData);
+		}
+		else
+		{
+			stack.push_back({ node.Child1, planesLeft });
+			stack.push_back({ node.Child2, planesLeft });
+		}
+	}
+}
+
+void DynamicBvh::QuerySphere(const BoundingSphere& sphere, std::vector<std::uint32_t>& out) const
+{
+	if (mRoot == NullNode)
+		return;
+
+	const XMFLOAT3& c = sphere.Center;
+	const float radiusSq = sphere.Radius * sphere.Radius;
+
+	std::vector<int> stack;
+	stack.push_back(mRoot);
+	while (!stack.empty())
+	{
+		const Node& node = mNodes[stack.back()];
+		stack.pop_back();
+
+		float dx = std::max({ node.Box.Min.x - c.x, 0.0f, c.x - node.Box.Max.x });
+		float dy = std::max({ node.Box.Min.y - c.y, 0.0f, c.y - node.Box.Max.y });
+		float dz = std::max({ node.Box.Min.z - c.z, 0.0f, c.z - node.Box.Max.z });
+		if (dx * dx + dy * dy + dz * dz > radiusSq)
+			continue;
+
+		if (node.IsLeaf())
+		{
+			out.push_back(node.UserData);
+		}
+		else
+		{
+			stack.push_back(node.Child1);
+			stack.push_back(node.Child2);
+		}
+	}
+}
+
+bool DynamicBvh::RayCast(
+	const XMFLOAT3& origin,
+	const XMFLOAT3& direction,
+	float maxDistance,
+	const RayHitTest& hitTest,
+	std::uint32_t& hitData,
+	float& hitDistance) const
+{
+	if (mRoot == NullNode)
+		return false;
+
+	const XMFLOAT3 invDir(SafeInverse(direction.x), SafeInverse(direction.y), SafeInverse(direction.z));
+	float closest = maxDistance;
+	bool hit = false;
+
+	struct Entry { int Node; float Enter; };
+	std::vector<Entry> stack;
+	float rootEnter = RayEnter(origin, invDir, closest, mNodes[mRoot].Box.Min, mNodes[mRoot].Box.Max);
+	if (rootEnter >= 0.0f)
+		stack.push_back({ mRoot, rootEnter });
+
+	while (!stack.empty())
+	{
+		Entry e = stack.back();
+		stack.pop_back();
+		if (e.Enter >= closest)
+			continue;
+
+		const Node& node = mNodes[e.Node];
+		if (node.IsLeaf())
+		{
+			float t = hitTest(node.UserData, closest);
+			if (t >= 0.0f && t < closest)
+			{
+				closest = t;
+				hitData = node.UserData;
+				hit = true;
+			}
+			continue;
+		}
+
+		const Node& c1 = mNodes[node.Child1];
+		const Node& c2 = mNodes[node.Child2];
+		float t1 = RayEnter(origin, invDir, closest, c1.Box.Min, c1.Box.Max);
+		float t2 = RayEnter(origin, invDir, closest, c2.Box.Min, c2.Box.Max);
+
+		// The nearer child goes on top so it is visited first.
+		Entry first = { node.Child1, t1 }, second = { node.Child2, t2 };
+		if (t2 >= 0.0f && (t1 < 0.0f || t2 < t1))
+			std::swap(first, second);
+		if (second.Enter >= 0.0f)
+			stack.push_back(second);
+		if (first.Enter >= 0.0f)
+			stack.push_back(first);
+	}
+
+	if (hit)
+		hitDistance = closest;
+	return hit;
+}
+
+int DynamicBvh::AllocateNode()
+{
+	int node;
+	if (mFreeList != NullNode)
+	{
+		node = mFreeList;
+		mFreeList = mNodes[node].Parent;
+	}
+	else
+	{
+		node = static_cast<int>(mNodes.size());
+		mNodes.emplace_back();
+	}
+
+	mNodes[node] = Node();
+	mNodes[node].Height = 0;
+	return node;
+}
+
+void DynamicBvh::FreeNode(int node)
+{
+	mNodes[node].Parent = mFreeList;
+	mNodes[node].Child1 = NullNode;
+	mNodes[node].Child2 = NullNode;
+	mNodes[node].Height = -1;
+	mFreeList = node;
+}
+
+void DynamicBvh::InsertLeaf(int leaf)
+{
+	if (mRoot == NullNode)
+	{
+		mRoot = leaf;
+		mNodes[leaf].Parent = NullNode;
+		return;
+	}
+
+	// Walk down towards the sibling whose union with the leaf adds the least
+	// surface area, counting the growth of every ancestor on the way.
+	const Aabb leafBox = mNodes[leaf].Box;
+	int index = mRoot;
+	while (!mNodes[index].IsLeaf())
+	{
+		const Node& node = mNodes[index];
+		float area = Area(node.Box);
+		float combinedArea = Area(Union(node.Box, leafBox));
+
+		// Cost of making the leaf a sibling of this node, and the cost every
+		// deeper choice inherits from growing this node.
+		float cost = 2.0f * combinedArea;
+		float inheritance = 2.0f * (combinedArea - area);
+
+		auto descendCost = [&](int child)
+		{
+			const Node& c = mNodes[child];
+			float grown = Area(Union(c.Box, leafBox));
+			return (c.IsLeaf() ? grown : grown - Area(c.Box)) + inheritance;
+		};
+		float cost1 = descendCost(node.Child1);
+		float cost2 = descendCost(node.Child2);
+
+		if (cost < cost1 && cost < cost2)
+			break;
+		index = cost1 < cost2 ? node.Child1 : node.Child2;
+	}
+
+	const int sibling = index;
+	const int oldParent = mNodes[sibling].Parent;
+	const int newParent = AllocateNode();
+	mNodes[newParent].Parent = oldParent;
+	mNodes[newParent].Box = Union(leafBox, mNodes[sibling].Box);
+	mNodes[newParent].Height = mNodes[sibling].Height + 1;
+	mNodes[newParent].Child1 = sibling;
+	mNodes[newParent].Child2 = leaf;
+	mNodes[sibling].Parent = newParent;
+	mNodes[leaf].Parent = newParent;
+
+	if (oldParent == NullNode)
+		mRoot = newParent;
+	else if (mNodes[oldParent].Child1 == sibling)
+		mNodes[oldParent].Child1 = newParent;
+	else
+		mNodes[oldParent].Child2 = newParent;
+
+	for (index = mNodes[leaf].Parent; index != NullNode; index = mNodes[index].Parent)
+	{
+		index = Balance(index);
+		Refit(index);
+	}
+}
+
+void DynamicBvh::RemoveLeaf(int leaf)
+{
+	if (leaf == mRoot)
+	{
+		mRoot = NullNode;
+		return;
+	}
+
+	const int parent = mNodes[leaf].Parent;
+	const int grandParent = mNodes[parent].Parent;
+	const int sibling = mNodes[parent].Child1 == leaf ? mNodes[parent].Child2 : mNodes[parent].Child1;
+
+	mNodes[sibling].Parent = grandParent;
+	FreeNode(parent);
+
+	if (grandParent == NullNode)
+	{
+		mRoot = sibling;
+		return;
+	}
+
+	if (mNodes[grandParent].Child1 == parent)
+		mNodes[grandParent].Child1 = sibling;
+	else
+		mNodes[grandParent].Child2 = sibling;
+
+	for (int index = grandParent; index != NullNode; index = mNodes[index].Parent)
+	{
+		index = Balance(index);
+		Refit(index);
+	}
+}
+
+// Rotates the taller grandchild up when the heights of a's children differ by
+// more than one.  Returns the node now in a's place.
+int DynamicBvh::Balance(int a)
+{
+	if (mNodes[a].IsLeaf() || mNodes[a].Height < 2)
+		return a;
+
+	const int b = mNodes[a].Child1;
+	const int c = mNodes[a].Child2;
+	const int balance = mNodes[c].Height - mNodes[b].Height;
+	if (balance >= -1 && balance <= 1)
+		return a;
+
+	// up is the taller child; it takes a's place and a adopts its shorter child.
+	const int up = balance > 1 ? c : b;
+	const int stay = balance > 1 ? b : c;
+	const int f = mNodes[up].Child1;
+	const int g = mNodes[up].Child2;
+	const int upTall = mNodes[f].Height > mNodes[g].Height ? f : g;
+	const int upShort = upTall == f ? g : f;
+
+	mNodes[up].Parent = mNodes[a].Parent;
+	mNodes[a].Parent = up;
+	if (mNodes[up].Parent == NullNode)
+		mRoot = up;
+	else if (mNodes[mNodes[up].Parent].Child1 == a)
+		mNodes[mNodes[up].Parent].Child1 = up;
+	else
+		mNodes[mNodes[up].Parent].Child2 = up;
+
+	mNodes[up].Child1 = a;
+	mNodes[up].Child2 = upTall;
+	mNodes[a].Child1 = stay;
+	mNodes[a].Child2 = upShort;
+	mNodes[upShort].Parent = a;
+
+	Refit(a);
+	Refit(up);
+	return up;
+}
+
+void DynamicBvh::Refit(int node)
+{
+	Node& n = mNodes[node];
+	n.Box = Union(mNodes[n.Child1].Box, mNodes[n.Child2].Box);
+	n.Height = 1 + std::max(mNodes[n.Child1].Height, mNodes[n.Child2].Height);
+}
+
+int DynamicBvh::BuildRange(int* leaves, std::size_t count)
+{
+	if (count == 1)
+		return leaves[0];
+
+	// Split at the median of the box centers along the longest axis of their bounds.
+	XMFLOAT3 lo(FLT_MAX, FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		const Aabb& b = mNodes[leaves[i]].Box;
+		lo = XMFLOAT3(std::min(lo.x, b.Min.x + b.Max.x), std::min(lo.y, b.Min.y + b.Max.y), std::min(lo.z, b.Min.z + b.Max.z));
+		hi = XMFLOAT3(std::max(hi.x, b.Min.x + b.Max.x), std::max(hi.y, b.Min.y + b.Max.y), std::max(hi.z, b.Min.z + b.Max.z));
+	}
+	const float size[3] = { hi.x - lo.x, hi.y - lo.y, hi.z - lo.z };
+	const int axis = size[0] >= size[1] && size[0] >= size[2] ? 0 : (size[1] >= size[2] ? 1 : 2);
+
+	auto center = [&](int leaf)
+	{
+		const Aabb& b = mNodes[leaf].Box;
+		return axis == 0 ? b.Min.x + b.Max.x : (axis == 1 ? b.Min.y + b.Max.y : b.Min.z + b.Max.z);
+	};
+	const std::size_t half = count / 2;
+	std::nth_element(leaves, leaves + half, leaves + count,
+		[&](int l, int r) { return center(l) < center(r); });
+
+	const int child1 = BuildRange(leaves, half);
+	const int child2 = BuildRange(leaves + half, count - half);
+
+	const int node = AllocateNode();
+	mNodes[node].Child1 = child1;
+	mNodes[node].Child2 = child2;
+	mNodes[child1].Parent = node;
+	mNodes[child2].Parent = node;
+	Refit(node);
+	return node;
+}
+
+DynamicBvh::Aabb DynamicBvh::Fatten(const BoundingBox& box, float margin)
+{
+	Aabb out;
+	out.Min = XMFLOAT3(box.Center.x - box.Extents.x - margin, box.Center.y - box.Extents.y - margin, box.Center.z - box.Extents.z - margin);
+	out.Max = XMFLOAT3(box.Center.x + box.Extents.x + margin, box.Center.y + box.Extents.y + margin, box.Center.z + box.Extents.z + margin);
+	return out;
+}
+
+DynamicBvh::Aabb DynamicBvh::Union(const Aabb& a, const Aabb& b)
+{
+	Aabb out;
+	out.Min = XMFLOAT3(std::min(a.Min.x, b.Min.x), std::min(a.Min.y, b.Min.y), std::min(a.Min.z, b.Min.z));
+	out.Max = XMFLOAT3(std::max(a.Max.x, b.Max.x), std::max(a.Max.y, b.Max.y), std::max(a.Max.z, b.Max.z));
+	return out;
+}
+
+float DynamicBvh::Area(const Aabb& box)
+{
+	float x = box.Max.x - box.Min.x, y = box.Max.y - box.Min.y, z = box.Max.z - box.Min.z;
+	return 2.0f * (x * y + y * z + z * x);
+}
+
+bool DynamicBvh::Contains(const Aabb& outer, const Aabb& inner)
+{
+	return outer.Min.x <= inner.Min.x && outer.Min.y <= inner.Min.y && outer.Min.z <= inner.Min.z
+		&& inner.Max.x <= outer.Max.x && inner.Max.y <= outer.Max.y && inner.Max.z <= outer.Max.z;
+}
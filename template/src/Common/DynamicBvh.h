@@ -0,0 +1,110 @@
+//***************************************************************************************
+// DynamicBvh.h
+//
+// Dynamic bounding volume hierarchy over axis-aligned boxes, for spatial queries
+// on objects that move now and then.  Leaves store a box enlarged by a margin, so
+// small moves only compare against it; a leaf that leaves its box is removed and
+// reinserted.  Insertion picks the sibling with the least surface area growth and
+// rotates unbalanced nodes on the way up; Rebuild recreates the inner nodes with
+// median splits when many reinsertions have worn the tree down.
+//
+// Proxies returned by Insert stay valid until Remove, across Move and Rebuild.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class DynamicBvh
+{
+public:
+
+	static const int NullNode = -1;
+
+	// Called for each leaf whose box the ray enters closer than maxDistance.
+	// Returns the distance of the actual hit, or a negative value if there is none.
+	using RayHitTest = std::function<float(std::uint32_t userData, float maxDistance)>;
+
+	explicit DynamicBvh(float margin = 0.1f);
+
+	// Adds a box and returns its proxy.  userData is handed back by the queries.
+	int Insert(const DirectX::BoundingBox& box, std::uint32_t userData);
+	void Remove(int proxy);
+
+	// Updates the box of proxy.  Returns true if the leaf had to be reinserted.
+	bool Move(int proxy, const DirectX::BoundingBox& box);
+
+	// Rebuilds the inner nodes from scratch.  Leaves and proxies are kept.
+	void Rebuild();
+
+	void Clear();
+
+	std::size_t LeafCount() const { return mLeafCount; }
+	// Reinsertions done by Move since the last Rebuild.
+	std::size_t ReinsertCount() const { return mReinsertCount; }
+	// Levels below the root; 0 for a single leaf or an empty tree.
+	int Height() const;
+
+	// Appends the user data of the leaves not entirely behind one of the planes
+	// (as returned by FrustumCuller::ExtractPlanes).
+	void QueryFrustum(const DirectX::XMFLOAT4 planes[6], std::vector<std::uint32_t>& out) const;
+
+	// Appends the user data of the leaves whose box touches the sphere.
+	void QuerySphere(const DirectX::BoundingSphere& sphere, std::vector<std::uint32_t>& out) const;
+
+	// Finds the closest hit along a ray with a unit length direction.  Leaves are
+	// visited front to back and skipped once they start beyond the closest hit.
+	bool RayCast(
+		const DirectX::XMFLOAT3& origin,
+		const DirectX::XMFLOAT3& direction,
+		float maxDistance,
+		const RayHitTest& hitTest,
+		std::uint32_t& hitData,
+		float& hitDistance) const;
+
+private:
+	struct Aabb
+	{
+		DirectX::XMFLOAT3 Min;
+		DirectX::XMFLOAT3 Max;
+	};
+
+	struct Node
+	{
+		Aabb Box;
+		std::uint32_t UserData = 0;
+		// Next free node while the node is on the free list.
+		int Parent = NullNode;
+		int Child1 = NullNode;
+		int Child2 = NullNode;
+		// 0 for leaves, -1 for free nodes.
+		int Height = -1;
+
+		bool IsLeaf() const { return Child1 == NullNode; }
+	};
+
+	int AllocateNode();
+	void FreeNode(int node);
+	void InsertLeaf(int leaf);
+	void RemoveLeaf(int leaf);
+	int Balance(int node);
+	void Refit(int node);
+	int BuildRange(int* leaves, std::size_t count);
+
+	static Aabb Fatten(const DirectX::BoundingBox& box, float margin);
+	static Aabb Union(const Aabb& a, const Aabb& b);
+	static float Area(const Aabb& box);
+	static bool Contains(const Aabb& outer, const Aabb& inner);
+
+	std::vector<Node> mNodes;
+	int mRoot = NullNode;
+	int mFreeList = NullNode;
+	std::size_t mLeafCount = 0;
+	std::size_t mReinsertCount = 0;
+	float mMargin;
+};
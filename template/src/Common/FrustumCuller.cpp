@@ -0,0 +1,184 @@
+#include "FrustumCuller.h"
+#include <cmath>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FRUSTUM_CULLER_SSE
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// One plane with its components and their absolute values, ready to be
+	// broadcast across the lanes.
+	struct Plane
+	{
+		float Nx, Ny, Nz, D;
+		float Ax, Ay, Az;
+	};
+
+	void PreparePlanes(const XMFLOAT4 planes[6], Plane out[6])
+	{
+		for (int p = 0; p < 6; ++p)
+		{
+			out[p].Nx = planes[p].x;
+			out[p].Ny = planes[p].y;
+			out[p].Nz = planes[p].z;
+			out[p].D = planes[p].w;
+			out[p].Ax = std::fabs(planes[p].x);
+			out[p].Ay = std::fabs(planes[p].y);
+			out[p].Az = std::fabs(planes[p].z);
+		}
+	}
+}
+
+void FrustumCuller::Resize(std::size_t count)
+{
+	mCount = count;
+	const std::size_t padded = (count + Padding - 1) / Padding * Padding;
+	mCenterX.resize(padded, 0.0f);
+	mCenterY.resize(padded, 0.0f);
+	mCenterZ.resize(padded, 0.0f);
+	mExtentX.resize(padded, 0.0f);
+	mExtentY.resize(padded, 0.0f);
+	mExtentZ.resize(padded, 0.0f);
+}
+
+void FrustumCuller::SetBounds(std::size_t index, const BoundingBox& box)
+{
+	mCenterX[index] = box.Center.x;
+	mCenterY[index] = box.Center.y;
+	mCenterZ[index] = box.Center.z;
+	mExtentX[index] = box.Extents.x;
+	mExtentY[index] = box.Extents.y;
+	mExtentZ[index] = box.Extents.z;
+}
+
+void FrustumCuller::ExtractPlanes(const XMFLOAT4X4& viewProj, XMFLOAT4 planes[6])
+{
+	// A point is inside when -w <= x <= w, -w <= y <= w and 0 <= z <= w in clip
+	// space; with row vectors each clip coordinate is the point dotted with a
+	// column of the matrix.
+	const XMFLOAT4X4& m = viewProj;
+	const XMFLOAT4 col[4] = {
+		XMFLOAT4(m._11, m._21, m._31, m._41),
+		XMFLOAT4(m._12, m._22, m._32, m._42),
+		XMFLOAT4(m._13, m._23, m._33, m._43),
+		XMFLOAT4(m._14, m._24, m._34, m._44) };
+
+	auto combine = [&](const XMFLOAT4& a, const XMFLOAT4& b, float s)
+	{
+		return XMFLOAT4(a.x + s * b.x, a.y + s * b.y, a.z + s * b.z, a.w + s * b.w);
+	};
+	planes[0] = combine(col[3], col[0], 1.0f);
+	planes[1] = combine(col[3], col[0], -1.0f);
+	planes[2] = combine(col[3], col[1], 1.0f);
+	planes[3] = combine(col[3], col[1], -1.0f);
+	planes[4] = col[2];
+	planes[5] = combine(col[3], col[2], -1.0f);
+
+	for (int p = 0; p < 6; ++p)
+	{
+		XMFLOAT4& plane = planes[p];
+		float length = std::sqrt(plane.x * plane.x + plane.y * plane.y + plane.z * plane.z);
+		if (length > 0.0f)
+			plane = XMFLOAT4(plane.x / length, plane.y / length, plane.z / length, plane.w / length);
+	}
+}
+
+void FrustumCuller::Cull(const XMFLOAT4 planes[6], std::vector<std::uint32_t>& visible) const
+{
+	// A box is behind a plane when its center is farther behind it than the
+	// box reaches along the normal: dot(n, c) + d + dot(|n|, e) < 0.
+	Plane p[6];
+	PreparePlanes(planes, p);
+
+	// Indices are written to every slot and the write position only advances for
+	// visible boxes, which avoids a branch per box.
+	visible.resize(mCenterX.size());
+	std::uint32_t* out = visible.data();
+	std::size_t written = 0;
+
+#if defined(__AVX__)
+	const std::size_t lanes = 8;
+	for (std::size_t i = 0; i < mCount; i += lanes)
+	{
+		const __m256 cx = _mm256_loadu_ps(&mCenterX[i]);
+		const __m256 cy = _mm256_loadu_ps(&mCenterY[i]);
+		const __m256 cz = _mm256_loadu_ps(&mCenterZ[i]);
+		const __m256 ex = _mm256_loadu_ps(&mExtentX[i]);
+		const __m256 ey = _mm256_loadu_ps(&mExtentY[i]);
+		const __m256 ez = _mm256_loadu_ps(&mExtentZ[i]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (int k = 0; k < 6; ++k)
+		{
+			__m256 d = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(p[k].Nx), cx), _mm256_set1_ps(p[k].D));
+			d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p[k].Ny), cy));
+			d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p[k].Nz), cz));
+			d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p[k].Ax), ex));
+			d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p[k].Ay), ey));
+			d = _mm256_add_ps(d, _mm256_mul_ps(_mm256_set1_ps(p[k].Az), ez));
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(d, _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+
+		const int mask = _mm256_movemask_ps(inside);
+		for (std::size_t l = 0; l < lanes; ++l)
+		{
+			out[written] = static_cast<std::uint32_t>(i + l);
+			written += (mask >> l) & 1;
+		}
+	}
+#elif defined(FRUSTUM_CULLER_SSE)
+	const std::size_t lanes = 4;
+	for (std::size_t i = 0; i < mCount; i += lanes)
+	{
+		const __m128 cx = _mm_loadu_ps(&mCenterX[i]);
+		const __m128 cy = _mm_loadu_ps(&mCenterY[i]);
+		const __m128 cz = _mm_loadu_ps(&mCenterZ[i]);
+		const __m128 ex = _mm_loadu_ps(&mExtentX[i]);
+		const __m128 ey = _mm_loadu_ps(&mExtentY[i]);
+		const __m128 ez = _mm_loadu_ps(&mExtentZ[i]);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (int k = 0; k < 6; ++k)
+		{
+			__m128 d = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(p[k].Nx), cx), _mm_set1_ps(p[k].D));
+			d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p[k].Ny), cy));
+			d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p[k].Nz), cz));
+			d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p[k].Ax), ex));
+			d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p[k].Ay), ey));
+			d = _mm_add_ps(d, _mm_mul_ps(_mm_set1_ps(p[k].Az), ez));
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(d, _mm_setzero_ps()));
+		}
+
+		const int mask = _mm_movemask_ps(inside);
+		for (std::size_t l = 0; l < lanes; ++l)
+		{
+			out[written] = static_cast<std::uint32_t>(i + l);
+			written += (mask >> l) & 1;
+		}
+	}
+#else
+	for (std::size_t i = 0; i < mCount; ++i)
+	{
+		bool inside = true;
+		for (int k = 0; k < 6; ++k)
+		{
+			float d = p[k].Nx * mCenterX[i] + p[k].Ny * mCenterY[i] + p[k].Nz * mCenterZ[i] + p[k].D
+				+ p[k].Ax * mExtentX[i] + p[k].Ay * mExtentY[i] + p[k].Az * mExtentZ[i];
+			inside = inside && d >= 0.0f;
+		}
+		out[written] = static_cast<std::uint32_t>(i);
+		written += inside ? 1 : 0;
+	}
+#endif
+
+	// Lanes past mCount are padding and may have been counted.
+	while (written > 0 && out[written - 1] >= mCount)
+		--written;
+	visible.resize(written);
+}
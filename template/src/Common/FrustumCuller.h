@@ -0,0 +1,51 @@
+//***************************************************************************************
+// FrustumCuller.h
+//
+// Frustum culling of many axis-aligned boxes at once.  The boxes are kept as
+// separate arrays of center and extent components, so one SIMD instruction tests
+// the same plane against 4 (SSE) or 8 (AVX) boxes.  Cull writes the indices of the
+// boxes that may be visible, in increasing order.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class FrustumCuller
+{
+public:
+
+	// Box arrays are padded to a multiple of this, so the SIMD loop never needs a
+	// scalar tail.
+	static const std::size_t Padding = 8;
+
+	// Sets the number of boxes.  New boxes are empty at the origin until SetBounds.
+	void Resize(std::size_t count);
+	std::size_t Size() const { return mCount; }
+
+	void SetBounds(std::size_t index, const DirectX::BoundingBox& box);
+
+	// The six planes (left, right, bottom, top, near, far) of the frustum of a
+	// row-vector view * projection matrix with D3D clip depth [0, 1].  Normals point
+	// into the frustum and are unit length.
+	static void ExtractPlanes(const DirectX::XMFLOAT4X4& viewProj, DirectX::XMFLOAT4 planes[6]);
+
+	// Replaces visible with the indices of the boxes not entirely behind one of the
+	// planes.  Boxes near a frustum corner may pass without being visible; none that
+	// are visible are culled.
+	void Cull(const DirectX::XMFLOAT4 planes[6], std::vector<std::uint32_t>& visible) const;
+
+private:
+	std::size_t mCount = 0;
+
+	std::vector<float> mCenterX;
+	std::vector<float> mCenterY;
+	std::vector<float> mCenterZ;
+	std::vector<float> mExtentX;
+	std::vector<float> mExtentY;
+	std::vector<float> mExtentZ;
+};
@@ -656,3 +656,64 @@ GeometryGenerator::MeshData GeometryGenerator::CreateQuad(float x, float y, floa
     return meshData;
 }
 
+
+std::vector<GeometryGenerator::MeshData> GeometryGenerator::SplitForIndex16(MeshData&& meshData, uint32 maxVertices)
+{
+	std::vector<MeshData> chunks;
+
+	if(meshData.Vertices.size() <= maxVertices)
+	{
+		chunks.push_back(std::move(meshData));
+		return chunks;
+	}
+
+	// Walk the triangles in order and start a new chunk whenever the next triangle
+	// would push the current one past maxVertices.  remap[v] holds the chunk-local
+	// index of source vertex v, valid only while remapChunk[v] == current chunk.
+	const uint32 invalidChunk = 0xffffffff;
+	std::vector<uint32> remap(meshData.Vertices.size());
+	std::vector<uint32> remapChunk(meshData.Vertices.size(), invalidChunk);
+
+	auto startChunk = [&]()
+	{
+		chunks.emplace_back();
+		chunks.back().matName = meshData.matName;
+		chunks.back().texfile = meshData.texfile;
+	};
+	startChunk();
+
+	for(size_t t = 0; t + 2 < meshData.Indices32.size(); t += 3)
+	{
+		uint32 chunkId = (uint32)chunks.size() - 1;
+
+		uint32 newVertices = 0;
+		for(size_t k = 0; k < 3; ++k)
+		{
+			uint32 v = meshData.Indices32[t + k];
+			if(remapChunk[v] != chunkId)
+				++newVertices;
+		}
+		// Shared corners of a degenerate triangle are counted twice here; that only
+		// makes the split slightly conservative.
+		if(chunks.back().Vertices.size() + newVertices > maxVertices)
+		{
+			startChunk();
+			chunkId = (uint32)chunks.size() - 1;
+		}
+
+		MeshData& chunk = chunks.back();
+		for(size_t k = 0; k < 3; ++k)
+		{
+			uint32 v = meshData.Indices32[t + k];
+			if(remapChunk[v] != chunkId)
+			{
+				remapChunk[v] = chunkId;
+				remap[v] = (uint32)chunk.Vertices.size();
+				chunk.Vertices.push_back(meshData.Vertices[v]);
+			}
+			chunk.Indices32.push_back(remap[v]);
+		}
+	}
+
+	return chunks;
+}
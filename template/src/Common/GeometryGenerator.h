@@ -60,12 +60,38 @@ public:
 		std::string normFile;
 		std::string diffFile;
 	};
+	// A simplified index list over the same vertices as its MeshData.  Error is the
+	// largest object space distance the simplification moved the surface by.
+	struct MeshLod
+	{
+		std::vector<uint32> Indices32;
+		float Error = 0.0f;
+	};
+
+	// A cluster of triangles that is culled as a unit: a contiguous run of the
+	// MeshData's Indices32, the bounding sphere of its vertices, and a cone around
+	// the triangle normals.  The cluster faces away from every viewer inside the
+	// cone, see MeshletBuilder.
+	struct Meshlet
+	{
+		uint32 FirstIndex = 0;
+		uint32 IndexCount = 0;
+		DirectX::XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+		float Radius = 0.0f;
+		DirectX::XMFLOAT3 ConeAxis = { 0.0f, 0.0f, 1.0f };
+		float ConeCutoff = 1.0f;
+	};
+
 	struct MeshData
 	{
 		std::vector<Vertex> Vertices;
         std::vector<uint32> Indices32;
 		std::string matName;
 		std::string texfile;
+		// Coarser versions of Indices32, finest first.  Empty if none were built.
+		std::vector<MeshLod> Lods;
+		// Clusters covering Indices32 in order.  Empty if none were built.
+		std::vector<Meshlet> Meshlets;
         std::vector<uint16>& GetIndices16()
         {
 			if(mIndices16.empty())
@@ -121,6 +147,15 @@ public:
 
 	std::vector<GeometryGenerator::MeshData> LoadCustomMesh(const std::string& filename, unsigned int& nMeshes);
 
+	///<summary>
+	/// Splits a mesh whose vertices cannot all be addressed with 16-bit indices into
+	/// chunks of at most maxVertices vertices each.  Every chunk carries its own copy
+	/// of the vertices it references and chunk-local indices, so it can be drawn from
+	/// a 16-bit index buffer with its own BaseVertexLocation.  Meshes that already fit
+	/// are returned unchanged as a single chunk.
+	///</summary>
+	std::vector<MeshData> SplitForIndex16(MeshData&& meshData, uint32 maxVertices = 65536);
+
 private:
 	void Subdivide(MeshData& meshData);
     Vertex MidPoint(const Vertex& v0, const Vertex& v1);
@@ -0,0 +1,123 @@
+#include "JobSystem.h"
+#include <algorithm>
+
+JobSystem::JobSystem(unsigned int threadCount)
+{
+	if (threadCount == 0)
+	{
+		unsigned int hw = std::thread::hardware_concurrency();
+		threadCount = hw > 1 ? hw - 1 : 1;
+	}
+
+	mWorkers.reserve(threadCount);
+	for (unsigned int i = 0; i < threadCount; ++i)
+		mWorkers.emplace_back(&JobSystem::WorkerLoop, this);
+}
+
+JobSystem::~JobSystem()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWake.notify_all();
+
+	for (auto& worker : mWorkers)
+		worker.join();
+}
+
+void JobSystem::Enqueue(std::function<void()> job)
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQueue.push_back(std::move(job));
+	}
+	mWake.notify_one();
+}
+
+void JobSystem::WorkerLoop()
+{
+	for (;;)
+	{
+		std::function<void()> job;
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this]() { return mStopping || !mQueue.empty(); });
+			if (mStopping && mQueue.empty())
+				return;
+			job = std::move(mQueue.front());
+			mQueue.pop_front();
+		}
+		job();
+	}
+}
+
+void JobSystem::ParallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& fn)
+{
+	if (count == 0)
+		return;
+	grain = std::max<std::size_t>(grain, 1);
+
+	const std::size_t chunkCount = (count + grain - 1) / grain;
+	if (chunkCount == 1 || mWorkers.empty())
+	{
+		fn(0, count);
+		return;
+	}
+
+	// Shared with the helper jobs, which may still be sitting in the queue after the
+	// caller has returned; they find no chunks left and exit without touching fn.
+	struct State
+	{
+		std::atomic<std::size_t> NextChunk{ 0 };
+		std::atomic<std::size_t> DoneChunks{ 0 };
+		std::mutex Mutex;
+		std::condition_variable AllDone;
+		std::exception_ptr Error;
+	};
+	auto state = std::make_shared<State>();
+	const auto* body = &fn;
+
+	auto runChunks = [state, body, count, grain, chunkCount]()
+	{
+		for (;;)
+		{
+			std::size_t chunk = state->NextChunk.fetch_add(1);
+			if (chunk >= chunkCount)
+				return;
+
+			std::size_t begin = chunk * grain;
+			std::size_t end = std::min(begin + grain, count);
+			try
+			{
+				(*body)(begin, end);
+			}
+			catch (...)
+			{
+				std::lock_guard<std::mutex> lock(state->Mutex);
+				if (!state->Error)
+					state->Error = std::current_exception();
+			}
+
+			if (state->DoneChunks.fetch_add(1) + 1 == chunkCount)
+			{
+				std::lock_guard<std::mutex> lock(state->Mutex);
+				state->AllDone.notify_all();
+			}
+		}
+	};
+
+	const std::size_t helpers = std::min<std::size_t>(mWorkers.size(), chunkCount - 1);
+	for (std::size_t i = 0; i < helpers; ++i)
+		Enqueue(runChunks);
+
+	runChunks();
+
+	{
+		std::unique_lock<std::mutex> lock(state->Mutex);
+		state->AllDone.wait(lock, [&]() { return state->DoneChunks.load() == chunkCount; });
+	}
+
+	if (state->Error)
+		std::rethrow_exception(state->Error);
+}
@@ -0,0 +1,60 @@
+//***************************************************************************************
+// JobSystem.h
+//
+// Small fixed-size worker pool.  Submit() runs a single task asynchronously and hands
+// back a future; ParallelFor() splits an index range into chunks, runs them on the
+// workers and on the calling thread, and returns once every chunk has finished.
+// Because the caller always helps, ParallelFor may be called from inside a job.
+//***************************************************************************************
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+class JobSystem
+{
+public:
+	// threadCount == 0 uses one worker per hardware thread, minus the caller.
+	explicit JobSystem(unsigned int threadCount = 0);
+	JobSystem(const JobSystem& rhs) = delete;
+	JobSystem& operator=(const JobSystem& rhs) = delete;
+	~JobSystem();
+
+	unsigned int WorkerCount()const { return (unsigned int)mWorkers.size(); }
+
+	template<typename F>
+	auto Submit(F&& f) -> std::future<std::invoke_result_t<std::decay_t<F>>>
+	{
+		using R = std::invoke_result_t<std::decay_t<F>>;
+		auto task = std::make_shared<std::packaged_task<R()>>(std::forward<F>(f));
+		std::future<R> result = task->get_future();
+		Enqueue([task]() { (*task)(); });
+		return result;
+	}
+
+	// Calls fn(begin, end) for consecutive sub-ranges of [0, count) of at most grain
+	// elements each.  Blocks until all ranges are done and rethrows the first
+	// exception thrown by fn, if any.
+	void ParallelFor(std::size_t count, std::size_t grain, const std::function<void(std::size_t, std::size_t)>& fn);
+
+private:
+	void Enqueue(std::function<void()> job);
+	void WorkerLoop();
+
+	std::vector<std::thread> mWorkers;
+	std::deque<std::function<void()>> mQueue;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	bool mStopping = false;
+};
@@ -0,0 +1,83 @@
+#include "LinearAllocator.h"
+#include <cassert>
+
+LinearAllocator::LinearAllocator(UploadPageSource& source, std::uint64_t pageSize)
+	: mSource(source), mPageSize(pageSize)
+{
+}
+
+LinearAllocator::~LinearAllocator()
+{
+	for (const UploadPage& page : mFramePages)
+		mSource.DestroyPage(page);
+	for (const UploadPage& page : mDedicatedPages)
+		mSource.DestroyPage(page);
+	for (const RetiredPage& retired : mRetiredPages)
+		mSource.DestroyPage(retired.Page);
+	for (const UploadPage& page : mFreePages)
+		mSource.DestroyPage(page);
+}
+
+LinearAllocator::Allocation LinearAllocator::Allocate(std::uint64_t size, std::uint64_t alignment)
+{
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+	if (size == 0)
+		return {};
+	mFrameBytes += size;
+
+	// Too big to share a page; the current page keeps its remaining space.
+	if (size > mPageSize)
+	{
+		mDedicatedPages.push_back(mSource.CreatePage(size));
+		++mPageCount;
+		return { mDedicatedPages.back().CpuAddress, mDedicatedPages.back().GpuAddress };
+	}
+
+	std::uint64_t offset = (mOffset + alignment - 1) & ~(alignment - 1);
+	if (mFramePages.empty() || offset + size > mPageSize)
+	{
+		if (!mFreePages.empty())
+		{
+			mFramePages.push_back(mFreePages.back());
+			mFreePages.pop_back();
+		}
+		else
+		{
+			mFramePages.push_back(mSource.CreatePage(mPageSize));
+			++mPageCount;
+		}
+		offset = 0;
+	}
+
+	const UploadPage& page = mFramePages.back();
+	mOffset = offset + size;
+	return { page.CpuAddress + offset, page.GpuAddress + offset };
+}
+
+void LinearAllocator::FinishFrame(std::uint64_t fence)
+{
+	for (const UploadPage& page : mFramePages)
+		mRetiredPages.push_back({ fence, page, false });
+	for (const UploadPage& page : mDedicatedPages)
+		mRetiredPages.push_back({ fence, page, true });
+	mFramePages.clear();
+	mDedicatedPages.clear();
+	mOffset = 0;
+	mFrameBytes = 0;
+}
+
+void LinearAllocator::Recycle(std::uint64_t completedFence)
+{
+	while (!mRetiredPages.empty() && mRetiredPages.front().Fence <= completedFence)
+	{
+		const RetiredPage& retired = mRetiredPages.front();
+		if (retired.Dedicated)
+		{
+			mSource.DestroyPage(retired.Page);
+			--mPageCount;
+		}
+		else
+			mFreePages.push_back(retired.Page);
+		mRetiredPages.pop_front();
+	}
+}
@@ -0,0 +1,98 @@
+//***************************************************************************************
+// LinearAllocator.h
+//
+// Per-frame linear suballocation of memory the CPU writes and the GPU reads, such as
+// constant and structured buffer data.  Memory comes in persistently mapped pages
+// from an UploadPageSource.  Allocate bumps an offset in the current page and moves
+// to another page when it is full.  FinishFrame tags the pages used since the last
+// call with the frame's fence value and Recycle returns the pages of completed
+// frames to the free list, so the amount of data can change from frame to frame
+// without creating buffers or waiting on the GPU once the pool covers the working
+// set.  A request larger than a page gets a page of its own, released once its
+// frame completes.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+struct UploadPage
+{
+	std::uint8_t* CpuAddress = nullptr;
+	std::uint64_t GpuAddress = 0;
+	std::uint64_t Size = 0;
+	// Owned by the page source.
+	void* Resource = nullptr;
+};
+
+// Creates and releases mapped pages for a LinearAllocator.
+class UploadPageSource
+{
+public:
+	virtual ~UploadPageSource() = default;
+
+	virtual UploadPage CreatePage(std::uint64_t size) = 0;
+	virtual void DestroyPage(const UploadPage& page) = 0;
+};
+
+class LinearAllocator
+{
+public:
+
+	static const std::uint64_t DefaultPageSize = 1 << 20;
+
+	// Constant buffer views must start at a multiple of this.
+	static const std::uint64_t ConstantBufferAlignment = 256;
+
+	struct Allocation
+	{
+		std::uint8_t* CpuAddress = nullptr;
+		std::uint64_t GpuAddress = 0;
+	};
+
+	explicit LinearAllocator(UploadPageSource& source, std::uint64_t pageSize = DefaultPageSize);
+	LinearAllocator(const LinearAllocator& rhs) = delete;
+	LinearAllocator& operator=(const LinearAllocator& rhs) = delete;
+	// Releases every page; the GPU must be done with all of them.
+	~LinearAllocator();
+
+	// alignment must be a power of two.  The memory stays valid until the frame it
+	// was allocated in has been finished and recycled.
+	Allocation Allocate(std::uint64_t size, std::uint64_t alignment = ConstantBufferAlignment);
+
+	// Ends the current frame: its pages are in use until the GPU reaches fence.
+	void FinishFrame(std::uint64_t fence);
+
+	// Makes the pages of every frame finished with a fence up to completedFence
+	// available again.
+	void Recycle(std::uint64_t completedFence);
+
+	// Pages currently held, in use or free, and the bytes allocated this frame.
+	std::size_t PageCount() const { return mPageCount; }
+	std::uint64_t FrameBytes() const { return mFrameBytes; }
+
+private:
+	struct RetiredPage
+	{
+		std::uint64_t Fence;
+		UploadPage Page;
+		// Made for one large request; released instead of reused.
+		bool Dedicated;
+	};
+
+	UploadPageSource& mSource;
+	std::uint64_t mPageSize;
+
+	// Pages used this frame; allocations are made from the last one at mOffset.
+	std::vector<UploadPage> mFramePages;
+	std::vector<UploadPage> mDedicatedPages;
+	std::uint64_t mOffset = 0;
+
+	std::deque<RetiredPage> mRetiredPages;
+	std::vector<UploadPage> mFreePages;
+	std::size_t mPageCount = 0;
+	std::uint64_t mFrameBytes = 0;
+};
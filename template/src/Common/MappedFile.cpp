@@ -0,0 +1,166 @@
+#include "MappedFile.h"
+
+#if defined(_WIN32)
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& filename)
+{
+	Open(filename);
+}
+
+MappedFile::MappedFile(MappedFile&& rhs) noexcept
+{
+	MoveFrom(rhs);
+}
+
+MappedFile& MappedFile::operator=(MappedFile&& rhs) noexcept
+{
+	if (this != &rhs)
+	{
+		Close();
+		MoveFrom(rhs);
+	}
+	return *this;
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+void MappedFile::MoveFrom(MappedFile& rhs)
+{
+	mData = rhs.mData;
+	mSize = rhs.mSize;
+	mIsOpen = rhs.mIsOpen;
+#if defined(_WIN32)
+	mFile = rhs.mFile;
+	mMapping = rhs.mMapping;
+	rhs.mFile = nullptr;
+	rhs.mMapping = nullptr;
+#else
+	mFd = rhs.mFd;
+	rhs.mFd = -1;
+#endif
+	rhs.mData = nullptr;
+	rhs.mSize = 0;
+	rhs.mIsOpen = false;
+}
+
+#if defined(_WIN32)
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size))
+	{
+		CloseHandle(file);
+		return false;
+	}
+
+	mFile = file;
+	mSize = static_cast<std::size_t>(size.QuadPart);
+	mIsOpen = true;
+
+	// Zero-length files cannot be mapped; treat them as open and empty.
+	if (mSize == 0)
+		return true;
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr)
+	{
+		Close();
+		return false;
+	}
+	mMapping = mapping;
+
+	mData = static_cast<const std::uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr)
+	{
+		Close();
+		return false;
+	}
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+		UnmapViewOfFile(mData);
+	if (mMapping != nullptr)
+		CloseHandle(static_cast<HANDLE>(mMapping));
+	if (mFile != nullptr)
+		CloseHandle(static_cast<HANDLE>(mFile));
+
+	mData = nullptr;
+	mMapping = nullptr;
+	mFile = nullptr;
+	mSize = 0;
+	mIsOpen = false;
+}
+
+#else
+
+bool MappedFile::Open(const std::string& filename)
+{
+	Close();
+
+	int fd = ::open(filename.c_str(), O_RDONLY);
+	if (fd < 0)
+		return false;
+
+	struct stat st;
+	if (::fstat(fd, &st) != 0)
+	{
+		::close(fd);
+		return false;
+	}
+
+	mFd = fd;
+	mSize = static_cast<std::size_t>(st.st_size);
+	mIsOpen = true;
+
+	if (mSize == 0)
+		return true;
+
+	void* view = ::mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (view == MAP_FAILED)
+	{
+		Close();
+		return false;
+	}
+	::madvise(view, mSize, MADV_SEQUENTIAL);
+	mData = static_cast<const std::uint8_t*>(view);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+		::munmap(const_cast<std::uint8_t*>(mData), mSize);
+	if (mFd >= 0)
+		::close(mFd);
+
+	mData = nullptr;
+	mFd = -1;
+	mSize = 0;
+	mIsOpen = false;
+}
+
+#endif
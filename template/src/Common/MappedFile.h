@@ -0,0 +1,47 @@
+//***************************************************************************************
+// MappedFile.h
+//
+// Read-only memory mapping of a whole file.  The mapped view stays valid for the
+// lifetime of the object, so callers can parse straight out of it without an
+// intermediate copy.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+class MappedFile
+{
+public:
+	MappedFile() = default;
+	explicit MappedFile(const std::string& filename);
+	MappedFile(const MappedFile& rhs) = delete;
+	MappedFile& operator=(const MappedFile& rhs) = delete;
+	MappedFile(MappedFile&& rhs) noexcept;
+	MappedFile& operator=(MappedFile&& rhs) noexcept;
+	~MappedFile();
+
+	// Returns false if the file does not exist or could not be mapped.
+	bool Open(const std::string& filename);
+	void Close();
+
+	bool IsOpen()const { return mIsOpen; }
+	const std::uint8_t* Data()const { return mData; }
+	std::size_t Size()const { return mSize; }
+
+private:
+	void MoveFrom(MappedFile& rhs);
+
+	const std::uint8_t* mData = nullptr;
+	std::size_t mSize = 0;
+	bool mIsOpen = false;
+
+#if defined(_WIN32)
+	void* mFile = nullptr;
+	void* mMapping = nullptr;
+#else
+	int mFd = -1;
+#endif
+};
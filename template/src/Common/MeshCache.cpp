@@ -0,0 +1,567 @@
+#include "MeshCache.h"
+#include "MappedFile.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t CookedMagic = 0x48534D43; // "CMSH"
+
+	// All cooked structures are plain 32/64-bit fields so the file can be read on
+	// any little-endian platform regardless of compiler packing.
+	struct CookedHeader
+	{
+		std::uint32_t Magic;
+		std::uint32_t Version;
+		std::uint64_t SourceHash;
+		std::uint32_t ImportFlags;
+		std::uint32_t VertexStride;
+		std::uint32_t MeshCount;
+		std::uint32_t MaterialCount;
+		std::uint64_t VertexCount;
+		std::uint64_t IndexCount;
+		std::uint64_t StringBytes;
+		std::uint64_t LodCount;
+		std::uint64_t MeshletCount;
+	};
+
+	struct CookedString
+	{
+		std::uint32_t Offset;
+		std::uint32_t Length;
+	};
+
+	struct CookedSubmesh
+	{
+		std::uint64_t FirstVertex;
+		std::uint64_t FirstIndex;
+		std::uint32_t VertexCount;
+		std::uint32_t IndexCount;
+		CookedString MatName;
+		CookedString TexFile;
+		std::uint32_t FirstLod;
+		std::uint32_t LodCount;
+		std::uint32_t FirstMeshlet;
+		std::uint32_t MeshletCount;
+	};
+
+	// LOD indices live in the index block after the base indices of all submeshes.
+	struct CookedLod
+	{
+		std::uint64_t FirstIndex;
+		std::uint32_t IndexCount;
+		float Error;
+	};
+
+	// FirstIndex is relative to the submesh's base indices, as in MeshData.
+	struct CookedMeshlet
+	{
+		std::uint32_t FirstIndex;
+		std::uint32_t IndexCount;
+		float Center[3];
+		float Radius;
+		float ConeAxis[3];
+		float ConeCutoff;
+	};
+
+	struct CookedMaterial
+	{
+		CookedString Name;
+		CookedString DiffFile;
+		CookedString NormFile;
+	};
+
+	static_assert(sizeof(GeometryGenerator::Vertex) == 44, "cooked vertex layout changed, bump MeshCache::Version");
+
+	CookedString AppendString(std::string& table, const std::string& s)
+	{
+		CookedString cs;
+		cs.Offset = static_cast<std::uint32_t>(table.size());
+		cs.Length = static_cast<std::uint32_t>(s.size());
+		table += s;
+		return cs;
+	}
+
+	const std::uint64_t FnvOffsetBasis = 14695981039346656037ull;
+
+	std::uint64_t Fnv1a(std::uint64_t h, const std::uint8_t* p, std::size_t size)
+	{
+		for (std::size_t i = 0; i < size; ++i)
+		{
+			h ^= p[i];
+			h *= 1099511628211ull;
+		}
+		return h;
+	}
+
+	// Names given by the mtllib lines of an OBJ.  As in Assimp's OBJ reader the rest
+	// of the line is one name, so names may contain spaces.
+	std::vector<std::string> MaterialLibraries(const MappedFile& obj)
+	{
+		std::vector<std::string> names;
+		const char* p = reinterpret_cast<const char*>(obj.Data());
+		const char* end = p + obj.Size();
+		while (p < end)
+		{
+			const char* lineEnd = static_cast<const char*>(std::memchr(p, '\n', end - p));
+			if (!lineEnd)
+				lineEnd = end;
+			const char* q = p;
+			while (q < lineEnd && (*q == ' ' || *q == '\t'))
+				++q;
+			if (lineEnd - q > 7 && std::memcmp(q, "mtllib", 6) == 0 && (q[6] == ' ' || q[6] == '\t'))
+			{
+				q += 7;
+				const char* last = lineEnd;
+				while (q < last && (*q == ' ' || *q == '\t'))
+					++q;
+				while (last > q && (last[-1] == ' ' || last[-1] == '\t' || last[-1] == '\r'))
+					--last;
+				if (q < last)
+					names.emplace_back(q, last);
+			}
+			p = lineEnd + 1;
+		}
+		return names;
+	}
+
+	bool ReadString(const char* table, std::uint64_t tableSize, const CookedString& cs, std::string& out)
+	{
+		if (std::uint64_t(cs.Offset) + cs.Length > tableSize)
+			return false;
+		out.assign(table + cs.Offset, cs.Length);
+		return true;
+	}
+}
+
+std::string MeshCache::CookedPathFor(const std::string& sourcePath)
+{
+	std::filesystem::path p(sourcePath);
+	p.replace_extension(".cmesh");
+	return p.string();
+}
+
+bool MeshCache::HashFile(const std::string& filename, std::uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+		return false;
+
+	hash = Fnv1a(FnvOffsetBasis, file.Data(), file.Size());
+	return true;
+}
+
+bool MeshCache::SourceHash(const std::string& sourcePath, std::uint64_t& hash)
+{
+	MappedFile file;
+	if (!file.Open(sourcePath))
+		return false;
+
+	std::uint64_t h = Fnv1a(FnvOffsetBasis, file.Data(), file.Size());
+	const std::filesystem::path dir = std::filesystem::path(sourcePath).parent_path();
+	for (const std::string& name : MaterialLibraries(file))
+	{
+		// Each library adds its name and its own hash, or a marker if it is missing.
+		std::uint64_t libraryHash = 0;
+		if (!HashFile((dir / name).string(), libraryHash))
+			libraryHash = ~0ull;
+		h = Fnv1a(h, reinterpret_cast<const std::uint8_t*>(name.data()), name.size());
+		h = Fnv1a(h, reinterpret_cast<const std::uint8_t*>(&libraryHash), sizeof(libraryHash));
+	}
+	hash = h;
+	return true;
+}
+
+bool MeshCache::LoadOrImport(const std::string& sourcePath, unsigned int importFlags, ImportedMesh& out)
+{
+	const std::string cookedPath = CookedPathFor(sourcePath);
+
+	std::uint64_t sourceHash = 0;
+	bool haveSource = SourceHash(sourcePath, sourceHash);
+
+	if (haveSource && LoadCooked(cookedPath, sourceHash, importFlags, out))
+	{
+		std::cout << "MeshCache: loaded " << cookedPath << "\n";
+		return true;
+	}
+
+	if (!haveSource)
+	{
+		std::cerr << "MeshCache: cannot read " << sourcePath << std::endl;
+		return false;
+	}
+
+	if (!Import(sourcePath, importFlags, out))
+		return false;
+
+	if (!SaveCooked(cookedPath, sourceHash, importFlags, out))
+		std::cerr << "MeshCache: failed to write " << cookedPath << std::endl;
+	else
+		std::cout << "MeshCache: cooked " << cookedPath << "\n";
+
+	return true;
+}
+
+bool MeshCache::Import(const std::string& sourcePath, unsigned int importFlags, ImportedMesh& out)
+{
+	Assimp::Importer importer;
+	const aiScene* scene = importer.ReadFile(sourcePath, importFlags);
+	if (!scene || !scene->mRootNode)
+	{
+		std::cerr << "Assimp error: " << importer.GetErrorString() << std::endl;
+		return false;
+	}
+
+	out.Meshes.clear();
+	out.Materials.clear();
+	out.Meshes.resize(scene->mNumMeshes);
+
+	for (unsigned int m = 0; m < scene->mNumMeshes; ++m)
+	{
+		const aiMesh* mesh = scene->mMeshes[m];
+		GeometryGenerator::MeshData& meshData = out.Meshes[m];
+
+		meshData.Vertices.resize(mesh->mNumVertices);
+		for (unsigned int i = 0; i < mesh->mNumVertices; ++i)
+		{
+			GeometryGenerator::Vertex& v = meshData.Vertices[i];
+
+			v.Position = XMFLOAT3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+
+			if (mesh->HasNormals())
+				v.Normal = XMFLOAT3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+			else
+				v.Normal = XMFLOAT3(0.0f, 0.0f, 0.0f);
+
+			if (mesh->HasTextureCoords(0))
+				v.TexC = XMFLOAT2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+			else
+				v.TexC = XMFLOAT2(0.0f, 0.0f);
+
+			if (mesh->HasTangentsAndBitangents())
+				v.TangentU = XMFLOAT3(mesh->mTangents[i].x, mesh->mTangents[i].y, mesh->mTangents[i].z);
+			else
+				v.TangentU = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		}
+
+		meshData.Indices32.reserve(mesh->mNumFaces * 3);
+		for (unsigned int i = 0; i < mesh->mNumFaces; ++i)
+		{
+			const aiFace& face = mesh->mFaces[i];
+			// Points and lines survive triangulation; skip them.
+			if (face.mNumIndices != 3) continue;
+			meshData.Indices32.push_back(face.mIndices[0]);
+			meshData.Indices32.push_back(face.mIndices[1]);
+			meshData.Indices32.push_back(face.mIndices[2]);
+		}
+
+		meshData.matName = scene->mMaterials[mesh->mMaterialIndex]->GetName().C_Str();
+	}
+
+	// The report is built up and printed in one go because several imports may be
+	// running at once.
+	std::ostringstream report;
+	report << std::fixed << std::setprecision(3);
+
+	// The renderer draws everything from one 16-bit index buffer, so meshes with more
+	// vertices than a 16-bit index can address are split into chunks first.  Each
+	// chunk becomes its own submesh.
+	GeometryGenerator geoGen;
+	std::vector<GeometryGenerator::MeshData> chunks;
+	for (auto& meshData : out.Meshes)
+	{
+		std::size_t vertexCount = meshData.Vertices.size();
+		std::vector<GeometryGenerator::MeshData> meshChunks = geoGen.SplitForIndex16(std::move(meshData));
+		if (meshChunks.size() > 1)
+			report << "MeshCache: " << sourcePath << " split " << vertexCount << " vertices into " << meshChunks.size() << " chunks\n";
+		for (auto& chunk : meshChunks)
+			chunks.push_back(std::move(chunk));
+	}
+	out.Meshes = std::move(chunks);
+
+	// Assimp keeps the file's face order, which is poor for both the post-transform
+	// cache and overdraw.  Clustering then regroups the optimized triangles, keeping
+	// their order inside each cluster.  LODs are built from the optimized mesh and
+	// get their own vertex cache pass.
+	for (std::size_t m = 0; m < out.Meshes.size(); ++m)
+	{
+		GeometryGenerator::MeshData& meshData = out.Meshes[m];
+		MeshOptimizer::Report r = MeshOptimizer::Optimize(meshData);
+		report << "MeshOptimizer: " << sourcePath << " [" << m << "] " << meshData.matName
+			<< " ACMR " << r.Before.Acmr << " -> " << r.After.Acmr
+			<< ", ATVR " << r.Before.Atvr << " -> " << r.After.Atvr;
+
+		MeshletBuilder::Build(meshData);
+		report << ", " << meshData.Meshlets.size() << " clusters";
+
+		MeshSimplifier::BuildLods(meshData);
+		report << ", LOD triangles " << meshData.Indices32.size() / 3;
+		for (auto& lod : meshData.Lods)
+		{
+			MeshOptimizer::OptimizeVertexCache(lod.Indices32, meshData.Vertices.size());
+			report << " / " << lod.Indices32.size() / 3;
+		}
+		report << "\n";
+	}
+	std::cout << report.str();
+
+	out.Materials.resize(scene->mNumMaterials);
+	for (unsigned int k = 0; k < scene->mNumMaterials; ++k)
+	{
+		const aiMaterial* mat = scene->mMaterials[k];
+		GeometryGenerator::Material& material = out.Materials[k];
+		material.name = mat->GetName().C_Str();
+
+		aiString texPath;
+		if (mat->GetTexture(aiTextureType_DIFFUSE, 0, &texPath) == AI_SUCCESS)
+			material.diffFile = texPath.C_Str();
+		// The OBJ files reference their normal maps through disp.  Materials without
+		// one fall back to the diffuse map, as the loader always did.
+		if (mat->GetTexture(aiTextureType_DISPLACEMENT, 0, &texPath) == AI_SUCCESS)
+			material.normFile = texPath.C_Str();
+		else
+			material.normFile = material.diffFile;
+	}
+
+	return true;
+}
+
+bool MeshCache::LoadCooked(const std::string& cookedPath, std::uint64_t sourceHash, unsigned int importFlags, ImportedMesh& out)
+{
+	MappedFile file;
+	if (!file.Open(cookedPath) || file.Size() < sizeof(CookedHeader))
+		return false;
+
+	const std::uint8_t* base = file.Data();
+	const std::uint64_t fileSize = file.Size();
+
+	CookedHeader header;
+	std::memcpy(&header, base, sizeof(header));
+	if (header.Magic != CookedMagic ||
+		header.Version != Version ||
+		header.SourceHash != sourceHash ||
+		header.ImportFlags != importFlags ||
+		header.VertexStride != sizeof(GeometryGenerator::Vertex))
+		return false;
+
+	const std::uint64_t submeshOffset = sizeof(CookedHeader);
+	const std::uint64_t lodOffset = submeshOffset + std::uint64_t(header.MeshCount) * sizeof(CookedSubmesh);
+	const std::uint64_t meshletOffset = lodOffset + header.LodCount * sizeof(CookedLod);
+	const std::uint64_t materialOffset = meshletOffset + header.MeshletCount * sizeof(CookedMeshlet);
+	const std::uint64_t vertexOffset = materialOffset + std::uint64_t(header.MaterialCount) * sizeof(CookedMaterial);
+	const std::uint64_t indexOffset = vertexOffset + header.VertexCount * sizeof(GeometryGenerator::Vertex);
+	const std::uint64_t stringOffset = indexOffset + header.IndexCount * sizeof(std::uint32_t);
+	if (stringOffset + header.StringBytes != fileSize)
+		return false;
+
+	const auto* submeshes = base + submeshOffset;
+	const auto* lods = base + lodOffset;
+	const auto* meshlets = base + meshletOffset;
+	const auto* materials = base + materialOffset;
+	const auto* vertices = base + vertexOffset;
+	const auto* indices = base + indexOffset;
+	const char* strings = reinterpret_cast<const char*>(base + stringOffset);
+
+	ImportedMesh result;
+	result.Meshes.resize(header.MeshCount);
+	for (std::uint32_t m = 0; m < header.MeshCount; ++m)
+	{
+		CookedSubmesh sm;
+		std::memcpy(&sm, submeshes + m * sizeof(CookedSubmesh), sizeof(sm));
+		if (sm.FirstVertex + sm.VertexCount > header.VertexCount ||
+			sm.FirstIndex + sm.IndexCount > header.IndexCount)
+			return false;
+
+		GeometryGenerator::MeshData& meshData = result.Meshes[m];
+		meshData.Vertices.resize(sm.VertexCount);
+		meshData.Indices32.resize(sm.IndexCount);
+		if (sm.VertexCount > 0)
+			std::memcpy(meshData.Vertices.data(), vertices + sm.FirstVertex * sizeof(GeometryGenerator::Vertex),
+				sm.VertexCount * sizeof(GeometryGenerator::Vertex));
+		if (sm.IndexCount > 0)
+			std::memcpy(meshData.Indices32.data(), indices + sm.FirstIndex * sizeof(std::uint32_t),
+				sm.IndexCount * sizeof(std::uint32_t));
+
+		if (!ReadString(strings, header.StringBytes, sm.MatName, meshData.matName) ||
+			!ReadString(strings, header.StringBytes, sm.TexFile, meshData.texfile))
+			return false;
+
+		if (std::uint64_t(sm.FirstLod) + sm.LodCount > header.LodCount)
+			return false;
+		meshData.Lods.resize(sm.LodCount);
+		for (std::uint32_t l = 0; l < sm.LodCount; ++l)
+		{
+			CookedLod cl;
+			std::memcpy(&cl, lods + (sm.FirstLod + l) * sizeof(CookedLod), sizeof(cl));
+			if (cl.FirstIndex + cl.IndexCount > header.IndexCount)
+				return false;
+
+			GeometryGenerator::MeshLod& lod = meshData.Lods[l];
+			lod.Error = cl.Error;
+			lod.Indices32.resize(cl.IndexCount);
+			if (cl.IndexCount > 0)
+				std::memcpy(lod.Indices32.data(), indices + cl.FirstIndex * sizeof(std::uint32_t),
+					cl.IndexCount * sizeof(std::uint32_t));
+		}
+
+		if (std::uint64_t(sm.FirstMeshlet) + sm.MeshletCount > header.MeshletCount)
+			return false;
+		meshData.Meshlets.resize(sm.MeshletCount);
+		for (std::uint32_t c = 0; c < sm.MeshletCount; ++c)
+		{
+			CookedMeshlet cm;
+			std::memcpy(&cm, meshlets + (sm.FirstMeshlet + c) * sizeof(CookedMeshlet), sizeof(cm));
+			if (std::uint64_t(cm.FirstIndex) + cm.IndexCount > sm.IndexCount)
+				return false;
+
+			GeometryGenerator::Meshlet& meshlet = meshData.Meshlets[c];
+			meshlet.FirstIndex = cm.FirstIndex;
+			meshlet.IndexCount = cm.IndexCount;
+			meshlet.Center = XMFLOAT3(cm.Center[0], cm.Center[1], cm.Center[2]);
+			meshlet.Radius = cm.Radius;
+			meshlet.ConeAxis = XMFLOAT3(cm.ConeAxis[0], cm.ConeAxis[1], cm.ConeAxis[2]);
+			meshlet.ConeCutoff = cm.ConeCutoff;
+		}
+	}
+
+	result.Materials.resize(header.MaterialCount);
+	for (std::uint32_t k = 0; k < header.MaterialCount; ++k)
+	{
+		CookedMaterial cm;
+		std::memcpy(&cm, materials + k * sizeof(CookedMaterial), sizeof(cm));
+		GeometryGenerator::Material& material = result.Materials[k];
+		if (!ReadString(strings, header.StringBytes, cm.Name, material.name) ||
+			!ReadString(strings, header.StringBytes, cm.DiffFile, material.diffFile) ||
+			!ReadString(strings, header.StringBytes, cm.NormFile, material.normFile))
+			return false;
+	}
+
+	out = std::move(result);
+	return true;
+}
+
+bool MeshCache::SaveCooked(const std::string& cookedPath, std::uint64_t sourceHash, unsigned int importFlags, const ImportedMesh& mesh)
+{
+	std::vector<CookedSubmesh> submeshes(mesh.Meshes.size());
+	std::vector<CookedLod> lods;
+	std::vector<CookedMeshlet> meshlets;
+	std::vector<CookedMaterial> materials(mesh.Materials.size());
+	std::string strings;
+
+	std::uint64_t vertexCount = 0;
+	std::uint64_t indexCount = 0;
+	for (size_t m = 0; m < mesh.Meshes.size(); ++m)
+	{
+		const GeometryGenerator::MeshData& meshData = mesh.Meshes[m];
+		CookedSubmesh& sm = submeshes[m];
+		sm.FirstVertex = vertexCount;
+		sm.FirstIndex = indexCount;
+		sm.VertexCount = static_cast<std::uint32_t>(meshData.Vertices.size());
+		sm.IndexCount = static_cast<std::uint32_t>(meshData.Indices32.size());
+		sm.MatName = AppendString(strings, meshData.matName);
+		sm.TexFile = AppendString(strings, meshData.texfile);
+		vertexCount += sm.VertexCount;
+		indexCount += sm.IndexCount;
+	}
+	for (size_t m = 0; m < mesh.Meshes.size(); ++m)
+	{
+		const GeometryGenerator::MeshData& meshData = mesh.Meshes[m];
+		CookedSubmesh& sm = submeshes[m];
+		sm.FirstLod = static_cast<std::uint32_t>(lods.size());
+		sm.LodCount = static_cast<std::uint32_t>(meshData.Lods.size());
+		for (const auto& lod : meshData.Lods)
+		{
+			CookedLod cl;
+			cl.FirstIndex = indexCount;
+			cl.IndexCount = static_cast<std::uint32_t>(lod.Indices32.size());
+			cl.Error = lod.Error;
+			lods.push_back(cl);
+			indexCount += cl.IndexCount;
+		}
+
+		sm.FirstMeshlet = static_cast<std::uint32_t>(meshlets.size());
+		sm.MeshletCount = static_cast<std::uint32_t>(meshData.Meshlets.size());
+		for (const auto& meshlet : meshData.Meshlets)
+		{
+			CookedMeshlet cm;
+			cm.FirstIndex = meshlet.FirstIndex;
+			cm.IndexCount = meshlet.IndexCount;
+			cm.Center[0] = meshlet.Center.x;
+			cm.Center[1] = meshlet.Center.y;
+			cm.Center[2] = meshlet.Center.z;
+			cm.Radius = meshlet.Radius;
+			cm.ConeAxis[0] = meshlet.ConeAxis.x;
+			cm.ConeAxis[1] = meshlet.ConeAxis.y;
+			cm.ConeAxis[2] = meshlet.ConeAxis.z;
+			cm.ConeCutoff = meshlet.ConeCutoff;
+			meshlets.push_back(cm);
+		}
+	}
+	for (size_t k = 0; k < mesh.Materials.size(); ++k)
+	{
+		materials[k].Name = AppendString(strings, mesh.Materials[k].name);
+		materials[k].DiffFile = AppendString(strings, mesh.Materials[k].diffFile);
+		materials[k].NormFile = AppendString(strings, mesh.Materials[k].normFile);
+	}
+
+	CookedHeader header;
+	header.Magic = CookedMagic;
+	header.Version = Version;
+	header.SourceHash = sourceHash;
+	header.ImportFlags = importFlags;
+	header.VertexStride = sizeof(GeometryGenerator::Vertex);
+	header.MeshCount = static_cast<std::uint32_t>(submeshes.size());
+	header.MaterialCount = static_cast<std::uint32_t>(materials.size());
+	header.VertexCount = vertexCount;
+	header.IndexCount = indexCount;
+	header.StringBytes = strings.size();
+	header.LodCount = lods.size();
+	header.MeshletCount = meshlets.size();
+
+	const std::string tmpPath = cookedPath + ".tmp";
+	{
+		std::ofstream fout(tmpPath, std::ios::binary | std::ios::trunc);
+		if (!fout)
+			return false;
+
+		fout.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		fout.write(reinterpret_cast<const char*>(submeshes.data()), submeshes.size() * sizeof(CookedSubmesh));
+		fout.write(reinterpret_cast<const char*>(lods.data()), lods.size() * sizeof(CookedLod));
+		fout.write(reinterpret_cast<const char*>(meshlets.data()), meshlets.size() * sizeof(CookedMeshlet));
+		fout.write(reinterpret_cast<const char*>(materials.data()), materials.size() * sizeof(CookedMaterial));
+		for (const auto& meshData : mesh.Meshes)
+			fout.write(reinterpret_cast<const char*>(meshData.Vertices.data()), meshData.Vertices.size() * sizeof(GeometryGenerator::Vertex));
+		for (const auto& meshData : mesh.Meshes)
+			fout.write(reinterpret_cast<const char*>(meshData.Indices32.data()), meshData.Indices32.size() * sizeof(std::uint32_t));
+		for (const auto& meshData : mesh.Meshes)
+			for (const auto& lod : meshData.Lods)
+				fout.write(reinterpret_cast<const char*>(lod.Indices32.data()), lod.Indices32.size() * sizeof(std::uint32_t));
+		fout.write(strings.data(), strings.size());
+
+		if (!fout)
+		{
+			fout.close();
+			std::remove(tmpPath.c_str());
+			return false;
+		}
+	}
+
+	std::error_code ec;
+	std::filesystem::rename(tmpPath, cookedPath, ec);
+	if (ec)
+	{
+		std::remove(tmpPath.c_str());
+		return false;
+	}
+	return true;
+}
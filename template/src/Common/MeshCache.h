@@ -0,0 +1,73 @@
+//***************************************************************************************
+// MeshCache.h
+//
+// Cooked binary cache for meshes imported through Assimp.  The first time a source
+// file is loaded it is imported and post-processed as usual and the result is written
+// next to it as <name>.cmesh.  Later loads map the cooked file and copy the vertices,
+// indices, submesh table and material names straight out of it, skipping Assimp.
+// Before they are cooked, meshes are split to fit 16-bit indices, optimized for the
+// vertex cache and overdraw, grouped into cullable clusters and given a chain of
+// simplified LODs.
+//
+// A cooked file is only used if its format version, the hash of the source file and
+// the material libraries it names, and the Assimp post-process flags all match;
+// otherwise the source is re-imported and the cache rewritten.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "GeometryGenerator.h"
+
+class MeshCache
+{
+public:
+
+	// Bump whenever the on-disk layout or the meaning of the cooked data changes.
+	static const std::uint32_t Version = 5;
+
+	// Post-process flags used by the application for every imported mesh.
+	static const unsigned int DefaultImportFlags =
+		aiProcess_Triangulate |
+		aiProcess_ConvertToLeftHanded |
+		aiProcess_FlipUVs |
+		aiProcess_GenNormals |
+		aiProcess_CalcTangentSpace;
+
+	// Everything the renderer needs from one source file.  Meshes[i].matName refers
+	// to Materials[j].name.
+	struct ImportedMesh
+	{
+		std::vector<GeometryGenerator::MeshData> Meshes;
+		std::vector<GeometryGenerator::Material> Materials;
+	};
+
+	// Loads the cooked version of sourcePath if it is up to date, otherwise imports
+	// the source with Assimp and refreshes the cache.  Returns false if neither works.
+	static bool LoadOrImport(const std::string& sourcePath, unsigned int importFlags, ImportedMesh& out);
+
+	// Runs the Assimp import and converts the scene into an ImportedMesh.
+	static bool Import(const std::string& sourcePath, unsigned int importFlags, ImportedMesh& out);
+
+	// Reads a cooked file.  Fails if the file is missing, truncated, of another
+	// version, or was cooked from different source data or flags.
+	static bool LoadCooked(const std::string& cookedPath, std::uint64_t sourceHash, unsigned int importFlags, ImportedMesh& out);
+
+	// Writes a cooked file.  The file is written to a temporary name first and
+	// renamed into place so a crash never leaves a half written cache behind.
+	static bool SaveCooked(const std::string& cookedPath, std::uint64_t sourceHash, unsigned int importFlags, const ImportedMesh& mesh);
+
+	// 64-bit FNV-1a hash of a file's contents.  Returns false if it cannot be read.
+	static bool HashFile(const std::string& filename, std::uint64_t& hash);
+
+	// Hash of an OBJ together with every .mtl it names with mtllib, which is where
+	// the cooked material and texture names come from.  A missing .mtl hashes as
+	// missing, so creating it later also invalidates the cache.  Returns false if
+	// the OBJ itself cannot be read.
+	static bool SourceHash(const std::string& sourcePath, std::uint64_t& hash);
+
+	// <dir>/<name>.obj -> <dir>/<name>.cmesh
+	static std::string CookedPathFor(const std::string& sourcePath);
+};
@@ -0,0 +1,393 @@
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+using namespace DirectX;
+
+namespace
+{
+	// Forsyth, "Linear-Speed Vertex Cache Optimisation", 2006.  The optimizer models a
+	// 32 entry LRU cache; the constants are the ones from the paper.
+	const int ModelCacheSize = 32;
+	const float CacheDecayPower = 1.5f;
+	const float LastTriScore = 0.75f;
+	const float ValenceBoostScale = 2.0f;
+	const float ValenceBoostPower = 0.5f;
+	const unsigned int ValenceTableSize = 32;
+
+	const std::uint32_t InvalidTriangle = 0xffffffff;
+
+	struct ScoreTables
+	{
+		float Cache[ModelCacheSize];
+		float Valence[ValenceTableSize];
+
+		ScoreTables()
+		{
+			for (int i = 0; i < ModelCacheSize; ++i)
+			{
+				if (i < 3)
+				{
+					// The three most recent vertices belong to the triangle just emitted.
+					// Scoring them lower avoids strips that keep turning back on themselves.
+					Cache[i] = LastTriScore;
+				}
+				else
+				{
+					float scaler = 1.0f / (ModelCacheSize - 3);
+					Cache[i] = std::pow(1.0f - (i - 3) * scaler, CacheDecayPower);
+				}
+			}
+			Valence[0] = 0.0f;
+			for (unsigned int i = 1; i < ValenceTableSize; ++i)
+				Valence[i] = ValenceBoostScale * std::pow(float(i), -ValenceBoostPower);
+		}
+	};
+
+	float VertexScore(const ScoreTables& tables, int cachePos, unsigned int valence)
+	{
+		// Vertices with nothing left to draw do not attract any triangle.
+		if (valence == 0)
+			return -1.0f;
+
+		float score = cachePos >= 0 ? tables.Cache[cachePos] : 0.0f;
+		score += valence < ValenceTableSize ? tables.Valence[valence] : ValenceBoostScale * std::pow(float(valence), -ValenceBoostPower);
+		return score;
+	}
+
+	// FIFO cache simulation; a vertex is a hit if it was transformed within the last
+	// cacheSize misses.  Returns the number of misses for one triangle.
+	unsigned int SimulateFifo(const std::uint32_t* tri, std::vector<unsigned int>& timestamps, unsigned int& time, unsigned int cacheSize)
+	{
+		unsigned int misses = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			std::uint32_t v = tri[k];
+			if (time - timestamps[v] > cacheSize)
+			{
+				timestamps[v] = time++;
+				++misses;
+			}
+		}
+		return misses;
+	}
+
+	XMFLOAT3 Sub(const XMFLOAT3& a, const XMFLOAT3& b) { return XMFLOAT3(a.x - b.x, a.y - b.y, a.z - b.z); }
+	XMFLOAT3 Cross(const XMFLOAT3& a, const XMFLOAT3& b) { return XMFLOAT3(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x); }
+	float Dot(const XMFLOAT3& a, const XMFLOAT3& b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+}
+
+MeshOptimizer::VertexCacheStats MeshOptimizer::AnalyzeVertexCache(const std::vector<std::uint32_t>& indices, std::size_t vertexCount, unsigned int cacheSize)
+{
+	VertexCacheStats stats;
+	const std::size_t triCount = indices.size() / 3;
+	if (triCount == 0)
+		return stats;
+
+	// Start the clock past cacheSize so untouched (zero) timestamps always miss.
+	std::vector<unsigned int> timestamps(vertexCount, 0);
+	unsigned int time = cacheSize + 1;
+	std::size_t misses = 0;
+	for (std::size_t t = 0; t < triCount; ++t)
+		misses += SimulateFifo(&indices[t * 3], timestamps, time, cacheSize);
+
+	std::vector<bool> referenced(vertexCount, false);
+	std::size_t uniqueVertices = 0;
+	for (std::uint32_t v : indices)
+	{
+		if (!referenced[v])
+		{
+			referenced[v] = true;
+			++uniqueVertices;
+		}
+	}
+
+	stats.Acmr = float(misses) / float(triCount);
+	stats.Atvr = float(misses) / float(uniqueVertices);
+	return stats;
+}
+
+void MeshOptimizer::OptimizeVertexCache(std::vector<std::uint32_t>& indices, std::size_t vertexCount)
+{
+	const std::size_t triCount = indices.size() / 3;
+	if (triCount == 0)
+		return;
+
+	static const ScoreTables tables;
+
+	// Vertex -> triangle adjacency in CSR form.  The first valence[v] entries of each
+	// vertex's range are the triangles still to be emitted.
+	std::vector<unsigned int> valence(vertexCount, 0);
+	for (std::size_t i = 0; i < triCount * 3; ++i)
+		++valence[indices[i]];
+
+	std::vector<std::uint32_t> adjacencyOffset(vertexCount + 1, 0);
+	for (std::size_t v = 0; v < vertexCount; ++v)
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+
+	std::vector<std::uint32_t> adjacency(triCount * 3);
+	{
+		std::vector<std::uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (std::size_t t = 0; t < triCount; ++t)
+			for (int k = 0; k < 3; ++k)
+				adjacency[fill[indices[t * 3 + k]]++] = (std::uint32_t)t;
+	}
+
+	std::vector<int> cachePos(vertexCount, -1);
+	std::vector<float> vertexScore(vertexCount);
+	for (std::size_t v = 0; v < vertexCount; ++v)
+		vertexScore[v] = VertexScore(tables, -1, valence[v]);
+
+	std::vector<float> triScore(triCount);
+	std::vector<bool> emitted(triCount, false);
+	std::uint32_t bestTri = 0;
+	float bestScore = -1.0f;
+	for (std::size_t t = 0; t < triCount; ++t)
+	{
+		const std::uint32_t* tri = &indices[t * 3];
+		triScore[t] = vertexScore[tri[0]] + vertexScore[tri[1]] + vertexScore[tri[2]];
+		if (triScore[t] > bestScore)
+		{
+			bestScore = triScore[t];
+			bestTri = (std::uint32_t)t;
+		}
+	}
+
+	std::vector<std::uint32_t> result;
+	result.reserve(triCount * 3);
+
+	// Three extra slots hold the vertices pushed out by the newest triangle.
+	std::uint32_t cache[ModelCacheSize + 3];
+	std::uint32_t newCache[ModelCacheSize + 3];
+	int cacheSize = 0;
+	std::size_t deadEndCursor = 0;
+
+	while (result.size() < triCount * 3)
+	{
+		// Nothing in the cache has triangles left: continue with the next triangle
+		// in input order.
+		if (bestTri == InvalidTriangle)
+		{
+			while (emitted[deadEndCursor])
+				++deadEndCursor;
+			bestTri = (std::uint32_t)deadEndCursor;
+		}
+
+		const std::uint32_t tri[3] = { indices[bestTri * 3 + 0], indices[bestTri * 3 + 1], indices[bestTri * 3 + 2] };
+		result.insert(result.end(), tri, tri + 3);
+		emitted[bestTri] = true;
+
+		for (int k = 0; k < 3; ++k)
+		{
+			std::uint32_t v = tri[k];
+			std::uint32_t* begin = &adjacency[adjacencyOffset[v]];
+			std::uint32_t* end = begin + valence[v];
+			std::uint32_t* it = std::find(begin, end, bestTri);
+			// A degenerate triangle lists the same vertex twice; it was removed already.
+			if (it != end)
+			{
+				std::swap(*it, *(end - 1));
+				--valence[v];
+			}
+		}
+
+		// New LRU order: the triangle's vertices first, then the old cache without them.
+		int newCacheSize = 0;
+		for (int k = 0; k < 3; ++k)
+		{
+			if (std::find(newCache, newCache + newCacheSize, tri[k]) == newCache + newCacheSize)
+				newCache[newCacheSize++] = tri[k];
+		}
+		for (int i = 0; i < cacheSize; ++i)
+		{
+			std::uint32_t v = cache[i];
+			if (v != tri[0] && v != tri[1] && v != tri[2])
+				newCache[newCacheSize++] = v;
+		}
+
+		for (int i = 0; i < newCacheSize; ++i)
+		{
+			std::uint32_t v = newCache[i];
+			cachePos[v] = i < ModelCacheSize ? i : -1;
+			vertexScore[v] = VertexScore(tables, cachePos[v], valence[v]);
+		}
+
+		// Only triangles touching a vertex whose score changed need rescoring, and the
+		// next triangle is picked among them.
+		bestTri = InvalidTriangle;
+		bestScore = -1.0f;
+		for (int i = 0; i < newCacheSize; ++i)
+		{
+			std::uint32_t v = newCache[i];
+			const std::uint32_t* adj = &adjacency[adjacencyOffset[v]];
+			for (unsigned int j = 0; j < valence[v]; ++j)
+			{
+				std::uint32_t t = adj[j];
+				const std::uint32_t* other = &indices[t * 3];
+				triScore[t] = vertexScore[other[0]] + vertexScore[other[1]] + vertexScore[other[2]];
+				if (triScore[t] > bestScore)
+				{
+					bestScore = triScore[t];
+					bestTri = t;
+				}
+			}
+		}
+
+		cacheSize = std::min(newCacheSize, ModelCacheSize);
+		std::copy(newCache, newCache + cacheSize, cache);
+	}
+
+	indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeOverdraw(std::vector<std::uint32_t>& indices, const std::vector<GeometryGenerator::Vertex>& vertices, float threshold)
+{
+	// Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and
+	// Reduced Overdraw", 2007: cut the cache-optimized order into clusters without
+	// losing more than threshold of the cache efficiency, then draw the clusters
+	// that face away from the mesh centre first since they tend to occlude the rest.
+	const std::size_t triCount = indices.size() / 3;
+	if (triCount == 0)
+		return;
+
+	const unsigned int cacheSize = AnalyzeCacheSize;
+	std::vector<unsigned int> timestamps(vertices.size(), 0);
+	unsigned int time = cacheSize + 1;
+
+	// Hard boundaries: triangles where the cache starts cold anyway.
+	std::vector<std::uint32_t> hard;
+	for (std::size_t t = 0; t < triCount; ++t)
+	{
+		if (SimulateFifo(&indices[t * 3], timestamps, time, cacheSize) == 3)
+			hard.push_back((std::uint32_t)t);
+	}
+	if (hard.empty() || hard[0] != 0)
+		hard.insert(hard.begin(), 0);
+	hard.push_back((std::uint32_t)triCount);
+
+	// Soft boundaries: inside each hard cluster, cut as soon as the running ACMR of the
+	// current piece, simulated from a cold cache, is within threshold of the cluster's.
+	std::vector<std::uint32_t> clusters;
+	for (std::size_t c = 0; c + 1 < hard.size(); ++c)
+	{
+		const std::uint32_t begin = hard[c];
+		const std::uint32_t end = hard[c + 1];
+
+		time += cacheSize + 1;
+		unsigned int clusterMisses = 0;
+		for (std::uint32_t t = begin; t < end; ++t)
+			clusterMisses += SimulateFifo(&indices[t * 3], timestamps, time, cacheSize);
+		const float limit = threshold * float(clusterMisses) / float(end - begin);
+
+		clusters.push_back(begin);
+		time += cacheSize + 1;
+		std::uint32_t start = begin;
+		unsigned int misses = 0;
+		for (std::uint32_t t = begin; t < end; ++t)
+		{
+			misses += SimulateFifo(&indices[t * 3], timestamps, time, cacheSize);
+			if (t + 1 < end && float(misses) <= limit * float(t + 1 - start))
+			{
+				clusters.push_back(t + 1);
+				time += cacheSize + 1;
+				start = t + 1;
+				misses = 0;
+			}
+		}
+	}
+	clusters.push_back((std::uint32_t)triCount);
+
+	const std::size_t clusterCount = clusters.size() - 1;
+	if (clusterCount < 2)
+		return;
+
+	XMFLOAT3 meshCentroid(0.0f, 0.0f, 0.0f);
+	for (std::uint32_t v : indices)
+	{
+		meshCentroid.x += vertices[v].Position.x;
+		meshCentroid.y += vertices[v].Position.y;
+		meshCentroid.z += vertices[v].Position.z;
+	}
+	float invCount = 1.0f / float(indices.size());
+	meshCentroid = XMFLOAT3(meshCentroid.x * invCount, meshCentroid.y * invCount, meshCentroid.z * invCount);
+
+	std::vector<float> sortKey(clusterCount);
+	for (std::size_t c = 0; c < clusterCount; ++c)
+	{
+		XMFLOAT3 centroid(0.0f, 0.0f, 0.0f);
+		XMFLOAT3 normal(0.0f, 0.0f, 0.0f);
+		float area = 0.0f;
+		for (std::uint32_t t = clusters[c]; t < clusters[c + 1]; ++t)
+		{
+			const XMFLOAT3& p0 = vertices[indices[t * 3 + 0]].Position;
+			const XMFLOAT3& p1 = vertices[indices[t * 3 + 1]].Position;
+			const XMFLOAT3& p2 = vertices[indices[t * 3 + 2]].Position;
+
+			// Twice the area-weighted normal; points out of the front face for the
+			// clockwise winding Direct3D uses.
+			XMFLOAT3 n = Cross(Sub(p1, p0), Sub(p2, p0));
+			float a = std::sqrt(Dot(n, n));
+
+			centroid.x += (p0.x + p1.x + p2.x) * a;
+			centroid.y += (p0.y + p1.y + p2.y) * a;
+			centroid.z += (p0.z + p1.z + p2.z) * a;
+			normal.x += n.x;
+			normal.y += n.y;
+			normal.z += n.z;
+			area += a;
+		}
+
+		float normalLength = std::sqrt(Dot(normal, normal));
+		if (area <= 0.0f || normalLength <= 0.0f)
+		{
+			sortKey[c] = 0.0f;
+			continue;
+		}
+		float invArea = 1.0f / (3.0f * area);
+		centroid = XMFLOAT3(centroid.x * invArea, centroid.y * invArea, centroid.z * invArea);
+		sortKey[c] = Dot(Sub(centroid, meshCentroid), normal) / normalLength;
+	}
+
+	std::vector<std::uint32_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b) { return sortKey[a] > sortKey[b]; });
+
+	std::vector<std::uint32_t> result;
+	result.reserve(indices.size());
+	for (std::uint32_t c : order)
+		result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+	indices.swap(result);
+}
+
+void MeshOptimizer::OptimizeVertexFetch(std::vector<GeometryGenerator::Vertex>& vertices, std::vector<std::uint32_t>& indices)
+{
+	const std::uint32_t unused = 0xffffffff;
+	std::vector<std::uint32_t> remap(vertices.size(), unused);
+	std::vector<GeometryGenerator::Vertex> result;
+	result.reserve(vertices.size());
+
+	for (std::uint32_t& index : indices)
+	{
+		if (remap[index] == unused)
+		{
+			remap[index] = (std::uint32_t)result.size();
+			result.push_back(vertices[index]);
+		}
+		index = remap[index];
+	}
+	vertices.swap(result);
+}
+
+MeshOptimizer::Report MeshOptimizer::Optimize(GeometryGenerator::MeshData& mesh)
+{
+	Report report;
+	report.Before = AnalyzeVertexCache(mesh.Indices32, mesh.Vertices.size());
+
+	OptimizeVertexCache(mesh.Indices32, mesh.Vertices.size());
+	OptimizeOverdraw(mesh.Indices32, mesh.Vertices);
+	OptimizeVertexFetch(mesh.Vertices, mesh.Indices32);
+
+	report.After = AnalyzeVertexCache(mesh.Indices32, mesh.Vertices.size());
+	return report;
+}
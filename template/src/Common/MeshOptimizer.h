@@ -0,0 +1,54 @@
+//***************************************************************************************
+// MeshOptimizer.h
+//
+// Import-time reordering of indexed triangle meshes:
+//   1. OptimizeVertexCache reorders triangles for post-transform cache reuse using
+//      Forsyth's linear-speed vertex cache optimization.
+//   2. OptimizeOverdraw splits that order into clusters that keep good cache reuse
+//      and sorts the clusters so outward facing ones are drawn first.
+//   3. OptimizeVertexFetch renumbers vertices in first-use order.
+//
+// AnalyzeVertexCache simulates a FIFO cache and reports ACMR (misses per triangle)
+// and ATVR (misses per referenced vertex, 1.0 is ideal).
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+class MeshOptimizer
+{
+public:
+
+	struct VertexCacheStats
+	{
+		float Acmr = 0.0f;
+		float Atvr = 0.0f;
+	};
+
+	struct Report
+	{
+		VertexCacheStats Before;
+		VertexCacheStats After;
+	};
+
+	// FIFO size used for reporting.  Roughly what current GPUs reuse in practice.
+	static const unsigned int AnalyzeCacheSize = 16;
+
+	static VertexCacheStats AnalyzeVertexCache(const std::vector<std::uint32_t>& indices, std::size_t vertexCount, unsigned int cacheSize = AnalyzeCacheSize);
+
+	static void OptimizeVertexCache(std::vector<std::uint32_t>& indices, std::size_t vertexCount);
+
+	// Expects indices already optimized for the vertex cache.  threshold is how much
+	// worse than the original ACMR a cluster may get; 1.05 allows a 5% loss.
+	static void OptimizeOverdraw(std::vector<std::uint32_t>& indices, const std::vector<GeometryGenerator::Vertex>& vertices, float threshold = 1.05f);
+
+	// Drops unreferenced vertices.
+	static void OptimizeVertexFetch(std::vector<GeometryGenerator::Vertex>& vertices, std::vector<std::uint32_t>& indices);
+
+	// Runs all three passes on one mesh and returns the cache stats around them.
+	static Report Optimize(GeometryGenerator::MeshData& mesh);
+};
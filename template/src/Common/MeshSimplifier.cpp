@@ -0,0 +1,335 @@
+#include "MeshSimplifier.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <numeric>
+#include <unordered_map>
+
+using namespace DirectX;
+
+const float MeshSimplifier::MaxRelativeError = 0.02f;
+
+namespace
+{
+	// Symmetric 4x4 error quadric plus the total weight (area) of the planes summed
+	// into it.  Error() divides by the weight, so it is a mean squared distance.
+	struct Quadric
+	{
+		double a00 = 0, a01 = 0, a02 = 0, a03 = 0;
+		double a11 = 0, a12 = 0, a13 = 0;
+		double a22 = 0, a23 = 0;
+		double a33 = 0;
+		double w = 0;
+
+		void AddPlane(double nx, double ny, double nz, double d, double weight)
+		{
+			a00 += weight * nx * nx; a01 += weight * nx * ny; a02 += weight * nx * nz; a03 += weight * nx * d;
+			a11 += weight * ny * ny; a12 += weight * ny * nz; a13 += weight * ny * d;
+			a22 += weight * nz * nz; a23 += weight * nz * d;
+			a33 += weight * d * d;
+			w += weight;
+		}
+
+		void Add(const Quadric& q)
+		{
+			a00 += q.a00; a01 += q.a01; a02 += q.a02; a03 += q.a03;
+			a11 += q.a11; a12 += q.a12; a13 += q.a13;
+			a22 += q.a22; a23 += q.a23;
+			a33 += q.a33;
+			w += q.w;
+		}
+
+		double Error(const XMFLOAT3& p) const
+		{
+			double x = p.x, y = p.y, z = p.z;
+			double e =
+				a00 * x * x + 2.0 * a01 * x * y + 2.0 * a02 * x * z + 2.0 * a03 * x +
+				a11 * y * y + 2.0 * a12 * y * z + 2.0 * a13 * y +
+				a22 * z * z + 2.0 * a23 * z +
+				a33;
+			return w > 0.0 ? std::max(e / w, 0.0) : 0.0;
+		}
+	};
+
+	struct PositionKey
+	{
+		std::uint32_t x, y, z;
+		bool operator==(const PositionKey& rhs) const { return x == rhs.x && y == rhs.y && z == rhs.z; }
+	};
+
+	struct PositionKeyHash
+	{
+		std::size_t operator()(const PositionKey& k) const
+		{
+			std::size_t h = k.x;
+			h = h * 73856093u ^ k.y;
+			h = h * 19349663u ^ k.z;
+			return h;
+		}
+	};
+
+	PositionKey KeyOf(const XMFLOAT3& p)
+	{
+		// +0.0f so that -0 and 0 hash the same.
+		float v[3] = { p.x + 0.0f, p.y + 0.0f, p.z + 0.0f };
+		PositionKey k;
+		std::memcpy(&k.x, &v[0], 4);
+		std::memcpy(&k.y, &v[1], 4);
+		std::memcpy(&k.z, &v[2], 4);
+		return k;
+	}
+
+	XMFLOAT3 TriangleNormal(const XMFLOAT3& p0, const XMFLOAT3& p1, const XMFLOAT3& p2)
+	{
+		XMFLOAT3 e0(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+		XMFLOAT3 e1(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+		return XMFLOAT3(e0.y * e1.z - e0.z * e1.y, e0.z * e1.x - e0.x * e1.z, e0.x * e1.y - e0.y * e1.x);
+	}
+
+	std::uint64_t EdgeKey(std::uint32_t a, std::uint32_t b)
+	{
+		return (std::uint64_t(a) << 32) | b;
+	}
+
+	struct Collapse
+	{
+		std::uint32_t From;
+		std::uint32_t To;
+		double Error;
+	};
+}
+
+std::vector<std::uint32_t> MeshSimplifier::Simplify(
+	const std::vector<GeometryGenerator::Vertex>& vertices,
+	const std::vector<std::uint32_t>& indices,
+	std::size_t targetIndexCount,
+	float maxError,
+	float* resultError)
+{
+	const std::size_t vertexCount = vertices.size();
+
+	std::vector<std::uint32_t> result;
+	result.reserve(indices.size());
+	for (std::size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		std::uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+		if (a != b && b != c && a != c)
+			result.insert(result.end(), { a, b, c });
+	}
+
+	// Lock seam vertices (another vertex has the same position) ...
+	std::vector<bool> locked(vertexCount, false);
+	{
+		std::unordered_map<PositionKey, std::uint32_t, PositionKeyHash> firstAt;
+		firstAt.reserve(vertexCount);
+		for (std::uint32_t v = 0; v < vertexCount; ++v)
+		{
+			auto inserted = firstAt.emplace(KeyOf(vertices[v].Position), v);
+			if (!inserted.second)
+			{
+				locked[v] = true;
+				locked[inserted.first->second] = true;
+			}
+		}
+	}
+
+	// ... and border vertices (an edge without its opposite half-edge).
+	{
+		std::vector<std::uint64_t> edges;
+		edges.reserve(result.size());
+		for (std::size_t i = 0; i < result.size(); i += 3)
+			for (int k = 0; k < 3; ++k)
+				edges.push_back(EdgeKey(result[i + k], result[i + (k + 1) % 3]));
+		std::sort(edges.begin(), edges.end());
+
+		for (std::size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				std::uint32_t a = result[i + k];
+				std::uint32_t b = result[i + (k + 1) % 3];
+				if (!std::binary_search(edges.begin(), edges.end(), EdgeKey(b, a)))
+				{
+					locked[a] = true;
+					locked[b] = true;
+				}
+			}
+		}
+	}
+
+	std::vector<Quadric> quadrics(vertexCount);
+	for (std::size_t i = 0; i < result.size(); i += 3)
+	{
+		const XMFLOAT3& p0 = vertices[result[i + 0]].Position;
+		XMFLOAT3 n = TriangleNormal(p0, vertices[result[i + 1]].Position, vertices[result[i + 2]].Position);
+		double length = std::sqrt(double(n.x) * n.x + double(n.y) * n.y + double(n.z) * n.z);
+		if (length <= 0.0)
+			continue;
+		double nx = n.x / length, ny = n.y / length, nz = n.z / length;
+		double d = -(nx * p0.x + ny * p0.y + nz * p0.z);
+		double area = 0.5 * length;
+		for (int k = 0; k < 3; ++k)
+			quadrics[result[i + k]].AddPlane(nx, ny, nz, d, area);
+	}
+
+	const double maxErrorSq = double(maxError) * maxError;
+	double worstErrorSq = 0.0;
+
+	std::vector<std::uint32_t> adjacencyOffset(vertexCount + 1);
+	std::vector<std::uint32_t> adjacency;
+	std::vector<std::uint32_t> remap(vertexCount);
+	std::vector<bool> touched(vertexCount);
+	std::vector<Collapse> collapses;
+
+	// Each pass collapses the cheapest edges first, at most one collapse per vertex,
+	// then rewrites the index list and starts over with fresh adjacency.
+	while (result.size() > targetIndexCount)
+	{
+		const std::size_t triCount = result.size() / 3;
+
+		std::fill(adjacencyOffset.begin(), adjacencyOffset.end(), 0);
+		for (std::uint32_t v : result)
+			++adjacencyOffset[v + 1];
+		std::partial_sum(adjacencyOffset.begin(), adjacencyOffset.end(), adjacencyOffset.begin());
+		adjacency.resize(result.size());
+		{
+			std::vector<std::uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+			for (std::size_t t = 0; t < triCount; ++t)
+				for (int k = 0; k < 3; ++k)
+					adjacency[fill[result[t * 3 + k]]++] = (std::uint32_t)t;
+		}
+
+		collapses.clear();
+		for (std::size_t i = 0; i < result.size(); i += 3)
+		{
+			for (int k = 0; k < 3; ++k)
+			{
+				std::uint32_t a = result[i + k];
+				std::uint32_t b = result[i + (k + 1) % 3];
+				// Interior edges show up once in each direction; look at them once.
+				if (a > b || (locked[a] && locked[b]))
+					continue;
+
+				Quadric q = quadrics[a];
+				q.Add(quadrics[b]);
+				double errorAB = locked[a] ? DBL_MAX : q.Error(vertices[b].Position);
+				double errorBA = locked[b] ? DBL_MAX : q.Error(vertices[a].Position);
+
+				Collapse c = errorAB <= errorBA ? Collapse{ a, b, errorAB } : Collapse{ b, a, errorBA };
+				if (c.Error <= maxErrorSq)
+					collapses.push_back(c);
+			}
+		}
+		if (collapses.empty())
+			break;
+
+		std::sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.Error < y.Error; });
+
+		std::iota(remap.begin(), remap.end(), 0);
+		std::fill(touched.begin(), touched.end(), false);
+
+		std::size_t remainingTris = triCount;
+		std::size_t collapseCount = 0;
+		for (const Collapse& c : collapses)
+		{
+			if (touched[c.From] || touched[c.To])
+				continue;
+
+			// Reject the collapse if any surviving triangle around From would flip.
+			const XMFLOAT3& target = vertices[c.To].Position;
+			bool flips = false;
+			std::size_t degenerate = 0;
+			for (std::uint32_t j = adjacencyOffset[c.From]; j < adjacencyOffset[c.From + 1] && !flips; ++j)
+			{
+				const std::uint32_t t = adjacency[j];
+				std::uint32_t tri[3] = { remap[result[t * 3 + 0]], remap[result[t * 3 + 1]], remap[result[t * 3 + 2]] };
+				if (tri[0] == c.To || tri[1] == c.To || tri[2] == c.To)
+				{
+					++degenerate;
+					continue;
+				}
+
+				XMFLOAT3 before = TriangleNormal(vertices[tri[0]].Position, vertices[tri[1]].Position, vertices[tri[2]].Position);
+				XMFLOAT3 p[3];
+				for (int k = 0; k < 3; ++k)
+					p[k] = tri[k] == c.From ? target : vertices[tri[k]].Position;
+				XMFLOAT3 after = TriangleNormal(p[0], p[1], p[2]);
+				flips = before.x * after.x + before.y * after.y + before.z * after.z <= 0.0f;
+			}
+			if (flips)
+				continue;
+
+			remap[c.From] = c.To;
+			quadrics[c.To].Add(quadrics[c.From]);
+			touched[c.From] = true;
+			touched[c.To] = true;
+			worstErrorSq = std::max(worstErrorSq, c.Error);
+			++collapseCount;
+
+			remainingTris -= std::min(degenerate, remainingTris);
+			if (remainingTris * 3 <= targetIndexCount)
+				break;
+		}
+		if (collapseCount == 0)
+			break;
+
+		std::size_t write = 0;
+		for (std::size_t i = 0; i < result.size(); i += 3)
+		{
+			std::uint32_t a = remap[result[i]], b = remap[result[i + 1]], c = remap[result[i + 2]];
+			if (a == b || b == c || a == c)
+				continue;
+			result[write++] = a;
+			result[write++] = b;
+			result[write++] = c;
+		}
+		result.resize(write);
+	}
+
+	if (resultError)
+		*resultError = (float)std::sqrt(worstErrorSq);
+	return result;
+}
+
+void MeshSimplifier::BuildLods(GeometryGenerator::MeshData& mesh)
+{
+	mesh.Lods.clear();
+	if (mesh.Vertices.empty() || mesh.Indices32.size() < 3)
+		return;
+
+	XMFLOAT3 minP = mesh.Vertices[0].Position;
+	XMFLOAT3 maxP = minP;
+	for (const auto& v : mesh.Vertices)
+	{
+		minP = XMFLOAT3(std::min(minP.x, v.Position.x), std::min(minP.y, v.Position.y), std::min(minP.z, v.Position.z));
+		maxP = XMFLOAT3(std::max(maxP.x, v.Position.x), std::max(maxP.y, v.Position.y), std::max(maxP.z, v.Position.z));
+	}
+	XMFLOAT3 extent((maxP.x - minP.x) * 0.5f, (maxP.y - minP.y) * 0.5f, (maxP.z - minP.z) * 0.5f);
+	const float radius = std::sqrt(extent.x * extent.x + extent.y * extent.y + extent.z * extent.z);
+	const float maxError = radius * MaxRelativeError;
+
+	// Every level is simplified from the full mesh rather than from the previous
+	// level, so its error is measured against the original surface.
+	std::size_t previousCount = mesh.Indices32.size();
+	for (unsigned int level = 1; level <= MaxLods; ++level)
+	{
+		std::size_t target = (mesh.Indices32.size() >> level) / 3 * 3;
+		if (target < 3)
+			break;
+
+		float error = 0.0f;
+		std::vector<std::uint32_t> lod = Simplify(mesh.Vertices, mesh.Indices32, target, maxError, &error);
+
+		// A level that keeps more than 3/4 of the previous one is not worth its
+		// index memory; the error limit or locked seams stopped the simplifier.
+		if (lod.empty() || lod.size() * 4 > previousCount * 3)
+			break;
+
+		previousCount = lod.size();
+		GeometryGenerator::MeshLod meshLod;
+		meshLod.Indices32 = std::move(lod);
+		meshLod.Error = error;
+		mesh.Lods.push_back(std::move(meshLod));
+	}
+}
@@ -0,0 +1,44 @@
+//***************************************************************************************
+// MeshSimplifier.h
+//
+// Quadric error edge-collapse simplification (Garland & Heckbert, "Surface
+// Simplification Using Quadric Error Metrics", 1997) restricted to the existing
+// vertices: an edge collapse moves one endpoint onto the other, so a simplified mesh
+// is just a new index list over the original vertex buffer.  That lets every LOD of a
+// submesh share its vertices and differ only in the index range that is drawn.
+//
+// Vertices on open borders and on attribute seams (positions shared by several
+// vertices) are never moved, so LODs do not crack or smear texture seams.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+class MeshSimplifier
+{
+public:
+
+	// Most LODs generated per mesh, not counting the full resolution one.
+	static const unsigned int MaxLods = 4;
+
+	// Largest error a LOD may introduce, relative to the mesh's bounding radius.
+	static const float MaxRelativeError;
+
+	// Collapses edges until at most targetIndexCount indices remain or no collapse
+	// stays below maxError (an object space distance).  Returns the new index list;
+	// resultError receives the largest error actually introduced.
+	static std::vector<std::uint32_t> Simplify(
+		const std::vector<GeometryGenerator::Vertex>& vertices,
+		const std::vector<std::uint32_t>& indices,
+		std::size_t targetIndexCount,
+		float maxError,
+		float* resultError = nullptr);
+
+	// Fills mesh.Lods with up to MaxLods levels, each aiming for half the triangles of
+	// the previous one.  Stops early once a level no longer saves enough triangles.
+	static void BuildLods(GeometryGenerator::MeshData& mesh);
+};
@@ -0,0 +1,228 @@
+#include "MeshletBuilder.h"
+#include <algorithm>
+#include <cmath>
+
+using namespace DirectX;
+
+namespace
+{
+	const std::uint32_t NoTriangle = 0xffffffffu;
+}
+
+void MeshletBuilder::Build(GeometryGenerator::MeshData& mesh)
+{
+	mesh.Meshlets.clear();
+
+	const std::vector<std::uint32_t>& indices = mesh.Indices32;
+	const std::size_t triangleCount = indices.size() / 3;
+	const std::size_t vertexCount = mesh.Vertices.size();
+	if (triangleCount == 0)
+		return;
+
+	// Triangles using each vertex, as offsets into one flat array.
+	std::vector<std::uint32_t> adjacencyOffset(vertexCount + 1, 0);
+	for (std::size_t i = 0; i < triangleCount * 3; ++i)
+		++adjacencyOffset[indices[i] + 1];
+	for (std::size_t v = 0; v < vertexCount; ++v)
+		adjacencyOffset[v + 1] += adjacencyOffset[v];
+	std::vector<std::uint32_t> adjacency(triangleCount * 3);
+	{
+		std::vector<std::uint32_t> fill(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (std::size_t i = 0; i < triangleCount * 3; ++i)
+			adjacency[fill[indices[i]]++] = static_cast<std::uint32_t>(i / 3);
+	}
+
+	// Cluster ids are 1-based so zero-initialized marks mean "not in any cluster yet".
+	std::vector<std::uint32_t> vertexCluster(vertexCount, 0);
+	std::vector<std::uint32_t> candidateCluster(triangleCount, 0);
+	std::vector<bool> emitted(triangleCount, false);
+
+	std::vector<std::uint32_t> reordered;
+	reordered.reserve(triangleCount * 3);
+	std::vector<std::uint32_t> clusterTriangles;
+	clusterTriangles.reserve(MaxTriangles);
+	std::vector<std::uint32_t> candidates;
+
+	std::uint32_t clusterId = 0;
+	std::size_t clusterVertices = 0;
+	std::size_t scan = 0;
+
+	auto newVertices = [&](std::uint32_t t)
+	{
+		std::size_t n = 0;
+		for (int k = 0; k < 3; ++k)
+			n += vertexCluster[indices[t * 3 + k]] != clusterId;
+		return n;
+	};
+
+	auto addTriangle = [&](std::uint32_t t)
+	{
+		emitted[t] = true;
+		clusterTriangles.push_back(t);
+		for (int k = 0; k < 3; ++k)
+		{
+			std::uint32_t v = indices[t * 3 + k];
+			if (vertexCluster[v] == clusterId)
+				continue;
+			vertexCluster[v] = clusterId;
+			++clusterVertices;
+			for (std::uint32_t a = adjacencyOffset[v]; a < adjacencyOffset[v + 1]; ++a)
+			{
+				std::uint32_t n = adjacency[a];
+				if (!emitted[n] && candidateCluster[n] != clusterId)
+				{
+					candidateCluster[n] = clusterId;
+					candidates.push_back(n);
+				}
+			}
+		}
+	};
+
+	for (;;)
+	{
+		while (scan < triangleCount && emitted[scan])
+			++scan;
+		if (scan == triangleCount)
+			break;
+
+		++clusterId;
+		clusterVertices = 0;
+		clusterTriangles.clear();
+		candidates.clear();
+		addTriangle(static_cast<std::uint32_t>(scan));
+
+		while (clusterTriangles.size() < MaxTriangles)
+		{
+			// Prefer the neighbour that adds the fewest vertices, then the one that
+			// came first in the previous order.
+			std::uint32_t best = NoTriangle;
+			std::size_t bestNew = 4;
+			for (std::size_t c = 0; c < candidates.size();)
+			{
+				std::uint32_t t = candidates[c];
+				if (emitted[t])
+				{
+					candidates[c] = candidates.back();
+					candidates.pop_back();
+					continue;
+				}
+				std::size_t n = newVertices(t);
+				if (clusterVertices + n <= MaxVertices && (n < bestNew || (n == bestNew && t < best)))
+				{
+					best = t;
+					bestNew = n;
+				}
+				++c;
+			}
+
+			// Disconnected pieces (foliage cards, small props) have no neighbours;
+			// continue with the next triangle in order rather than leaving a
+			// nearly empty cluster.
+			if (best == NoTriangle)
+			{
+				while (scan < triangleCount && emitted[scan])
+					++scan;
+				if (scan < triangleCount && clusterVertices + newVertices(static_cast<std::uint32_t>(scan)) <= MaxVertices)
+					best = static_cast<std::uint32_t>(scan);
+			}
+			if (best == NoTriangle)
+				break;
+
+			addTriangle(best);
+		}
+
+		std::sort(clusterTriangles.begin(), clusterTriangles.end());
+
+		GeometryGenerator::Meshlet meshlet;
+		meshlet.FirstIndex = static_cast<std::uint32_t>(reordered.size());
+		meshlet.IndexCount = static_cast<std::uint32_t>(clusterTriangles.size() * 3);
+		for (std::uint32_t t : clusterTriangles)
+		{
+			reordered.push_back(indices[t * 3 + 0]);
+			reordered.push_back(indices[t * 3 + 1]);
+			reordered.push_back(indices[t * 3 + 2]);
+		}
+		mesh.Meshlets.push_back(meshlet);
+	}
+
+	mesh.Indices32 = std::move(reordered);
+	for (auto& meshlet : mesh.Meshlets)
+		ComputeBounds(mesh.Vertices, mesh.Indices32, meshlet);
+}
+
+void MeshletBuilder::ComputeBounds(
+	const std::vector<GeometryGenerator::Vertex>& vertices,
+	const std::vector<std::uint32_t>& indices,
+	GeometryGenerator::Meshlet& meshlet)
+{
+	const std::uint32_t first = meshlet.FirstIndex;
+	const std::uint32_t last = meshlet.FirstIndex + meshlet.IndexCount;
+	if (meshlet.IndexCount == 0)
+		return;
+
+	// Sphere around the center of the bounding box: not the tightest, but cheap
+	// and never smaller than needed.
+	XMFLOAT3 minP = vertices[indices[first]].Position;
+	XMFLOAT3 maxP = minP;
+	for (std::uint32_t i = first; i < last; ++i)
+	{
+		const XMFLOAT3& p = vertices[indices[i]].Position;
+		minP = XMFLOAT3(std::min(minP.x, p.x), std::min(minP.y, p.y), std::min(minP.z, p.z));
+		maxP = XMFLOAT3(std::max(maxP.x, p.x), std::max(maxP.y, p.y), std::max(maxP.z, p.z));
+	}
+	XMFLOAT3 c((minP.x + maxP.x) * 0.5f, (minP.y + maxP.y) * 0.5f, (minP.z + maxP.z) * 0.5f);
+	float radiusSq = 0.0f;
+	for (std::uint32_t i = first; i < last; ++i)
+	{
+		const XMFLOAT3& p = vertices[indices[i]].Position;
+		float dx = p.x - c.x, dy = p.y - c.y, dz = p.z - c.z;
+		radiusSq = std::max(radiusSq, dx * dx + dy * dy + dz * dz);
+	}
+	meshlet.Center = c;
+	meshlet.Radius = std::sqrt(radiusSq);
+
+	// Face normals, with the D3D clockwise winding: cross(p1 - p0, p2 - p0) points
+	// out of the front face.  Degenerate triangles do not constrain the cone.
+	std::vector<XMFLOAT3> normals;
+	normals.reserve(meshlet.IndexCount / 3);
+	XMFLOAT3 sum(0.0f, 0.0f, 0.0f);
+	for (std::uint32_t i = first; i + 2 < last; i += 3)
+	{
+		const XMFLOAT3& p0 = vertices[indices[i + 0]].Position;
+		const XMFLOAT3& p1 = vertices[indices[i + 1]].Position;
+		const XMFLOAT3& p2 = vertices[indices[i + 2]].Position;
+		XMFLOAT3 e1(p1.x - p0.x, p1.y - p0.y, p1.z - p0.z);
+		XMFLOAT3 e2(p2.x - p0.x, p2.y - p0.y, p2.z - p0.z);
+		XMFLOAT3 n(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x);
+		float len = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+		if (!(len > 0.0f))
+			continue;
+		n = XMFLOAT3(n.x / len, n.y / len, n.z / len);
+		normals.push_back(n);
+		sum = XMFLOAT3(sum.x + n.x, sum.y + n.y, sum.z + n.z);
+	}
+
+	// Cutoff 1 never culls: the cone test would need dot(c - e, axis) >= |c - e| + 2r.
+	meshlet.ConeAxis = XMFLOAT3(0.0f, 0.0f, 1.0f);
+	meshlet.ConeCutoff = 1.0f;
+
+	float sumLen = std::sqrt(sum.x * sum.x + sum.y * sum.y + sum.z * sum.z);
+	if (normals.empty() || !(sumLen > 1.0e-6f))
+		return;
+	XMFLOAT3 axis(sum.x / sumLen, sum.y / sumLen, sum.z / sumLen);
+
+	float minDot = 1.0f;
+	for (const XMFLOAT3& n : normals)
+		minDot = std::min(minDot, n.x * axis.x + n.y * axis.y + n.z * axis.z);
+
+	// The normals spread over more than a hemisphere; some triangle always faces
+	// the viewer.
+	if (minDot <= 0.0f)
+		return;
+
+	// All normals lie within acos(minDot) of the axis, so a view direction within
+	// 90 degrees minus that of the axis sees only back faces: cutoff = sin(angle).
+	// A little slack covers the rounding of the normals.
+	meshlet.ConeAxis = axis;
+	meshlet.ConeCutoff = std::min(std::sqrt(1.0f - minDot * minDot) + 1.0e-3f, 1.0f);
+}
@@ -0,0 +1,41 @@
+//***************************************************************************************
+// MeshletBuilder.h
+//
+// Splits a mesh into small clusters ("meshlets") that can be culled individually.
+// Clusters are grown greedily across shared vertices so they stay spatially compact,
+// and the mesh's triangles are reordered so every cluster is one contiguous index
+// range that a plain DrawIndexedInstanced can draw.
+//
+// Each cluster gets a bounding sphere for frustum tests and a normal cone for
+// backface tests: with the eye at e, every triangle of a cluster whose sphere is
+// (c, r) faces away when dot(c - e, ConeAxis) >= ConeCutoff * (|c - e| + r) + r.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+class MeshletBuilder
+{
+public:
+
+	// Cluster size limits, the usual mesh shader sizes so the same clusters could
+	// later feed an amplification/mesh shader pipeline.
+	static const std::size_t MaxVertices = 64;
+	static const std::size_t MaxTriangles = 124;
+
+	// Reorders mesh.Indices32 into clusters and fills mesh.Meshlets.  Within a
+	// cluster the triangles keep their previous relative order, so most of an
+	// earlier vertex cache optimization survives.  mesh.Lods are not touched.
+	static void Build(GeometryGenerator::MeshData& mesh);
+
+	// Bounding sphere and normal cone of the triangles in
+	// indices[meshlet.FirstIndex, meshlet.FirstIndex + meshlet.IndexCount).
+	static void ComputeBounds(
+		const std::vector<GeometryGenerator::Vertex>& vertices,
+		const std::vector<std::uint32_t>& indices,
+		GeometryGenerator::Meshlet& meshlet);
+};
@@ -0,0 +1,374 @@
+#include "ObjParser.h"
+#include "JobSystem.h"
+#include "MappedFile.h"
+#include <algorithm>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <iostream>
+#include <assimp/fast_atof.h>
+
+using namespace DirectX;
+
+namespace
+{
+	// How a face index is held until the chunks are merged.  Relative (negative)
+	// indices are stored relative to the chunk's first element, because the number
+	// of elements in earlier chunks is not known yet.
+	enum IndexKind : std::uint8_t
+	{
+		Absent = 0,
+		Absolute = 1,
+		Relative = 2,
+	};
+
+	// Slot order of RawCorner: position, texture coordinate, normal.
+	struct RawCorner
+	{
+		std::int32_t Value[3];
+		std::uint8_t Kind[3];
+	};
+
+	struct Chunk
+	{
+		const char* Begin = nullptr;
+		const char* End = nullptr;
+
+		std::vector<XMFLOAT3> Positions;
+		std::vector<XMFLOAT2> TexCoords;
+		std::vector<XMFLOAT3> Normals;
+		std::vector<RawCorner> Corners;
+
+		// Where this chunk's elements land in the merged mesh.
+		std::size_t Base[3] = { 0, 0, 0 };
+		std::size_t CornerBase = 0;
+
+		std::string Error;
+	};
+
+	bool IsBlank(char c)
+	{
+		return c == ' ' || c == '\t';
+	}
+
+	bool IsDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	bool StartsNumber(char c)
+	{
+		return IsDigit(c) || c == '-' || c == '+' || c == '.';
+	}
+
+	const char* SkipBlanks(const char* p, const char* end)
+	{
+		while (p < end && IsBlank(*p))
+			++p;
+		return p;
+	}
+
+	const char* LineEnd(const char* p, const char* end)
+	{
+		while (p < end && *p != '\n')
+			++p;
+		return p;
+	}
+
+	// Every chunk ends with a newline, so fast_atof always stops inside the chunk.
+	bool ParseFloat(const char*& p, const char* end, float& out)
+	{
+		p = SkipBlanks(p, end);
+		if (p == end || !StartsNumber(*p))
+			return false;
+		p = Assimp::fast_atoreal_move<float>(p, out, false);
+		return true;
+	}
+
+	bool ParseIndex(const char*& p, const char* end, std::int32_t& out)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+'))
+		{
+			negative = *p == '-';
+			++p;
+		}
+		if (p == end || !IsDigit(*p))
+			return false;
+
+		std::int64_t value = 0;
+		while (p < end && IsDigit(*p))
+		{
+			value = value * 10 + (*p - '0');
+			if (value > INT32_MAX)
+				return false;
+			++p;
+		}
+		out = static_cast<std::int32_t>(negative ? -value : value);
+		return true;
+	}
+
+	// v, v/vt, v//vn or v/vt/vn.  counts holds how many positions, texture
+	// coordinates and normals the chunk has read so far.
+	bool ParseCorner(const char*& p, const char* end, const std::size_t counts[3], RawCorner& c)
+	{
+		for (int k = 0; k < 3; ++k)
+		{
+			c.Value[k] = 0;
+			c.Kind[k] = Absent;
+		}
+
+		for (int k = 0; k < 3; ++k)
+		{
+			if (k > 0)
+			{
+				if (p == end || *p != '/')
+					break;
+				++p;
+				if (k == 1 && p < end && *p == '/')
+					continue;
+			}
+
+			std::int32_t raw;
+			if (!ParseIndex(p, end, raw) || raw == 0)
+				return false;
+			if (raw > 0)
+			{
+				c.Kind[k] = Absolute;
+				c.Value[k] = raw - 1;
+			}
+			else
+			{
+				c.Kind[k] = Relative;
+				c.Value[k] = static_cast<std::int32_t>(counts[k]) + raw;
+			}
+		}
+		return true;
+	}
+
+	void ParseChunk(Chunk& chunk)
+	{
+		const char* p = chunk.Begin;
+		const char* end = chunk.End;
+		std::vector<RawCorner> polygon;
+
+		while (p < end)
+		{
+			const char* line = p;
+			p = SkipBlanks(p, end);
+
+			bool ok = true;
+			if (end - p > 2 && p[0] == 'v' && IsBlank(p[1]))
+			{
+				XMFLOAT3 v;
+				++p;
+				ok = ParseFloat(p, end, v.x) && ParseFloat(p, end, v.y) && ParseFloat(p, end, v.z);
+				chunk.Positions.push_back(v);
+			}
+			else if (end - p > 3 && p[0] == 'v' && p[1] == 't' && IsBlank(p[2]))
+			{
+				// The second coordinate is optional and defaults to 0.
+				XMFLOAT2 t(0.0f, 0.0f);
+				p += 2;
+				ok = ParseFloat(p, end, t.x);
+				const char* q = SkipBlanks(p, end);
+				if (ok && q < end && StartsNumber(*q))
+					ok = ParseFloat(p, end, t.y);
+				chunk.TexCoords.push_back(t);
+			}
+			else if (end - p > 3 && p[0] == 'v' && p[1] == 'n' && IsBlank(p[2]))
+			{
+				XMFLOAT3 n;
+				p += 2;
+				ok = ParseFloat(p, end, n.x) && ParseFloat(p, end, n.y) && ParseFloat(p, end, n.z);
+				chunk.Normals.push_back(n);
+			}
+			else if (end - p > 2 && p[0] == 'f' && IsBlank(p[1]))
+			{
+				const std::size_t counts[3] = { chunk.Positions.size(), chunk.TexCoords.size(), chunk.Normals.size() };
+				++p;
+				polygon.clear();
+				for (;;)
+				{
+					p = SkipBlanks(p, end);
+					if (p == end || *p == '\n' || *p == '\r' || *p == '#')
+						break;
+					RawCorner c;
+					if (!ParseCorner(p, end, counts, c))
+					{
+						ok = false;
+						break;
+					}
+					polygon.push_back(c);
+				}
+
+				// Faces with fewer than three corners draw nothing and are dropped.
+				for (std::size_t i = 2; ok && i < polygon.size(); ++i)
+				{
+					chunk.Corners.push_back(polygon[0]);
+					chunk.Corners.push_back(polygon[i - 1]);
+					chunk.Corners.push_back(polygon[i]);
+				}
+			}
+
+			if (!ok)
+			{
+				const char* e = LineEnd(line, end);
+				chunk.Error = "malformed line \"" + std::string(line, std::min<std::size_t>(e - line, 80)) + "\"";
+				return;
+			}
+
+			p = LineEnd(p, end);
+			if (p < end)
+				++p;
+		}
+	}
+
+	// Copies the chunk into its slice of out and resolves its face indices.
+	void MergeChunk(Chunk& chunk, ObjParser::Mesh& out)
+	{
+		std::copy(chunk.Positions.begin(), chunk.Positions.end(), out.Positions.begin() + chunk.Base[0]);
+		std::copy(chunk.TexCoords.begin(), chunk.TexCoords.end(), out.TexCoords.begin() + chunk.Base[1]);
+		std::copy(chunk.Normals.begin(), chunk.Normals.end(), out.Normals.begin() + chunk.Base[2]);
+
+		const std::int64_t totals[3] = { (std::int64_t)out.Positions.size(), (std::int64_t)out.TexCoords.size(), (std::int64_t)out.Normals.size() };
+		for (std::size_t i = 0; i < chunk.Corners.size(); ++i)
+		{
+			const RawCorner& c = chunk.Corners[i];
+			int resolved[3];
+			for (int k = 0; k < 3; ++k)
+			{
+				std::int64_t index = -1;
+				if (c.Kind[k] == Absolute)
+					index = c.Value[k];
+				else if (c.Kind[k] == Relative)
+					index = std::int64_t(chunk.Base[k]) + c.Value[k];
+
+				if (c.Kind[k] != Absent && (index < 0 || index >= totals[k]))
+				{
+					chunk.Error = "face index out of range";
+					return;
+				}
+				resolved[k] = static_cast<int>(index);
+			}
+
+			ObjParser::Index& dst = out.Indices[chunk.CornerBase + i];
+			dst.Position = resolved[0];
+			dst.TexC = resolved[1];
+			dst.Normal = resolved[2];
+		}
+	}
+
+	bool FirstError(const std::vector<Chunk>& chunks, const std::string& name)
+	{
+		for (const Chunk& chunk : chunks)
+		{
+			if (!chunk.Error.empty())
+			{
+				std::cerr << "ObjParser: " << name << ": " << chunk.Error << std::endl;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool ParseText(const char* data, std::size_t size, ObjParser::Mesh& out, JobSystem* jobs, const std::string& name)
+	{
+		out = ObjParser::Mesh();
+
+		// A last line without a newline is parsed from a terminated copy so the
+		// number parser never runs off the end of the mapping.
+		const char* end = data + size;
+		const char* bodyEnd = end;
+		while (bodyEnd > data && bodyEnd[-1] != '\n')
+			--bodyEnd;
+		std::string tail(bodyEnd, end);
+		tail += '\n';
+
+		std::vector<Chunk> chunks;
+		for (const char* p = data; p < bodyEnd;)
+		{
+			const char* q = p + std::min<std::size_t>(ObjParser::ChunkBytes, bodyEnd - p);
+			while (q < bodyEnd && q[-1] != '\n')
+				++q;
+			chunks.emplace_back();
+			chunks.back().Begin = p;
+			chunks.back().End = q;
+			p = q;
+		}
+		if (tail.size() > 1)
+		{
+			chunks.emplace_back();
+			chunks.back().Begin = tail.data();
+			chunks.back().End = tail.data() + tail.size();
+		}
+
+		auto forEachChunk = [&](const std::function<void(Chunk&)>& fn)
+		{
+			auto body = [&](std::size_t first, std::size_t last)
+			{
+				for (std::size_t i = first; i < last; ++i)
+				{
+					try
+					{
+						fn(chunks[i]);
+					}
+					catch (const std::exception& e)
+					{
+						chunks[i].Error = e.what();
+					}
+				}
+			};
+			if (jobs)
+				jobs->ParallelFor(chunks.size(), 1, body);
+			else
+				body(0, chunks.size());
+		};
+
+		forEachChunk(ParseChunk);
+		if (FirstError(chunks, name))
+			return false;
+
+		std::size_t totals[3] = { 0, 0, 0 };
+		std::size_t cornerCount = 0;
+		for (Chunk& chunk : chunks)
+		{
+			chunk.Base[0] = totals[0];
+			chunk.Base[1] = totals[1];
+			chunk.Base[2] = totals[2];
+			chunk.CornerBase = cornerCount;
+			totals[0] += chunk.Positions.size();
+			totals[1] += chunk.TexCoords.size();
+			totals[2] += chunk.Normals.size();
+			cornerCount += chunk.Corners.size();
+		}
+		out.Positions.resize(totals[0]);
+		out.TexCoords.resize(totals[1]);
+		out.Normals.resize(totals[2]);
+		out.Indices.resize(cornerCount);
+
+		forEachChunk([&](Chunk& chunk) { MergeChunk(chunk, out); });
+		if (FirstError(chunks, name))
+		{
+			out = ObjParser::Mesh();
+			return false;
+		}
+		return true;
+	}
+}
+
+bool ObjParser::Parse(const std::string& filename, Mesh& out, JobSystem* jobs)
+{
+	MappedFile file;
+	if (!file.Open(filename))
+	{
+		std::cerr << "ObjParser: cannot read " << filename << std::endl;
+		return false;
+	}
+	return ParseText(reinterpret_cast<const char*>(file.Data()), file.Size(), out, jobs, filename);
+}
+
+bool ObjParser::Parse(const char* data, std::size_t size, Mesh& out, JobSystem* jobs)
+{
+	return ParseText(data, size, out, jobs, "<memory>");
+}
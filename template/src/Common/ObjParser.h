@@ -0,0 +1,55 @@
+//***************************************************************************************
+// ObjParser.h
+//
+// Fast reader for the geometry part of Wavefront OBJ files (v, vt, vn and f lines;
+// everything else is skipped).  The file is memory mapped and numbers are parsed
+// in place with Assimp's fast_atof.  Large files are cut into chunks at line
+// boundaries and parsed in parallel; the chunks are then merged in file order, so
+// the result does not depend on the number of threads.
+//
+// Faces may use any of the v, v/vt, v//vn and v/vt/vn forms, negative (relative)
+// indices, and any number of corners; polygons are triangulated as fans.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <DirectXMath.h>
+
+class JobSystem;
+
+class ObjParser
+{
+public:
+
+	// Files are split into chunks of about this many bytes for parallel parsing.
+	static const std::size_t ChunkBytes = 256 * 1024;
+
+	// One face corner, as zero-based indices into the Mesh arrays.  -1 if the
+	// corner has no texture coordinate or normal.
+	struct Index
+	{
+		int Position = -1;
+		int TexC = -1;
+		int Normal = -1;
+	};
+
+	struct Mesh
+	{
+		std::vector<DirectX::XMFLOAT3> Positions;
+		std::vector<DirectX::XMFLOAT3> Normals;
+		std::vector<DirectX::XMFLOAT2> TexCoords;
+		// Three corners per triangle.
+		std::vector<Index> Indices;
+	};
+
+	// Parses filename into out.  Chunks run on jobs if it is not null.  Returns false
+	// and logs the reason if the file cannot be read, a number is malformed or a face
+	// refers to an element that does not exist.
+	static bool Parse(const std::string& filename, Mesh& out, JobSystem* jobs = nullptr);
+
+	// Same, for OBJ text already in memory.
+	static bool Parse(const char* data, std::size_t size, Mesh& out, JobSystem* jobs = nullptr);
+};
@@ -0,0 +1,378 @@
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <emmintrin.h>
+#define OCCLUSION_CULLER_SSE
+#endif
+
+using namespace DirectX;
+
+namespace
+{
+	// Triangles are clipped to this many screens in x and y, which keeps the edge
+	// functions well inside float precision.
+	const float GuardBand = 2.0f;
+
+	struct ClipVertex
+	{
+		float X, Y, Z, W;
+	};
+
+	ClipVertex Transform(const XMFLOAT3& p, const XMFLOAT4X4& m)
+	{
+		return {
+			p.x * m._11 + p.y * m._21 + p.z * m._31 + m._41,
+			p.x * m._12 + p.y * m._22 + p.z * m._32 + m._42,
+			p.x * m._13 + p.y * m._23 + p.z * m._33 + m._43,
+			p.x * m._14 + p.y * m._24 + p.z * m._34 + m._44 };
+	}
+
+	XMFLOAT4X4 Multiply(const XMFLOAT4X4& a, const XMFLOAT4X4& b)
+	{
+		XMFLOAT4X4 r;
+		for (int i = 0; i < 4; ++i)
+			for (int j = 0; j < 4; ++j)
+				r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+		return r;
+	}
+
+	// Signed distance to the clip planes kept by ClipPolygon: near, then the guard
+	// band on each side.
+	float PlaneDistance(const ClipVertex& v, int plane)
+	{
+		switch (plane)
+		{
+		case 0: return v.Z;
+		case 1: return GuardBand * v.W - v.X;
+		case 2: return GuardBand * v.W + v.X;
+		case 3: return GuardBand * v.W - v.Y;
+		default: return GuardBand * v.W + v.Y;
+		}
+	}
+
+	// Sutherland-Hodgman in homogeneous space.  Returns the vertex count, at most 8.
+	int ClipPolygon(ClipVertex* poly, int count)
+	{
+		ClipVertex scratch[8];
+		for (int plane = 0; plane < 5 && count >= 3; ++plane)
+		{
+			int outCount = 0;
+			for (int i = 0; i < count; ++i)
+			{
+				const ClipVertex& a = poly[i];
+				const ClipVertex& b = poly[(i + 1) % count];
+				float da = PlaneDistance(a, plane);
+				float db = PlaneDistance(b, plane);
+				if (da >= 0.0f)
+					scratch[outCount++] = a;
+				if ((da >= 0.0f) != (db >= 0.0f))
+				{
+					float t = da / (da - db);
+					scratch[outCount++] = {
+						a.X + t * (b.X - a.X),
+						a.Y + t * (b.Y - a.Y),
+						a.Z + t * (b.Z - a.Z),
+						a.W + t * (b.W - a.W) };
+				}
+			}
+			std::copy(scratch, scratch + outCount, poly);
+			count = outCount;
+		}
+		return count >= 3 ? count : 0;
+	}
+}
+
+void OcclusionCuller::Resize(int width, int height)
+{
+	mWidth = (std::max(width, 4) + 3) & ~3;
+	mHeight = std::max(height, 1);
+
+	mLevels.clear();
+	int w = mWidth, h = mHeight;
+	for (;;)
+	{
+		Level level;
+		level.Width = w;
+		level.Height = h;
+		level.Depth.assign((std::size_t)w * h, 1.0f);
+		mLevels.push_back(std::move(level));
+		if (w == 1 && h == 1)
+			break;
+		w = (w + 1) / 2;
+		h = (h + 1) / 2;
+	}
+}
+
+void OcclusionCuller::Begin(const XMFLOAT4X4& viewProj)
+{
+	mViewProj = viewProj;
+	mOccluders.clear();
+	mTriangles.clear();
+}
+
+void OcclusionCuller::AddOccluder(
+	const XMFLOAT3* positions,
+	std::size_t vertexCount,
+	const std::uint32_t* indices,
+	std::size_t indexCount,
+	const XMFLOAT4X4& world)
+{
+	mOccluders.push_back({ positions, vertexCount, indices, indexCount, world });
+}
+
+void OcclusionCuller::Rasterize(JobSystem* jobs)
+{
+	// Set up the triangles of each occluder separately, then concatenate them in
+	// order so the result does not depend on scheduling.
+	std::vector<std::vector<Triangle>> perOccluder(mOccluders.size());
+	auto setup = [&](std::size_t first, std::size_t last)
+	{
+		for (std::size_t i = first; i < last; ++i)
+			SetupTriangles(mOccluders[i], perOccluder[i]);
+	};
+	if (jobs)
+		jobs->ParallelFor(mOccluders.size(), 1, setup);
+	else
+		setup(0, mOccluders.size());
+
+	mTriangles.clear();
+	for (const auto& triangles : perOccluder)
+		mTriangles.insert(mTriangles.end(), triangles.begin(), triangles.end());
+
+	// Bin the triangles by the bands of rows they overlap.
+	const int bands = (mHeight + BandRows - 1) / BandRows;
+	mBandTriangles.resize(bands);
+	for (auto& band : mBandTriangles)
+		band.clear();
+	for (std::uint32_t i = 0; i < (std::uint32_t)mTriangles.size(); ++i)
+	{
+		const Triangle& t = mTriangles[i];
+		const int first = std::max(0, (int)(t.MinY - 0.5f) / BandRows);
+		const int last = std::min(bands - 1, (int)std::max(t.MaxY - 0.5f, 0.0f) / BandRows);
+		for (int b = first; b <= last; ++b)
+			mBandTriangles[b].push_back(i);
+	}
+
+	auto raster = [&](std::size_t first, std::size_t last)
+	{
+		for (std::size_t b = first; b < last; ++b)
+			RasterizeBand((int)b, (int)b * BandRows, std::min((int)(b + 1) * BandRows, mHeight));
+	};
+	if (jobs)
+		jobs->ParallelFor(bands, 1, raster);
+	else
+		raster(0, bands);
+
+	BuildPyramid();
+}
+
+void OcclusionCuller::SetupTriangles(const Occluder& occluder, std::vector<Triangle>& out) const
+{
+	const XMFLOAT4X4 m = Multiply(occluder.World, mViewProj);
+	const float halfW = 0.5f * mWidth, halfH = 0.5f * mHeight;
+
+	// Vertices are shared by several triangles; transform each once, and note which
+	// clip planes it is outside of.
+	std::vector<ClipVertex> clip(occluder.VertexCount);
+	std::vector<std::uint8_t> outside(occluder.VertexCount);
+	for (std::size_t v = 0; v < occluder.VertexCount; ++v)
+	{
+		clip[v] = Transform(occluder.Positions[v], m);
+		std::uint8_t bits = 0;
+		for (int plane = 0; plane < 5; ++plane)
+			bits |= (PlaneDistance(clip[v], plane) < 0.0f) << plane;
+		outside[v] = bits;
+	}
+
+	out.reserve(out.size() + occluder.IndexCount / 3);
+	for (std::size_t i = 0; i + 2 < occluder.IndexCount; i += 3)
+	{
+		const std::uint32_t i0 = occluder.Indices[i + 0], i1 = occluder.Indices[i + 1], i2 = occluder.Indices[i + 2];
+		if (outside[i0] & outside[i1] & outside[i2])
+			continue;
+
+		ClipVertex poly[8] = { clip[i0], clip[i1], clip[i2] };
+		const int count = (outside[i0] | outside[i1] | outside[i2]) ? ClipPolygon(poly, 3) : 3;
+
+		// After the near plane w is positive, so the divide is safe.
+		float sx[8], sy[8], sz[8];
+		for (int k = 0; k < count; ++k)
+		{
+			float invW = 1.0f / poly[k].W;
+			sx[k] = (poly[k].X * invW + 1.0f) * halfW;
+			sy[k] = (1.0f - poly[k].Y * invW) * halfH;
+			sz[k] = poly[k].Z * invW;
+		}
+
+		for (int k = 2; k < count; ++k)
+		{
+			const int v[3] = { 0, k - 1, k };
+			float area = (sx[v[1]] - sx[v[0]]) * (sy[v[2]] - sy[v[0]]) - (sx[v[2]] - sx[v[0]]) * (sy[v[1]] - sy[v[0]]);
+			if (std::fabs(area) < 1.0e-6f)
+				continue;
+
+			// Edge e is opposite vertex e: cross(a - p, b - p) for the other two.
+			Triangle t;
+			float sign = area > 0.0f ? 1.0f : -1.0f;
+			for (int e = 0; e < 3; ++e)
+			{
+				const int a = v[(e + 1) % 3], b = v[(e + 2) % 3];
+				float A = sy[a] - sy[b], B = sx[b] - sx[a], C = sx[a] * sy[b] - sy[a] * sx[b];
+				t.Edge[e][0] = A * sign;
+				t.Edge[e][1] = B * sign;
+				t.Edge[e][2] = C * sign;
+			}
+
+			// Inside, the edge functions are the barycentric weights times |area|.
+			for (int c = 0; c < 3; ++c)
+				t.Depth[c] = (t.Edge[0][c] * sz[v[0]] + t.Edge[1][c] * sz[v[1]] + t.Edge[2][c] * sz[v[2]]) / std::fabs(area);
+
+			t.MinX = std::min({ sx[v[0]], sx[v[1]], sx[v[2]] });
+			t.MaxX = std::max({ sx[v[0]], sx[v[1]], sx[v[2]] });
+			t.MinY = std::min({ sy[v[0]], sy[v[1]], sy[v[2]] });
+			t.MaxY = std::max({ sy[v[0]], sy[v[1]], sy[v[2]] });
+			out.push_back(t);
+		}
+	}
+}
+
+void OcclusionCuller::RasterizeBand(int band, int firstRow, int lastRow)
+{
+	float* depth = mLevels[0].Depth.data();
+	std::fill(depth + (std::size_t)firstRow * mWidth, depth + (std::size_t)lastRow * mWidth, 1.0f);
+
+	for (std::uint32_t index : mBandTriangles[band])
+	{
+		const Triangle& t = mTriangles[index];
+
+		// Pixels whose centers can fall inside the triangle.
+		int y0 = std::max(firstRow, (int)std::ceil(t.MinY - 0.5f));
+		int y1 = std::min(lastRow - 1, (int)std::floor(t.MaxY - 0.5f));
+		int x0 = std::max(0, (int)std::ceil(t.MinX - 0.5f)) & ~3;
+		int x1 = std::min(mWidth - 1, (int)std::floor(t.MaxX - 0.5f));
+		if (y0 > y1 || x0 > x1)
+			continue;
+
+#if defined(OCCLUSION_CULLER_SSE)
+		const __m128 laneX = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 a0 = _mm_set1_ps(t.Edge[0][0]), a1 = _mm_set1_ps(t.Edge[1][0]), a2 = _mm_set1_ps(t.Edge[2][0]);
+		const __m128 za = _mm_set1_ps(t.Depth[0]);
+		for (int y = y0; y <= y1; ++y)
+		{
+			const float py = y + 0.5f;
+			const __m128 r0 = _mm_set1_ps(t.Edge[0][1] * py + t.Edge[0][2]);
+			const __m128 r1 = _mm_set1_ps(t.Edge[1][1] * py + t.Edge[1][2]);
+			const __m128 r2 = _mm_set1_ps(t.Edge[2][1] * py + t.Edge[2][2]);
+			const __m128 rz = _mm_set1_ps(t.Depth[1] * py + t.Depth[2]);
+			float* row = depth + (std::size_t)y * mWidth;
+			for (int x = x0; x <= x1; x += 4)
+			{
+				const __m128 px = _mm_add_ps(_mm_set1_ps((float)x), laneX);
+				__m128 inside = _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a0, px), r0), zero);
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a1, px), r1), zero));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(_mm_mul_ps(a2, px), r2), zero));
+				if (_mm_movemask_ps(inside) == 0)
+					continue;
+
+				const __m128 z = _mm_add_ps(_mm_mul_ps(za, px), rz);
+				const __m128 old = _mm_loadu_ps(row + x);
+				const __m128 nearer = _mm_min_ps(old, z);
+				_mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, nearer), _mm_andnot_ps(inside, old)));
+			}
+		}
+#else
+		for (int y = y0; y <= y1; ++y)
+		{
+			const float py = y + 0.5f;
+			float* row = depth + (std::size_t)y * mWidth;
+			for (int x = x0; x <= x1; ++x)
+			{
+				const float px = x + 0.5f;
+				bool inside = true;
+				for (int e = 0; e < 3; ++e)
+					inside = inside && t.Edge[e][0] * px + t.Edge[e][1] * py + t.Edge[e][2] >= 0.0f;
+				if (inside)
+					row[x] = std::min(row[x], t.Depth[0] * px + t.Depth[1] * py + t.Depth[2]);
+			}
+		}
+#endif
+	}
+}
+
+void OcclusionCuller::BuildPyramid()
+{
+	// Each texel keeps the farthest depth of the four below it, so a box nearer
+	// than a texel is nearer than every pixel the texel covers.
+	for (std::size_t l = 1; l < mLevels.size(); ++l)
+	{
+		const Level& src = mLevels[l - 1];
+		Level& dst = mLevels[l];
+		for (int y = 0; y < dst.Height; ++y)
+		{
+			const int sy0 = 2 * y, sy1 = std::min(2 * y + 1, src.Height - 1);
+			for (int x = 0; x < dst.Width; ++x)
+			{
+				const int sx0 = 2 * x, sx1 = std::min(2 * x + 1, src.Width - 1);
+				dst.Depth[(std::size_t)y * dst.Width + x] = std::max(
+					std::max(src.Depth[(std::size_t)sy0 * src.Width + sx0], src.Depth[(std::size_t)sy0 * src.Width + sx1]),
+					std::max(src.Depth[(std::size_t)sy1 * src.Width + sx0], src.Depth[(std::size_t)sy1 * src.Width + sx1]));
+			}
+		}
+	}
+}
+
+bool OcclusionCuller::IsVisible(const BoundingBox& box) const
+{
+	if (mLevels.empty())
+		return true;
+
+	float minX = FLT_MAX, minY = FLT_MAX, minZ = FLT_MAX;
+	float maxX = -FLT_MAX, maxY = -FLT_MAX;
+	for (int i = 0; i < 8; ++i)
+	{
+		const XMFLOAT3 corner(
+			box.Center.x + ((i & 1) ? box.Extents.x : -box.Extents.x),
+			box.Center.y + ((i & 2) ? box.Extents.y : -box.Extents.y),
+			box.Center.z + ((i & 4) ? box.Extents.z : -box.Extents.z));
+		const ClipVertex c = Transform(corner, mViewProj);
+		if (c.Z < 0.0f)
+			return true;
+
+		const float invW = 1.0f / c.W;
+		minX = std::min(minX, c.X * invW);
+		maxX = std::max(maxX, c.X * invW);
+		minY = std::min(minY, c.Y * invW);
+		maxY = std::max(maxY, c.Y * invW);
+		minZ = std::min(minZ, c.Z * invW);
+	}
+
+	// Every pixel the screen rectangle touches, clamped to the screen.
+	int x0 = (int)std::floor((minX + 1.0f) * 0.5f * mWidth);
+	int x1 = (int)std::floor((maxX + 1.0f) * 0.5f * mWidth);
+	int y0 = (int)std::floor((1.0f - maxY) * 0.5f * mHeight);
+	int y1 = (int)std::floor((1.0f - minY) * 0.5f * mHeight);
+	if (x1 < 0 || y1 < 0 || x0 >= mWidth || y0 >= mHeight)
+		return true;
+	x0 = std::max(x0, 0);
+	y0 = std::max(y0, 0);
+	x1 = std::min(x1, mWidth - 1);
+	y1 = std::min(y1, mHeight - 1);
+
+	// The finest level at which the rectangle spans at most 2x2 texels.
+	std::size_t l = 0;
+	while (l + 1 < mLevels.size() && ((x1 >> l) - (x0 >> l) > 1 || (y1 >> l) - (y0 >> l) > 1))
+		++l;
+
+	const Level& level = mLevels[l];
+	float farthest = 0.0f;
+	for (int y = y0 >> l; y <= (y1 >> l); ++y)
+		for (int x = x0 >> l; x <= (x1 >> l); ++x)
+			farthest = std::max(farthest, level.Depth[(std::size_t)y * level.Width + x]);
+
+	return minZ <= farthest;
+}
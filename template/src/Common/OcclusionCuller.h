@@ -0,0 +1,102 @@
+//***************************************************************************************
+// OcclusionCuller.h
+//
+// Software occlusion culling.  A few low-poly occluders are rasterized into a small
+// CPU depth buffer, 4 pixels per SSE instruction, with the screen cut into bands of
+// rows that run as separate jobs.  A max-depth pyramid (hierarchical Z) is built from
+// the buffer, and bounding boxes are then tested against the level where their
+// screen rectangle spans at most 2x2 texels.
+//
+// Depth follows D3D conventions: clip space z in [0, w], smaller is nearer.  The
+// culler has no GPU dependencies, so it can run headless.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+
+class JobSystem;
+
+class OcclusionCuller
+{
+public:
+
+	// Rows of the depth buffer rasterized by one job.
+	static const int BandRows = 16;
+
+	// Sets the depth buffer size.  The width is rounded up to a multiple of 4.
+	void Resize(int width, int height);
+	int Width() const { return mWidth; }
+	int Height() const { return mHeight; }
+
+	// Starts a frame seen through a row-vector view * projection matrix and drops
+	// the previous frame's occluders.
+	void Begin(const DirectX::XMFLOAT4X4& viewProj);
+
+	// Queues an indexed triangle list to be drawn with the given world matrix.  The
+	// arrays are read by Rasterize and must stay alive until then.
+	void AddOccluder(
+		const DirectX::XMFLOAT3* positions,
+		std::size_t vertexCount,
+		const std::uint32_t* indices,
+		std::size_t indexCount,
+		const DirectX::XMFLOAT4X4& world);
+
+	// Draws the queued occluders and builds the depth pyramid.  Runs on jobs if
+	// it is not null.
+	void Rasterize(JobSystem* jobs = nullptr);
+
+	// False only if the world space box is certainly behind the occluders.  Boxes
+	// crossing the near plane or off screen are reported visible.
+	bool IsVisible(const DirectX::BoundingBox& box) const;
+
+	// Triangles that reached the rasterizer after clipping, for statistics.
+	std::size_t RasterizedTriangles() const { return mTriangles.size(); }
+
+	// Level 0 of the depth pyramid, Width() * Height() values row by row.
+	const std::vector<float>& Depth() const { return mLevels.empty() ? mEmpty : mLevels[0].Depth; }
+
+private:
+	struct Occluder
+	{
+		const DirectX::XMFLOAT3* Positions;
+		std::size_t VertexCount;
+		const std::uint32_t* Indices;
+		std::size_t IndexCount;
+		DirectX::XMFLOAT4X4 World;
+	};
+
+	// A screen space triangle with its edge functions set up; Edge[i] * (x, y, 1)
+	// is non-negative inside, and depth is Depth * (x, y, 1).
+	struct Triangle
+	{
+		float Edge[3][3];
+		float Depth[3];
+		float MinX, MaxX, MinY, MaxY;
+	};
+
+	struct Level
+	{
+		int Width = 0;
+		int Height = 0;
+		std::vector<float> Depth;
+	};
+
+	void SetupTriangles(const Occluder& occluder, std::vector<Triangle>& out) const;
+	void RasterizeBand(int band, int firstRow, int lastRow);
+	void BuildPyramid();
+
+	int mWidth = 0;
+	int mHeight = 0;
+	DirectX::XMFLOAT4X4 mViewProj;
+	std::vector<Occluder> mOccluders;
+	std::vector<Triangle> mTriangles;
+	// Indices into mTriangles of the triangles overlapping each band.
+	std::vector<std::vector<std::uint32_t>> mBandTriangles;
+	std::vector<Level> mLevels;
+	std::vector<float> mEmpty;
+};
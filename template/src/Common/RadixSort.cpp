@@ -0,0 +1,69 @@
+#include "RadixSort.h"
+#include <utility>
+
+namespace
+{
+	const int DigitBits = 8;
+	const int DigitCount = 64 / DigitBits;
+	const std::size_t BucketCount = std::size_t(1) << DigitBits;
+
+	// Below this many entries an insertion sort beats clearing the histograms.
+	const std::size_t InsertionSortLimit = 64;
+}
+
+void RadixSort::Sort(std::vector<Entry>& entries, std::vector<Entry>& scratch)
+{
+	const std::size_t count = entries.size();
+	if (count <= InsertionSortLimit)
+	{
+		for (std::size_t i = 1; i < count; ++i)
+		{
+			const Entry e = entries[i];
+			std::size_t j = i;
+			for (; j > 0 && entries[j - 1].Key > e.Key; --j)
+				entries[j] = entries[j - 1];
+			entries[j] = e;
+		}
+		return;
+	}
+
+	std::uint32_t histograms[DigitCount][BucketCount] = {};
+	for (const Entry& e : entries)
+	{
+		for (int d = 0; d < DigitCount; ++d)
+			++histograms[d][(e.Key >> (d * DigitBits)) & (BucketCount - 1)];
+	}
+
+	scratch.resize(count);
+	Entry* src = entries.data();
+	Entry* dst = scratch.data();
+	for (int d = 0; d < DigitCount; ++d)
+	{
+		std::uint32_t* histogram = histograms[d];
+
+		// Every key has the same digit here; this pass would not move anything.
+		const std::size_t digit = (src[0].Key >> (d * DigitBits)) & (BucketCount - 1);
+		if (histogram[digit] == count)
+			continue;
+
+		// Histogram to starting offsets.
+		std::uint32_t offset = 0;
+		for (std::size_t b = 0; b < BucketCount; ++b)
+		{
+			std::uint32_t n = histogram[b];
+			histogram[b] = offset;
+			offset += n;
+		}
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			const Entry& e = src[i];
+			dst[histogram[(e.Key >> (d * DigitBits)) & (BucketCount - 1)]++] = e;
+		}
+		std::swap(src, dst);
+	}
+
+	// An odd number of passes leaves the result in scratch.
+	if (src != entries.data())
+		entries.swap(scratch);
+}
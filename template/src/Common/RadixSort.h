@@ -0,0 +1,30 @@
+//***************************************************************************************
+// RadixSort.h
+//
+// Least significant digit radix sort of 64-bit keys, 8 bits per pass.  All eight
+// digit histograms are gathered in one read of the input, and passes whose digit
+// is the same for every key are skipped, so keys that only use their high and low
+// bits cost little more than the passes they need.  The sort is stable.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+class RadixSort
+{
+public:
+
+	// A key and the index of whatever it was computed for.
+	struct Entry
+	{
+		std::uint64_t Key;
+		std::uint32_t Value;
+	};
+
+	// Sorts entries by Key, keeping equal keys in their order.  scratch is working
+	// memory; pass the same vector every time to avoid reallocating it.
+	static void Sort(std::vector<Entry>& entries, std::vector<Entry>& scratch);
+};
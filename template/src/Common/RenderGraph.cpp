@@ -0,0 +1,303 @@
+#include "RenderGraph.h"
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	std::uint64_t AlignUp(std::uint64_t value, std::uint64_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	struct Use
+	{
+		std::size_t Order;
+		std::uint32_t State;
+		bool Write;
+	};
+}
+
+void RenderGraph::Clear()
+{
+	mResources.clear();
+	mPasses.clear();
+	mFinalBarriers.clear();
+	mHeapSize = 0;
+	mHeapAlignment = 1;
+}
+
+RenderGraph::Resource RenderGraph::Import(const std::string& name, std::uint32_t initialState, std::uint32_t finalState)
+{
+	ResourceInfo info;
+	info.Name = name;
+	info.Transient = false;
+	info.InitialState = initialState;
+	info.FinalState = finalState;
+	mResources.push_back(info);
+	return Resource(mResources.size() - 1);
+}
+
+RenderGraph::Resource RenderGraph::CreateTransient(const std::string& name, std::uint64_t size, std::uint64_t alignment)
+{
+	assert(size > 0 && alignment > 0);
+	ResourceInfo info;
+	info.Name = name;
+	info.Transient = true;
+	info.Size = size;
+	info.Alignment = alignment;
+	mResources.push_back(info);
+	return Resource(mResources.size() - 1);
+}
+
+void RenderGraph::MarkOutput(Resource r)
+{
+	mResources[r].Output = true;
+}
+
+RenderGraph::Pass RenderGraph::AddPass(const std::string& name, std::function<void()> execute, bool sideEffects)
+{
+	PassInfo info;
+	info.Name = name;
+	info.Execute = std::move(execute);
+	info.SideEffects = sideEffects;
+	mPasses.push_back(std::move(info));
+	return Pass(mPasses.size() - 1);
+}
+
+void RenderGraph::Read(Pass pass, Resource r, std::uint32_t state)
+{
+	mPasses[pass].Accesses.push_back({ r, state, false });
+}
+
+void RenderGraph::Write(Pass pass, Resource r, std::uint32_t state)
+{
+	mPasses[pass].Accesses.push_back({ r, state, true });
+}
+
+void RenderGraph::Compile()
+{
+	for (ResourceInfo& res : mResources)
+	{
+		res.Offset = NoOffset;
+		if (res.Transient)
+			res.InitialState = 0;
+	}
+	for (PassInfo& pass : mPasses)
+		pass.Barriers.clear();
+	mFinalBarriers.clear();
+
+	CullPasses();
+
+	std::vector<Pass> order;
+	for (Pass p = 0; p < mPasses.size(); ++p)
+	{
+		if (mPasses[p].Live)
+			order.push_back(p);
+	}
+
+	PlaceTransients(order);
+	BuildBarriers(order);
+}
+
+void RenderGraph::CullPasses()
+{
+	// Walk back from the outputs.  A pass is live if it has side effects or writes
+	// something a live pass after it reads; its reads are then needed in turn.
+	std::vector<bool> needed(mResources.size());
+	for (std::size_t r = 0; r < mResources.size(); ++r)
+		needed[r] = mResources[r].Output;
+
+	for (std::size_t p = mPasses.size(); p-- > 0;)
+	{
+		PassInfo& pass = mPasses[p];
+		pass.Live = pass.SideEffects;
+		for (const Access& access : pass.Accesses)
+		{
+			if (access.Write && needed[access.Target])
+				pass.Live = true;
+		}
+		if (!pass.Live)
+			continue;
+		for (const Access& access : pass.Accesses)
+		{
+			if (!access.Write)
+				needed[access.Target] = true;
+		}
+	}
+}
+
+void RenderGraph::PlaceTransients(const std::vector<Pass>& order)
+{
+	std::vector<Resource> used;
+	std::vector<bool> seen(mResources.size());
+	for (std::size_t i = 0; i < order.size(); ++i)
+	{
+		for (const Access& access : mPasses[order[i]].Accesses)
+		{
+			ResourceInfo& res = mResources[access.Target];
+			if (!seen[access.Target])
+			{
+				seen[access.Target] = true;
+				res.FirstUse = i;
+				if (res.Transient)
+					used.push_back(access.Target);
+			}
+			res.LastUse = i;
+		}
+	}
+
+	// Largest first, each at the lowest offset clear of the placed resources it is
+	// alive at the same time as.
+	std::stable_sort(used.begin(), used.end(), [this](Resource a, Resource b) {
+		return mResources[a].Size > mResources[b].Size; });
+
+	mHeapSize = 0;
+	mHeapAlignment = 1;
+	std::vector<Resource> placed;
+	std::vector<Resource> conflicts;
+	for (Resource r : used)
+	{
+		ResourceInfo& res = mResources[r];
+		conflicts.clear();
+		for (Resource other : placed)
+		{
+			const ResourceInfo& o = mResources[other];
+			if (res.FirstUse <= o.LastUse && o.FirstUse <= res.LastUse)
+				conflicts.push_back(other);
+		}
+		std::sort(conflicts.begin(), conflicts.end(), [this](Resource a, Resource b) {
+			return mResources[a].Offset < mResources[b].Offset; });
+
+		std::uint64_t offset = 0;
+		for (Resource other : conflicts)
+		{
+			const ResourceInfo& o = mResources[other];
+			if (AlignUp(offset, res.Alignment) + res.Size <= o.Offset)
+				break;
+			offset = std::max(offset, o.Offset + o.Size);
+		}
+		res.Offset = AlignUp(offset, res.Alignment);
+		placed.push_back(r);
+
+		mHeapSize = std::max(mHeapSize, res.Offset + res.Size);
+		mHeapAlignment = std::max(mHeapAlignment, res.Alignment);
+	}
+}
+
+bool RenderGraph::Aliased(Resource r) const
+{
+	const ResourceInfo& res = mResources[r];
+	for (std::size_t other = 0; other < mResources.size(); ++other)
+	{
+		const ResourceInfo& o = mResources[other];
+		if (other == r || !o.Transient || o.Offset == NoOffset)
+			continue;
+		if (res.Offset < o.Offset + o.Size && o.Offset < res.Offset + res.Size)
+			return true;
+	}
+	return false;
+}
+
+void RenderGraph::BuildBarriers(const std::vector<Pass>& order)
+{
+	// The uses of each resource in live pass order, one per pass with the states of
+	// its accesses combined.
+	std::vector<std::vector<Use>> uses(mResources.size());
+	for (std::size_t i = 0; i < order.size(); ++i)
+	{
+		for (const Access& access : mPasses[order[i]].Accesses)
+		{
+			std::vector<Use>& list = uses[access.Target];
+			if (!list.empty() && list.back().Order == i)
+			{
+				list.back().State |= access.State;
+				list.back().Write = list.back().Write || access.Write;
+			}
+			else
+				list.push_back({ i, access.State, access.Write });
+		}
+	}
+
+	// A run of reads needs the resource in the union of their states, so it is
+	// transitioned once at the start of the run.
+	for (std::vector<Use>& list : uses)
+	{
+		for (std::size_t begin = 0; begin < list.size();)
+		{
+			std::size_t end = begin + 1;
+			if (!list[begin].Write)
+			{
+				std::uint32_t state = list[begin].State;
+				while (end < list.size() && !list[end].Write)
+					state |= list[end++].State;
+				for (std::size_t u = begin; u < end; ++u)
+					list[u].State = state;
+			}
+			begin = end;
+		}
+	}
+
+	std::vector<std::vector<Barrier>> aliasing(order.size());
+	std::vector<std::vector<Barrier>> transitions(order.size());
+	for (Resource r = 0; r < mResources.size(); ++r)
+	{
+		ResourceInfo& res = mResources[r];
+		const std::vector<Use>& list = uses[r];
+
+		std::uint32_t state = res.InitialState;
+		if (res.Transient && !list.empty())
+		{
+			state = res.InitialState = list.back().State;
+			if (Aliased(r))
+				aliasing[list.front().Order].push_back({ BarrierType::Aliasing, r, 0, 0 });
+		}
+
+		for (const Use& use : list)
+		{
+			if (use.State != state)
+				transitions[use.Order].push_back({ BarrierType::Transition, r, state, use.State });
+			state = use.State;
+		}
+
+		if (!res.Transient && state != res.FinalState)
+			mFinalBarriers.push_back({ BarrierType::Transition, r, state, res.FinalState });
+	}
+
+	for (std::size_t i = 0; i < order.size(); ++i)
+	{
+		std::vector<Barrier>& barriers = mPasses[order[i]].Barriers;
+		barriers = std::move(aliasing[i]);
+		barriers.insert(barriers.end(), transitions[i].begin(), transitions[i].end());
+	}
+}
+
+void RenderGraph::Execute(const std::function<void(const std::vector<Barrier>&)>& issueBarriers) const
+{
+	for (const PassInfo& pass : mPasses)
+	{
+		if (!pass.Live)
+			continue;
+		if (!pass.Barriers.empty())
+			issueBarriers(pass.Barriers);
+		if (pass.Execute)
+			pass.Execute();
+	}
+	if (!mFinalBarriers.empty())
+		issueBarriers(mFinalBarriers);
+}
+
+std::size_t RenderGraph::LivePassCount() const
+{
+	std::size_t count = 0;
+	for (const PassInfo& pass : mPasses)
+		count += pass.Live ? 1 : 0;
+	return count;
+}
+
+std::size_t RenderGraph::BarrierCount() const
+{
+	std::size_t count = mFinalBarriers.size();
+	for (const PassInfo& pass : mPasses)
+		count += pass.Barriers.size();
+	return count;
+}
@@ -0,0 +1,141 @@
+//***************************************************************************************
+// RenderGraph.h
+//
+// Describes a frame as passes that declare which resources they read and write, in
+// the state they need them.  Compile works out everything the passes would
+// otherwise do by hand:
+//
+//  - passes whose writes nothing live consumes are culled, walking back from the
+//    resources marked as outputs and the passes with side effects;
+//  - each pass gets one batch of barriers covering all of its resources, and a run
+//    of passes that only read a resource shares a single transition to the union
+//    of their read states;
+//  - transient resources, which live only between their first and last use, are
+//    placed in one heap, and those whose lifetimes do not overlap share memory.
+//
+// Resources and states are opaque (handles are 64-bit values, states bit masks that
+// may be ORed when several reads need the resource at once), so the graph knows
+// nothing of D3D12 and Compile can be checked anywhere.  Imported resources start
+// each frame in their initial state and are returned to their final state at the
+// end.  A transient starts each frame in the state its last use left it in, so the
+// barriers are the same every frame; it must be created in InitialState.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+class RenderGraph
+{
+public:
+	typedef std::uint32_t Resource;
+	typedef std::uint32_t Pass;
+
+	static const std::uint64_t NoOffset = ~std::uint64_t(0);
+
+	enum class BarrierType : std::uint8_t
+	{
+		Transition,
+		// Target becomes the resource using its memory.  Its contents are undefined
+		// until the pass writes them in full.
+		Aliasing
+	};
+
+	struct Barrier
+	{
+		BarrierType Type;
+		Resource Target;
+		std::uint32_t Before;
+		std::uint32_t After;
+	};
+
+	// Drops all passes and resources.
+	void Clear();
+
+	Resource Import(const std::string& name, std::uint32_t initialState, std::uint32_t finalState);
+	Resource CreateTransient(const std::string& name, std::uint64_t size, std::uint64_t alignment);
+	// Keeps the passes writing r alive.
+	void MarkOutput(Resource r);
+
+	// Passes run in the order they are added.
+	Pass AddPass(const std::string& name, std::function<void()> execute, bool sideEffects = false);
+	void Read(Pass pass, Resource r, std::uint32_t state);
+	void Write(Pass pass, Resource r, std::uint32_t state);
+
+	void Compile();
+
+	void SetHandle(Resource r, std::uint64_t handle) { mResources[r].Handle = handle; }
+	std::uint64_t Handle(Resource r) const { return mResources[r].Handle; }
+
+	// Runs the live passes, handing each one's barriers to issueBarriers first, then
+	// the barriers returning imported resources to their final state.  Empty batches
+	// are skipped.
+	void Execute(const std::function<void(const std::vector<Barrier>&)>& issueBarriers) const;
+
+	// Results of Compile.
+	bool Live(Pass pass) const { return mPasses[pass].Live; }
+	std::size_t LivePassCount() const;
+	const std::vector<Barrier>& BarriersBefore(Pass pass) const { return mPasses[pass].Barriers; }
+	const std::vector<Barrier>& FinalBarriers() const { return mFinalBarriers; }
+	std::size_t BarrierCount() const;
+
+	// NoOffset for a transient no live pass uses.
+	std::uint64_t Offset(Resource r) const { return mResources[r].Offset; }
+	std::uint32_t InitialState(Resource r) const { return mResources[r].InitialState; }
+	std::uint64_t TransientHeapSize() const { return mHeapSize; }
+	std::uint64_t TransientHeapAlignment() const { return mHeapAlignment; }
+
+	const std::string& Name(Resource r) const { return mResources[r].Name; }
+	const std::string& PassName(Pass pass) const { return mPasses[pass].Name; }
+
+private:
+	struct ResourceInfo
+	{
+		std::string Name;
+		bool Transient;
+		bool Output = false;
+		std::uint32_t InitialState = 0;
+		std::uint32_t FinalState = 0;
+		std::uint64_t Size = 0;
+		std::uint64_t Alignment = 1;
+		std::uint64_t Handle = 0;
+
+		// Live pass order indices of the first and last use.
+		std::size_t FirstUse;
+		std::size_t LastUse;
+		std::uint64_t Offset = NoOffset;
+	};
+
+	struct Access
+	{
+		Resource Target;
+		std::uint32_t State;
+		bool Write;
+	};
+
+	struct PassInfo
+	{
+		std::string Name;
+		std::function<void()> Execute;
+		bool SideEffects;
+		std::vector<Access> Accesses;
+
+		bool Live = false;
+		std::vector<Barrier> Barriers;
+	};
+
+	void CullPasses();
+	void PlaceTransients(const std::vector<Pass>& order);
+	void BuildBarriers(const std::vector<Pass>& order);
+	bool Aliased(Resource r) const;
+
+	std::vector<ResourceInfo> mResources;
+	std::vector<PassInfo> mPasses;
+	std::vector<Barrier> mFinalBarriers;
+	std::uint64_t mHeapSize = 0;
+	std::uint64_t mHeapAlignment = 1;
+};
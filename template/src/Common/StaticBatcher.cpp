@@ -0,0 +1,115 @@
+#include "StaticBatcher.h"
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+
+namespace
+{
+	// The indices of a mesh's LOD level, or of its coarsest level past the last.
+	const GeometryGenerator::MeshLod* LodOrCoarsest(const GeometryGenerator::MeshData& mesh, std::size_t level)
+	{
+		if (mesh.Lods.empty())
+			return nullptr;
+		return &mesh.Lods[std::min(level, mesh.Lods.size() - 1)];
+	}
+
+	void AppendIndices(const std::vector<std::uint32_t>& src, std::uint32_t baseVertex, std::vector<std::uint32_t>& dst)
+	{
+		for (std::uint32_t index : src)
+			dst.push_back(baseVertex + index);
+	}
+}
+
+std::vector<GeometryGenerator::MeshData> StaticBatcher::Merge(
+	const std::vector<GeometryGenerator::MeshData>& meshes,
+	std::vector<std::vector<std::size_t>>* parts)
+{
+	// Assign every mesh to the open batch of its material, opening a new one when
+	// the mesh would not fit.
+	std::vector<std::vector<std::size_t>> batchParts;
+	std::vector<std::size_t> batchVertices;
+	std::unordered_map<std::string, std::size_t> openBatch;
+	for (std::size_t m = 0; m < meshes.size(); ++m)
+	{
+		const std::size_t vertexCount = meshes[m].Vertices.size();
+		auto it = openBatch.find(meshes[m].matName);
+		if (it == openBatch.end() || batchVertices[it->second] + vertexCount > MaxVertices)
+		{
+			openBatch[meshes[m].matName] = batchParts.size();
+			batchParts.emplace_back();
+			batchVertices.push_back(0);
+			it = openBatch.find(meshes[m].matName);
+		}
+		batchParts[it->second].push_back(m);
+		batchVertices[it->second] += vertexCount;
+	}
+
+	std::vector<GeometryGenerator::MeshData> batches(batchParts.size());
+	for (std::size_t b = 0; b < batches.size(); ++b)
+	{
+		GeometryGenerator::MeshData& batch = batches[b];
+		const std::vector<std::size_t>& members = batchParts[b];
+		batch.matName = meshes[members[0]].matName;
+		batch.texfile = meshes[members[0]].texfile;
+		batch.Vertices.reserve(batchVertices[b]);
+
+		// Full resolution indices and clusters, part after part.
+		std::vector<std::uint32_t> baseVertex;
+		std::size_t lodCount = 0;
+		for (std::size_t m : members)
+		{
+			const GeometryGenerator::MeshData& mesh = meshes[m];
+			baseVertex.push_back(static_cast<std::uint32_t>(batch.Vertices.size()));
+			const std::uint32_t firstIndex = static_cast<std::uint32_t>(batch.Indices32.size());
+
+			batch.Vertices.insert(batch.Vertices.end(), mesh.Vertices.begin(), mesh.Vertices.end());
+			AppendIndices(mesh.Indices32, baseVertex.back(), batch.Indices32);
+			for (GeometryGenerator::Meshlet meshlet : mesh.Meshlets)
+			{
+				meshlet.FirstIndex += firstIndex;
+				batch.Meshlets.push_back(meshlet);
+			}
+			lodCount = std::max(lodCount, mesh.Lods.size());
+		}
+
+		// A part without LODs stays at full resolution in every level, and its error
+		// stays zero.
+		batch.Lods.resize(lodCount);
+		for (std::size_t level = 0; level < lodCount; ++level)
+		{
+			GeometryGenerator::MeshLod& lod = batch.Lods[level];
+			for (std::size_t p = 0; p < members.size(); ++p)
+			{
+				const GeometryGenerator::MeshData& mesh = meshes[members[p]];
+				const GeometryGenerator::MeshLod* src = LodOrCoarsest(mesh, level);
+				AppendIndices(src ? src->Indices32 : mesh.Indices32, baseVertex[p], lod.Indices32);
+				if (src)
+					lod.Error = std::max(lod.Error, src->Error);
+			}
+		}
+	}
+
+	if (parts)
+		*parts = std::move(batchParts);
+	return batches;
+}
+
+std::size_t StaticBatcher::MaxIndexCount(const std::vector<GeometryGenerator::MeshData>& meshes)
+{
+	std::size_t lodCount = 0;
+	for (const auto& mesh : meshes)
+		lodCount = std::max(lodCount, mesh.Lods.size());
+
+	// Each part contributes its own levels, then repeats its coarsest one up to the
+	// deepest chain of any batch.
+	std::size_t count = 0;
+	for (const auto& mesh : meshes)
+	{
+		count += mesh.Indices32.size();
+		for (const auto& lod : mesh.Lods)
+			count += lod.Indices32.size();
+		const GeometryGenerator::MeshLod* coarsest = LodOrCoarsest(mesh, lodCount);
+		count += (lodCount - mesh.Lods.size()) * (coarsest ? coarsest->Indices32.size() : mesh.Indices32.size());
+	}
+	return count;
+}
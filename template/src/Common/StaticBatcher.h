@@ -0,0 +1,38 @@
+//***************************************************************************************
+// StaticBatcher.h
+//
+// Load-time batching of static geometry.  The submeshes of an asset that is placed
+// with a single transform are merged by material: their vertices are concatenated
+// and their indices rebased, so each material becomes one contiguous index range
+// drawn with one call instead of one call per submesh.
+//
+// Merging keeps what the renderer culls and selects LODs with.  Clusters move along
+// with their triangles and keep their bounds, and LOD level k of a batch is level k
+// of every part, falling back to a part's coarsest level once it has no more.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "GeometryGenerator.h"
+
+class StaticBatcher
+{
+public:
+
+	// Most vertices in one batch, so batches can still use 16-bit indices.
+	static const std::size_t MaxVertices = 65536;
+
+	// Merges meshes sharing matName into batches of at most MaxVertices vertices,
+	// in order of each material's first appearance.  The meshes must be in the
+	// same object space.  If parts is not null, parts[b] receives the indices into
+	// meshes that went into batch b.
+	static std::vector<GeometryGenerator::MeshData> Merge(
+		const std::vector<GeometryGenerator::MeshData>& meshes,
+		std::vector<std::vector<std::size_t>>* parts = nullptr);
+
+	// Most indices, LODs included, that Merge can produce from meshes.
+	static std::size_t MaxIndexCount(const std::vector<GeometryGenerator::MeshData>& meshes);
+};
@@ -0,0 +1,54 @@
+#include "UploadRing.h"
+#include <cassert>
+
+UploadRing::UploadRing(std::uint64_t capacity)
+	: mCapacity(capacity)
+{
+}
+
+bool UploadRing::Allocate(std::uint64_t size, std::uint64_t alignment, std::uint64_t& offset)
+{
+	assert(alignment != 0 && (alignment & (alignment - 1)) == 0);
+	if (size > mCapacity)
+		return false;
+
+	// Pad up to the alignment, or skip to the start of the ring if the block would
+	// run past the end.
+	std::uint64_t position = mHead;
+	std::uint64_t start = ((position % mCapacity) + alignment - 1) & ~(alignment - 1);
+	if (start + size > mCapacity)
+	{
+		position += mCapacity - position % mCapacity;
+		start = 0;
+	}
+	position += start - position % mCapacity;
+
+	// With nothing in use the skipped bytes need not be kept, so any block up to the
+	// capacity fits.
+	if (mTail == mHead)
+		mTail = position;
+
+	if (position + size - mTail > mCapacity)
+		return false;
+
+	mHead = position + size;
+	offset = start;
+	return true;
+}
+
+void UploadRing::Submit(std::uint64_t fence)
+{
+	if (mHead == mSubmittedHead)
+		return;
+	mSubmissions.push_back({ fence, mHead });
+	mSubmittedHead = mHead;
+}
+
+void UploadRing::Retire(std::uint64_t completedFence)
+{
+	while (!mSubmissions.empty() && mSubmissions.front().Fence <= completedFence)
+	{
+		mTail = mSubmissions.front().End;
+		mSubmissions.pop_front();
+	}
+}
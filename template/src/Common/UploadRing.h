@@ -0,0 +1,54 @@
+//***************************************************************************************
+// UploadRing.h
+//
+// Space management of a ring buffer of staging memory shared by all the copies to
+// static GPU resources.  Allocate takes space at the head, wrapping to the start when
+// a request does not fit before the end.  Submit closes the copies allocated since
+// the last call with the fence value the GPU signals after executing them, and
+// Retire moves the tail past every submission whose fence has completed.  Offsets
+// are all this class deals in; D3D12UploadRing owns the memory.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <deque>
+
+class UploadRing
+{
+public:
+	explicit UploadRing(std::uint64_t capacity);
+
+	// Reserves size bytes at a multiple of alignment, a power of two, and returns
+	// their offset from the start of the ring.  Returns false, changing nothing, if
+	// they do not fit until more submissions retire.
+	bool Allocate(std::uint64_t size, std::uint64_t alignment, std::uint64_t& offset);
+
+	// The allocations made since the last Submit are in use until fence completes.
+	void Submit(std::uint64_t fence);
+
+	// Frees the allocations of every submission with a fence up to completedFence.
+	void Retire(std::uint64_t completedFence);
+
+	std::uint64_t Capacity() const { return mCapacity; }
+	// Bytes not yet retired, including the padding skipped when wrapping.
+	std::uint64_t UsedBytes() const { return mHead - mTail; }
+	// Bytes allocated but not yet submitted.
+	std::uint64_t PendingBytes() const { return mHead - mSubmittedHead; }
+
+private:
+	struct Submission
+	{
+		std::uint64_t Fence;
+		std::uint64_t End;
+	};
+
+	std::uint64_t mCapacity;
+
+	// Positions count every byte ever allocated, so the ring offset is the position
+	// modulo the capacity and head - tail is the space in use.
+	std::uint64_t mHead = 0;
+	std::uint64_t mTail = 0;
+	std::uint64_t mSubmittedHead = 0;
+	std::deque<Submission> mSubmissions;
+};
@@ -0,0 +1,147 @@
+#include "VertexQuantization.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+// Measured over VertexQuantizationTest's direction set with the best-of-four rounding in
+// EncodeDirection, then given some headroom.
+const float VertexQuantization::DirectionErrorBound = 6.0e-5f;
+const float VertexQuantization::TexCoordRelativeErrorBound = 1.0f / 2048.0f;
+const float VertexQuantization::TexCoordAbsoluteErrorBound = 1.0f / 16777216.0f;
+
+namespace
+{
+	const float SnormScale = 32767.0f;
+	const float MinExtent = 1.0e-6f;
+
+	std::int16_t EncodeSnorm16(float v)
+	{
+		v = std::min(std::max(v, -1.0f), 1.0f);
+		return (std::int16_t)std::lround(v * SnormScale);
+	}
+
+	// Same as the input assembler's SNORM conversion: -32768 and -32767 both map to -1.
+	float DecodeSnorm16(std::int16_t v)
+	{
+		return std::max(float(v) / SnormScale, -1.0f);
+	}
+
+	float SignNotZero(float v)
+	{
+		return v >= 0.0f ? 1.0f : -1.0f;
+	}
+
+	XMFLOAT3 OctDecode(float x, float y)
+	{
+		XMFLOAT3 n(x, y, 1.0f - std::fabs(x) - std::fabs(y));
+		float t = std::max(-n.z, 0.0f);
+		n.x += n.x >= 0.0f ? -t : t;
+		n.y += n.y >= 0.0f ? -t : t;
+		float len = std::sqrt(n.x * n.x + n.y * n.y + n.z * n.z);
+		return XMFLOAT3(n.x / len, n.y / len, n.z / len);
+	}
+
+	float AngleBetween(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		// atan2 of |cross| and dot stays accurate for tiny angles, unlike acos.
+		XMFLOAT3 c(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+		float s = std::sqrt(c.x * c.x + c.y * c.y + c.z * c.z);
+		return std::atan2(s, a.x * b.x + a.y * b.y + a.z * b.z);
+	}
+
+}
+
+XMFLOAT3 VertexQuantization::QuantizationExtents(const XMFLOAT3& extents)
+{
+	return XMFLOAT3(std::max(extents.x, MinExtent), std::max(extents.y, MinExtent), std::max(extents.z, MinExtent));
+}
+
+XMFLOAT3 VertexQuantization::PositionErrorBound(const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	XMFLOAT3 e = QuantizationExtents(extents);
+	auto bound = [](float c, float e)
+	{
+		return e * (0.5f / SnormScale) + 4.0f * FLT_EPSILON * (std::fabs(c) + e);
+	};
+	return XMFLOAT3(bound(center.x, e.x), bound(center.y, e.y), bound(center.z, e.z));
+}
+
+void VertexQuantization::EncodePosition(const XMFLOAT3& p, const XMFLOAT3& center, const XMFLOAT3& extents, std::int16_t out[4])
+{
+	XMFLOAT3 e = QuantizationExtents(extents);
+	out[0] = EncodeSnorm16((p.x - center.x) / e.x);
+	out[1] = EncodeSnorm16((p.y - center.y) / e.y);
+	out[2] = EncodeSnorm16((p.z - center.z) / e.z);
+	out[3] = 0;
+}
+
+XMFLOAT3 VertexQuantization::DecodePosition(const std::int16_t in[4], const XMFLOAT3& center, const XMFLOAT3& extents)
+{
+	XMFLOAT3 e = QuantizationExtents(extents);
+	return XMFLOAT3(
+		center.x + DecodeSnorm16(in[0]) * e.x,
+		center.y + DecodeSnorm16(in[1]) * e.y,
+		center.z + DecodeSnorm16(in[2]) * e.z);
+}
+
+void VertexQuantization::EncodeDirection(const XMFLOAT3& v, std::int16_t out[2])
+{
+	float l1 = std::fabs(v.x) + std::fabs(v.y) + std::fabs(v.z);
+	if (!(l1 > 0.0f) || !std::isfinite(l1))
+	{
+		out[0] = 0;
+		out[1] = 0;
+		return;
+	}
+
+	float x = v.x / l1;
+	float y = v.y / l1;
+	if (v.z < 0.0f)
+	{
+		float fx = (1.0f - std::fabs(y)) * SignNotZero(x);
+		float fy = (1.0f - std::fabs(x)) * SignNotZero(y);
+		x = fx;
+		y = fy;
+	}
+
+	// Plain rounding can be a step off the closest representable direction; try
+	// the four neighbouring grid points and keep the best one.
+	float len = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+	XMFLOAT3 n(v.x / len, v.y / len, v.z / len);
+	float fx = std::floor(std::min(std::max(x, -1.0f), 1.0f) * SnormScale);
+	float fy = std::floor(std::min(std::max(y, -1.0f), 1.0f) * SnormScale);
+	float bestError = FLT_MAX;
+	for (int i = 0; i < 4; ++i)
+	{
+		float qx = std::min(fx + float(i & 1), SnormScale);
+		float qy = std::min(fy + float(i >> 1), SnormScale);
+		std::int16_t cx = (std::int16_t)qx;
+		std::int16_t cy = (std::int16_t)qy;
+		float error = AngleBetween(n, OctDecode(DecodeSnorm16(cx), DecodeSnorm16(cy)));
+		if (error < bestError)
+		{
+			bestError = error;
+			out[0] = cx;
+			out[1] = cy;
+		}
+	}
+}
+
+XMFLOAT3 VertexQuantization::DecodeDirection(const std::int16_t in[2])
+{
+	return OctDecode(DecodeSnorm16(in[0]), DecodeSnorm16(in[1]));
+}
+
+void VertexQuantization::EncodeTexCoord(const XMFLOAT2& uv, HALF out[2])
+{
+	out[0] = XMConvertFloatToHalf(uv.x);
+	out[1] = XMConvertFloatToHalf(uv.y);
+}
+
+XMFLOAT2 VertexQuantization::DecodeTexCoord(const HALF in[2])
+{
+	return XMFLOAT2(XMConvertHalfToFloat(in[0]), XMConvertHalfToFloat(in[1]));
+}
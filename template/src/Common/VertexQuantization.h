@@ -0,0 +1,48 @@
+//***************************************************************************************
+// VertexQuantization.h
+//
+// Encode/decode routines for the compact vertex format:
+//   - positions as snorm16 relative to the bounding box of their submesh,
+//   - normals and tangents as octahedral snorm16 pairs,
+//   - texture coordinates as half floats.
+// The decode functions mirror what the input assembler and the COMPACT_VERTEX
+// shader path do, so CPU and GPU see the same values.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdint>
+#include <DirectXMath.h>
+#include <DirectXPackedVector.h>
+
+class VertexQuantization
+{
+public:
+
+	// Worst-case decode error of a unit direction, in radians.
+	static const float DirectionErrorBound;
+
+	// Worst-case relative decode error of a texture coordinate (half has 11 bits of
+	// mantissa).  Values below the smallest normal half are bounded absolutely by
+	// TexCoordAbsoluteErrorBound instead.
+	static const float TexCoordRelativeErrorBound;
+	static const float TexCoordAbsoluteErrorBound;
+
+	// Box extents actually used for quantization.  Flat boxes get a tiny non-zero
+	// extent so nothing divides by zero.  Pass the same value to the shader.
+	static DirectX::XMFLOAT3 QuantizationExtents(const DirectX::XMFLOAT3& extents);
+
+	// Per-axis worst-case decode error for positions quantized against the box
+	// (center, extents): half a quantization step plus float rounding.
+	static DirectX::XMFLOAT3 PositionErrorBound(const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents);
+
+	static void EncodePosition(const DirectX::XMFLOAT3& p, const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents, std::int16_t out[4]);
+	static DirectX::XMFLOAT3 DecodePosition(const std::int16_t in[4], const DirectX::XMFLOAT3& center, const DirectX::XMFLOAT3& extents);
+
+	// v does not need to be normalized.  A zero vector encodes as +Z.
+	static void EncodeDirection(const DirectX::XMFLOAT3& v, std::int16_t out[2]);
+	static DirectX::XMFLOAT3 DecodeDirection(const std::int16_t in[2]);
+
+	static void EncodeTexCoord(const DirectX::XMFLOAT2& uv, DirectX::PackedVector::HALF out[2]);
+	static DirectX::XMFLOAT2 DecodeTexCoord(const DirectX::PackedVector::HALF in[2]);
+};
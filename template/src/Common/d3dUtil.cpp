@@ -1,9 +1,11 @@
 
 #include "d3dUtil.h"
+#include "D3D12UploadRing.h"
 #include <comdef.h>
 #include <fstream>
 
 using Microsoft::WRL::ComPtr;
+using namespace DirectX;
 
 DxException::DxException(HRESULT hr, const std::wstring& functionName, const std::wstring& filename, int lineNumber) :
     ErrorCode(hr),
@@ -36,55 +38,74 @@ ComPtr<ID3DBlob> d3dUtil::LoadBinary(const std::wstring& filename)
 }
 
 Microsoft::WRL::ComPtr<ID3D12Resource> d3dUtil::CreateDefaultBuffer(
-    ID3D12Device* device,
-    ID3D12GraphicsCommandList* cmdList,
-    const void* initData,
-    UINT64 byteSize,
-    Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer)
+	ID3D12Device* device,
+	ID3D12GraphicsCommandList* cmdList,
+	const void* initData,
+	UINT64 byteSize,
+	D3D12UploadRing& uploadRing)
 {
-    ComPtr<ID3D12Resource> defaultBuffer;
-
-    // Create the actual default buffer resource.
-    ThrowIfFailed(device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
-        D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
+	ComPtr<ID3D12Resource> defaultBuffer;
+	ThrowIfFailed(device->CreateCommittedResource(
+		&CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_DEFAULT),
+		D3D12_HEAP_FLAG_NONE,
+		&CD3DX12_RESOURCE_DESC::Buffer(byteSize),
 		D3D12_RESOURCE_STATE_COMMON,
-        nullptr,
-        IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
+		nullptr,
+		IID_PPV_ARGS(defaultBuffer.GetAddressOf())));
 
-    // In order to copy CPU memory data into our default buffer, we need to create
-    // an intermediate upload heap. 
-    ThrowIfFailed(device->CreateCommittedResource(
-        &CD3DX12_HEAP_PROPERTIES(D3D12_HEAP_TYPE_UPLOAD),
-		D3D12_HEAP_FLAG_NONE,
-        &CD3DX12_RESOURCE_DESC::Buffer(byteSize),
-		D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(uploadBuffer.GetAddressOf())));
-
-
-    // Describe the data we want to copy into the default buffer.
-    D3D12_SUBRESOURCE_DATA subResourceData = {};
-    subResourceData.pData = initData;
-    subResourceData.RowPitch = byteSize;
-    subResourceData.SlicePitch = subResourceData.RowPitch;
-
-    // Schedule to copy the data to the default buffer resource.  At a high level, the helper function UpdateSubresources
-    // will copy the CPU memory into the intermediate upload heap.  Then, using ID3D12CommandList::CopySubresourceRegion,
-    // the intermediate upload heap data will be copied to mBuffer.
-	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(), 
+	D3D12_SUBRESOURCE_DATA subResourceData = {};
+	subResourceData.pData = initData;
+	subResourceData.RowPitch = byteSize;
+	subResourceData.SlicePitch = subResourceData.RowPitch;
+
+	// The data is copied into the ring now, so initData need not outlive this call.
+	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
 		D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST));
-    UpdateSubresources<1>(cmdList, defaultBuffer.Get(), uploadBuffer.Get(), 0, 0, 1, &subResourceData);
+	uploadRing.Upload(cmdList, defaultBuffer.Get(), 0, 1, &subResourceData);
 	cmdList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(defaultBuffer.Get(),
 		D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_GENERIC_READ));
 
-    // Note: uploadBuffer has to be kept alive after the above function calls because
-    // the command list has not been executed yet that performs the actual copy.
-    // The caller can Release the uploadBuffer after it knows the copy has been executed.
-
+	return defaultBuffer;
+}
 
-    return defaultBuffer;
+void d3dUtil::ComputeBounds(
+    const XMFLOAT3* positions,
+    UINT count,
+    UINT stride,
+    BoundingBox& box,
+    BoundingSphere& sphere)
+{
+    if (count == 0)
+    {
+        box = BoundingBox(XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(0.0f, 0.0f, 0.0f));
+        sphere = BoundingSphere(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.0f);
+        return;
+    }
+
+    auto at = [&](UINT i)
+    {
+        return XMLoadFloat3(reinterpret_cast<const XMFLOAT3*>(reinterpret_cast<const BYTE*>(positions) + size_t(i) * stride));
+    };
+
+    // One SIMD pass for the box, a second for the farthest point from its center.
+    XMVECTOR vMin = at(0);
+    XMVECTOR vMax = vMin;
+    for (UINT i = 1; i < count; ++i)
+    {
+        XMVECTOR p = at(i);
+        vMin = XMVectorMin(vMin, p);
+        vMax = XMVectorMax(vMax, p);
+    }
+
+    XMVECTOR center = XMVectorScale(XMVectorAdd(vMin, vMax), 0.5f);
+    XMVECTOR maxDistSq = XMVectorZero();
+    for (UINT i = 0; i < count; ++i)
+        maxDistSq = XMVectorMax(maxDistSq, XMVector3LengthSq(XMVectorSubtract(at(i), center)));
+
+    XMStoreFloat3(&box.Center, center);
+    XMStoreFloat3(&box.Extents, XMVectorScale(XMVectorSubtract(vMax, vMin), 0.5f));
+    XMStoreFloat3(&sphere.Center, center);
+    XMStoreFloat(&sphere.Radius, XMVectorSqrt(maxDistSq));
 }
 
 ComPtr<ID3DBlob> d3dUtil::CompileShader(
@@ -30,6 +30,8 @@
 #include "MathHelper.h"
 #include "GeometryGenerator.h"
 
+class D3D12UploadRing;
+
 extern const int gNumFrameResources;
 
 inline void d3dSetDebugName(IDXGIObject* obj, const char* name)
@@ -115,12 +117,24 @@ public:
 
     static Microsoft::WRL::ComPtr<ID3DBlob> LoadBinary(const std::wstring& filename);
 
-    static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
-        ID3D12Device* device,
-        ID3D12GraphicsCommandList* cmdList,
-        const void* initData,
-        UINT64 byteSize,
-        Microsoft::WRL::ComPtr<ID3D12Resource>& uploadBuffer);
+	// Creates a default heap buffer and records a copy of initData into it, staged
+	// in uploadRing.
+	static Microsoft::WRL::ComPtr<ID3D12Resource> CreateDefaultBuffer(
+		ID3D12Device* device,
+		ID3D12GraphicsCommandList* cmdList,
+		const void* initData,
+		UINT64 byteSize,
+		D3D12UploadRing& uploadRing);
+
+	// Axis aligned box and bounding sphere of count positions, each stride bytes
+	// apart.  The sphere is centered on the box and just encloses the points, so it
+	// is usually much tighter than the box's circumscribed sphere.
+	static void ComputeBounds(
+		const DirectX::XMFLOAT3* positions,
+		UINT count,
+		UINT stride,
+		DirectX::BoundingBox& box,
+		DirectX::BoundingSphere& sphere);
 
 	static Microsoft::WRL::ComPtr<ID3DBlob> CompileShader(
 		const std::wstring& filename,
@@ -143,6 +157,36 @@ public:
     int LineNumber = -1;
 };
 
+// One level of detail of a submesh: an index range over the submesh's vertices and
+// the object space error it introduces.
+struct SubmeshLod
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	float Error = 0.0f;
+};
+
+// A cluster of a submesh's full resolution triangles that is culled on its own:
+// an index range plus the object space bounding sphere and normal cone built by
+// MeshletBuilder.
+struct SubmeshCluster
+{
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	DirectX::XMFLOAT3 Center = { 0.0f, 0.0f, 0.0f };
+	float Radius = 0.0f;
+	DirectX::XMFLOAT3 ConeAxis = { 0.0f, 0.0f, 1.0f };
+	float ConeCutoff = 1.0f;
+};
+
+// Low-poly copy of a submesh for CPU occlusion culling, in the submesh's object
+// space.  Shared by every render item drawing the submesh.
+struct SubmeshOccluder
+{
+	std::vector<DirectX::XMFLOAT3> Positions;
+	std::vector<std::uint32_t> Indices;
+};
+
 // Defines a subrange of geometry in a MeshGeometry.  This is for when multiple
 // geometries are stored in one vertex and index buffer.  It provides the offsets
 // and data needed to draw a subset of geometry stores in the vertex and index 
@@ -153,9 +197,37 @@ struct SubmeshGeometry
 	UINT StartIndexLocation = 0;
 	INT BaseVertexLocation = 0;
 
+	// Number of vertices starting at BaseVertexLocation that this submesh owns.
+	UINT VertexCount = 0;
+
+	// Levels of detail, finest first; Lods[0] is the range above.  Empty if the
+	// submesh has none.
+	std::vector<SubmeshLod> Lods;
+
+	// Clusters that together cover Lods[0], in index order.  Empty if the submesh
+	// was not clustered.
+	std::vector<SubmeshCluster> Clusters;
+
+	// Name of the material the submesh was imported with.  Empty for generated shapes.
+	std::string MaterialName;
+
+	// Occluder built from the finest LOD within the occluder triangle limit, or null
+	// if the submesh is too detailed to be one.
+	std::shared_ptr<const SubmeshOccluder> Occluder;
+
     // Bounding box of the geometry defined by this submesh. 
     // This is used in later chapters of the book.
 	DirectX::BoundingBox Bounds;
+	DirectX::BoundingSphere Sphere;
+};
+
+// What happens to a MeshGeometry's system memory copies of its vertices and
+// indices once the GPU buffers are uploaded.  Keep them only if something on the
+// CPU (picking, collision) reads them.
+enum class CpuGeometryPolicy
+{
+	Release,
+	Keep
 };
 
 struct MeshGeometry
@@ -164,19 +236,24 @@ struct MeshGeometry
 	std::string Name;
 
 	// System memory copies.  Use Blobs because the vertex/index format can be generic.
-	// It is up to the client to cast appropriately.  
+	// It is up to the client to cast appropriately.  Only filled in, and only kept
+	// after FinishUpload, when CpuPolicy is Keep.
+	CpuGeometryPolicy CpuPolicy = CpuGeometryPolicy::Release;
 	Microsoft::WRL::ComPtr<ID3DBlob> VertexBufferCPU = nullptr;
 	Microsoft::WRL::ComPtr<ID3DBlob> IndexBufferCPU  = nullptr;
 
 	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferGPU = nullptr;
 	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferGPU = nullptr;
 
-	Microsoft::WRL::ComPtr<ID3D12Resource> VertexBufferUploader = nullptr;
-	Microsoft::WRL::ComPtr<ID3D12Resource> IndexBufferUploader = nullptr;
+	// Optional second copy of the vertices in the quantized CompactVertex layout,
+	// drawn with the same index buffer and submesh offsets.
+	Microsoft::WRL::ComPtr<ID3D12Resource> CompactVertexBufferGPU = nullptr;
 
     // Data about the buffers.
 	UINT VertexByteStride = 0;
 	UINT VertexBufferByteSize = 0;
+	UINT CompactVertexByteStride = 0;
+	UINT CompactVertexBufferByteSize = 0;
 	DXGI_FORMAT IndexFormat = DXGI_FORMAT_R16_UINT;
 	UINT IndexBufferByteSize = 0;
 
@@ -184,7 +261,8 @@ struct MeshGeometry
 	// Use this container to define the Submesh geometries so we can draw
 	// the Submeshes individually.
 	std::unordered_map<std::string, SubmeshGeometry> DrawArgs;
-	std::unordered_map<std::string, std::vector<std::pair<GeometryGenerator::MeshData,SubmeshGeometry>>> MultiDrawArgs;
+	// Imported meshes, one submesh per (split) mesh of the source file.
+	std::unordered_map<std::string, std::vector<SubmeshGeometry>> MultiDrawArgs;
 
 	D3D12_VERTEX_BUFFER_VIEW VertexBufferView()const
 	{
@@ -196,6 +274,16 @@ struct MeshGeometry
 		return vbv;
 	}
 
+	D3D12_VERTEX_BUFFER_VIEW CompactVertexBufferView()const
+	{
+		D3D12_VERTEX_BUFFER_VIEW vbv;
+		vbv.BufferLocation = CompactVertexBufferGPU->GetGPUVirtualAddress();
+		vbv.StrideInBytes = CompactVertexByteStride;
+		vbv.SizeInBytes = CompactVertexBufferByteSize;
+
+		return vbv;
+	}
+
 	D3D12_INDEX_BUFFER_VIEW IndexBufferView()const
 	{
 		D3D12_INDEX_BUFFER_VIEW ibv;
@@ -206,11 +294,15 @@ struct MeshGeometry
 		return ibv;
 	}
 
-	// We can free this memory after we finish upload to the GPU.
-	void DisposeUploaders()
+	// Call once the upload commands have completed on the GPU.  Frees the system
+	// memory copies unless CpuPolicy says to keep them.
+	void FinishUpload()
 	{
-		VertexBufferUploader = nullptr;
-		IndexBufferUploader = nullptr;
+		if (CpuPolicy == CpuGeometryPolicy::Release)
+		{
+			VertexBufferCPU = nullptr;
+			IndexBufferCPU = nullptr;
+		}
 	}
 };
 
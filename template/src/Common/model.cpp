@@ -1,56 +1,27 @@
 #include <iostream>
-#include <fstream>
-#include <sstream>
 #include <vector>
 #include "model.h"
+#include "ObjParser.h"
 
-Model::Model(std::string filename) : verts_(), faces_() {
-    std::ifstream in;
-    in.open (filename, std::ifstream::in);
-    if (in.fail()) { std::cerr << ":("; }
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            XMFLOAT3 v;
-            iss >> v.x >> v.y >> v.z;
-            verts_.push_back(v);
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash >> trash;
-            XMFLOAT3 n;
-            iss >> n.x >> n.y >> n.z;
-            normals_.push_back(n);
+Model::Model(std::string filename, JobSystem* jobs) : verts_(), faces_() {
+    ObjParser::Mesh mesh;
+    if (!ObjParser::Parse(filename, mesh, jobs)) { std::cerr << ":("; return; }
+    verts_ = std::move(mesh.Positions);
+    normals_ = std::move(mesh.Normals);
+    uv_coords_ = std::move(mesh.TexCoords);
 
-        }else if (!line.compare(0, 3, "vt ")) {
-            iss >> trash >> trash;
-            XMFLOAT2 uv;
-            iss >> uv.x >> uv.y;
-            uv_coords_.push_back(uv);
-        }
-        else if (!line.compare(0, 2, "f ")) {
-            polygon f;
-            int v, uv, n, i = 0;
-            iss >> trash;
-            while (iss >> v >> trash >> uv >> trash >> n) {
-                Vert vt;
-                v--;
-                uv--;
-                n--;
-                vt.Position = vert(v);
-                vt.TexC = uv_coords(uv);
-                vt.Normal = normal(n);
-                f.verts[i] = vt;
-                i++;
-            }
-            faces_.push_back(f);
-        } else if (!line.compare(0, 3, "vn ")) {
-            iss >> trash;
+    // Corners without a texture coordinate or normal get zeros.
+    faces_.resize(mesh.Indices.size() / 3);
+    for (size_t f = 0; f < faces_.size(); f++) {
+        for (int i = 0; i < 3; i++) {
+            const ObjParser::Index& idx = mesh.Indices[f * 3 + i];
+            Vert vt(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0), XMFLOAT2(0, 0));
+            vt.Position = vert(idx.Position);
+            if (idx.TexC >= 0) vt.TexC = uv_coords(idx.TexC);
+            if (idx.Normal >= 0) vt.Normal = normal(idx.Normal);
+            faces_[f].verts[i] = vt;
         }
     }
-    in.close();
  //   load_texture(filename, "_diffuse.tga", diffuse_map_);
     std::cerr << "# v# " << verts_.size() << " f# "  << faces_.size() << std::endl;
 }
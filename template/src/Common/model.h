@@ -4,6 +4,7 @@
 #include "DirectXMath.h"
 #include <vector>
 #include <string>
+class JobSystem;
 struct mVertex
 {
     mVertex() {}
@@ -51,7 +52,8 @@ private:
     std::vector<XMFLOAT2> uv_coords_;
    // TGAImage diffuse_map_;
 public:
-    Model(std::string filename);
+    // Parses the OBJ file with ObjParser; chunks run on jobs if given.
+    Model(std::string filename, JobSystem* jobs = nullptr);
     ~Model();
     int nverts();
     int nfaces();
@@ -0,0 +1,73 @@
+//***************************************************************************************
+// AssimpShim.cpp
+//
+// ObjParser parses numbers with the header-only fast_atof from the Assimp headers
+// in src/Common, which refers to Assimp's logger and import exception on its error
+// paths.  Where the Assimp library is not installed, these definitions stand in for
+// the symbols it needs: warnings go to stderr and errors keep their message.
+//
+// MeshCache also links against the Importer.  Here every import fails with an
+// error saying why, so MeshCache::Import returns false and the cooked file code,
+// which does not depend on Assimp, can still be tested.
+//***************************************************************************************
+
+#include <assimp/DefaultLogger.hpp>
+#include <assimp/Exceptional.h>
+#include <assimp/Importer.hpp>
+#include <assimp/material.h>
+#include <cstdio>
+
+DeadlyErrorBase::DeadlyErrorBase(Assimp::Formatter::format f)
+	: std::runtime_error(std::string(f))
+{
+}
+
+namespace Assimp
+{
+	void Intern::AllocateFromAssimpHeap::operator delete(void* p)
+	{
+		::operator delete(p);
+	}
+
+	void Logger::warn(const char* message)
+	{
+		std::fprintf(stderr, "warning: %s\n", message);
+	}
+
+	Logger* DefaultLogger::get()
+	{
+		static NullLogger logger;
+		return &logger;
+	}
+
+	Importer::Importer()
+		: pimpl(nullptr)
+	{
+	}
+
+	Importer::~Importer()
+	{
+	}
+
+	const aiScene* Importer::ReadFile(const char* /*pFile*/, unsigned int /*pFlags*/)
+	{
+		return nullptr;
+	}
+
+	const char* Importer::GetErrorString() const
+	{
+		return "this build has no Assimp library";
+	}
+}
+
+aiString aiMaterial::GetName() const
+{
+	return aiString();
+}
+
+aiReturn aiGetMaterialTexture(const aiMaterial* /*mat*/, aiTextureType /*type*/, unsigned int /*index*/, aiString* /*path*/,
+	aiTextureMapping* /*mapping*/, unsigned int* /*uvindex*/, ai_real* /*blend*/, aiTextureOp* /*op*/,
+	aiTextureMapMode* /*mapmode*/, unsigned int* /*flags*/)
+{
+	return aiReturn_FAILURE;
+}
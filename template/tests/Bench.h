@@ -0,0 +1,33 @@
+//***************************************************************************************
+// Bench.h
+//
+// Timing for the benchmarks.  BestOf runs a function a number of times and returns
+// the fastest run in milliseconds, which is the least disturbed by the rest of the
+// machine.
+//***************************************************************************************
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+
+template<typename F>
+double BestOf(int runs, F&& f)
+{
+	double best = 1e30;
+	for (int i = 0; i < runs; ++i)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		best = std::min(best, elapsed.count());
+	}
+	return best;
+}
+
+// The argIndex-th command line argument as a count, or fallback if it is missing.
+inline std::size_t ArgCount(int argc, char** argv, int argIndex, std::size_t fallback)
+{
+	return argIndex < argc ? (std::size_t)std::strtoull(argv[argIndex], nullptr, 10) : fallback;
+}
@@ -0,0 +1,81 @@
+//***************************************************************************************
+// BenchScene.h
+//
+// Synthetic scenes for the culling benchmarks: boxes scattered at random through a
+// cube, and the view * projection matrix of a camera looking across it, built by
+// hand so the benchmarks need only the DirectXMath storage types.
+//***************************************************************************************
+
+#pragma once
+
+#include <DirectXMath.h>
+#include <DirectXCollision.h>
+#include <cmath>
+#include <random>
+#include <vector>
+
+// count boxes with centers in [-halfSize, halfSize]^3 and extents in
+// [minExtent, maxExtent].  The same seed gives the same boxes.
+inline std::vector<DirectX::BoundingBox> RandomBoxes(std::size_t count, float halfSize, float minExtent, float maxExtent, unsigned int seed = 1)
+{
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> position(-halfSize, halfSize);
+	std::uniform_real_distribution<float> extent(minExtent, maxExtent);
+	std::vector<DirectX::BoundingBox> boxes(count);
+	for (DirectX::BoundingBox& box : boxes)
+	{
+		box.Center = DirectX::XMFLOAT3(position(rng), position(rng), position(rng));
+		box.Extents = DirectX::XMFLOAT3(extent(rng), extent(rng), extent(rng));
+	}
+	return boxes;
+}
+
+inline DirectX::XMFLOAT4X4 Multiply(const DirectX::XMFLOAT4X4& a, const DirectX::XMFLOAT4X4& b)
+{
+	DirectX::XMFLOAT4X4 r;
+	for (int i = 0; i < 4; ++i)
+	{
+		for (int j = 0; j < 4; ++j)
+			r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j] + a.m[i][3] * b.m[3][j];
+	}
+	return r;
+}
+
+// Row-vector view * projection of a camera at eye turned yaw radians about +y from
+// +z, with the left-handed perspective projection of XMMatrixPerspectiveFovLH.
+inline DirectX::XMFLOAT4X4 CameraViewProj(const DirectX::XMFLOAT3& eye, float yaw, float fovY, float aspect, float nearZ, float farZ)
+{
+	const float c = std::cos(yaw);
+	const float s = std::sin(yaw);
+	const DirectX::XMFLOAT3 right(c, 0.0f, -s);
+	const DirectX::XMFLOAT3 up(0.0f, 1.0f, 0.0f);
+	const DirectX::XMFLOAT3 look(s, 0.0f, c);
+	auto dot = [&eye](const DirectX::XMFLOAT3& v) { return eye.x * v.x + eye.y * v.y + eye.z * v.z; };
+
+	DirectX::XMFLOAT4X4 view = {};
+	view.m[0][0] = right.x; view.m[0][1] = up.x; view.m[0][2] = look.x;
+	view.m[1][0] = right.y; view.m[1][1] = up.y; view.m[1][2] = look.y;
+	view.m[2][0] = right.z; view.m[2][1] = up.z; view.m[2][2] = look.z;
+	view.m[3][0] = -dot(right); view.m[3][1] = -dot(up); view.m[3][2] = -dot(look);
+	view.m[3][3] = 1.0f;
+
+	const float h = 1.0f / std::tan(0.5f * fovY);
+	const float q = farZ / (farZ - nearZ);
+	DirectX::XMFLOAT4X4 proj = {};
+	proj.m[0][0] = h / aspect;
+	proj.m[1][1] = h;
+	proj.m[2][2] = q;
+	proj.m[2][3] = 1.0f;
+	proj.m[3][2] = -q * nearZ;
+
+	return Multiply(view, proj);
+}
+
+// Whether p is inside the clip volume of viewProj (D3D depth [0, 1]).
+inline bool InsideClipVolume(const DirectX::XMFLOAT4X4& viewProj, const DirectX::XMFLOAT3& p)
+{
+	float clip[4];
+	for (int j = 0; j < 4; ++j)
+		clip[j] = p.x * viewProj.m[0][j] + p.y * viewProj.m[1][j] + p.z * viewProj.m[2][j] + viewProj.m[3][j];
+	return clip[3] > 0.0f && std::fabs(clip[0]) <= clip[3] && std::fabs(clip[1]) <= clip[3] && clip[2] >= 0.0f && clip[2] <= clip[3];
+}
@@ -0,0 +1,35 @@
+//***************************************************************************************
+// Check.h
+//
+// The little the tests need: CHECK reports a failed condition with its location and
+// counts it, and a test's main returns CheckResult() so CTest sees the failure.
+//***************************************************************************************
+
+#pragma once
+
+#include <cstdio>
+
+inline int& CheckFailures()
+{
+	static int failures = 0;
+	return failures;
+}
+
+#define CHECK(condition) \
+	do \
+	{ \
+		if (!(condition)) \
+		{ \
+			std::printf("%s(%d): check failed: %s\n", __FILE__, __LINE__, #condition); \
+			++CheckFailures(); \
+		} \
+	} while (0)
+
+inline int CheckResult()
+{
+	if (CheckFailures() != 0)
+		std::printf("%d check(s) failed\n", CheckFailures());
+	else
+		std::printf("all checks passed\n");
+	return CheckFailures() != 0 ? 1 : 0;
+}
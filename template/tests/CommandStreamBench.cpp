@@ -0,0 +1,102 @@
+#include "CommandStream.h"
+#include "JobSystem.h"
+#include "Bench.h"
+#include <cstdio>
+#include <vector>
+
+namespace
+{
+	// A draw batch as TexColumnsApp sorts them: runs of batches share geometry, and
+	// shorter runs share a material.
+	struct Batch
+	{
+		std::uint32_t Geometry;
+		std::uint32_t Material;
+		std::uint32_t FirstInstance;
+		std::uint32_t InstanceCount;
+	};
+
+	const std::uint32_t IndexCountPerDraw = 300;
+
+	void Record(CommandStream& stream, const std::vector<Batch>& batches, std::size_t begin, std::size_t end)
+	{
+		stream.Clear();
+		stream.SetPipeline(0);
+		stream.SetTopology(PrimitiveTopology::TriangleList);
+		std::uint32_t geometry = ~0u;
+		std::uint32_t material = ~0u;
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			const Batch& b = batches[i];
+			if (b.Geometry != geometry)
+			{
+				stream.SetVertexBuffer({ 0x10000ull + b.Geometry * 65536ull, 65536, 32 });
+				stream.SetIndexBuffer({ 0x90000000ull + b.Geometry * 4096ull, 4096, 2 });
+				geometry = b.Geometry;
+			}
+			if (b.Material != material)
+			{
+				stream.SetRootTable(0, 0x1000 + b.Material * 32ull);
+				stream.SetRootConstantBuffer(4, 0x100000ull + b.Material * 256ull);
+				material = b.Material;
+			}
+			stream.SetRootConstant(2, b.FirstInstance);
+			stream.DrawIndexed({ IndexCountPerDraw, b.InstanceCount, 0, 0, 0 });
+		}
+	}
+}
+
+// Usage: CommandStreamBench [batches] [batches per stream] [workers]
+int main(int argc, char** argv)
+{
+	const std::size_t count = ArgCount(argc, argv, 1, 20000);
+	const std::size_t grain = std::max<std::size_t>(1, ArgCount(argc, argv, 2, 64));
+	JobSystem jobs((unsigned int)ArgCount(argc, argv, 3, 0));
+
+	std::vector<Batch> batches(count);
+	std::uint64_t instances = 0;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		batches[i] = { std::uint32_t(i / 50), std::uint32_t(i / 10), std::uint32_t(instances), 1 + std::uint32_t(i % 3) };
+		instances += batches[i].InstanceCount;
+	}
+
+	std::vector<CommandStream> streams((count + grain - 1) / grain);
+	auto recordChunks = [&](std::size_t first, std::size_t last) {
+		for (std::size_t c = first; c < last; ++c)
+			Record(streams[c], batches, c * grain, std::min(count, c * grain + grain));
+	};
+
+	const double serial = BestOf(10, [&] { recordChunks(0, streams.size()); });
+	const double parallel = BestOf(10, [&] { jobs.ParallelFor(streams.size(), 1, recordChunks); });
+	NullCommandBackend backend;
+	const double replay = BestOf(10, [&] {
+		backend.Reset();
+		for (const CommandStream& stream : streams)
+			stream.Replay(backend);
+	});
+
+	std::size_t commands = 0;
+	std::size_t bytes = 0;
+	for (const CommandStream& stream : streams)
+	{
+		commands += stream.CommandCount();
+		bytes += stream.SizeInBytes();
+	}
+
+	std::printf("%zu batches in %zu streams: %zu commands, %zu bytes\n", count, streams.size(), commands, bytes);
+	std::printf("record: %.3f ms serial, %.3f ms with %u workers\n", serial, parallel, jobs.WorkerCount());
+	std::printf("replay into NullCommandBackend: %.3f ms (%.1f M commands/s)\n", replay, commands / replay / 1000.0);
+
+	const bool countsMatch = backend.Valid() &&
+		backend.CommandCount() == commands &&
+		backend.Count(CommandType::DrawIndexed) == count &&
+		backend.InstanceCount() == instances &&
+		backend.IndexCount() == instances * IndexCountPerDraw;
+	if (!countsMatch)
+	{
+		std::printf("replay does not match the recording: %s\n", backend.Valid() ? "counts differ" : backend.FirstError().c_str());
+		return 1;
+	}
+	return 0;
+}
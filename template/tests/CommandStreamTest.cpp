@@ -0,0 +1,187 @@
+#include "CommandStream.h"
+#include "Check.h"
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Writes every command it receives as a line of text, so a replay can be
+	// compared with what was recorded, arguments included.
+	class LogBackend : public CommandBackend
+	{
+	public:
+		std::vector<std::string> Log;
+
+		void SetPipeline(std::uint32_t pipeline) override
+		{
+			Add("pipeline " + std::to_string(pipeline));
+		}
+		void SetVertexBuffer(const VertexBufferBinding& binding) override
+		{
+			Add("vb " + std::to_string(binding.Address) + " " + std::to_string(binding.SizeInBytes) + " " + std::to_string(binding.StrideInBytes));
+		}
+		void SetIndexBuffer(const IndexBufferBinding& binding) override
+		{
+			Add("ib " + std::to_string(binding.Address) + " " + std::to_string(binding.SizeInBytes) + " " + std::to_string(binding.IndexSize));
+		}
+		void SetTopology(PrimitiveTopology topology) override
+		{
+			Add("topology " + std::to_string((int)topology));
+		}
+		void SetRootTable(std::uint32_t slot, std::uint64_t descriptor) override
+		{
+			Add("table " + std::to_string(slot) + " " + std::to_string(descriptor));
+		}
+		void SetRootConstantBuffer(std::uint32_t slot, std::uint64_t address) override
+		{
+			Add("cbv " + std::to_string(slot) + " " + std::to_string(address));
+		}
+		void SetRootShaderResource(std::uint32_t slot, std::uint64_t address) override
+		{
+			Add("srv " + std::to_string(slot) + " " + std::to_string(address));
+		}
+		void SetRootConstant(std::uint32_t slot, std::uint32_t value, std::uint32_t offset) override
+		{
+			Add("constant " + std::to_string(slot) + " " + std::to_string(value) + " " + std::to_string(offset));
+		}
+		void DrawIndexed(const DrawIndexedArgs& args) override
+		{
+			Add("draw " + std::to_string(args.IndexCount) + " " + std::to_string(args.InstanceCount) + " " +
+				std::to_string(args.StartIndex) + " " + std::to_string(args.BaseVertex) + " " + std::to_string(args.StartInstance));
+		}
+		void Barrier(std::uint64_t resource, std::uint32_t before, std::uint32_t after) override
+		{
+			Add("barrier " + std::to_string(resource) + " " + std::to_string(before) + " " + std::to_string(after));
+		}
+
+	private:
+		void Add(const std::string& line) { Log.push_back(line); }
+	};
+
+	// One pass the way TexColumnsApp records it: bind once, then per batch the
+	// material and the first instance.
+	void RecordPass(CommandStream& stream)
+	{
+		stream.Barrier(0x5000, 0x80, 0x4);
+		stream.SetPipeline(3);
+		stream.SetRootShaderResource(1, 0x20000);
+		stream.SetRootConstantBuffer(2, 0x30000);
+		stream.SetVertexBuffer({ 0x100000000ull, 96000, 32 });
+		stream.SetIndexBuffer({ 0x200000000ull, 12000, 2 });
+		stream.SetTopology(PrimitiveTopology::TriangleList);
+		for (std::uint32_t i = 0; i < 3; ++i)
+		{
+			stream.SetRootTable(0, 0x1000 + i * 32);
+			stream.SetRootConstant(4, i * 10, 1);
+			stream.DrawIndexed({ 36, i + 1, i * 36, -int(i), i * 10 });
+		}
+		stream.Barrier(0x5000, 0x4, 0x80);
+	}
+
+	void TestReplayOrder()
+	{
+		CommandStream stream;
+		RecordPass(stream);
+		CHECK(stream.CommandCount() == 17);
+
+		LogBackend log;
+		stream.Replay(log);
+		const std::vector<std::string> expected = {
+			"barrier 20480 128 4",
+			"pipeline 3",
+			"srv 1 131072",
+			"cbv 2 196608",
+			"vb 4294967296 96000 32",
+			"ib 8589934592 12000 2",
+			"topology 0",
+			"table 0 4096",
+			"constant 4 0 1",
+			"draw 36 1 0 0 0",
+			"table 0 4128",
+			"constant 4 10 1",
+			"draw 36 2 36 -1 10",
+			"table 0 4160",
+			"constant 4 20 1",
+			"draw 36 3 72 -2 20",
+			"barrier 20480 4 128" };
+		CHECK(log.Log == expected);
+
+		// Replaying does not consume the stream.
+		LogBackend again;
+		stream.Replay(again);
+		CHECK(again.Log == expected);
+
+		// Clear drops the commands; recording starts over.
+		stream.Clear();
+		CHECK(stream.CommandCount() == 0 && stream.SizeInBytes() == 0);
+		stream.SetTopology(PrimitiveTopology::LineList);
+		LogBackend cleared;
+		stream.Replay(cleared);
+		CHECK(cleared.Log == std::vector<std::string>{ "topology 2" });
+	}
+
+	void TestCounts()
+	{
+		CommandStream stream;
+		RecordPass(stream);
+
+		NullCommandBackend backend;
+		stream.Replay(backend);
+		CHECK(backend.Valid());
+		CHECK(backend.CommandCount() == stream.CommandCount());
+		CHECK(backend.Count(CommandType::DrawIndexed) == 3);
+		CHECK(backend.Count(CommandType::SetRootTable) == 3);
+		CHECK(backend.Count(CommandType::SetRootConstant) == 3);
+		CHECK(backend.Count(CommandType::Barrier) == 2);
+		CHECK(backend.Count(CommandType::SetPipeline) == 1);
+		CHECK(backend.InstanceCount() == 1 + 2 + 3);
+		CHECK(backend.IndexCount() == 36 * (1 + 2 + 3));
+
+		// Chunks recorded separately replay into one backend like a single stream.
+		CommandStream first;
+		CommandStream second;
+		RecordPass(first);
+		second.SetRootConstant(4, 99);
+		second.DrawIndexed({ 6, 1, 0, 0, 0 });
+		NullCommandBackend chunked;
+		first.Replay(chunked);
+		second.Replay(chunked);
+		CHECK(chunked.Valid());
+		CHECK(chunked.Count(CommandType::DrawIndexed) == 4);
+		CHECK(chunked.IndexCount() == 36 * 6 + 6);
+
+		backend.Reset();
+		CHECK(backend.CommandCount() == 0 && backend.IndexCount() == 0 && backend.Valid());
+	}
+
+	void TestValidation()
+	{
+		CommandStream stream;
+		stream.DrawIndexed({ 3, 1, 0, 0, 0 });
+		NullCommandBackend backend;
+		stream.Replay(backend);
+		CHECK(!backend.Valid());
+		CHECK(backend.FirstError() == "draw before pipeline, buffers and topology are set");
+
+		stream.Clear();
+		stream.SetRootConstantBuffer(1, 0x104);
+		stream.Barrier(0x1234, 4, 4);
+		stream.SetRootTable(NullCommandBackend::MaxRootSlots, 8);
+		stream.SetVertexBuffer({ 0x1000, 16, 32 });
+		stream.SetIndexBuffer({ 0x1000, 16, 3 });
+		backend.Reset();
+		stream.Replay(backend);
+		CHECK(backend.ErrorCount() == 5);
+		CHECK(backend.FirstError() == "constant buffer address not 256-byte aligned");
+		// Invalid commands are still counted.
+		CHECK(backend.CommandCount() == 5);
+	}
+}
+
+int main()
+{
+	TestReplayOrder();
+	TestCounts();
+	TestValidation();
+	return CheckResult();
+}
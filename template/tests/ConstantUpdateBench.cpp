@@ -0,0 +1,204 @@
+#include "JobSystem.h"
+#include "Bench.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+
+namespace
+{
+	// Grain TexColumnsApp::UpdateObjectCBs splits render items by.
+	const std::size_t ObjectUpdateGrain = 256;
+
+	struct Matrix
+	{
+		float m[4][4];
+	};
+
+	// Same layout as ObjectConstants in FrameResource.h.
+	struct ObjectConstants
+	{
+		Matrix World;
+		Matrix InvWorld;
+		Matrix TexTransform;
+		float PosCenter[3];
+		float Pad0;
+		float PosExtents[3];
+		float Pad1;
+	};
+
+	// The fields of a RenderItem the object update reads.
+	struct Item
+	{
+		Matrix World;
+		Matrix TexTransform;
+		float Center[3];
+		float Extents[3];
+		std::size_t ObjCBIndex;
+		int NumFramesDirty;
+	};
+
+	Matrix Transpose(const Matrix& a)
+	{
+		Matrix r;
+		for (int i = 0; i < 4; ++i)
+		{
+			for (int j = 0; j < 4; ++j)
+				r.m[i][j] = a.m[j][i];
+		}
+		return r;
+	}
+
+	// MathHelper::InverseTranspose: the translation is dropped, as only normals are
+	// transformed by it.  The inverse is transposed twice, once more for HLSL, so
+	// the result is just the inverse.
+	Matrix InverseTranspose(const Matrix& a)
+	{
+		const float (*m)[4] = a.m;
+		const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+		const float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+		const float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+		const float det = m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02;
+		const float s = det != 0.0f ? 1.0f / det : 0.0f;
+
+		Matrix r = {};
+		r.m[0][0] = c00 * s;
+		r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * s;
+		r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * s;
+		r.m[1][0] = c01 * s;
+		r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * s;
+		r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * s;
+		r.m[2][0] = c02 * s;
+		r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * s;
+		r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * s;
+		r.m[3][3] = 1.0f;
+		return r;
+	}
+
+	void UpdateItems(std::vector<Item>& items, std::vector<ObjectConstants>& mirror, std::size_t begin, std::size_t end)
+	{
+		for (std::size_t i = begin; i < end; ++i)
+		{
+			Item& e = items[i];
+			if (e.NumFramesDirty > 0)
+			{
+				ObjectConstants& c = mirror[e.ObjCBIndex];
+				c.World = Transpose(e.World);
+				c.InvWorld = InverseTranspose(e.World);
+				c.TexTransform = Transpose(e.TexTransform);
+				std::memcpy(c.PosCenter, e.Center, sizeof(c.PosCenter));
+				std::memcpy(c.PosExtents, e.Extents, sizeof(c.PosExtents));
+				e.NumFramesDirty = 0;
+			}
+		}
+	}
+
+	void CopyConstants(const std::vector<ObjectConstants>& mirror, std::vector<std::uint8_t>& upload, std::size_t begin, std::size_t end)
+	{
+		std::memcpy(upload.data() + begin * sizeof(ObjectConstants), mirror.data() + begin, (end - begin) * sizeof(ObjectConstants));
+	}
+
+	// Render items with random rotation, scale and translation, stored out of
+	// ObjCBIndex order as in the app.
+	std::vector<Item> MakeScene(std::size_t count)
+	{
+		std::mt19937 rng(5);
+		std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+		std::vector<Item> items(count);
+		std::vector<std::size_t> order(count);
+		for (std::size_t i = 0; i < count; ++i)
+			order[i] = i;
+		std::shuffle(order.begin(), order.end(), rng);
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			Item& e = items[i];
+			const float angle = 3.14159265f * unit(rng);
+			const float scale = 1.5f + unit(rng);
+			const float c = std::cos(angle) * scale;
+			const float s = std::sin(angle) * scale;
+			e.World = { { { c, 0.0f, -s, 0.0f }, { 0.0f, scale, 0.0f, 0.0f }, { s, 0.0f, c, 0.0f },
+				{ 500.0f * unit(rng), 50.0f * unit(rng), 500.0f * unit(rng), 1.0f } } };
+			e.TexTransform = { { { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f }, { 0.0f, 0.0f, 0.0f, 1.0f } } };
+			for (int k = 0; k < 3; ++k)
+			{
+				e.Center[k] = unit(rng);
+				e.Extents[k] = 1.0f + unit(rng) * 0.5f;
+			}
+			e.ObjCBIndex = order[i];
+			e.NumFramesDirty = 0;
+		}
+		return items;
+	}
+}
+
+// Times the object constant update of TexColumnsApp::UpdateObjectCBs on synthetic
+// scenes, from 1 up to the given number of threads (by default the hardware's):
+// recomputing every item's constants, as when the whole scene moves, and only the
+// copy into the upload buffer, as when nothing does.
+//
+// Usage: ConstantUpdateBench [max threads] [items ...]
+int main(int argc, char** argv)
+{
+	const unsigned int hardwareThreads = std::max(1u, std::thread::hardware_concurrency());
+	const unsigned int maxThreads = std::max<unsigned int>(1, (unsigned int)ArgCount(argc, argv, 1, hardwareThreads));
+	std::vector<std::size_t> sizes;
+	for (int i = 2; i < argc; ++i)
+		sizes.push_back(ArgCount(argc, argv, i, 0));
+	if (sizes.empty())
+		sizes = { 10000, 100000, 500000 };
+
+	std::printf("%u hardware threads\n", hardwareThreads);
+	std::printf("%10s %8s %12s %8s %12s %8s\n", "items", "threads", "all dirty", "speedup", "copy only", "speedup");
+	int failures = 0;
+	for (std::size_t count : sizes)
+	{
+		std::vector<Item> items = MakeScene(count);
+		std::vector<ObjectConstants> mirror(count);
+		std::vector<std::uint8_t> upload(count * sizeof(ObjectConstants));
+		std::vector<std::uint8_t> expected;
+
+		double dirtyBase = 0.0;
+		double copyBase = 0.0;
+		for (unsigned int threads = 1; threads <= maxThreads; ++threads)
+		{
+			// One thread is the caller alone; ParallelFor then runs inline.
+			std::unique_ptr<JobSystem> jobs = threads > 1 ? std::make_unique<JobSystem>(threads - 1) : nullptr;
+			auto update = [&] {
+				if (!jobs)
+				{
+					UpdateItems(items, mirror, 0, count);
+					CopyConstants(mirror, upload, 0, count);
+					return;
+				}
+				jobs->ParallelFor(count, ObjectUpdateGrain, [&](std::size_t begin, std::size_t end) { UpdateItems(items, mirror, begin, end); });
+				jobs->ParallelFor(count, ObjectUpdateGrain, [&](std::size_t begin, std::size_t end) { CopyConstants(mirror, upload, begin, end); });
+			};
+
+			std::memset(upload.data(), 0, upload.size());
+			const double dirty = BestOf(5, [&] {
+				for (Item& e : items)
+					e.NumFramesDirty = 3;
+				update();
+			});
+			const double copy = BestOf(5, update);
+			if (threads == 1)
+			{
+				dirtyBase = dirty;
+				copyBase = copy;
+				expected = upload;
+			}
+			else if (upload != expected)
+			{
+				std::printf("%zu items, %u threads: constants differ from the single-threaded update\n", count, threads);
+				++failures;
+			}
+			std::printf("%10zu %8u %9.2f ms %7.2fx %9.2f ms %7.2fx\n", count, threads, dirty, dirtyBase / dirty, copy, copyBase / copy);
+		}
+	}
+	return failures != 0 ? 1 : 0;
+}
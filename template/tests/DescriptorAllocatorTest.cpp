@@ -0,0 +1,97 @@
+#include "DescriptorAllocator.h"
+#include "Check.h"
+
+namespace
+{
+	void TestAllocate()
+	{
+		DescriptorAllocator allocator(16);
+		CHECK(allocator.HeapSize() == 16);
+		CHECK(allocator.InUse() == 0);
+
+		// Ranges are handed out first fit, back to back.
+		CHECK(allocator.Allocate() == 0);
+		CHECK(allocator.Allocate(3) == 1);
+		CHECK(allocator.Allocate(4) == 4);
+		CHECK(allocator.InUse() == 8);
+		CHECK(allocator.Allocate(0) == DescriptorAllocator::Invalid);
+
+		// Running out: a request longer than any free range fails and changes nothing.
+		CHECK(allocator.Allocate(9) == DescriptorAllocator::Invalid);
+		CHECK(allocator.InUse() == 8);
+		CHECK(allocator.Allocate(8) == 8);
+		CHECK(allocator.Allocate() == DescriptorAllocator::Invalid);
+		CHECK(allocator.InUse() == 16);
+
+		DescriptorAllocator empty(0);
+		CHECK(empty.HeapSize() == 0);
+		CHECK(empty.Allocate() == DescriptorAllocator::Invalid);
+	}
+
+	void TestFree()
+	{
+		DescriptorAllocator allocator(16);
+		const std::uint32_t a = allocator.Allocate(4); // 0-3
+		const std::uint32_t b = allocator.Allocate(4); // 4-7
+		const std::uint32_t c = allocator.Allocate(4); // 8-11
+		const std::uint32_t d = allocator.Allocate(4); // 12-15
+		CHECK(allocator.Allocate() == DescriptorAllocator::Invalid);
+
+		// A freed range is reused by the next request that fits it, which need not
+		// take all of it.
+		allocator.Free(b, 4);
+		CHECK(allocator.InUse() == 12);
+		CHECK(allocator.Allocate(5) == DescriptorAllocator::Invalid);
+		CHECK(allocator.Allocate(2) == b);
+		CHECK(allocator.Allocate(2) == b + 2);
+
+		// Freeing neighbours one at a time merges them into one range: first alone,
+		// then next to the free range before, then between two free ranges.
+		allocator.Free(a, 4);
+		allocator.Free(c, 4);
+		allocator.Free(b, 2);
+		allocator.Free(b + 2, 2);
+		CHECK(allocator.InUse() == 4);
+		CHECK(allocator.Allocate(12) == 0);
+		allocator.Free(0, 12);
+
+		// Joining the free range after it.
+		allocator.Free(d, 4);
+		CHECK(allocator.InUse() == 0);
+		CHECK(allocator.Allocate(16) == 0);
+		allocator.Free(0, 16);
+
+		// Free with a zero count does nothing.
+		allocator.Free(3, 0);
+		CHECK(allocator.InUse() == 0);
+	}
+
+	// Screen views keep their slots across resizes, while textures loaded later come
+	// and go around them.
+	void TestFragmentation()
+	{
+		DescriptorAllocator allocator(8);
+		const std::uint32_t texture0 = allocator.Allocate();
+		const std::uint32_t gbuffer = allocator.Allocate(3);
+		const std::uint32_t texture1 = allocator.Allocate();
+		const std::uint32_t scene = allocator.Allocate();
+		CHECK(texture0 == 0 && gbuffer == 1 && texture1 == 4 && scene == 5);
+
+		allocator.Free(texture0);
+		allocator.Free(texture1);
+		// Three slots are free but not together, so a table of two goes at the end.
+		CHECK(allocator.Allocate(2) == 6);
+		CHECK(allocator.Allocate(2) == DescriptorAllocator::Invalid);
+		CHECK(allocator.Allocate() == 0);
+		CHECK(allocator.Allocate() == 4);
+		CHECK(allocator.InUse() == 8);
+	}
+}
+
+int main()
+{
+	TestAllocate();
+	TestFree();
+	TestFragmentation();
+	return CheckResult();
+}
@@ -0,0 +1,25 @@
+//***************************************************************************************
+// DirectXCollision.h
+//
+// Stand-in for the DirectXCollision header: the bounding volumes as plain data, with
+// the defaults of the real ones.  See DirectXMath.h here.
+//***************************************************************************************
+
+#pragma once
+
+#include "DirectXMath.h"
+
+namespace DirectX
+{
+	struct BoundingSphere
+	{
+		XMFLOAT3 Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		float Radius = 1.0f;
+	};
+
+	struct BoundingBox
+	{
+		XMFLOAT3 Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		XMFLOAT3 Extents = XMFLOAT3(1.0f, 1.0f, 1.0f);
+	};
+}
@@ -0,0 +1,108 @@
+//***************************************************************************************
+// DirectXMath.h
+//
+// Stand-in for the DirectXMath header on platforms without it, for the tests only.
+// Besides the plain storage types there is a scalar XMVECTOR with the few loads,
+// stores and 3D vector functions GeometryGenerator uses; nothing else is provided.
+//***************************************************************************************
+
+#pragma once
+
+#include <cmath>
+
+namespace DirectX
+{
+	struct XMFLOAT2
+	{
+		float x;
+		float y;
+
+		XMFLOAT2() = default;
+		constexpr XMFLOAT2(float _x, float _y) : x(_x), y(_y) {}
+	};
+
+	struct XMFLOAT3
+	{
+		float x;
+		float y;
+		float z;
+
+		XMFLOAT3() = default;
+		constexpr XMFLOAT3(float _x, float _y, float _z) : x(_x), y(_y), z(_z) {}
+	};
+
+	struct XMFLOAT4
+	{
+		float x;
+		float y;
+		float z;
+		float w;
+
+		XMFLOAT4() = default;
+		constexpr XMFLOAT4(float _x, float _y, float _z, float _w) : x(_x), y(_y), z(_z), w(_w) {}
+	};
+
+	struct XMFLOAT4X4
+	{
+		union
+		{
+			struct
+			{
+				float _11, _12, _13, _14;
+				float _21, _22, _23, _24;
+				float _31, _32, _33, _34;
+				float _41, _42, _43, _44;
+			};
+			float m[4][4];
+		};
+
+		XMFLOAT4X4() = default;
+	};
+
+	const float XM_PI = 3.141592654f;
+	const float XM_2PI = 6.283185307f;
+
+	struct XMVECTOR
+	{
+		float v[4];
+	};
+
+	inline XMVECTOR operator+(const XMVECTOR& a, const XMVECTOR& b)
+	{
+		return { { a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3] } };
+	}
+
+	inline XMVECTOR operator-(const XMVECTOR& a, const XMVECTOR& b)
+	{
+		return { { a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3] } };
+	}
+
+	inline XMVECTOR operator*(float s, const XMVECTOR& a)
+	{
+		return { { s * a.v[0], s * a.v[1], s * a.v[2], s * a.v[3] } };
+	}
+
+	inline XMVECTOR operator*(const XMVECTOR& a, float s)
+	{
+		return s * a;
+	}
+
+	inline XMVECTOR XMLoadFloat2(const XMFLOAT2* p) { return { { p->x, p->y, 0.0f, 0.0f } }; }
+	inline XMVECTOR XMLoadFloat3(const XMFLOAT3* p) { return { { p->x, p->y, p->z, 0.0f } }; }
+	inline void XMStoreFloat2(XMFLOAT2* p, const XMVECTOR& a) { *p = XMFLOAT2(a.v[0], a.v[1]); }
+	inline void XMStoreFloat3(XMFLOAT3* p, const XMVECTOR& a) { *p = XMFLOAT3(a.v[0], a.v[1], a.v[2]); }
+
+	inline XMVECTOR XMVector3Cross(const XMVECTOR& a, const XMVECTOR& b)
+	{
+		return { { a.v[1] * b.v[2] - a.v[2] * b.v[1], a.v[2] * b.v[0] - a.v[0] * b.v[2], a.v[0] * b.v[1] - a.v[1] * b.v[0], 0.0f } };
+	}
+
+	// Like the real one, a zero vector stays zero.
+	inline XMVECTOR XMVector3Normalize(const XMVECTOR& a)
+	{
+		const float length = std::sqrt(a.v[0] * a.v[0] + a.v[1] * a.v[1] + a.v[2] * a.v[2]);
+		if (length == 0.0f)
+			return { { 0.0f, 0.0f, 0.0f, 0.0f } };
+		return { { a.v[0] / length, a.v[1] / length, a.v[2] / length, a.v[3] / length } };
+	}
+}
@@ -0,0 +1,75 @@
+//***************************************************************************************
+// DirectXPackedVector.h
+//
+// Stand-in for the DirectXPackedVector header: half floats and their conversions,
+// rounding to nearest even as the real ones do.  See DirectXMath.h here.
+//***************************************************************************************
+
+#pragma once
+
+#include "DirectXMath.h"
+#include <cstdint>
+#include <cstring>
+
+namespace DirectX
+{
+	namespace PackedVector
+	{
+		typedef std::uint16_t HALF;
+
+		inline float XMConvertHalfToFloat(HALF value)
+		{
+			const std::uint32_t sign = std::uint32_t(value & 0x8000) << 16;
+			std::uint32_t exponent = (value >> 10) & 0x1F;
+			std::uint32_t mantissa = value & 0x3FF;
+			std::uint32_t bits;
+			if (exponent == 0x1F)
+				bits = sign | 0x7F800000 | (mantissa << 13);
+			else if (exponent != 0)
+				bits = sign | ((exponent + 112) << 23) | (mantissa << 13);
+			else if (mantissa == 0)
+				bits = sign;
+			else
+			{
+				// Denormal: shift the mantissa up until it is normalized.
+				exponent = 113;
+				while ((mantissa & 0x400) == 0)
+				{
+					mantissa <<= 1;
+					--exponent;
+				}
+				bits = sign | (exponent << 23) | ((mantissa & 0x3FF) << 13);
+			}
+			float f;
+			std::memcpy(&f, &bits, sizeof(f));
+			return f;
+		}
+
+		inline HALF XMConvertFloatToHalf(float value)
+		{
+			std::uint32_t bits;
+			std::memcpy(&bits, &value, sizeof(bits));
+			const HALF sign = HALF((bits >> 16) & 0x8000);
+			const std::uint32_t magnitude = bits & 0x7FFFFFFF;
+			if (magnitude >= 0x7F800000)
+				return HALF(sign | 0x7C00 | (magnitude > 0x7F800000 ? 0x200 : 0));
+			if (magnitude >= 0x477FF000)
+				return HALF(sign | 0x7C00);
+			if (magnitude < 0x33000001)
+				return sign;
+
+			std::uint32_t exponent = magnitude >> 23;
+			std::uint32_t mantissa = (magnitude & 0x7FFFFF) | 0x800000;
+			// Halves below 2^-14 are denormal and keep fewer mantissa bits.
+			const std::uint32_t shift = exponent < 113 ? 13 + 113 - exponent : 13;
+			std::uint32_t half = exponent < 113 ? 0 : (exponent - 112) << 10;
+			const std::uint32_t rest = mantissa & ((1u << shift) - 1);
+			const std::uint32_t halfway = 1u << (shift - 1);
+			mantissa >>= shift;
+			half = exponent < 113 ? mantissa : half | (mantissa & 0x3FF);
+			if (rest > halfway || (rest == halfway && (half & 1)))
+				++half;
+			return HALF(sign | half);
+		}
+	}
+}
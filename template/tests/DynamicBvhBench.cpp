@@ -0,0 +1,256 @@
+#include "DynamicBvh.h"
+#include "FrustumCuller.h"
+#include "Bench.h"
+#include "BenchScene.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <utility>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	bool InFrustum(const XMFLOAT4 planes[6], const BoundingBox& b)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			const XMFLOAT4& p = planes[i];
+			const float distance = p.x * b.Center.x + p.y * b.Center.y + p.z * b.Center.z + p.w +
+				std::fabs(p.x) * b.Extents.x + std::fabs(p.y) * b.Extents.y + std::fabs(p.z) * b.Extents.z;
+			if (distance < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	bool Touches(const BoundingSphere& s, const BoundingBox& b)
+	{
+		const float dx = std::max(std::fabs(s.Center.x - b.Center.x) - b.Extents.x, 0.0f);
+		const float dy = std::max(std::fabs(s.Center.y - b.Center.y) - b.Extents.y, 0.0f);
+		const float dz = std::max(std::fabs(s.Center.z - b.Center.z) - b.Extents.z, 0.0f);
+		return dx * dx + dy * dy + dz * dz <= s.Radius * s.Radius;
+	}
+
+	// Distance along the ray to the box, or -1 if the ray misses it before maxDistance.
+	float RayBox(const XMFLOAT3& origin, const XMFLOAT3& direction, const BoundingBox& b, float maxDistance)
+	{
+		const float o[3] = { origin.x, origin.y, origin.z };
+		const float d[3] = { direction.x, direction.y, direction.z };
+		const float c[3] = { b.Center.x, b.Center.y, b.Center.z };
+		const float e[3] = { b.Extents.x, b.Extents.y, b.Extents.z };
+		float tMin = 0.0f;
+		float tMax = maxDistance;
+		for (int k = 0; k < 3; ++k)
+		{
+			if (std::fabs(d[k]) < 1e-12f)
+			{
+				if (o[k] < c[k] - e[k] || o[k] > c[k] + e[k])
+					return -1.0f;
+				continue;
+			}
+			float t0 = (c[k] - e[k] - o[k]) / d[k];
+			float t1 = (c[k] + e[k] - o[k]) / d[k];
+			if (t0 > t1)
+				std::swap(t0, t1);
+			tMin = std::max(tMin, t0);
+			tMax = std::min(tMax, t1);
+			if (tMin > tMax)
+				return -1.0f;
+		}
+		return tMin;
+	}
+
+	// Whether every index in expected is in found, which may hold more.
+	bool Covers(std::vector<std::uint32_t> found, const std::vector<std::uint32_t>& expected)
+	{
+		std::sort(found.begin(), found.end());
+		return std::includes(found.begin(), found.end(), expected.begin(), expected.end());
+	}
+}
+
+// Usage: DynamicBvhBench [boxes]
+int main(int argc, char** argv)
+{
+	const std::size_t count = ArgCount(argc, argv, 1, 100000);
+	const float halfSize = 1000.0f;
+	std::vector<BoundingBox> boxes = RandomBoxes(count, halfSize, 0.5f, 5.0f);
+	int failures = 0;
+
+	// Build.
+	DynamicBvh bvh(0.5f);
+	std::vector<int> proxies(count);
+	const double insertTime = BestOf(1, [&] {
+		for (std::size_t i = 0; i < count; ++i)
+			proxies[i] = bvh.Insert(boxes[i], (std::uint32_t)i);
+	});
+	const int insertHeight = bvh.Height();
+	const double rebuildTime = BestOf(1, [&] { bvh.Rebuild(); });
+	std::printf("%zu boxes: insert %.1f ms (height %d), Rebuild %.1f ms (height %d)\n",
+		count, insertTime, insertHeight, rebuildTime, bvh.Height());
+
+	// Frustum, against a linear scan and FrustumCuller.
+	const XMFLOAT4X4 viewProj = CameraViewProj(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.7f, 0.4f * XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(viewProj, planes);
+	FrustumCuller culler;
+	culler.Resize(count);
+	for (std::size_t i = 0; i < count; ++i)
+		culler.SetBounds(i, boxes[i]);
+
+	std::vector<std::uint32_t> expected;
+	std::vector<std::uint32_t> found;
+	const double linearFrustum = BestOf(10, [&] {
+		expected.clear();
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			if (InFrustum(planes, boxes[i]))
+				expected.push_back((std::uint32_t)i);
+		}
+	});
+	const double cullerFrustum = BestOf(10, [&] { culler.Cull(planes, found); });
+	const double bvhFrustum = BestOf(10, [&] {
+		found.clear();
+		bvh.QueryFrustum(planes, found);
+	});
+	std::printf("frustum: linear %.3f ms, FrustumCuller %.3f ms, DynamicBvh %.3f ms (%zu of %zu exact)\n",
+		linearFrustum, cullerFrustum, bvhFrustum, expected.size(), found.size());
+	if (!Covers(found, expected))
+	{
+		std::printf("frustum query missed boxes\n");
+		++failures;
+	}
+
+	// Spheres.
+	std::mt19937 rng(2);
+	std::uniform_real_distribution<float> position(-halfSize, halfSize);
+	std::vector<BoundingSphere> spheres(200);
+	for (BoundingSphere& s : spheres)
+	{
+		s.Center = XMFLOAT3(position(rng), position(rng), position(rng));
+		s.Radius = 30.0f;
+	}
+	std::vector<std::vector<std::uint32_t>> sphereExpected(spheres.size());
+	std::vector<std::vector<std::uint32_t>> sphereFound(spheres.size());
+	const double linearSphere = BestOf(1, [&] {
+		for (std::size_t k = 0; k < spheres.size(); ++k)
+		{
+			sphereExpected[k].clear();
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				if (Touches(spheres[k], boxes[i]))
+					sphereExpected[k].push_back((std::uint32_t)i);
+			}
+		}
+	}) / spheres.size();
+	const double bvhSphere = BestOf(5, [&] {
+		for (std::size_t k = 0; k < spheres.size(); ++k)
+		{
+			sphereFound[k].clear();
+			bvh.QuerySphere(spheres[k], sphereFound[k]);
+		}
+	}) / spheres.size();
+	std::printf("sphere r=30: linear %.4f ms, DynamicBvh %.4f ms per query\n", linearSphere, bvhSphere);
+	for (std::size_t k = 0; k < spheres.size(); ++k)
+	{
+		if (!Covers(sphereFound[k], sphereExpected[k]))
+		{
+			std::printf("sphere query %zu missed boxes\n", k);
+			++failures;
+		}
+	}
+
+	// Rays: the closest box hit must be the same as by brute force.
+	std::normal_distribution<float> normal;
+	std::vector<std::pair<XMFLOAT3, XMFLOAT3>> rays(200);
+	for (auto& ray : rays)
+	{
+		ray.first = XMFLOAT3(position(rng), position(rng), position(rng));
+		XMFLOAT3 d(normal(rng), normal(rng), normal(rng));
+		const float length = std::sqrt(d.x * d.x + d.y * d.y + d.z * d.z);
+		ray.second = XMFLOAT3(d.x / length, d.y / length, d.z / length);
+	}
+	const float noHit = 1e9f;
+	std::vector<float> linearHits(rays.size());
+	std::vector<float> bvhHits(rays.size());
+	const double linearRay = BestOf(1, [&] {
+		for (std::size_t k = 0; k < rays.size(); ++k)
+		{
+			float closest = noHit;
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				const float t = RayBox(rays[k].first, rays[k].second, boxes[i], closest);
+				if (t >= 0.0f && t < closest)
+					closest = t;
+			}
+			linearHits[k] = closest;
+		}
+	}) / rays.size();
+	const double bvhRay = BestOf(5, [&] {
+		for (std::size_t k = 0; k < rays.size(); ++k)
+		{
+			auto hitTest = [&](std::uint32_t i, float maxDistance) { return RayBox(rays[k].first, rays[k].second, boxes[i], maxDistance); };
+			std::uint32_t hitData;
+			float hitDistance;
+			bvhHits[k] = bvh.RayCast(rays[k].first, rays[k].second, noHit, hitTest, hitData, hitDistance) ? hitDistance : noHit;
+		}
+	}) / rays.size();
+	std::printf("ray: linear %.4f ms, DynamicBvh %.4f ms per ray\n", linearRay, bvhRay);
+	for (std::size_t k = 0; k < rays.size(); ++k)
+	{
+		if (std::fabs(linearHits[k] - bvhHits[k]) > 1e-3f)
+		{
+			std::printf("ray %zu hit at %g, expected %g\n", k, bvhHits[k], linearHits[k]);
+			++failures;
+		}
+	}
+
+	// Moves: 1% of the boxes drift a little each frame.
+	std::uniform_int_distribution<std::size_t> pick(0, count - 1);
+	std::uniform_real_distribution<float> drift(-3.0f, 3.0f);
+	const int frames = 100;
+	std::size_t reinserts = 0;
+	const double moveTime = BestOf(1, [&] {
+		for (int f = 0; f < frames; ++f)
+		{
+			for (std::size_t j = 0; j < count / 100; ++j)
+			{
+				const std::size_t i = pick(rng);
+				boxes[i].Center.x += drift(rng);
+				boxes[i].Center.y += drift(rng);
+				boxes[i].Center.z += drift(rng);
+				reinserts += bvh.Move(proxies[i], boxes[i]) ? 1 : 0;
+			}
+		}
+	}) / frames;
+	std::printf("moving 1%% per frame: %.3f ms per frame, %zu reinsertions in %d frames, height %d\n",
+		moveTime, reinserts, frames, bvh.Height());
+
+	// Remove every other box; the rest must still be found, and Rebuild must not
+	// change the answer.
+	for (std::size_t i = 0; i < count; i += 2)
+		bvh.Remove(proxies[i]);
+	expected.clear();
+	for (std::size_t i = 1; i < count; i += 2)
+	{
+		if (InFrustum(planes, boxes[i]))
+			expected.push_back((std::uint32_t)i);
+	}
+	found.clear();
+	bvh.QueryFrustum(planes, found);
+	std::sort(found.begin(), found.end());
+	std::vector<std::uint32_t> rebuilt;
+	bvh.Rebuild();
+	bvh.QueryFrustum(planes, rebuilt);
+	std::sort(rebuilt.begin(), rebuilt.end());
+	const bool noneRemoved = std::all_of(found.begin(), found.end(), [](std::uint32_t i) { return i % 2 == 1; });
+	if (bvh.LeafCount() != count / 2 || !Covers(found, expected) || !noneRemoved || rebuilt != found)
+	{
+		std::printf("queries are wrong after removing half of the boxes\n");
+		++failures;
+	}
+
+	return failures != 0 ? 1 : 0;
+}
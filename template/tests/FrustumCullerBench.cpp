@@ -0,0 +1,93 @@
+#include "FrustumCuller.h"
+#include "Bench.h"
+#include "BenchScene.h"
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	// What the per-item loop read its box from before FrustumCuller: the bounds in
+	// the middle of a render-item-sized struct.
+	struct Item
+	{
+		char Before[200];
+		BoundingBox WorldBounds;
+		char After[100];
+	};
+
+	bool Visible(const XMFLOAT4 planes[6], const BoundingBox& b)
+	{
+		for (int i = 0; i < 6; ++i)
+		{
+			const XMFLOAT4& p = planes[i];
+			const float distance = p.x * b.Center.x + p.y * b.Center.y + p.z * b.Center.z + p.w +
+				std::fabs(p.x) * b.Extents.x + std::fabs(p.y) * b.Extents.y + std::fabs(p.z) * b.Extents.z;
+			if (distance < 0.0f)
+				return false;
+		}
+		return true;
+	}
+}
+
+// Usage: FrustumCullerBench [boxes]
+int main(int argc, char** argv)
+{
+	const std::size_t count = ArgCount(argc, argv, 1, 100000);
+	const std::vector<BoundingBox> boxes = RandomBoxes(count, 1000.0f, 0.5f, 5.0f);
+
+	std::vector<Item> items(count);
+	FrustumCuller culler;
+	culler.Resize(count);
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		items[i].WorldBounds = boxes[i];
+		culler.SetBounds(i, boxes[i]);
+	}
+
+	const XMFLOAT4X4 viewProj = CameraViewProj(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.7f, 0.4f * XM_PI, 16.0f / 9.0f, 1.0f, 1000.0f);
+	XMFLOAT4 planes[6];
+	FrustumCuller::ExtractPlanes(viewProj, planes);
+
+	std::vector<std::uint32_t> reference;
+	std::vector<std::uint32_t> visible;
+	reference.reserve(count);
+	visible.reserve(count + FrustumCuller::Padding);
+	const double perItem = BestOf(20, [&] {
+		reference.clear();
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			if (Visible(planes, items[i].WorldBounds))
+				reference.push_back((std::uint32_t)i);
+		}
+	});
+	const double soa = BestOf(20, [&] { culler.Cull(planes, visible); });
+
+#if defined(__AVX__)
+	const char* path = "AVX";
+#elif defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+	const char* path = "SSE";
+#else
+	const char* path = "scalar";
+#endif
+	std::printf("%zu boxes, %zu visible\n", count, visible.size());
+	std::printf("per-item loop: %.3f ms, FrustumCuller (%s): %.3f ms, %.1fx\n", perItem, path, soa, perItem / soa);
+
+	// Every box whose center is on screen must survive, and the culler must agree
+	// with the per-item test it replaces.
+	std::size_t missed = 0;
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		if (InsideClipVolume(viewProj, boxes[i].Center) && !std::binary_search(visible.begin(), visible.end(), (std::uint32_t)i))
+			++missed;
+	}
+	if (missed != 0 || visible != reference)
+	{
+		std::printf("culling is wrong: %zu on-screen boxes culled, %zu visible against %zu from the per-item test\n",
+			missed, visible.size(), reference.size());
+		return 1;
+	}
+	return 0;
+}
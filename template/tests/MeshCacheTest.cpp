@@ -0,0 +1,271 @@
+#include "MeshCache.h"
+#include "MeshOptimizer.h"
+#include "MeshSimplifier.h"
+#include "MeshletBuilder.h"
+#include "ObjParser.h"
+#include "Check.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <string>
+#include <tuple>
+#include <vector>
+
+namespace
+{
+	const std::filesystem::path Dir = std::filesystem::temp_directory_path() / "MeshCacheTest";
+
+	std::string PathOf(const char* name)
+	{
+		return (Dir / name).string();
+	}
+
+	void WriteText(const std::string& filename, const std::string& text)
+	{
+		std::ofstream(filename, std::ios::binary | std::ios::trunc) << text;
+	}
+
+	std::string ReadBytes(const std::string& filename)
+	{
+		std::ifstream in(filename, std::ios::binary);
+		return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+	}
+
+	void WriteMaterials(const std::string& normalMap)
+	{
+		WriteText(PathOf("grid.mtl"), "newmtl stone\nmap_Kd stone_d.dds\ndisp " + normalMap + "\n");
+	}
+
+	// An n x n grid of quads with a bump in the middle, large enough to get several
+	// clusters and LODs, using the material library above.
+	void WriteGrid(int n)
+	{
+		std::ofstream out(PathOf("grid.obj"), std::ios::binary | std::ios::trunc);
+		out << "mtllib grid.mtl\n";
+		for (int y = 0; y <= n; ++y)
+		{
+			for (int x = 0; x <= n; ++x)
+			{
+				const float dx = x - 0.5f * n;
+				const float dy = y - 0.5f * n;
+				out << "v " << x << " " << 4.0f / (1.0f + 0.05f * (dx * dx + dy * dy)) << " " << -y << "\n";
+			}
+		}
+		for (int y = 0; y <= n; ++y)
+		{
+			for (int x = 0; x <= n; ++x)
+				out << "vt " << float(x) / n << " " << float(y) / n << "\n";
+		}
+		out << "vn 0 1 0\nusemtl stone\n";
+		for (int y = 0; y < n; ++y)
+		{
+			for (int x = 0; x < n; ++x)
+			{
+				const int a = y * (n + 1) + x + 1;
+				const int b = a + 1;
+				const int c = a + n + 1;
+				const int d = c + 1;
+				out << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << b << "/" << b << "/1\n";
+				out << "f " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+			}
+		}
+	}
+
+	// What MeshCache::Import produces for the grid, where the Assimp library is not
+	// available: the geometry read with ObjParser and run through the same
+	// optimization, clustering and LOD steps, and the material the .mtl describes.
+	MeshCache::ImportedMesh ImportWithObjParser(const std::string& filename)
+	{
+		MeshCache::ImportedMesh imported;
+		ObjParser::Mesh obj;
+		if (!ObjParser::Parse(filename, obj))
+			return imported;
+
+		GeometryGenerator::MeshData mesh;
+		std::map<std::tuple<int, int, int>, std::uint32_t> welded;
+		for (const ObjParser::Index& corner : obj.Indices)
+		{
+			auto inserted = welded.emplace(std::make_tuple(corner.Position, corner.TexC, corner.Normal), (std::uint32_t)mesh.Vertices.size());
+			if (inserted.second)
+			{
+				GeometryGenerator::Vertex v;
+				v.Position = obj.Positions[corner.Position];
+				v.Normal = obj.Normals[corner.Normal];
+				v.TangentU = DirectX::XMFLOAT3(1.0f, 0.0f, 0.0f);
+				v.TexC = obj.TexCoords[corner.TexC];
+				mesh.Vertices.push_back(v);
+			}
+			mesh.Indices32.push_back(inserted.first->second);
+		}
+		mesh.matName = "stone";
+		MeshOptimizer::Optimize(mesh);
+		MeshletBuilder::Build(mesh);
+		MeshSimplifier::BuildLods(mesh);
+		imported.Meshes.push_back(std::move(mesh));
+		imported.Materials.push_back({ "stone", "stone_n.dds", "stone_d.dds" });
+		return imported;
+	}
+
+	MeshCache::ImportedMesh ImportGrid()
+	{
+		MeshCache::ImportedMesh imported;
+#ifdef MESHCACHE_TEST_ASSIMP
+		CHECK(MeshCache::Import(PathOf("grid.obj"), MeshCache::DefaultImportFlags, imported));
+#else
+		imported = ImportWithObjParser(PathOf("grid.obj"));
+#endif
+		return imported;
+	}
+
+	bool SameMeshes(const MeshCache::ImportedMesh& a, const MeshCache::ImportedMesh& b)
+	{
+		if (a.Meshes.size() != b.Meshes.size() || a.Materials.size() != b.Materials.size())
+			return false;
+		for (std::size_t m = 0; m < a.Meshes.size(); ++m)
+		{
+			const GeometryGenerator::MeshData& x = a.Meshes[m];
+			const GeometryGenerator::MeshData& y = b.Meshes[m];
+			if (x.Vertices.size() != y.Vertices.size() ||
+				std::memcmp(x.Vertices.data(), y.Vertices.data(), x.Vertices.size() * sizeof(GeometryGenerator::Vertex)) != 0 ||
+				x.Indices32 != y.Indices32 || x.matName != y.matName || x.texfile != y.texfile ||
+				x.Lods.size() != y.Lods.size() || x.Meshlets.size() != y.Meshlets.size())
+				return false;
+			for (std::size_t l = 0; l < x.Lods.size(); ++l)
+			{
+				if (x.Lods[l].Indices32 != y.Lods[l].Indices32 || x.Lods[l].Error != y.Lods[l].Error)
+					return false;
+			}
+			for (std::size_t c = 0; c < x.Meshlets.size(); ++c)
+			{
+				const GeometryGenerator::Meshlet& p = x.Meshlets[c];
+				const GeometryGenerator::Meshlet& q = y.Meshlets[c];
+				if (p.FirstIndex != q.FirstIndex || p.IndexCount != q.IndexCount || p.Radius != q.Radius || p.ConeCutoff != q.ConeCutoff ||
+					p.Center.x != q.Center.x || p.Center.y != q.Center.y || p.Center.z != q.Center.z ||
+					p.ConeAxis.x != q.ConeAxis.x || p.ConeAxis.y != q.ConeAxis.y || p.ConeAxis.z != q.ConeAxis.z)
+					return false;
+			}
+		}
+		for (std::size_t k = 0; k < a.Materials.size(); ++k)
+		{
+			const GeometryGenerator::Material& x = a.Materials[k];
+			const GeometryGenerator::Material& y = b.Materials[k];
+			if (x.name != y.name || x.diffFile != y.diffFile || x.normFile != y.normFile)
+				return false;
+		}
+		return true;
+	}
+
+	void TestRoundTrip()
+	{
+		const MeshCache::ImportedMesh imported = ImportGrid();
+		CHECK(imported.Meshes.size() == 1 && imported.Materials.size() == 1);
+		CHECK(!imported.Meshes.empty() && !imported.Meshes[0].Lods.empty() && imported.Meshes[0].Meshlets.size() > 1);
+
+		const std::string cooked = PathOf("grid.cmesh");
+		CHECK(MeshCache::CookedPathFor(PathOf("grid.obj")) == cooked);
+		CHECK(MeshCache::SaveCooked(cooked, 1234, MeshCache::DefaultImportFlags, imported));
+		CHECK(!std::filesystem::exists(cooked + ".tmp"));
+
+		MeshCache::ImportedMesh loaded;
+		CHECK(MeshCache::LoadCooked(cooked, 1234, MeshCache::DefaultImportFlags, loaded));
+		CHECK(SameMeshes(imported, loaded));
+	}
+
+	void TestRejects()
+	{
+		const std::string cooked = PathOf("grid.cmesh");
+		const std::string bytes = ReadBytes(cooked);
+		const std::string broken = PathOf("broken.cmesh");
+		MeshCache::ImportedMesh out;
+		out.Materials.push_back({ "untouched", "", "" });
+
+		auto loads = [&](const std::string& contents, std::uint64_t hash, unsigned int flags) {
+			WriteText(broken, contents);
+			return MeshCache::LoadCooked(broken, hash, flags, out);
+		};
+
+		CHECK(loads(bytes, 1234, MeshCache::DefaultImportFlags));
+		out = MeshCache::ImportedMesh();
+		out.Materials.push_back({ "untouched", "", "" });
+
+		// Different source data or import flags.
+		CHECK(!loads(bytes, 1235, MeshCache::DefaultImportFlags));
+		CHECK(!loads(bytes, 1234, MeshCache::DefaultImportFlags | aiProcess_JoinIdenticalVertices));
+
+		// Another format version; Version follows the magic.
+		std::string otherVersion = bytes;
+		const std::uint32_t oldVersion = MeshCache::Version - 1;
+		std::memcpy(&otherVersion[4], &oldVersion, sizeof(oldVersion));
+		CHECK(!loads(otherVersion, 1234, MeshCache::DefaultImportFlags));
+
+		std::string badMagic = bytes;
+		badMagic[0] ^= 1;
+		CHECK(!loads(badMagic, 1234, MeshCache::DefaultImportFlags));
+
+		// Truncated anywhere, from an empty file to one missing its last byte, or
+		// with bytes appended.
+		for (std::size_t size : { std::size_t(0), std::size_t(16), bytes.size() / 2, bytes.size() - 1 })
+			CHECK(!loads(bytes.substr(0, size), 1234, MeshCache::DefaultImportFlags));
+		CHECK(!loads(bytes + "x", 1234, MeshCache::DefaultImportFlags));
+
+		CHECK(!MeshCache::LoadCooked(PathOf("missing.cmesh"), 1234, MeshCache::DefaultImportFlags, out));
+
+		// A failed load leaves the output alone.
+		CHECK(out.Meshes.empty() && out.Materials.size() == 1 && out.Materials[0].name == "untouched");
+	}
+
+	// Editing the .mtl changes the source hash, so LoadOrImport does not use the
+	// file cooked before the edit.
+	void TestMaterialEdits()
+	{
+		const std::string obj = PathOf("grid.obj");
+		std::uint64_t objHash = 0;
+		std::uint64_t before = 0;
+		std::uint64_t after = 0;
+		std::uint64_t missing = 0;
+		CHECK(MeshCache::HashFile(obj, objHash));
+		CHECK(MeshCache::SourceHash(obj, before));
+		CHECK(before != objHash);
+
+		const MeshCache::ImportedMesh imported = ImportGrid();
+		CHECK(MeshCache::SaveCooked(MeshCache::CookedPathFor(obj), before, MeshCache::DefaultImportFlags, imported));
+		MeshCache::ImportedMesh loaded;
+		CHECK(MeshCache::LoadOrImport(obj, MeshCache::DefaultImportFlags, loaded));
+		CHECK(SameMeshes(imported, loaded));
+
+		WriteMaterials("stone_bump.dds");
+		CHECK(MeshCache::SourceHash(obj, after));
+		CHECK(after != before);
+		CHECK(!MeshCache::LoadCooked(MeshCache::CookedPathFor(obj), after, MeshCache::DefaultImportFlags, loaded));
+#ifdef MESHCACHE_TEST_ASSIMP
+		// The edit reaches the renderer and the cache is rewritten with it.
+		CHECK(MeshCache::LoadOrImport(obj, MeshCache::DefaultImportFlags, loaded));
+		CHECK(!loaded.Materials.empty() && loaded.Materials[0].normFile == "stone_bump.dds");
+		CHECK(MeshCache::LoadCooked(MeshCache::CookedPathFor(obj), after, MeshCache::DefaultImportFlags, loaded));
+#else
+		// Without Assimp the re-import fails rather than loading the stale file.
+		CHECK(!MeshCache::LoadOrImport(obj, MeshCache::DefaultImportFlags, loaded));
+#endif
+
+		std::filesystem::remove(PathOf("grid.mtl"));
+		CHECK(MeshCache::SourceHash(obj, missing));
+		CHECK(missing != after && missing != objHash);
+		CHECK(!MeshCache::SourceHash(PathOf("missing.obj"), missing));
+	}
+}
+
+int main()
+{
+	std::filesystem::remove_all(Dir);
+	std::filesystem::create_directories(Dir);
+	WriteGrid(40);
+	WriteMaterials("stone_n.dds");
+
+	TestRoundTrip();
+	TestRejects();
+	TestMaterialEdits();
+
+	std::filesystem::remove_all(Dir);
+	return CheckResult();
+}
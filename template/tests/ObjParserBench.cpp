@@ -0,0 +1,247 @@
+#include "model.h"
+#include "JobSystem.h"
+#include "Bench.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace
+{
+	// The Model loader before ObjParser: getline and an istringstream per line.  It
+	// only understood triangles with v/vt/vn corners, so Supported is false for
+	// files with anything else and its faces are not compared.
+	struct LineByLineModel
+	{
+		std::vector<polygon> Faces;
+		bool Supported = true;
+
+		explicit LineByLineModel(const std::string& filename)
+		{
+			std::vector<XMFLOAT3> positions;
+			std::vector<XMFLOAT3> normals;
+			std::vector<XMFLOAT2> texCoords;
+			std::ifstream in(filename);
+			std::string line;
+			while (std::getline(in, line))
+			{
+				std::istringstream iss(line);
+				char trash;
+				if (!line.compare(0, 2, "v "))
+				{
+					XMFLOAT3 v;
+					iss >> trash >> v.x >> v.y >> v.z;
+					positions.push_back(v);
+				}
+				else if (!line.compare(0, 3, "vn "))
+				{
+					XMFLOAT3 n;
+					iss >> trash >> trash >> n.x >> n.y >> n.z;
+					normals.push_back(n);
+				}
+				else if (!line.compare(0, 3, "vt "))
+				{
+					XMFLOAT2 uv;
+					iss >> trash >> trash >> uv.x >> uv.y;
+					texCoords.push_back(uv);
+				}
+				else if (!line.compare(0, 2, "f "))
+				{
+					if (!TriangleWithAllIndices(line))
+					{
+						Supported = false;
+						continue;
+					}
+					polygon f;
+					int v, uv, n, i = 0;
+					iss >> trash;
+					while (i < 3 && iss >> v >> trash >> uv >> trash >> n)
+					{
+						Vert vt(XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0), XMFLOAT3(0, 0, 0), XMFLOAT2(0, 0));
+						vt.Position = positions[v - 1];
+						vt.TexC = texCoords[uv - 1];
+						vt.Normal = normals[n - 1];
+						f.verts[i++] = vt;
+					}
+					Faces.push_back(f);
+				}
+			}
+		}
+
+		// Three corners, each v/vt/vn with positive indices.
+		static bool TriangleWithAllIndices(const std::string& line)
+		{
+			std::istringstream iss(line.substr(2));
+			std::string corner;
+			int corners = 0;
+			while (iss >> corner)
+			{
+				int v, uv, n;
+				char s0, s1;
+				std::istringstream c(corner);
+				if (!(c >> v >> s0 >> uv >> s1 >> n) || s0 != '/' || s1 != '/' || v <= 0 || uv <= 0 || n <= 0)
+					return false;
+				++corners;
+			}
+			return corners == 3;
+		}
+	};
+
+	// FNV-1a over the position, normal and texture coordinate of every corner.
+	std::uint64_t Hash(const std::vector<polygon>& faces)
+	{
+		std::uint64_t h = 1469598103934665603ull;
+		for (const polygon& f : faces)
+		{
+			for (const Vert& v : f.verts)
+			{
+				const float values[8] = { v.Position.x, v.Position.y, v.Position.z, v.Normal.x, v.Normal.y, v.Normal.z, v.TexC.x, v.TexC.y };
+				unsigned char bytes[sizeof(values)];
+				std::memcpy(bytes, values, sizeof(values));
+				for (unsigned char b : bytes)
+				{
+					h ^= b;
+					h *= 1099511628211ull;
+				}
+			}
+		}
+		return h;
+	}
+
+	// fast_atof is not always correctly rounded, so a few numbers differ from the
+	// istream's in the last bit.
+	bool Close(float a, float b)
+	{
+		return std::fabs(a - b) <= 1e-6f * std::max(1.0f, std::fabs(a));
+	}
+
+	bool SameFaces(const std::vector<polygon>& a, const std::vector<polygon>& b)
+	{
+		if (a.size() != b.size())
+			return false;
+		for (std::size_t f = 0; f < a.size(); ++f)
+		{
+			for (int i = 0; i < 3; ++i)
+			{
+				const Vert& u = a[f].verts[i];
+				const Vert& v = b[f].verts[i];
+				if (!Close(u.Position.x, v.Position.x) || !Close(u.Position.y, v.Position.y) || !Close(u.Position.z, v.Position.z) ||
+					!Close(u.Normal.x, v.Normal.x) || !Close(u.Normal.y, v.Normal.y) || !Close(u.Normal.z, v.Normal.z) ||
+					!Close(u.TexC.x, v.TexC.x) || !Close(u.TexC.y, v.TexC.y))
+					return false;
+			}
+		}
+		return true;
+	}
+
+	std::vector<polygon> Faces(Model& model)
+	{
+		std::vector<polygon> faces(model.nfaces());
+		for (int i = 0; i < model.nfaces(); ++i)
+			faces[i] = model.face(i);
+		return faces;
+	}
+
+	// An n x n grid of quads split into triangles, with texture coordinates and
+	// normals, large enough to be parsed in many chunks.
+	std::string WriteGrid(int n)
+	{
+		const std::string filename = (std::filesystem::temp_directory_path() / "ObjParserBench_grid.obj").string();
+		std::ofstream out(filename);
+		for (int y = 0; y <= n; ++y)
+		{
+			for (int x = 0; x <= n; ++x)
+				out << "v " << x * 0.25f << " " << 0.001f * ((x * 7 + y * 13) % 97) << " " << y * -0.25f << "\n";
+		}
+		for (int y = 0; y <= n; ++y)
+		{
+			for (int x = 0; x <= n; ++x)
+				out << "vt " << float(x) / n << " " << float(y) / n << "\n";
+		}
+		out << "vn 0 1 0\n";
+		for (int y = 0; y < n; ++y)
+		{
+			for (int x = 0; x < n; ++x)
+			{
+				const int a = y * (n + 1) + x + 1;
+				const int b = a + 1;
+				const int c = a + n + 1;
+				const int d = c + 1;
+				out << "f " << a << "/" << a << "/1 " << c << "/" << c << "/1 " << b << "/" << b << "/1\n";
+				out << "f " << b << "/" << b << "/1 " << c << "/" << c << "/1 " << d << "/" << d << "/1\n";
+			}
+		}
+		return filename;
+	}
+}
+
+// Usage: ObjParserBench [file.obj ...]
+// With no files, loads the OBJs shipped in src/Common and a generated grid.
+int main(int argc, char** argv)
+{
+	std::vector<std::string> files;
+	std::string grid;
+	for (int i = 1; i < argc; ++i)
+		files.push_back(argv[i]);
+	if (files.empty())
+	{
+		for (const char* name : { "left.obj", "right.obj", "negr.obj", "madoka.obj", "plane.obj", "plane2.obj",
+			"arch_stones_01_Internal.OBJ", "sponza_ornament.OBJ", "sponza_ornament_Internal.OBJ" })
+			files.push_back(std::string(OBJ_DIR) + "/" + name);
+		grid = WriteGrid(400);
+		files.push_back(grid);
+	}
+
+	JobSystem jobs;
+	// Model reports every load on std::cerr.
+	std::cerr.setstate(std::ios::failbit);
+
+	int failures = 0;
+	std::printf("%-30s %8s %12s %12s %12s\n", "file", "faces", "line-by-line", "ObjParser", "with jobs");
+	for (const std::string& file : files)
+	{
+		std::vector<polygon> reference;
+		bool referenceSupported = true;
+		std::vector<polygon> serial;
+		std::vector<polygon> parallel;
+		const double lineByLineTime = BestOf(3, [&] {
+			LineByLineModel model(file);
+			reference = std::move(model.Faces);
+			referenceSupported = model.Supported;
+		});
+		const double serialTime = BestOf(3, [&] {
+			Model model(file);
+			serial = Faces(model);
+		});
+		const double parallelTime = BestOf(3, [&] {
+			Model model(file, &jobs);
+			parallel = Faces(model);
+		});
+
+		const std::string name = std::filesystem::path(file).filename().string();
+		std::printf("%-30s %8zu %9.2f ms %9.2f ms %9.2f ms%s\n", name.c_str(), serial.size(),
+			lineByLineTime, serialTime, parallelTime, referenceSupported ? "" : "  (line-by-line cannot read it)");
+
+		if (serial.empty() || Hash(serial) != Hash(parallel))
+		{
+			std::printf("  %s: serial and parallel loads differ or are empty\n", name.c_str());
+			++failures;
+		}
+		if (referenceSupported && !SameFaces(reference, serial))
+		{
+			std::printf("  %s: ObjParser does not match the line-by-line loader\n", name.c_str());
+			++failures;
+		}
+	}
+	std::printf("%u workers\n", jobs.WorkerCount());
+	if (!grid.empty())
+		std::filesystem::remove(grid);
+	return failures != 0 ? 1 : 0;
+}
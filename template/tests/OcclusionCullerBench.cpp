@@ -0,0 +1,199 @@
+#include "OcclusionCuller.h"
+#include "JobSystem.h"
+#include "Bench.h"
+#include "BenchScene.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+
+using namespace DirectX;
+
+namespace
+{
+	const int Width = 320;
+	const int Height = 180;
+
+	// Axis-aligned quads facing the camera, as one indexed triangle list.
+	struct QuadMesh
+	{
+		std::vector<XMFLOAT3> Positions;
+		std::vector<std::uint32_t> Indices;
+
+		void Add(float x0, float y0, float x1, float y1, float z)
+		{
+			const std::uint32_t base = (std::uint32_t)Positions.size();
+			Positions.push_back(XMFLOAT3(x0, y0, z));
+			Positions.push_back(XMFLOAT3(x1, y0, z));
+			Positions.push_back(XMFLOAT3(x1, y1, z));
+			Positions.push_back(XMFLOAT3(x0, y1, z));
+			const std::uint32_t quad[6] = { base, base + 1, base + 2, base, base + 2, base + 3 };
+			Indices.insert(Indices.end(), quad, quad + 6);
+		}
+	};
+
+	XMFLOAT4X4 Identity()
+	{
+		XMFLOAT4X4 m = {};
+		m._11 = m._22 = m._33 = m._44 = 1.0f;
+		return m;
+	}
+
+	// Pixel rectangle covered by the box, or false if any corner is behind the eye.
+	bool ScreenRect(const XMFLOAT4X4& viewProj, const BoundingBox& box, float rect[4])
+	{
+		rect[0] = rect[1] = 1e30f;
+		rect[2] = rect[3] = -1e30f;
+		for (int i = 0; i < 8; ++i)
+		{
+			const XMFLOAT3 p(
+				box.Center.x + (i & 1 ? box.Extents.x : -box.Extents.x),
+				box.Center.y + (i & 2 ? box.Extents.y : -box.Extents.y),
+				box.Center.z + (i & 4 ? box.Extents.z : -box.Extents.z));
+			float clip[4];
+			for (int j = 0; j < 4; ++j)
+				clip[j] = p.x * viewProj.m[0][j] + p.y * viewProj.m[1][j] + p.z * viewProj.m[2][j] + viewProj.m[3][j];
+			if (clip[3] <= 0.0f)
+				return false;
+			const float x = (clip[0] / clip[3] + 1.0f) * 0.5f * Width;
+			const float y = (1.0f - clip[1] / clip[3]) * 0.5f * Height;
+			rect[0] = std::min(rect[0], x);
+			rect[1] = std::min(rect[1], y);
+			rect[2] = std::max(rect[2], x);
+			rect[3] = std::max(rect[3], y);
+		}
+		return true;
+	}
+}
+
+// Usage: OcclusionCullerBench [boxes] [workers]
+int main(int argc, char** argv)
+{
+	const std::size_t count = ArgCount(argc, argv, 1, 100000);
+	JobSystem jobs((unsigned int)ArgCount(argc, argv, 2, 0));
+	int failures = 0;
+
+	const XMFLOAT4X4 viewProj = CameraViewProj(XMFLOAT3(0.0f, 0.0f, 0.0f), 0.0f, XM_PI / 3.0f, 16.0f / 9.0f, 0.5f, 500.0f);
+	const XMFLOAT4X4 identity = Identity();
+
+	std::mt19937 rng(3);
+	std::uniform_real_distribution<float> across(-60.0f, 60.0f);
+	std::uniform_real_distribution<float> depth(3.0f, 95.0f);
+	std::uniform_real_distribution<float> extent(0.3f, 2.0f);
+	std::vector<BoundingBox> boxes(count);
+	for (BoundingBox& b : boxes)
+	{
+		b.Center = XMFLOAT3(across(rng), 0.6f * across(rng), depth(rng));
+		b.Extents = XMFLOAT3(extent(rng), extent(rng), extent(rng));
+	}
+
+	// A wall at z = 50 with a 20 x 20 hole in the middle.
+	const float wallZ = 50.0f;
+	QuadMesh wall;
+	wall.Add(-400.0f, 10.0f, 400.0f, 400.0f, wallZ);
+	wall.Add(-400.0f, -400.0f, 400.0f, -10.0f, wallZ);
+	wall.Add(-400.0f, -10.0f, -10.0f, 10.0f, wallZ);
+	wall.Add(10.0f, -10.0f, 400.0f, 10.0f, wallZ);
+
+	OcclusionCuller culler;
+	culler.Resize(Width, Height);
+	culler.Begin(viewProj);
+	culler.AddOccluder(wall.Positions.data(), wall.Positions.size(), wall.Indices.data(), wall.Indices.size(), identity);
+	culler.Rasterize(nullptr);
+	const std::vector<float> serialDepth = culler.Depth();
+	culler.Begin(viewProj);
+	culler.AddOccluder(wall.Positions.data(), wall.Positions.size(), wall.Indices.data(), wall.Indices.size(), identity);
+	culler.Rasterize(&jobs);
+	if (culler.Depth() != serialDepth)
+	{
+		std::printf("depth differs between serial and jobs\n");
+		++failures;
+	}
+
+	// Boxes in front of the wall or seen through the hole must stay visible; most of
+	// those behind the wall should be culled.
+	float hole[4];
+	ScreenRect(viewProj, BoundingBox{ XMFLOAT3(0.0f, 0.0f, wallZ), XMFLOAT3(10.0f, 10.0f, 0.0f) }, hole);
+	std::size_t wrongInFront = 0;
+	std::size_t wrongThroughHole = 0;
+	std::size_t behind = 0;
+	std::size_t behindCulled = 0;
+	for (const BoundingBox& b : boxes)
+	{
+		const bool visible = culler.IsVisible(b);
+		if (b.Center.z + b.Extents.z < wallZ)
+		{
+			wrongInFront += visible ? 0 : 1;
+			continue;
+		}
+		float rect[4];
+		if (b.Center.z - b.Extents.z <= wallZ || !ScreenRect(viewProj, b, rect))
+			continue;
+		if (rect[2] <= 0.0f || rect[0] >= Width || rect[3] <= 0.0f || rect[1] >= Height)
+			continue;
+		if (rect[2] > hole[0] && rect[0] < hole[2] && rect[3] > hole[1] && rect[1] < hole[3])
+			wrongThroughHole += visible ? 0 : 1;
+		else
+		{
+			++behind;
+			behindCulled += visible ? 0 : 1;
+		}
+	}
+	std::printf("wall: %zu of %zu on-screen boxes behind it culled (%.1f%%)\n",
+		behindCulled, behind, 100.0 * behindCulled / std::max<std::size_t>(behind, 1));
+	if (wrongInFront != 0 || wrongThroughHole != 0)
+	{
+		std::printf("visible boxes culled: %zu in front of the wall, %zu through the hole\n", wrongInFront, wrongThroughHole);
+		++failures;
+	}
+
+	// A floor running from behind the eye into the distance is clipped at the near
+	// plane, not smeared across the screen.
+	QuadMesh floor;
+	floor.Positions = { XMFLOAT3(-100.0f, -2.0f, -50.0f), XMFLOAT3(100.0f, -2.0f, -50.0f), XMFLOAT3(100.0f, -2.0f, 400.0f), XMFLOAT3(-100.0f, -2.0f, 400.0f) };
+	floor.Indices = { 0, 2, 1, 0, 3, 2 };
+	culler.Begin(viewProj);
+	culler.AddOccluder(floor.Positions.data(), floor.Positions.size(), floor.Indices.data(), floor.Indices.size(), identity);
+	culler.Rasterize(&jobs);
+	const bool finite = std::all_of(culler.Depth().begin(), culler.Depth().end(), [](float d) { return std::isfinite(d); });
+	const bool underFloorCulled = !culler.IsVisible(BoundingBox{ XMFLOAT3(0.0f, -5.0f, 20.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) });
+	const bool aboveFloorVisible = culler.IsVisible(BoundingBox{ XMFLOAT3(0.0f, 0.0f, 20.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) });
+	if (!finite || !underFloorCulled || !aboveFloorVisible)
+	{
+		std::printf("floor crossing the near plane: finite depth %d, box under it culled %d, box above it visible %d\n",
+			(int)finite, (int)underFloorCulled, (int)aboveFloorVisible);
+		++failures;
+	}
+
+	// Timing: 10 occluders of 2k triangles each, then the boxes tested against them.
+	std::uniform_real_distribution<float> size(1.0f, 6.0f);
+	std::vector<QuadMesh> occluders(10);
+	for (int i = 0; i < 10000; ++i)
+	{
+		const float x = across(rng);
+		const float y = 0.6f * across(rng);
+		const float z = depth(rng) + 5.0f;
+		const float s = size(rng);
+		occluders[i % occluders.size()].Add(x - s, y - s, x + s, y + s, z);
+	}
+	auto draw = [&](JobSystem* rasterJobs) {
+		culler.Begin(viewProj);
+		for (const QuadMesh& mesh : occluders)
+			culler.AddOccluder(mesh.Positions.data(), mesh.Positions.size(), mesh.Indices.data(), mesh.Indices.size(), identity);
+		culler.Rasterize(rasterJobs);
+	};
+	const double serial = BestOf(20, [&] { draw(nullptr); });
+	const double parallel = BestOf(20, [&] { draw(&jobs); });
+	std::size_t culled = 0;
+	const double test = BestOf(5, [&] {
+		culled = 0;
+		for (const BoundingBox& b : boxes)
+			culled += culler.IsVisible(b) ? 0 : 1;
+	});
+	std::printf("rasterize %zu triangles into %dx%d: %.2f ms serial, %.2f ms with %u workers\n",
+		culler.RasterizedTriangles(), Width, Height, serial, parallel, jobs.WorkerCount());
+	std::printf("test %zu boxes: %.2f ms, %zu culled\n", count, test, culled);
+
+	return failures != 0 ? 1 : 0;
+}
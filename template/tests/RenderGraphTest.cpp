@@ -0,0 +1,287 @@
+#include "RenderGraph.h"
+#include "Check.h"
+#include <string>
+#include <vector>
+
+namespace
+{
+	// Stand-ins for D3D12_RESOURCE_STATES; the graph only ORs and compares them.
+	const std::uint32_t Present = 0x0;
+	const std::uint32_t RenderTarget = 0x4;
+	const std::uint32_t DepthWrite = 0x10;
+	const std::uint32_t NonPixelShaderResource = 0x40;
+	const std::uint32_t PixelShaderResource = 0x80;
+
+	const std::uint64_t MB = 1 << 20;
+	const std::uint64_t TargetAlignment = 64 * 1024;
+
+	bool Overlap(std::uint64_t offsetA, std::uint64_t sizeA, std::uint64_t offsetB, std::uint64_t sizeB)
+	{
+		return offsetA < offsetB + sizeB && offsetB < offsetA + sizeA;
+	}
+
+	std::size_t CountAliasing(const std::vector<RenderGraph::Barrier>& barriers)
+	{
+		std::size_t count = 0;
+		for (const RenderGraph::Barrier& b : barriers)
+			count += b.Type == RenderGraph::BarrierType::Aliasing ? 1 : 0;
+		return count;
+	}
+
+	// The frame TexColumnsApp draws: shadow maps, a G-buffer, a lighting pass and a
+	// post pass writing the back buffer, plus a debug view nothing consumes.
+	void TestCulling()
+	{
+		RenderGraph g;
+		RenderGraph::Resource backBuffer = g.Import("back buffer", Present, Present);
+		g.MarkOutput(backBuffer);
+		RenderGraph::Resource depth = g.Import("depth", DepthWrite, DepthWrite);
+		RenderGraph::Resource shadow0 = g.Import("shadow0", PixelShaderResource, PixelShaderResource);
+		RenderGraph::Resource shadow1 = g.Import("shadow1", PixelShaderResource, PixelShaderResource);
+		RenderGraph::Resource gbuffer[3] = {
+			g.CreateTransient("albedo", 8 * MB, TargetAlignment),
+			g.CreateTransient("normal", 16 * MB, TargetAlignment),
+			g.CreateTransient("position", 32 * MB, TargetAlignment) };
+		RenderGraph::Resource scene = g.CreateTransient("scene", 8 * MB, TargetAlignment);
+		RenderGraph::Resource debug = g.CreateTransient("debug", 4 * MB, TargetAlignment);
+		RenderGraph::Resource debugSource = g.CreateTransient("debug source", 4 * MB, TargetAlignment);
+
+		int ran = 0;
+		RenderGraph::Pass shadowPass = g.AddPass("shadow", [&] { ran |= 1; });
+		g.Write(shadowPass, shadow0, DepthWrite);
+		g.Write(shadowPass, shadow1, DepthWrite);
+		RenderGraph::Pass geometryPass = g.AddPass("geometry", [&] { ran |= 2; });
+		for (RenderGraph::Resource r : gbuffer)
+			g.Write(geometryPass, r, RenderTarget);
+		g.Write(geometryPass, depth, DepthWrite);
+		// Feeds only the debug view, so it goes with it.
+		RenderGraph::Pass debugSourcePass = g.AddPass("debug source", [&] { ran |= 16; });
+		g.Write(debugSourcePass, debugSource, RenderTarget);
+		RenderGraph::Pass debugPass = g.AddPass("debug view", [&] { ran |= 32; });
+		g.Read(debugPass, gbuffer[1], PixelShaderResource);
+		g.Read(debugPass, debugSource, PixelShaderResource);
+		g.Write(debugPass, debug, RenderTarget);
+		RenderGraph::Pass lightingPass = g.AddPass("lighting", [&] { ran |= 4; });
+		for (RenderGraph::Resource r : gbuffer)
+			g.Read(lightingPass, r, PixelShaderResource);
+		g.Read(lightingPass, shadow0, PixelShaderResource);
+		g.Read(lightingPass, shadow1, PixelShaderResource);
+		g.Write(lightingPass, depth, DepthWrite);
+		g.Write(lightingPass, scene, RenderTarget);
+		RenderGraph::Pass postPass = g.AddPass("post", [&] { ran |= 8; });
+		g.Read(postPass, scene, PixelShaderResource);
+		g.Write(postPass, backBuffer, RenderTarget);
+		// Writes nothing anyone reads, but is kept for its side effects.
+		RenderGraph::Pass queryPass = g.AddPass("query", [&] { ran |= 64; }, true);
+
+		g.Compile();
+
+		CHECK(g.Live(shadowPass) && g.Live(geometryPass) && g.Live(lightingPass) && g.Live(postPass));
+		CHECK(!g.Live(debugPass) && !g.Live(debugSourcePass));
+		CHECK(g.Live(queryPass));
+		CHECK(g.LivePassCount() == 5);
+		CHECK(g.Offset(debug) == RenderGraph::NoOffset);
+		CHECK(g.Offset(debugSource) == RenderGraph::NoOffset);
+
+		// The shadow maps go to DepthWrite, the G-buffer, created in the state its last
+		// use leaves it in, to RenderTarget.
+		CHECK(g.BarriersBefore(shadowPass).size() == 2);
+		CHECK(g.BarriersBefore(geometryPass).size() == 3);
+		CHECK(g.BarriersBefore(lightingPass).size() == 6);
+		CHECK(g.BarriersBefore(postPass).size() == 2);
+		CHECK(g.BarriersBefore(queryPass).empty());
+		CHECK(g.BarriersBefore(debugPass).empty());
+		CHECK(g.InitialState(gbuffer[0]) == PixelShaderResource);
+		CHECK(g.InitialState(scene) == PixelShaderResource);
+
+		// Every transient is alive during lighting, so none can share memory.
+		CHECK(g.TransientHeapSize() == 64 * MB);
+		CHECK(g.TransientHeapAlignment() == TargetAlignment);
+		for (const RenderGraph::Barrier& b : g.BarriersBefore(lightingPass))
+			CHECK(b.Type == RenderGraph::BarrierType::Transition);
+
+		g.Execute([](const std::vector<RenderGraph::Barrier>&) {});
+		CHECK(ran == (1 | 2 | 4 | 8 | 64));
+	}
+
+	void TestReadRunMerging()
+	{
+		RenderGraph g;
+		RenderGraph::Resource out = g.Import("out", Present, Present);
+		g.MarkOutput(out);
+		RenderGraph::Resource t = g.CreateTransient("t", MB, TargetAlignment);
+
+		RenderGraph::Pass write = g.AddPass("write", nullptr);
+		g.Write(write, t, RenderTarget);
+		RenderGraph::Pass read1 = g.AddPass("read1", nullptr);
+		g.Read(read1, t, PixelShaderResource);
+		g.Write(read1, out, RenderTarget);
+		RenderGraph::Pass read2 = g.AddPass("read2", nullptr);
+		g.Read(read2, t, NonPixelShaderResource);
+		g.Write(read2, out, RenderTarget);
+		RenderGraph::Pass rewrite = g.AddPass("rewrite", nullptr);
+		g.Write(rewrite, t, RenderTarget);
+		g.Write(rewrite, out, RenderTarget);
+		RenderGraph::Pass read3 = g.AddPass("read3", nullptr);
+		g.Read(read3, t, PixelShaderResource);
+		g.Write(read3, out, RenderTarget);
+
+		g.Compile();
+
+		// Both readers of the first write share one transition to the union of their
+		// states, ahead of the first one.  Barriers are in resource order, so t's comes
+		// after the one taking out to RenderTarget.
+		const std::vector<RenderGraph::Barrier>& before1 = g.BarriersBefore(read1);
+		CHECK(before1.size() == 2);
+		CHECK(before1.size() == 2 && before1[0].Target == out);
+		CHECK(before1.size() == 2 && before1[1].Target == t);
+		CHECK(before1.size() == 2 && before1[1].Before == RenderTarget);
+		CHECK(before1.size() == 2 && before1[1].After == (PixelShaderResource | NonPixelShaderResource));
+		CHECK(g.BarriersBefore(read2).empty());
+
+		// The write ends the run; the read after it starts a new one.
+		const std::vector<RenderGraph::Barrier>& beforeRewrite = g.BarriersBefore(rewrite);
+		CHECK(beforeRewrite.size() == 1);
+		CHECK(beforeRewrite.size() == 1 && beforeRewrite[0].After == RenderTarget);
+		const std::vector<RenderGraph::Barrier>& before3 = g.BarriersBefore(read3);
+		CHECK(before3.size() == 1);
+		CHECK(before3.size() == 1 && before3[0].After == PixelShaderResource);
+
+		// t starts the frame in the state read3 leaves it in.
+		const std::vector<RenderGraph::Barrier>& beforeWrite = g.BarriersBefore(write);
+		CHECK(beforeWrite.size() == 1);
+		CHECK(beforeWrite.size() == 1 && beforeWrite[0].Before == PixelShaderResource);
+		CHECK(g.InitialState(t) == PixelShaderResource);
+	}
+
+	// A chain of targets, each read only by the pass after the one writing it, so
+	// only neighbours are alive at the same time.
+	void TestAliasing()
+	{
+		const int count = 6;
+		RenderGraph g;
+		RenderGraph::Resource out = g.Import("out", Present, Present);
+		g.MarkOutput(out);
+		RenderGraph::Resource targets[count];
+		std::uint64_t sizes[count];
+		std::uint64_t total = 0;
+		for (int i = 0; i < count; ++i)
+		{
+			sizes[i] = (count - i) * MB + (i % 2) * 4096;
+			total += sizes[i];
+			targets[i] = g.CreateTransient("t" + std::to_string(i), sizes[i], TargetAlignment);
+		}
+		RenderGraph::Pass passes[count + 1];
+		for (int i = 0; i < count; ++i)
+		{
+			passes[i] = g.AddPass("p" + std::to_string(i), nullptr);
+			if (i > 0)
+				g.Read(passes[i], targets[i - 1], PixelShaderResource);
+			g.Write(passes[i], targets[i], RenderTarget);
+		}
+		passes[count] = g.AddPass("final", nullptr);
+		g.Read(passes[count], targets[count - 1], PixelShaderResource);
+		g.Write(passes[count], out, RenderTarget);
+
+		g.Compile();
+
+		CHECK(g.TransientHeapSize() < total);
+		CHECK(g.TransientHeapAlignment() == TargetAlignment);
+		for (int i = 0; i < count; ++i)
+		{
+			CHECK(g.Offset(targets[i]) != RenderGraph::NoOffset);
+			CHECK(g.Offset(targets[i]) % TargetAlignment == 0);
+			CHECK(g.Offset(targets[i]) + sizes[i] <= g.TransientHeapSize());
+			if (i + 1 < count)
+				CHECK(!Overlap(g.Offset(targets[i]), sizes[i], g.Offset(targets[i + 1]), sizes[i + 1]));
+		}
+
+		// Every target shares memory with another, so each gets an aliasing barrier
+		// ahead of the pass that first writes it, before any transitions.
+		for (int i = 0; i < count; ++i)
+		{
+			const std::vector<RenderGraph::Barrier>& barriers = g.BarriersBefore(passes[i]);
+			CHECK(CountAliasing(barriers) == 1);
+			CHECK(!barriers.empty() && barriers[0].Type == RenderGraph::BarrierType::Aliasing);
+			CHECK(!barriers.empty() && barriers[0].Target == targets[i]);
+		}
+		CHECK(CountAliasing(g.BarriersBefore(passes[count])) == 0);
+
+		// Two transients alive at once and nothing else: no sharing, no aliasing.
+		RenderGraph h;
+		RenderGraph::Resource hout = h.Import("out", Present, Present);
+		h.MarkOutput(hout);
+		RenderGraph::Resource a = h.CreateTransient("a", 3 * MB, TargetAlignment);
+		RenderGraph::Resource b = h.CreateTransient("b", MB + 1, TargetAlignment);
+		RenderGraph::Pass both = h.AddPass("both", nullptr);
+		h.Write(both, a, RenderTarget);
+		h.Write(both, b, RenderTarget);
+		RenderGraph::Pass use = h.AddPass("use", nullptr);
+		h.Read(use, a, PixelShaderResource);
+		h.Read(use, b, PixelShaderResource);
+		h.Write(use, hout, RenderTarget);
+		h.Compile();
+		CHECK(!Overlap(h.Offset(a), 3 * MB, h.Offset(b), MB + 1));
+		CHECK(h.Offset(b) % TargetAlignment == 0);
+		CHECK(h.TransientHeapSize() == 3 * MB + MB + 1);
+		CHECK(CountAliasing(h.BarriersBefore(both)) == 0);
+	}
+
+	void TestFinalBarriers()
+	{
+		RenderGraph g;
+		RenderGraph::Resource backBuffer = g.Import("back buffer", Present, Present);
+		g.MarkOutput(backBuffer);
+		// Ends the frame in the state it must be left in: no final barrier.
+		RenderGraph::Resource depth = g.Import("depth", DepthWrite, DepthWrite);
+		// Used by no live pass, but still moved to its final state.
+		RenderGraph::Resource idle = g.Import("idle", PixelShaderResource, RenderTarget);
+		RenderGraph::Resource scene = g.CreateTransient("scene", MB, TargetAlignment);
+
+		std::vector<std::string> log;
+		RenderGraph::Pass draw = g.AddPass("draw", [&] { log.push_back("draw"); });
+		g.Write(draw, depth, DepthWrite);
+		g.Write(draw, scene, RenderTarget);
+		RenderGraph::Pass post = g.AddPass("post", [&] { log.push_back("post"); });
+		g.Read(post, scene, PixelShaderResource);
+		g.Write(post, backBuffer, RenderTarget);
+
+		g.Compile();
+
+		// The back buffer is returned to Present and the unused import taken to its
+		// final state; depth and the transient are left where they are.
+		const std::vector<RenderGraph::Barrier>& final = g.FinalBarriers();
+		CHECK(final.size() == 2);
+		CHECK(final.size() == 2 && final[0].Target == backBuffer);
+		CHECK(final.size() == 2 && final[0].Before == RenderTarget && final[0].After == Present);
+		CHECK(final.size() == 2 && final[1].Target == idle);
+		CHECK(final.size() == 2 && final[1].Before == PixelShaderResource && final[1].After == RenderTarget);
+		for (const RenderGraph::Barrier& b : final)
+			CHECK(b.Target != depth && b.Target != scene);
+
+		// Batches are handed out before their pass, empty ones skipped, and the final
+		// batch comes last.
+		g.Execute([&](const std::vector<RenderGraph::Barrier>& barriers) {
+			log.push_back("barriers " + std::to_string(barriers.size())); });
+		const std::vector<std::string> expected = {
+			"barriers 1", "draw", "barriers 2", "post", "barriers 2" };
+		CHECK(log == expected);
+		CHECK(g.BarrierCount() == 5);
+
+		// Compiling again gives the same result.
+		std::vector<RenderGraph::Barrier> before(g.BarriersBefore(post));
+		g.Compile();
+		CHECK(g.BarrierCount() == 5);
+		CHECK(g.BarriersBefore(post).size() == before.size());
+		CHECK(g.FinalBarriers().size() == 2);
+	}
+}
+
+int main()
+{
+	TestCulling();
+	TestReadRunMerging();
+	TestAliasing();
+	TestFinalBarriers();
+	return CheckResult();
+}
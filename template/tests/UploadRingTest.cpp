@@ -0,0 +1,215 @@
+#include "UploadRing.h"
+#include "Check.h"
+#include <cstdint>
+#include <deque>
+#include <random>
+#include <vector>
+
+namespace
+{
+	void TestAlignment()
+	{
+		UploadRing ring(4096);
+		std::uint64_t offset = ~0ull;
+		CHECK(ring.Allocate(3, 1, offset) && offset == 0);
+		CHECK(ring.Allocate(8, 256, offset) && offset == 256);
+		CHECK(ring.Allocate(1, 4, offset) && offset == 264);
+		CHECK(ring.Allocate(16, 16, offset) && offset == 272);
+		// The padding counts as used until it retires.
+		CHECK(ring.UsedBytes() == 288);
+		CHECK(ring.PendingBytes() == 288);
+	}
+
+	void TestWrap()
+	{
+		UploadRing ring(1000);
+		std::uint64_t offset = ~0ull;
+		CHECK(ring.Allocate(600, 1, offset) && offset == 0);
+		ring.Submit(1);
+		ring.Retire(1);
+		CHECK(ring.UsedBytes() == 0);
+
+		CHECK(ring.Allocate(200, 1, offset) && offset == 600);
+		ring.Submit(2);
+
+		// 300 bytes do not fit between 800 and the end, so the block starts over at 0
+		// and the skipped 200 bytes are used until it retires.
+		CHECK(ring.Allocate(300, 1, offset) && offset == 0);
+		CHECK(ring.UsedBytes() == 200 + 200 + 300);
+		ring.Submit(3);
+		// The padding goes with the block after it.
+		ring.Retire(2);
+		CHECK(ring.UsedBytes() == 200 + 300);
+		ring.Retire(3);
+		CHECK(ring.UsedBytes() == 0);
+
+		// Alignment padding that runs past the end wraps too.
+		CHECK(ring.Allocate(650, 1, offset) && offset == 300);
+		CHECK(ring.Allocate(50, 128, offset) && offset == 0);
+		CHECK(ring.UsedBytes() == 650 + 50 + 50);
+	}
+
+	void TestFullRing()
+	{
+		UploadRing ring(1024);
+		std::uint64_t offset = ~0ull;
+		CHECK(ring.Allocate(512, 1, offset) && offset == 0);
+		CHECK(ring.Allocate(512, 1, offset) && offset == 512);
+		CHECK(ring.UsedBytes() == 1024);
+
+		// Full: nothing fits, and a failed allocation changes nothing.
+		offset = 12345;
+		CHECK(!ring.Allocate(1, 1, offset));
+		CHECK(offset == 12345);
+		CHECK(ring.UsedBytes() == 1024);
+		CHECK(ring.PendingBytes() == 1024);
+
+		// Still full once submitted, until the fence completes.
+		ring.Submit(7);
+		CHECK(ring.PendingBytes() == 0);
+		ring.Retire(6);
+		CHECK(!ring.Allocate(1, 1, offset));
+		ring.Retire(7);
+		CHECK(ring.UsedBytes() == 0);
+		CHECK(ring.Allocate(1024, 1, offset) && offset == 0);
+	}
+
+	void TestSubmitRetire()
+	{
+		UploadRing ring(1000);
+		std::uint64_t offset = ~0ull;
+		CHECK(ring.Allocate(100, 1, offset));
+		ring.Submit(1);
+		CHECK(ring.Allocate(200, 1, offset));
+		ring.Submit(2);
+		// Nothing allocated since the last Submit: no submission is recorded, so
+		// fence 3 completing frees nothing early.
+		ring.Submit(3);
+		CHECK(ring.Allocate(300, 1, offset));
+		ring.Submit(4);
+		CHECK(ring.UsedBytes() == 600);
+
+		// Retiring frees submissions in order, up to the completed fence.
+		ring.Retire(0);
+		CHECK(ring.UsedBytes() == 600);
+		ring.Retire(1);
+		CHECK(ring.UsedBytes() == 500);
+		ring.Retire(3);
+		CHECK(ring.UsedBytes() == 300);
+		ring.Retire(3);
+		CHECK(ring.UsedBytes() == 300);
+		ring.Retire(100);
+		CHECK(ring.UsedBytes() == 0);
+
+		// The freed space is reused from the head on, not from the start.
+		CHECK(ring.Allocate(100, 1, offset) && offset == 600);
+	}
+
+	void TestOversize()
+	{
+		UploadRing ring(1024);
+		std::uint64_t offset = 99;
+		// Larger than the whole ring: never fits, however much is retired, and the
+		// caller has to stage it some other way.
+		CHECK(!ring.Allocate(1025, 1, offset));
+		CHECK(offset == 99);
+		CHECK(ring.UsedBytes() == 0);
+
+		// Up to the capacity fits once the ring is empty, wherever the head is.
+		CHECK(ring.Allocate(1024, 256, offset) && offset == 0);
+		ring.Submit(1);
+		ring.Retire(1);
+		CHECK(ring.Allocate(10, 1, offset) && offset == 0);
+		ring.Submit(2);
+		ring.Retire(2);
+		CHECK(ring.Allocate(1024, 1, offset) && offset == 0);
+		CHECK(ring.UsedBytes() == 1024);
+
+		// But not while anything is still in flight.
+		ring.Submit(3);
+		ring.Retire(3);
+		CHECK(ring.Allocate(10, 1, offset) && offset == 0);
+		ring.Submit(4);
+		CHECK(!ring.Allocate(1020, 1, offset));
+		ring.Retire(4);
+		CHECK(ring.Allocate(1020, 1, offset) && offset == 0);
+	}
+
+	// A GPU lagging two frames behind: every allocation must be aligned, inside the
+	// ring and clear of everything not yet retired.
+	void TestRandom()
+	{
+		struct Block
+		{
+			std::uint64_t Fence;
+			std::uint64_t Offset;
+			std::uint64_t Size;
+		};
+
+		const std::uint64_t capacity = 1 << 20;
+		UploadRing ring(capacity);
+		std::mt19937 rng(7);
+		std::deque<Block> inFlight;
+		std::vector<Block> pending;
+		std::uint64_t fence = 0;
+		int errors = 0;
+
+		auto retire = [&](std::uint64_t completed) {
+			ring.Retire(completed);
+			while (!inFlight.empty() && inFlight.front().Fence <= completed)
+				inFlight.pop_front();
+		};
+		auto submit = [&] {
+			ring.Submit(++fence);
+			for (Block& b : pending)
+			{
+				b.Fence = fence;
+				inFlight.push_back(b);
+			}
+			pending.clear();
+		};
+		auto overlaps = [](const Block& b, std::uint64_t offset, std::uint64_t size) {
+			return offset < b.Offset + b.Size && b.Offset < offset + size;
+		};
+
+		for (int step = 0; step < 20000; ++step)
+		{
+			std::uint64_t size = 1 + rng() % 200000;
+			std::uint64_t alignment = 1ull << (rng() % 10);
+			std::uint64_t offset;
+			while (!ring.Allocate(size, alignment, offset))
+			{
+				// Flush and wait for the GPU, as D3D12UploadRing does.
+				submit();
+				retire(fence);
+			}
+
+			errors += offset % alignment != 0;
+			errors += offset + size > capacity;
+			for (const Block& b : inFlight)
+				errors += overlaps(b, offset, size);
+			for (const Block& b : pending)
+				errors += overlaps(b, offset, size);
+			pending.push_back({ 0, offset, size });
+
+			if (rng() % 4 == 0)
+			{
+				submit();
+				if (fence > 2)
+					retire(fence - 2);
+			}
+		}
+		CHECK(errors == 0);
+	}
+}
+
+int main()
+{
+	TestAlignment();
+	TestWrap();
+	TestFullRing();
+	TestSubmitRetire();
+	TestOversize();
+	TestRandom();
+	return CheckResult();
+}
@@ -0,0 +1,143 @@
+#include "VertexQuantization.h"
+#include "Check.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+
+using namespace DirectX;
+using namespace DirectX::PackedVector;
+
+namespace
+{
+	// Small deterministic generator so the checks do not depend on the CRT's rand().
+	struct Lcg
+	{
+		std::uint32_t State = 12345u;
+		float Next(float lo, float hi)
+		{
+			State = State * 1664525u + 1013904223u;
+			return lo + (hi - lo) * float(State >> 8) / 16777216.0f;
+		}
+	};
+
+	float AngleBetween(const XMFLOAT3& a, const XMFLOAT3& b)
+	{
+		// atan2 of |cross| and dot stays accurate for tiny angles, unlike acos.
+		XMFLOAT3 c(a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x);
+		float s = std::sqrt(c.x * c.x + c.y * c.y + c.z * c.z);
+		return std::atan2(s, a.x * b.x + a.y * b.y + a.z * b.z);
+	}
+
+	// Boxes of very different sizes and offsets, including flat ones, with points on
+	// the faces and corners as well as inside.
+	void TestPositions()
+	{
+		Lcg rng;
+		const XMFLOAT3 boxes[][2] =
+		{
+			{ XMFLOAT3(0.0f, 0.0f, 0.0f), XMFLOAT3(1.0f, 1.0f, 1.0f) },
+			{ XMFLOAT3(120.0f, -40.0f, 15.0f), XMFLOAT3(1800.0f, 700.0f, 1100.0f) },
+			{ XMFLOAT3(-3.0f, 2.5f, 0.25f), XMFLOAT3(0.01f, 0.02f, 0.005f) },
+			{ XMFLOAT3(10.0f, 0.0f, -10.0f), XMFLOAT3(10.0f, 0.0f, 15.0f) },
+		};
+		for (const auto& box : boxes)
+		{
+			const XMFLOAT3& c = box[0];
+			const XMFLOAT3& e = box[1];
+			const XMFLOAT3 bound = VertexQuantization::PositionErrorBound(c, e);
+			int outside = 0;
+			for (int i = 0; i < 4096; ++i)
+			{
+				float t[3];
+				for (int k = 0; k < 3; ++k)
+				{
+					// Every eighth sample sits exactly on a face.
+					t[k] = (i & 7) == 0 ? (rng.Next(0.0f, 1.0f) < 0.5f ? -1.0f : 1.0f) : rng.Next(-1.0f, 1.0f);
+				}
+				const XMFLOAT3 p(c.x + t[0] * e.x, c.y + t[1] * e.y, c.z + t[2] * e.z);
+
+				std::int16_t q[4];
+				VertexQuantization::EncodePosition(p, c, e, q);
+				const XMFLOAT3 d = VertexQuantization::DecodePosition(q, c, e);
+				if (std::fabs(d.x - p.x) > bound.x || std::fabs(d.y - p.y) > bound.y || std::fabs(d.z - p.z) > bound.z)
+				{
+					if (outside++ == 0)
+						std::printf("position (%g, %g, %g) decoded as (%g, %g, %g)\n", p.x, p.y, p.z, d.x, d.y, d.z);
+				}
+			}
+			CHECK(outside == 0);
+		}
+	}
+
+	// A Fibonacci sphere plus the axes and octant diagonals, where the octahedral
+	// fold has its seams.
+	void TestDirections()
+	{
+		const int sphereCount = 20000;
+		float worst = 0.0f;
+		for (int i = 0; i < sphereCount + 26; ++i)
+		{
+			XMFLOAT3 v;
+			if (i < sphereCount)
+			{
+				float z = 1.0f - (2.0f * i + 1.0f) / sphereCount;
+				float r = std::sqrt(std::max(0.0f, 1.0f - z * z));
+				float phi = 2.399963229728653f * i;
+				v = XMFLOAT3(r * std::cos(phi), r * std::sin(phi), z);
+			}
+			else
+			{
+				int j = i - sphereCount;
+				if (j >= 13) ++j; // skip (0,0,0)
+				v = XMFLOAT3(float(j % 3 - 1), float(j / 3 % 3 - 1), float(j / 9 - 1));
+			}
+
+			std::int16_t q[2];
+			VertexQuantization::EncodeDirection(v, q);
+			const XMFLOAT3 d = VertexQuantization::DecodeDirection(q);
+			const float len = std::sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
+			worst = std::max(worst, AngleBetween(XMFLOAT3(v.x / len, v.y / len, v.z / len), d));
+		}
+		std::printf("worst direction error %g rad, bound %g\n", worst, VertexQuantization::DirectionErrorBound);
+		CHECK(worst <= VertexQuantization::DirectionErrorBound);
+
+		// A zero vector encodes as +Z.
+		std::int16_t q[2];
+		VertexQuantization::EncodeDirection(XMFLOAT3(0.0f, 0.0f, 0.0f), q);
+		const XMFLOAT3 z = VertexQuantization::DecodeDirection(q);
+		CHECK(z.x == 0.0f && z.y == 0.0f && z.z == 1.0f);
+	}
+
+	// The tiled range the scene uses plus tiny values.
+	void TestTexCoords()
+	{
+		Lcg rng;
+		int outside = 0;
+		for (int i = 0; i < 8192; ++i)
+		{
+			const float range = (i & 1) ? 64.0f : 1.0e-4f;
+			const XMFLOAT2 uv(rng.Next(-range, range), rng.Next(-range, range));
+
+			HALF q[2];
+			VertexQuantization::EncodeTexCoord(uv, q);
+			const XMFLOAT2 d = VertexQuantization::DecodeTexCoord(q);
+			const float bx = std::max(std::fabs(uv.x) * VertexQuantization::TexCoordRelativeErrorBound, VertexQuantization::TexCoordAbsoluteErrorBound);
+			const float by = std::max(std::fabs(uv.y) * VertexQuantization::TexCoordRelativeErrorBound, VertexQuantization::TexCoordAbsoluteErrorBound);
+			if (std::fabs(d.x - uv.x) > bx || std::fabs(d.y - uv.y) > by)
+			{
+				if (outside++ == 0)
+					std::printf("texcoord (%g, %g) decoded as (%g, %g)\n", uv.x, uv.y, d.x, d.y);
+			}
+		}
+		CHECK(outside == 0);
+	}
+}
+
+int main()
+{
+	TestPositions();
+	TestDirections();
+	TestTexCoords();
+	return CheckResult();
+}